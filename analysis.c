@@ -0,0 +1,510 @@
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "analysis.h"
+#include "decode.h"
+#include "config.h"
+
+
+static AnalysisEntry *_entry_new(const char path[], size_t path_len);
+static int            _entry_cmp(const void *a, const void *b);
+static AnalysisEntry *_entry_find(ArrayPtr *arr, const char path[]);
+static void           _entries_free(ArrayPtr *arr);
+static int            _entry_is_measured(Analysis *a, const AnalysisEntry *entry);
+static int            _entries_are_pending(Analysis *a, const ArrayPtr *arr);
+static void           _cache_load(Analysis *a);
+static void           _cache_merge(Analysis *a);
+static void           _cache_save(Analysis *a);
+static int            _cache_parse(ArrayPtr *arr, char line[]);
+static void           _analyse(Job *j, void *item, void *udata);
+
+
+/*
+ * public
+ */
+int
+analysis_init(Analysis *a)
+{
+	a->is_running = 0;
+	array_ptr_init(&a->cache);
+	array_ptr_init(&a->pending);
+
+	if (str_init_alloc(&a->file, 256) < 0) {
+		log_err(errno, "analysis: analysis_init: str_init_alloc");
+		return -1;
+	}
+
+	if (file_cache_path(&a->file, CFG_ANALYSIS_CACHE_FILE) == NULL) {
+		/* no persistence, but keep going */
+		log_err(errno, "analysis: analysis_init: file_cache_path");
+		str_set_n(&a->file, NULL, 0);
+		return 0;
+	}
+
+	_cache_load(a);
+	return 0;
+}
+
+
+void
+analysis_deinit(Analysis *a)
+{
+	analysis_stop(a);
+	_entries_free(&a->cache);
+	str_deinit(&a->file);
+}
+
+
+/*
+ * the tracks measured before and unchanged since are left out, going by the size and
+ * mtime the scan saw; a running job carries on when it already has all the rest, as
+ * they are now, it restarts otherwise
+ */
+int
+analysis_start(Analysis *a, const PlaylistItem *items[], int len)
+{
+	char cwd[PATH_MAX];
+	if (getcwd(cwd, sizeof(cwd)) == NULL) {
+		log_err(errno, "analysis: analysis_start: getcwd");
+		return -1;
+	}
+
+	ArrayPtr next;
+	array_ptr_init(&next);
+
+	const size_t cwd_len = strlen(cwd);
+	for (int i = 0; i < len; i++) {
+		if (items[i]->has_replaygain)
+			continue;
+
+		const char *const file_path = items[i]->file_path;
+		AnalysisEntry *entry;
+		if (file_path[0] == '/') {
+			entry = _entry_new(file_path, strlen(file_path));
+			if (entry == NULL)
+				break;
+		} else {
+			/* skip './' */
+			const char *const rel = (strncmp(file_path, "./", 2) == 0)? file_path + 2 : file_path;
+			const size_t rel_len = strlen(rel);
+			entry = _entry_new(cwd, cwd_len + 1 + rel_len);
+			if (entry == NULL)
+				break;
+
+			entry->path[cwd_len] = '/';
+			memcpy(&entry->path[cwd_len + 1], rel, rel_len + 1);
+		}
+
+		/* the cache keeps seconds */
+		entry->size = items[i]->size;
+		entry->mtime = items[i]->mtime / 1000000000;
+		if (_entry_is_measured(a, entry)) {
+			free(entry);
+			continue;
+		}
+
+		if (array_ptr_append(&next, entry) < 0) {
+			log_err(errno, "analysis: analysis_start: array_ptr_append");
+			free(entry);
+			break;
+		}
+	}
+
+	if (next.len > 0)
+		qsort(next.items, next.len, sizeof(void *), _entry_cmp);
+
+	if (a->is_running && _entries_are_pending(a, &next)) {
+		_entries_free(&next);
+		return 0;
+	}
+
+	analysis_stop(a);
+	if (next.len == 0)
+		return 0;
+
+	a->pending = next;
+	const int ret = job_start(&a->job, a->pending.items, (int)a->pending.len,
+				  CFG_ANALYSIS_THREADS_NUM, _analyse, a);
+	if (ret < 0) {
+		_entries_free(&a->pending);
+		return -1;
+	}
+
+	a->is_running = 1;
+	return 0;
+}
+
+
+void
+analysis_stop(Analysis *a)
+{
+	if (a->is_running == 0)
+		return;
+
+	job_stop(&a->job);
+	_cache_merge(a);
+	_cache_save(a);
+	a->is_running = 0;
+}
+
+
+void
+analysis_set_throttle(Analysis *a, int enable)
+{
+	if (a->is_running)
+		job_set_throttle(&a->job, enable);
+}
+
+
+/*
+ * returns: done items count, -1: idle
+ */
+int
+analysis_update(Analysis *a, int *total)
+{
+	if (a->is_running == 0)
+		return -1;
+
+	const int done = job_get_progress(&a->job, total);
+	if (done < *total)
+		return done;
+
+	analysis_stop(a);
+	return -1;
+}
+
+
+/*
+ * private
+ */
+static AnalysisEntry *
+_entry_new(const char path[], size_t path_len)
+{
+	AnalysisEntry *const entry = malloc(sizeof(AnalysisEntry) + path_len + 1);
+	if (entry == NULL) {
+		log_err(errno, "analysis: _entry_new: malloc");
+		return NULL;
+	}
+
+	cstr_copy_n(entry->path, path_len + 1, path, path_len);
+	entry->is_done = 0;
+	entry->size = 0;
+	entry->mtime = 0;
+	return entry;
+}
+
+
+static int
+_entry_cmp(const void *a, const void *b)
+{
+	const AnalysisEntry *const x = *(const AnalysisEntry **)a;
+	const AnalysisEntry *const y = *(const AnalysisEntry **)b;
+	return strcmp(x->path, y->path);
+}
+
+
+static AnalysisEntry *
+_entry_find(ArrayPtr *arr, const char path[])
+{
+	size_t lo = 0;
+	size_t hi = arr->len;
+	while (lo < hi) {
+		const size_t mid = lo + ((hi - lo) / 2);
+		AnalysisEntry *const entry = arr->items[mid];
+		const int cmp = strcmp(path, entry->path);
+		if (cmp == 0)
+			return entry;
+
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return NULL;
+}
+
+
+static void
+_entries_free(ArrayPtr *arr)
+{
+	for (size_t i = 0; i < arr->len; i++)
+		free(arr->items[i]);
+
+	array_ptr_deinit(arr);
+	array_ptr_init(arr);
+}
+
+
+/*
+ * the cache is only read: the running job reads it too
+ */
+static int
+_entry_is_measured(Analysis *a, const AnalysisEntry *entry)
+{
+	const AnalysisEntry *const hit = _entry_find(&a->cache, entry->path);
+	return (hit != NULL) && (hit->size == entry->size) && (hit->mtime == entry->mtime);
+}
+
+
+/*
+ * both sorted by path; a file rewritten since it was queued is not pending anymore
+ */
+static int
+_entries_are_pending(Analysis *a, const ArrayPtr *arr)
+{
+	size_t j = 0;
+	for (size_t i = 0; i < arr->len; i++) {
+		const AnalysisEntry *const e = arr->items[i];
+		while ((j < a->pending.len) &&
+		       (strcmp(((AnalysisEntry *)a->pending.items[j])->path, e->path) < 0))
+			j++;
+
+		if (j == a->pending.len)
+			return 0;
+
+		const AnalysisEntry *const p = a->pending.items[j];
+		if ((strcmp(p->path, e->path) != 0) || (p->size != e->size) || (p->mtime != e->mtime))
+			return 0;
+	}
+
+	return 1;
+}
+
+
+static void
+_cache_load(Analysis *a)
+{
+	FILE *const file = fopen(a->file.cstr, "r");
+	if (file == NULL) {
+		if (errno != ENOENT)
+			log_err(errno, "analysis: _cache_load: fopen: %s", a->file.cstr);
+
+		return;
+	}
+
+	char *line = NULL;
+	size_t line_size = 0;
+	ssize_t line_len;
+	while ((line_len = getline(&line, &line_size, file)) > 0) {
+		if (line[line_len - 1] == '\n')
+			line[line_len - 1] = '\0';
+
+		if (_cache_parse(&a->cache, line) < 0)
+			log_err(0, "analysis: _cache_load: invalid entry: \"%s\"", line);
+	}
+
+	free(line);
+	fclose(file);
+
+	qsort(a->cache.items, a->cache.len, sizeof(void *), _entry_cmp);
+#ifdef DEBUG
+	log_info("analysis: _cache_load: %zu entries", a->cache.len);
+#endif
+}
+
+
+/*
+ * the finished entries of the job go into the cache, in order, replacing what was
+ * measured again; the next analysis_start() finds them there. The job's entries are
+ * all gone afterwards.
+ */
+static void
+_cache_merge(Analysis *a)
+{
+	ArrayPtr *const cache = &a->cache;
+	ArrayPtr *const pending = &a->pending;
+	void **const items = malloc((cache->len + pending->len + 1) * sizeof(void *));
+	if (items == NULL) {
+		log_err(errno, "analysis: _cache_merge: malloc");
+		_entries_free(pending);
+		return;
+	}
+
+	/* both sorted by path */
+	size_t len = 0;
+	size_t i = 0;
+	size_t j = 0;
+	while ((i < cache->len) || (j < pending->len)) {
+		AnalysisEntry *const p = (j < pending->len)? pending->items[j] : NULL;
+		if ((p != NULL) && (p->is_done == 0)) {
+			free(p);
+			j++;
+			continue;
+		}
+
+		AnalysisEntry *const c = (i < cache->len)? cache->items[i] : NULL;
+		int cmp = 1;
+		if (p == NULL)
+			cmp = -1;
+		else if (c != NULL)
+			cmp = strcmp(c->path, p->path);
+
+		if (cmp < 0) {
+			items[len++] = c;
+			i++;
+			continue;
+		}
+
+		if (cmp == 0) {
+			free(c);
+			i++;
+		}
+
+		items[len++] = p;
+		j++;
+	}
+
+	array_ptr_deinit(cache);
+	cache->items = items;
+	cache->len = len;
+
+	array_ptr_deinit(pending);
+	array_ptr_init(pending);
+}
+
+
+static void
+_cache_save(Analysis *a)
+{
+	if (cstr_is_empty(a->file.cstr))
+		return;
+
+	char tmp[PATH_MAX];
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", a->file.cstr) >= (int)sizeof(tmp)) {
+		log_err(ENAMETOOLONG, "analysis: _cache_save: snprintf");
+		return;
+	}
+
+	FILE *const file = fopen(tmp, "w");
+	if (file == NULL) {
+		log_err(errno, "analysis: _cache_save: fopen: %s", tmp);
+		return;
+	}
+
+	for (size_t i = 0; i < a->cache.len; i++) {
+		const AnalysisEntry *const e = a->cache.items[i];
+		fprintf(file, "%" PRIi64 " %" PRIi64 " %.2f %.2f %.2f %s\n", e->size, e->mtime,
+			e->result.integrated, e->result.range, e->result.true_peak, e->path);
+	}
+
+	if (fclose(file) != 0) {
+		log_err(errno, "analysis: _cache_save: fclose: %s", tmp);
+		unlink(tmp);
+		return;
+	}
+
+	if (rename(tmp, a->file.cstr) < 0) {
+		log_err(errno, "analysis: _cache_save: rename: %s", a->file.cstr);
+		unlink(tmp);
+	}
+}
+
+
+/*
+ * line: "<size> <mtime> <integrated> <range> <true peak> <path>"
+ */
+static int
+_cache_parse(ArrayPtr *arr, char line[])
+{
+	char *p = line;
+	char *end;
+
+	errno = 0;
+	const int64_t size = strtoll(p, &end, 10);
+	if ((errno != 0) || (end == p))
+		return -1;
+
+	p = end;
+	const int64_t mtime = strtoll(p, &end, 10);
+	if ((errno != 0) || (end == p))
+		return -1;
+
+	double vals[3];
+	for (int i = 0; i < (int)LEN(vals); i++) {
+		p = end;
+		vals[i] = strtod(p, &end);
+		if ((errno != 0) || (end == p))
+			return -1;
+	}
+
+	if (*end != ' ')
+		return -1;
+
+	const char *const path = end + 1;
+	AnalysisEntry *const entry = _entry_new(path, strlen(path));
+	if (entry == NULL)
+		return -1;
+
+	entry->is_done = 1;
+	entry->size = size;
+	entry->mtime = mtime;
+	entry->result.integrated = vals[0];
+	entry->result.range = vals[1];
+	entry->result.true_peak = vals[2];
+	if (array_ptr_append(arr, entry) < 0) {
+		free(entry);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static void
+_analyse(Job *j, void *item, void *udata)
+{
+	Analysis *const a = (Analysis *)udata;
+	AnalysisEntry *const e = (AnalysisEntry *)item;
+
+	/* size and mtime as queued, see analysis_start(); the cache is read only while the job runs */
+	const AnalysisEntry *const hit = _entry_find(&a->cache, e->path);
+	if ((hit != NULL) && (hit->size == e->size) && (hit->mtime == e->mtime)) {
+		e->result = hit->result;
+		e->is_done = 1;
+		return;
+	}
+
+	Decode dec;
+	if (decode_open(&dec, e->path, LOUDNESS_CHANNELS_MAX) < 0)
+		return;
+
+	Loudness loud;
+	if (loudness_init(&loud, dec.rate, dec.channels) < 0)
+		goto out0;
+
+	for (;;) {
+		if (job_yield(j) < 0)
+			goto out1;
+
+		const float *frames;
+		const int ret = decode_read(&dec, &frames);
+		if (ret < 0)
+			goto out1;
+
+		if (ret == 0)
+			break;
+
+		if (loudness_add(&loud, frames, (size_t)ret) < 0)
+			goto out1;
+	}
+
+	loudness_get(&loud, &e->result);
+	e->is_done = 1;
+#ifdef DEBUG
+	log_info("analysis: _analyse: %s: I: %.2f LUFS, LRA: %.2f LU, TP: %.2f dBTP", e->path,
+		 e->result.integrated, e->result.range, e->result.true_peak);
+#endif
+
+out1:
+	loudness_deinit(&loud);
+out0:
+	decode_close(&dec);
+}
@@ -0,0 +1,42 @@
+#ifndef __ANALYSIS_H__
+#define __ANALYSIS_H__
+
+
+#include <stdint.h>
+
+#include "job.h"
+#include "loudness.h"
+#include "playlist.h"
+#include "util.h"
+
+
+/*
+ * Analysis: background EBU R128 measurement of tracks without ReplayGain tags,
+ * persisted in "$XDG_CACHE_HOME/moedance/CFG_ANALYSIS_CACHE_FILE".
+ */
+typedef struct analysis_entry {
+	int            is_done;
+	int64_t        size;
+	int64_t        mtime;
+	LoudnessResult result;
+	char           path[];
+} AnalysisEntry;
+
+typedef struct analysis {
+	int      is_running;
+	Job      job;
+	ArrayPtr cache;		/* AnalysisEntry: sorted by path */
+	ArrayPtr pending;	/* AnalysisEntry: sorted by path */
+	Str      file;
+} Analysis;
+
+
+int  analysis_init(Analysis *a);
+void analysis_deinit(Analysis *a);
+int  analysis_start(Analysis *a, const PlaylistItem *items[], int len);
+void analysis_stop(Analysis *a);
+void analysis_set_throttle(Analysis *a, int enable);
+int  analysis_update(Analysis *a, int *total);
+
+
+#endif
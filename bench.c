@@ -0,0 +1,954 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <libavutil/channel_layout.h>
+#include <libavutil/opt.h>
+
+#include <sys/sysinfo.h>
+
+#include "bench.h"
+#include "eq.h"
+#include "limiter.h"
+#include "pcm.h"
+#include "player.h"
+#include "playlist.h"
+#include "resample.h"
+#include "scan.h"
+#include "stats.h"
+#include "stretch.h"
+#include "tags.h"
+#include "uring.h"
+#include "util.h"
+#include "config.h"
+
+
+#define _RATE     (44100)
+#define _CHANNELS (2)
+#define _FRAMES   (_RATE * 10)
+#define _BLOCK    (1024)
+#define _HIRES_S  (5)
+#define _PI       (3.14159265358979323846)
+
+/* files per io_uring round */
+#define _HEADS_BATCH (128)
+
+/* the most common case: 48 kHz files on a 44.1 kHz device */
+#define _RS_IN     (48000)
+#define _RS_OUT    (44100)
+#define _RS_S      (10)
+#define _RS_TONE   (_RS_IN / 2)		/* frames per tone */
+#define _RS_SKIP   (2048)		/* filter settling, both ends */
+#define _RS_AMP    (0.5)
+
+#define _SD_RUNS    (8)
+#define _SD_PLAY_MS (300)		/* the rings fill up, the decoder waits for room */
+
+
+typedef struct bench_entry {
+	const char *name;
+	int       (*func)(void);
+} BenchEntry;
+
+
+static int    _bench_eq(void);
+static int    _bench_stretch(void);
+static int    _bench_limiter(void);
+static int    _bench_pcm(void);
+static int    _bench_hires(void);
+static int    _bench_resampler(void);
+static int    _bench_shutdown(void);
+static int    _bench_library(void);
+static int    _bench_scan(void);
+static int    _bench_scan_heads(const ScanFile files[], int len);
+static int    _bench_scan_tags(const ScanFile files[], int len);
+static int    _swr_new(SwrContext **swr, const ResampleParams *params, int channels);
+static double _swr_gain(const ResampleParams *params, double freq);
+static float *_noise_new(size_t frames);
+static int    _wav_new(char path[]);
+static void   _le_put(uint8_t dst[], uint32_t val, int size);
+
+
+static const BenchEntry _entries[] = {
+	{ "eq", _bench_eq },
+	{ "stretch", _bench_stretch },
+	{ "limiter", _bench_limiter },
+	{ "pcm", _bench_pcm },
+	{ "hires", _bench_hires },
+	{ "resampler", _bench_resampler },
+	{ "shutdown", _bench_shutdown },
+	{ "library", _bench_library },
+	{ "scan", _bench_scan },
+};
+
+
+/*
+ * public
+ */
+int
+bench_run(const char name[])
+{
+	for (size_t i = 0; i < LEN(_entries); i++) {
+		if (strcmp(_entries[i].name, name) == 0)
+			return _entries[i].func();
+	}
+
+	return -1;
+}
+
+
+/*
+ * private
+ */
+static int
+_bench_eq(void)
+{
+	static const int bands_num[] = { 1, 5, 10 };
+
+	float *const frames = _noise_new(_FRAMES);
+	if (frames == NULL)
+		return -1;
+
+	Eq eq;
+	if (eq_init(&eq, _RATE, _CHANNELS, _BLOCK) < 0) {
+		free(frames);
+		return -1;
+	}
+
+	for (size_t i = 0; i < LEN(bands_num); i++) {
+		EqBand bands[EQ_BANDS_MAX];
+		for (int j = 0; j < bands_num[i]; j++) {
+			bands[j] = (EqBand) {
+				.type = EQ_BAND_TYPE_PEAK,
+				.freq = 60.0 * (double)(1 << j),
+				.gain = (j & 1)? -3.0 : 3.0,
+				.q = 1.0,
+			};
+		}
+
+		/* the first block swaps the parameters in */
+		eq_set(&eq, bands, bands_num[i]);
+		eq_process(&eq, frames, _BLOCK);
+
+		const int64_t start = stats_now_ns();
+		for (size_t j = 0; (j + _BLOCK) <= _FRAMES; j += _BLOCK)
+			eq_process(&eq, &frames[j * _CHANNELS], _BLOCK);
+
+		const int64_t elapsed = stats_now_ns() - start;
+		log_info("bench: eq: %2d band(s): %.3f ns/sample, %.3f ns/frame", bands_num[i],
+			 (double)elapsed / (double)(_FRAMES * _CHANNELS), (double)elapsed / (double)_FRAMES);
+	}
+
+	eq_deinit(&eq);
+	free(frames);
+	return 0;
+}
+
+
+/*
+ * ns per output frame, should not depend on the speed
+ */
+static int
+_bench_stretch(void)
+{
+	static const double speeds[] = { 0.5, 0.75, 1.25, 1.5, 2.0 };
+
+	float *const frames = _noise_new(_FRAMES);
+	if (frames == NULL)
+		return -1;
+
+	float *const out = malloc(_BLOCK * _CHANNELS * sizeof(float));
+	if (out == NULL) {
+		log_err(errno, "bench: _bench_stretch: malloc");
+		free(frames);
+		return -1;
+	}
+
+	int ret = -1;
+	Stretch st;
+	if (stretch_init(&st, _CHANNELS, _RATE) < 0)
+		goto out0;
+
+	for (size_t i = 0; i < LEN(speeds); i++) {
+		stretch_set_speed(&st, speeds[i]);
+		stretch_reset(&st);
+
+		size_t pos = 0;
+		size_t produced = 0;
+		const int64_t start = stats_now_ns();
+		for (;;) {
+			const size_t want = stretch_want(&st);
+			if ((pos + want) > _FRAMES)
+				break;
+
+			memcpy(stretch_feed_ptr(&st, want), &frames[pos * _CHANNELS], want * _CHANNELS * sizeof(float));
+			stretch_feed_commit(&st, want);
+			pos += want;
+			produced += stretch_read(&st, out, _BLOCK);
+		}
+
+		const int64_t elapsed = stats_now_ns() - start;
+		log_info("bench: stretch: %.2fx: %.3f ns/frame", speeds[i],
+			 (double)elapsed / (double)((produced > 0)? produced : 1));
+	}
+
+	stretch_deinit(&st);
+	ret = 0;
+
+out0:
+	free(out);
+	free(frames);
+	return ret;
+}
+
+
+/*
+ * noise at -12 dBFS: bypassed, at +6 dBFS: limited all the time
+ */
+static int
+_bench_limiter(void)
+{
+	static const struct { const char *name; float scale; } cases[] = {
+		{ "bypass", 0.5f },
+		{ "limiting", 4.0f },
+	};
+
+	float *const frames = _noise_new(_FRAMES);
+	if (frames == NULL)
+		return -1;
+
+	float *const tmp = malloc(_FRAMES * _CHANNELS * sizeof(float));
+	if (tmp == NULL) {
+		log_err(errno, "bench: _bench_limiter: malloc");
+		free(frames);
+		return -1;
+	}
+
+	int ret = -1;
+	Stats stats;
+	stats_init(&stats);
+	for (size_t i = 0; i < LEN(cases); i++) {
+		Limiter lim;
+		if (limiter_init(&lim, _RATE, _CHANNELS, -1.0, 5, 80, &stats) < 0)
+			goto out0;
+
+		for (size_t j = 0; j < (_FRAMES * _CHANNELS); j++)
+			tmp[j] = frames[j] * cases[i].scale;
+
+		const int64_t start = stats_now_ns();
+		for (size_t j = 0; (j + _BLOCK) <= _FRAMES; j += _BLOCK)
+			limiter_process(&lim, &tmp[j * _CHANNELS], _BLOCK);
+
+		const int64_t elapsed = stats_now_ns() - start;
+		log_info("bench: limiter: %s: %.3f ns/frame", cases[i].name,
+			 (double)elapsed / (double)_FRAMES);
+
+		limiter_deinit(&lim);
+	}
+
+	ret = 0;
+
+out0:
+	free(tmp);
+	free(frames);
+	return ret;
+}
+
+
+/*
+ * float -> device format, every format and dither mode
+ */
+static int
+_bench_pcm(void)
+{
+	static const char *const dither_names[PCM_DITHER_END] = { "none", "tpdf", "shaped" };
+
+	float *const frames = _noise_new(_FRAMES);
+	if (frames == NULL)
+		return -1;
+
+	uint8_t *const out = malloc(_FRAMES * _CHANNELS * sizeof(float));
+	if (out == NULL) {
+		log_err(errno, "bench: _bench_pcm: malloc");
+		free(frames);
+		return -1;
+	}
+
+	for (int i = 0; i < PCM_FORMAT_END; i++) {
+		for (int j = 0; j < PCM_DITHER_END; j++) {
+			Pcm pcm;
+			pcm_init(&pcm, (PcmFormat)i, (PcmDither)j, _CHANNELS);
+			if ((j > 0) && (pcm.dither == PCM_DITHER_NONE))
+				continue;
+
+			const int64_t start = stats_now_ns();
+			for (size_t k = 0; (k + _BLOCK) <= _FRAMES; k += _BLOCK) {
+				pcm_encode(&pcm, &out[k * _CHANNELS * pcm_format_size(pcm.format)],
+					   &frames[k * _CHANNELS], _BLOCK);
+			}
+
+			const int64_t elapsed = stats_now_ns() - start;
+			log_info("bench: pcm: %s: dither: %s: %.3f ns/frame", pcm_format_str(pcm.format),
+				 dither_names[j], (double)elapsed / (double)_FRAMES);
+		}
+	}
+
+	free(out);
+	free(frames);
+	return 0;
+}
+
+
+/*
+ * the mixer path at 44.1, 96 and 192 kHz: context ring -> mix buffer, eq (10 bands),
+ * limiter, s24 + TPDF -> device ring; what is not spent here is left for decoding
+ */
+static int
+_bench_hires(void)
+{
+	static const unsigned rates[] = { 44100, 96000, 192000 };
+	const size_t frames_max = 192000 * _HIRES_S;
+	const size_t frame_size = pcm_format_size(PCM_FORMAT_S24) * _CHANNELS;
+
+	float *const frames = _noise_new(frames_max);
+	if (frames == NULL)
+		return -1;
+
+	int ret = -1;
+	float *const mix = malloc(_BLOCK * _CHANNELS * sizeof(float));
+	uint8_t *const out = malloc(frames_max * frame_size);
+	if ((mix == NULL) || (out == NULL)) {
+		log_err(errno, "bench: _bench_hires: malloc");
+		goto out0;
+	}
+
+	EqBand bands[10];
+	for (int i = 0; i < (int)LEN(bands); i++) {
+		bands[i] = (EqBand) {
+			.type = EQ_BAND_TYPE_PEAK,
+			.freq = 31.25 * (double)(1 << i),
+			.gain = (i & 1)? -3.0 : 3.0,
+			.q = 1.0,
+		};
+	}
+
+	Stats stats;
+	stats_init(&stats);
+	for (size_t i = 0; i < LEN(rates); i++) {
+		const size_t len = (size_t)rates[i] * _HIRES_S;
+		Eq eq;
+		if (eq_init(&eq, rates[i], _CHANNELS, _BLOCK) < 0)
+			goto out0;
+
+		Limiter lim;
+		if (limiter_init(&lim, rates[i], _CHANNELS, -1.0, 5, 80, &stats) < 0) {
+			eq_deinit(&eq);
+			goto out0;
+		}
+
+		Pcm pcm;
+		pcm_init(&pcm, PCM_FORMAT_S24, PCM_DITHER_TPDF, _CHANNELS);
+		eq_set(&eq, bands, (int)LEN(bands));
+
+		const int64_t start = stats_now_ns();
+		for (size_t j = 0; (j + _BLOCK) <= len; j += _BLOCK) {
+			memcpy(mix, &frames[j * _CHANNELS], _BLOCK * _CHANNELS * sizeof(float));
+			eq_process(&eq, mix, _BLOCK);
+			limiter_process(&lim, mix, _BLOCK);
+			pcm_encode(&pcm, &out[j * frame_size], mix, _BLOCK);
+		}
+
+		/* read from the context ring, written to the device ring */
+		const int64_t elapsed = stats_now_ns() - start;
+		const double bytes = (double)len * (double)((_CHANNELS * sizeof(float)) + frame_size);
+		log_info("bench: hires: %6u Hz: %.3f ns/frame, %.0fx real time, %.1f MB/s", rates[i],
+			 (double)elapsed / (double)len, (_HIRES_S * 1e9) / (double)elapsed,
+			 (bytes * 1e3) / (double)elapsed);
+
+		limiter_deinit(&lim);
+		eq_deinit(&eq);
+	}
+
+	ret = 0;
+
+out0:
+	free(out);
+	free(mix);
+	free(frames);
+	return ret;
+}
+
+
+/*
+ * 48 -> 44.1 kHz per setting: ns per output frame (stereo noise), the ripple up to
+ * 18 kHz, the gain at 20 kHz, and the worst alias of a tone above 22.05 kHz
+ */
+static int
+_bench_resampler(void)
+{
+	static const char *const settings[] = { "cheap", "default", "swr 64", "swr 64 0.99", "best" };
+	static const double aliases[] = { 22500.0, 23000.0, 23500.0 };
+	const size_t out_max = ((size_t)_RS_OUT * _RS_S) + 4096;
+
+	float *const frames = _noise_new((size_t)_RS_IN * _RS_S);
+	if (frames == NULL)
+		return -1;
+
+	float *const out = malloc(out_max * _CHANNELS * sizeof(float));
+	if (out == NULL) {
+		log_err(errno, "bench: _bench_resampler: malloc");
+		free(frames);
+		return -1;
+	}
+
+	for (size_t i = 0; i < LEN(settings); i++) {
+		ResampleParams params;
+		if (resample_params_from_str(&params, settings[i]) < 0)
+			continue;
+
+		SwrContext *swr;
+		if (_swr_new(&swr, &params, _CHANNELS) < 0)
+			continue;
+
+		const int64_t start = stats_now_ns();
+		const uint8_t *in_ptr = (const uint8_t *)frames;
+		uint8_t *out_ptr = (uint8_t *)out;
+		const int len = swr_convert(swr, &out_ptr, (int)out_max, &in_ptr, _RS_IN * _RS_S);
+		const int64_t elapsed = stats_now_ns() - start;
+		swr_free(&swr);
+		if (len <= 0)
+			continue;
+
+		/* 1/3 octaves from 20 Hz */
+		double lo = 1e9, hi = -1e9;
+		for (double f = 20.0; f <= 18000.0; f *= 1.2599) {
+			const double g = _swr_gain(&params, f);
+			lo = (g < lo)? g : lo;
+			hi = (g > hi)? g : hi;
+		}
+
+		double alias = -1e9;
+		for (size_t j = 0; j < LEN(aliases); j++) {
+			const double g = _swr_gain(&params, aliases[j]);
+			alias = (g > alias)? g : alias;
+		}
+
+		char buffer[64];
+		log_info("bench: resampler: %s (%s): %.3f ns/frame, ripple: %.4f dB, 20 kHz: %.2f dB, "
+			 "aliasing: %.1f dB", settings[i], resample_params_str(&params, buffer, sizeof(buffer)),
+			 (double)elapsed / (double)len, hi - lo, _swr_gain(&params, 20000.0), alias);
+	}
+
+	free(out);
+	free(frames);
+	return 0;
+}
+
+
+/*
+ * while playing, null output: player_close() alone, what the UI thread waits for, and
+ * through player_deinit(), everything gone; the latter is what quitting costs
+ */
+static int
+_bench_shutdown(void)
+{
+	char path[] = "/tmp/moedance-bench-XXXXXX";
+	if (_wav_new(path) < 0)
+		return -1;
+
+	Player *const p = malloc(sizeof(*p));
+	if (p == NULL) {
+		log_err(errno, "bench: _bench_shutdown: malloc");
+		unlink(path);
+		return -1;
+	}
+
+	const struct timespec play = { .tv_sec = 0, .tv_nsec = _SD_PLAY_MS * 1000000L };
+	int64_t close_max = 0, total_sum = 0, total_max = 0;
+	int runs = 0;
+	for (int i = 0; i < _SD_RUNS; i++) {
+		if (player_init(p, PLAYER_OUTPUT_NULL) < 0)
+			break;
+
+		if (player_item_play(p, path, 0) < 0) {
+			player_deinit(p);
+			break;
+		}
+
+		thrd_sleep(&play, NULL);
+		const size_t played = atomic_load(&p->frames_played);
+
+		const int64_t start = stats_now_ns();
+		player_close(p);
+		const int64_t closed = stats_now_ns() - start;
+		player_deinit(p);
+		const int64_t total = stats_now_ns() - start;
+		if (played == 0) {
+			log_err(0, "bench: _bench_shutdown: nothing was played");
+			break;
+		}
+
+		close_max = (closed > close_max)? closed : close_max;
+		total_max = (total > total_max)? total : total_max;
+		total_sum += total;
+		runs++;
+	}
+
+	if (runs > 0) {
+		log_info("bench: shutdown: %d run(s), close: %.3f ms max, close + deinit: %.3f ms avg, "
+			 "%.3f ms max", runs, (double)close_max / 1e6, ((double)total_sum / runs) / 1e6,
+			 (double)total_max / 1e6);
+	}
+
+	free(p);
+	unlink(path);
+	return (runs == _SD_RUNS)? 0 : -1;
+}
+
+
+/*
+ * what the UI waits for before its first draw, on the playlist root: playlist_load()
+ * probing every file as it did without an index, then from the index (built by the
+ * first of the two if there was none)
+ */
+static int
+_bench_library(void)
+{
+	static const struct { const char *name; PlaylistLoadMode mode; } loads[] = {
+		{ "probe", PLAYLIST_LOAD_PROBE },
+		{ "index, first", PLAYLIST_LOAD_INDEX },
+		{ "index", PLAYLIST_LOAD_INDEX },
+	};
+
+	for (size_t i = 0; i < LEN(loads); i++) {
+		Playlist pl;
+		if (playlist_init(&pl, ".") < 0) {
+			log_err(errno, "bench: _bench_library: playlist_init");
+			return -1;
+		}
+
+		const PlaylistItem **items;
+		const int64_t start = stats_now_ns();
+		const int len = playlist_load(&pl, loads[i].mode, &items);
+		const int64_t elapsed = stats_now_ns() - start;
+		if (len < 0) {
+			playlist_deinit(&pl);
+			return -1;
+		}
+
+		log_info("bench: library: %s: %d items, %zu probed, %.3f ms, %.3f us/item", loads[i].name, len,
+			 pl.probed, (double)elapsed / 1e6, (len > 0)? ((double)elapsed / 1e3) / len : 0.0);
+		playlist_deinit(&pl);
+	}
+
+	return 0;
+}
+
+
+/*
+ * the playlist root listed by one thread and by CFG_DIR_THREADS_NUM, file attributes
+ * by fstatat() and through io_uring, twice (the second time from the page and
+ * attribute caches): the same files in the same order, and how many per second; worth
+ * running on a local disk and on NFS
+ */
+static int
+_bench_scan(void)
+{
+	int nprocs = CFG_DIR_THREADS_NUM;
+	if (nprocs <= 0)
+		nprocs = get_nprocs();
+
+	const int thrds_num[] = { 1, nprocs, 1, nprocs };
+	const ScanBackend backends[] = { SCAN_BACKEND_PLAIN, SCAN_BACKEND_PLAIN, SCAN_BACKEND_URING, SCAN_BACKEND_URING };
+	ScanFile *files[LEN(thrds_num)] = { NULL };
+	int lens[LEN(thrds_num)] = { 0 };
+	int64_t elapsed[LEN(thrds_num)] = { 0 };
+
+	Arena arena;
+	arena_init(&arena, 64 * 1024);
+
+	int ret = -1;
+	for (int pass = 0; pass < 2; pass++) {
+		for (size_t i = 0; i < LEN(thrds_num); i++) {
+			const Scan scan = {
+				.thrds_num = thrds_num[i],
+				.max_depth = CFG_DIR_RECURSIVE_SIZE,
+				.is_tree = 1,
+				.filter = NULL,
+				.backend = backends[i],
+				.arena = &arena,
+			};
+
+			free(files[i]);
+			files[i] = NULL;
+
+			const int64_t start = stats_now_ns();
+			lens[i] = scan_files(&scan, ".", &files[i]);
+			elapsed[i] = stats_now_ns() - start;
+			if (lens[i] < 0)
+				goto out0;
+
+			const double secs = (double)elapsed[i] / 1e9;
+			log_info("bench: scan: %s: %s: %d thread(s): %d files, %.3f ms, %.0f files/s",
+				 (pass == 0)? "first" : "again", (backends[i] == SCAN_BACKEND_URING)? "uring" : "plain",
+				 thrds_num[i], lens[i], secs * 1e3, (secs > 0)? lens[i] / secs : 0.0);
+		}
+
+		log_info("bench: scan: %s: threads: %.2fx, uring: %.2fx", (pass == 0)? "first" : "again",
+			 (elapsed[1] > 0)? (double)elapsed[0] / (double)elapsed[1] : 0.0,
+			 (elapsed[3] > 0)? (double)elapsed[1] / (double)elapsed[3] : 0.0);
+	}
+
+	for (size_t i = 1; i < LEN(thrds_num); i++) {
+		if (lens[0] != lens[i]) {
+			log_err(0, "bench: _bench_scan: %d != %d files", lens[0], lens[i]);
+			goto out0;
+		}
+
+		for (int j = 0; j < lens[0]; j++) {
+			if (strcmp(files[0][j].path, files[i][j].path) != 0) {
+				log_err(0, "bench: _bench_scan: order: [%d]: %s != %s", j, files[0][j].path, files[i][j].path);
+				goto out0;
+			}
+		}
+	}
+
+	log_info("bench: scan: same order");
+	ret = _bench_scan_heads(files[0], lens[0]);
+	if (ret == 0)
+		ret = _bench_scan_tags(files[0], lens[0]);
+
+out0:
+	for (size_t i = 0; i < LEN(thrds_num); i++)
+		free(files[i]);
+
+	arena_deinit(&arena);
+	return ret;
+}
+
+
+/*
+ * the first CFG_SCAN_HEADER_KB of every file: open(), read(), close() each, then the
+ * same in io_uring batches; the second run has the cache the first one warmed
+ */
+static int
+_bench_scan_heads(const ScanFile files[], int len)
+{
+	const size_t size = (size_t)CFG_SCAN_HEADER_KB * 1024;
+	uint8_t *const data = malloc(_HEADS_BATCH * size);
+	if (data == NULL) {
+		log_err(errno, "bench: _bench_scan_heads: malloc");
+		return -1;
+	}
+
+	int64_t start = stats_now_ns();
+	int64_t total_plain = 0;
+	for (int i = 0; i < len; i++) {
+		const int fd = open(files[i].path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			continue;
+
+		const ssize_t rd = read(fd, data, size);
+		if (rd > 0)
+			total_plain += rd;
+
+		close(fd);
+	}
+
+	double secs = (double)(stats_now_ns() - start) / 1e9;
+	log_info("bench: scan: heads: plain: %d files, %.3f ms, %.0f files/s, %.1f MB/s", len, secs * 1e3,
+		 (secs > 0)? len / secs : 0.0, (secs > 0)? (double)total_plain / secs / 1e6 : 0.0);
+
+	int ret = -1;
+	Uring ring;
+	if (uring_init(&ring, _HEADS_BATCH) < 0) {
+		log_info("bench: scan: heads: uring: not available");
+		ret = 0;
+		goto out0;
+	}
+
+	const char *paths[_HEADS_BATCH];
+	uint8_t *bufs[_HEADS_BATCH];
+	int res[_HEADS_BATCH];
+	for (int i = 0; i < _HEADS_BATCH; i++)
+		bufs[i] = &data[(size_t)i * size];
+
+	start = stats_now_ns();
+	int64_t total_uring = 0;
+	for (int i = 0; i < len; i += _HEADS_BATCH) {
+		const int count = ((len - i) < _HEADS_BATCH)? (len - i) : _HEADS_BATCH;
+		for (int j = 0; j < count; j++)
+			paths[j] = files[i + j].path;
+
+		if (uring_read_heads(&ring, paths, (size_t)count, bufs, size, res) < 0)
+			goto out1;
+
+		for (int j = 0; j < count; j++) {
+			if (res[j] > 0)
+				total_uring += res[j];
+		}
+	}
+
+	secs = (double)(stats_now_ns() - start) / 1e9;
+	log_info("bench: scan: heads: uring: %d files, %.3f ms, %.0f files/s, %.1f MB/s", len, secs * 1e3,
+		 (secs > 0)? len / secs : 0.0, (secs > 0)? (double)total_uring / secs / 1e6 : 0.0);
+
+	if (total_plain != total_uring) {
+		log_err(0, "bench: _bench_scan_heads: %" PRId64 " != %" PRId64 " bytes", total_plain, total_uring);
+		goto out1;
+	}
+
+	ret = 0;
+
+out1:
+	uring_deinit(&ring);
+out0:
+	free(data);
+	return ret;
+}
+
+
+/*
+ * the playable files (CFG_FILE_TYPES): the native tag readers, then libav's probe on
+ * the same ones; the durations they both have have to agree (within a second)
+ */
+static int
+_bench_scan_tags(const ScanFile files[], int len)
+{
+	static const char *const types[] = CFG_FILE_TYPES;
+
+	const ScanFile **const playable = malloc(sizeof(*playable) * (size_t)(len + 1));
+	int64_t *const durations = malloc(sizeof(*durations) * (size_t)(len + 1));
+	if ((playable == NULL) || (durations == NULL)) {
+		log_err(errno, "bench: _bench_scan_tags: malloc");
+		free(playable);
+		free(durations);
+		return -1;
+	}
+
+	int count = 0;
+	for (int i = 0; i < len; i++) {
+		const char *const ext = strrchr(files[i].path, '.');
+		if (ext == NULL)
+			continue;
+
+		for (size_t j = 0; j < LEN(types); j++) {
+			if (strcasecmp(&ext[1], types[j]) == 0) {
+				playable[count++] = &files[i];
+				break;
+			}
+		}
+	}
+
+	Tags tags;
+	int native = 0;
+	int64_t start = stats_now_ns();
+	for (int i = 0; i < count; i++) {
+		durations[i] = -1;
+		if (tags_read(&tags, playable[i]->path, playable[i]->size, NULL, 0) < 0)
+			continue;
+
+		durations[i] = tags.duration;
+		native++;
+	}
+
+	const double secs_native = (double)(stats_now_ns() - start) / 1e9;
+	log_info("bench: scan: tags: native: %d/%d files, %.3f ms, %.0f files/s", native, count,
+		 secs_native * 1e3, (secs_native > 0)? count / secs_native : 0.0);
+
+	int probed = 0;
+	int mismatched = 0;
+	start = stats_now_ns();
+	for (int i = 0; i < count; i++) {
+		AVFormatContext *ctx = NULL;
+		if (avformat_open_input(&ctx, playable[i]->path, NULL, NULL) < 0)
+			continue;
+
+		if (avformat_find_stream_info(ctx, NULL) >= 0) {
+			const int64_t duration = ctx->duration / AV_TIME_BASE;
+			if ((durations[i] >= 0) && (llabs(durations[i] - duration) > 1)) {
+				log_info("bench: scan: tags: \"%s\": %" PRId64 " s != %" PRId64 " s (libav)",
+					 playable[i]->path, durations[i], duration);
+				mismatched++;
+			}
+
+			probed++;
+		}
+
+		avformat_close_input(&ctx);
+	}
+
+	const double secs_libav = (double)(stats_now_ns() - start) / 1e9;
+	log_info("bench: scan: tags: libav: %d/%d files, %.3f ms, %.0f files/s", probed, count, secs_libav * 1e3,
+		 (secs_libav > 0)? count / secs_libav : 0.0);
+	log_info("bench: scan: tags: native: %.2fx, %d duration(s) off", (secs_native > 0)? secs_libav / secs_native : 0.0,
+		 mismatched);
+
+	free(playable);
+	free(durations);
+	return 0;
+}
+
+
+/*
+ * 48 -> 44.1 kHz, float
+ */
+static int
+_swr_new(SwrContext **swr, const ResampleParams *params, int channels)
+{
+	SwrContext *ret = swr_alloc();
+	if (ret == NULL) {
+		log_err(0, "bench: _swr_new: swr_alloc: failed");
+		return -1;
+	}
+
+	AVChannelLayout chan;
+	av_channel_layout_default(&chan, channels);
+	av_opt_set_chlayout(ret, "in_chlayout", &chan, 0);
+	av_opt_set_chlayout(ret, "out_chlayout", &chan, 0);
+	av_opt_set_int(ret, "in_sample_fmt", AV_SAMPLE_FMT_FLT, 0);
+	av_opt_set_int(ret, "out_sample_fmt", AV_SAMPLE_FMT_FLT, 0);
+	av_opt_set_int(ret, "in_sample_rate", _RS_IN, 0);
+	av_opt_set_int(ret, "out_sample_rate", _RS_OUT, 0);
+	if (resample_apply(ret, params) < 0)
+		goto err0;
+
+	const int err = swr_init(ret);
+	if (err < 0) {
+		log_err(0, "bench: _swr_new: swr_init: %s", av_err2str(err));
+		goto err0;
+	}
+
+	*swr = ret;
+	return 0;
+
+err0:
+	swr_free(&ret);
+	return -1;
+}
+
+
+/*
+ * returns: dB, the RMS of a resampled mono tone against the input one, settling
+ * excluded; above the output Nyquist frequency whatever is left is an alias
+ */
+static double
+_swr_gain(const ResampleParams *params, double freq)
+{
+	float in[_RS_TONE];
+	float out[_RS_TONE];
+	for (size_t i = 0; i < _RS_TONE; i++)
+		in[i] = (float)(_RS_AMP * sin((2.0 * _PI * freq * (double)i) / _RS_IN));
+
+	SwrContext *swr;
+	if (_swr_new(&swr, params, 1) < 0)
+		return NAN;
+
+	const uint8_t *in_ptr = (const uint8_t *)in;
+	uint8_t *out_ptr = (uint8_t *)out;
+	const int len = swr_convert(swr, &out_ptr, _RS_TONE, &in_ptr, _RS_TONE);
+	swr_free(&swr);
+	if (len <= (_RS_SKIP * 2))
+		return NAN;
+
+	double sum = 0.0;
+	for (int i = _RS_SKIP; i < (len - _RS_SKIP); i++)
+		sum += (double)out[i] * (double)out[i];
+
+	const double rms = sqrt(sum / (double)(len - (_RS_SKIP * 2)));
+	return 20.0 * log10((rms + 1e-12) / (_RS_AMP / sqrt(2.0)));
+}
+
+
+static float *
+_noise_new(size_t frames)
+{
+	float *const ret = malloc(frames * _CHANNELS * sizeof(float));
+	if (ret == NULL) {
+		log_err(errno, "bench: _noise_new: malloc");
+		return NULL;
+	}
+
+	uint32_t seed = 0x12345678;
+	for (size_t i = 0; i < (frames * _CHANNELS); i++) {
+		seed = (seed * 1664525u) + 1013904223u;
+		ret[i] = ((float)(seed >> 8) / (float)(1 << 24)) - 0.5f;
+	}
+
+	return ret;
+}
+
+
+/*
+ * 16-bit stereo at _RATE, _FRAMES long, a -12 dB 1 kHz tone; path: a mkstemp()
+ * template, the file is left behind
+ */
+static int
+_wav_new(char path[])
+{
+	const int fd = mkstemp(path);
+	if (fd < 0) {
+		log_err(errno, "bench: _wav_new: mkstemp: %s", path);
+		return -1;
+	}
+
+	const size_t data = (size_t)_FRAMES * _CHANNELS * sizeof(int16_t);
+	uint8_t *const buffer = malloc(44 + data);
+	if (buffer == NULL) {
+		log_err(errno, "bench: _wav_new: malloc");
+		goto err0;
+	}
+
+	memcpy(&buffer[0], "RIFF", 4);
+	_le_put(&buffer[4], (uint32_t)(36 + data), 4);
+	memcpy(&buffer[8], "WAVEfmt ", 8);
+	_le_put(&buffer[16], 16, 4);
+	_le_put(&buffer[20], 1, 2);		/* PCM */
+	_le_put(&buffer[22], _CHANNELS, 2);
+	_le_put(&buffer[24], _RATE, 4);
+	_le_put(&buffer[28], _RATE * _CHANNELS * sizeof(int16_t), 4);
+	_le_put(&buffer[32], _CHANNELS * sizeof(int16_t), 2);
+	_le_put(&buffer[34], 16, 2);
+	memcpy(&buffer[36], "data", 4);
+	_le_put(&buffer[40], (uint32_t)data, 4);
+
+	uint8_t *const samples = &buffer[44];
+	for (size_t i = 0; i < _FRAMES; i++) {
+		const double val = 0.25 * sin((2.0 * _PI * 1000.0 * (double)i) / _RATE);
+		const uint16_t s = (uint16_t)(int16_t)lrint(val * 32767.0);
+		for (size_t j = 0; j < _CHANNELS; j++)
+			_le_put(&samples[((i * _CHANNELS) + j) * 2], s, 2);
+	}
+
+	if (write(fd, buffer, 44 + data) != (ssize_t)(44 + data)) {
+		log_err(errno, "bench: _wav_new: write: %s", path);
+		goto err1;
+	}
+
+	free(buffer);
+	close(fd);
+	return 0;
+
+err1:
+	free(buffer);
+err0:
+	close(fd);
+	unlink(path);
+	return -1;
+}
+
+
+static void
+_le_put(uint8_t dst[], uint32_t val, int size)
+{
+	for (int i = 0; i < size; i++)
+		dst[i] = (uint8_t)(val >> (i * 8));
+}
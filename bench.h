@@ -0,0 +1,11 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+
+/*
+ * Bench: in-app micro benchmarks, results go to the log file (see ":bench <name>")
+ */
+int bench_run(const char name[]);
+
+
+#endif
@@ -8,6 +8,9 @@
 static void _handle_quit(Cmd *c);
 static void _handle_sleep(Cmd *c, const char *arg);
 static void _handle_repeat(Cmd *c, const char *arg);
+static void _handle_crossfade(Cmd *c, const char *arg);
+static void _handle_arg(Cmd *c, int type, const char *arg);
+static void _handle_args(Cmd *c, int type, const char *arg);
 
 
 void
@@ -36,6 +39,56 @@ cmd_parse_query(Cmd *c, const char query[])
                 return;
         }
 
+        if (strncmp(st.value, "crossfade", 9) == 0) {
+                _handle_crossfade(c, next);
+                return;
+        }
+
+        if (strncmp(st.value, "eq", 2) == 0) {
+                _handle_arg(c, CMD_TYPE_EQ, next);
+                return;
+        }
+
+        if (strncmp(st.value, "bench", 5) == 0) {
+                _handle_arg(c, CMD_TYPE_BENCH, next);
+                return;
+        }
+
+        if (strncmp(st.value, "filter", 6) == 0) {
+                _handle_arg(c, CMD_TYPE_FILTER, next);
+                return;
+        }
+
+        if (strncmp(st.value, "stats", 5) == 0) {
+                _handle_arg(c, CMD_TYPE_STATS, next);
+                return;
+        }
+
+        if (strncmp(st.value, "speed", 5) == 0) {
+                _handle_arg(c, CMD_TYPE_SPEED, next);
+                return;
+        }
+
+        if (strncmp(st.value, "viz", 3) == 0) {
+                _handle_arg(c, CMD_TYPE_VIZ, next);
+                return;
+        }
+
+        if (strncmp(st.value, "channels", 8) == 0) {
+                _handle_arg(c, CMD_TYPE_CHANNELS, next);
+                return;
+        }
+
+        if (strncmp(st.value, "resampler", 9) == 0) {
+                _handle_args(c, CMD_TYPE_RESAMPLER, next);
+                return;
+        }
+
+        if (strncmp(st.value, "rescan", 6) == 0) {
+                _handle_arg(c, CMD_TYPE_RESCAN, next);
+                return;
+        }
+
         c->type = CMD_TYPE_UNKNOWN;
         c->args_len = 0;
 }
@@ -76,3 +129,50 @@ _handle_repeat(Cmd *c, const char *arg)
 
         c->args_len = 1;
 }
+
+
+static void
+_handle_crossfade(Cmd *c, const char *arg)
+{
+        c->type = CMD_TYPE_CROSSFADE;
+        if (space_tokenizer_next(&c->args[0], arg) == NULL) {
+                c->args_len = 0;
+                return;
+        }
+
+        c->args_len = 1;
+}
+
+
+/*
+ * commands with a single argument
+ */
+static void
+_handle_arg(Cmd *c, int type, const char *arg)
+{
+        c->type = type;
+        if (space_tokenizer_next(&c->args[0], arg) == NULL) {
+                c->args_len = 0;
+                return;
+        }
+
+        c->args_len = 1;
+}
+
+
+/*
+ * up to CFG_CMD_ARGS_SIZE arguments
+ */
+static void
+_handle_args(Cmd *c, int type, const char *arg)
+{
+        c->type = type;
+        c->args_len = 0;
+        while (c->args_len < CFG_CMD_ARGS_SIZE) {
+                arg = space_tokenizer_next(&c->args[c->args_len], arg);
+                if (arg == NULL)
+                        break;
+
+                c->args_len++;
+        }
+}
@@ -11,6 +11,16 @@ enum {
         CMD_TYPE_QUIT,
         CMD_TYPE_SLEEP,
         CMD_TYPE_REPEAT,
+        CMD_TYPE_CROSSFADE,
+        CMD_TYPE_EQ,
+        CMD_TYPE_BENCH,
+        CMD_TYPE_FILTER,
+        CMD_TYPE_STATS,
+        CMD_TYPE_SPEED,
+        CMD_TYPE_VIZ,
+        CMD_TYPE_CHANNELS,
+        CMD_TYPE_RESAMPLER,
+        CMD_TYPE_RESCAN,
         CMD_TYPE_UNKNOWN,
 };
 
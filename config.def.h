@@ -54,6 +54,9 @@
 #define CFG_FOOTER_COLOR_BG   "44"
 //#define CFG_FOOTER_COLOR_BG   "45"
 
+#define CFG_VIZ_COLOR_FG      "36"
+#define CFG_VIZ_COLOR_BG      "49"
+
 
 #define CFG_DIR_RECURSIVE_SIZE (8)
 #define CFG_LOG_FILE           "/tmp/moedance.log"
@@ -65,9 +68,242 @@
 
 
 /*
+ * metadata probing threads, they take files a few at a time as they get done; mostly
+ * waiting on the disk, so more of them than CPUs
+ * -1: default twice the CPU count (32 at most)
+ */
+#define CFG_FILE_META_THREADS_NUM (-1)
+
+
+/*
+ * directory listing threads, mostly waiting on the file system (on NFS: the network)
  * -1: default CPU count
  */
-#define CFG_FILE_META_THREADS_NUM (1)
+#define CFG_DIR_THREADS_NUM (8)
+
+
+/*
+ * io_uring for the library scan: file attributes a directory at a time, file headers a
+ * batch at a time, fewer system calls on large libraries; plain calls if the kernel
+ * does not allow it. Not a win everywhere (statx is run by kernel worker threads),
+ * see ":bench scan" on the disk in question.
+ * enable; 1 = true, otherwise false
+ * header: read ahead of the metadata probe, most tags fit (KB)
+ */
+#define CFG_SCAN_URING_ENABLE (0)
+#define CFG_SCAN_HEADER_KB    (32)
+
+
+/*
+ * native tag readers: MP3, FLAC, Ogg Opus, WAV and MP4 headers parsed here, only the
+ * bytes needed are read; libav for anything else, or anything they are not sure of
+ * enable; 1 = true, otherwise false
+ */
+#define CFG_TAGS_NATIVE_ENABLE (1)
+
+
+/*
+ * library index: metadata of every probed file, per root directory; unchanged files
+ * are not opened again on the next start
+ * enable; 1 = true, otherwise false
+ * cache dir: relative to "$XDG_CACHE_HOME/moedance/"
+ */
+#define CFG_LIBRARY_ENABLE    (1)
+#define CFG_LIBRARY_CACHE_DIR "library"
+
+
+/*
+ * live library updates: files added, changed or removed below the root directory show
+ * up without a restart
+ * enable; 1 = true, otherwise false
+ * settle: merged once nothing changed for this long (ms)
+ * delay max: or once the first change is this old, a long copy shows up in batches (ms)
+ */
+#define CFG_WATCH_ENABLE       (1)
+#define CFG_WATCH_SETTLE_MS    (1000)
+#define CFG_WATCH_DELAY_MAX_MS (5000)
+
+
+/*
+ * seek step: left/right (or h/l) keys (s)
+ */
+#define CFG_SEEK_STEP_S (5)
+
+
+/*
+ * crossfade: overlap of two consecutive items (s), 0 = disabled, see ":crossfade N"
+ * fade manual: short fade on manual next/prev/play (ms), 0 = hard cut
+ */
+#define CFG_CROSSFADE_S     (0)
+#define CFG_CROSSFADE_MAX_S (12)
+#define CFG_FADE_MANUAL_MS  (250)
+
+
+/*
+ * parametric equalizer, see ":eq <preset>"
+ * presets file: relative to "$XDG_CONFIG_HOME/moedance/", one preset per line:
+ *	<name> <peak|lowshelf|highshelf>:<freq Hz>:<gain dB>:<q> ...
+ *	e.g: bass lowshelf:100:6:0.7 peak:3000:-2:1.0
+ * preset: applied at startup, "off" = bypass
+ */
+#define CFG_EQ_PRESETS_FILE "eq"
+#define CFG_EQ_PRESET       "off"
+
+
+/*
+ * libavfilter graph applied to every decoded frame, "" = none, see ":filter <graph>"
+ * e.g: "dynaudnorm", "aecho=0.8:0.9:500:0.3", "loudnorm,atempo=1.25"
+ */
+#define CFG_FILTER ""
+
+
+/*
+ * used whenever the file rate is not the device rate, see ":resampler <setting>"
+ * "cheap", "default", "best" (soxr), or "<swr|soxr> [filter_size [cutoff]]"
+ * filter_size: swr only, 2 .. 256; cutoff: of the output Nyquist frequency
+ * ":bench resampler" compares the cost, ripple and aliasing of each
+ */
+#define CFG_RESAMPLER "default"
+
+
+/*
+ * look-ahead true-peak limiter, the last stage before the output
+ * enable; 1 = true, otherwise false
+ * ceiling: dBTP
+ * lookahead: ms, the added output latency
+ * release: ms
+ */
+#define CFG_LIMITER_ENABLE       (1)
+#define CFG_LIMITER_CEILING_DB   (-1.0)
+#define CFG_LIMITER_LOOKAHEAD_MS (5)
+#define CFG_LIMITER_RELEASE_MS   (80)
+
+
+/*
+ * device sample format: "f32", "s32", "s24" (packed) or "s16"
+ * dither, s24 and s16 only: 0 = none, 1 = TPDF, 2 = TPDF + noise shaping
+ */
+#define CFG_OUTPUT_FORMAT "f32"
+#define CFG_OUTPUT_DITHER (1)
+
+
+/*
+ * hi-res: the device follows the source rate, up to CFG_HIRES_RATE_MAX Hz, when it
+ * supports that rate; no resampling, a short gap where the rate changes.
+ * Off, or a rate the device refuses: everything is resampled to 44.1 kHz.
+ * enable; 1 = true, otherwise false
+ */
+#define CFG_HIRES_ENABLE   (0)
+#define CFG_HIRES_RATE_MAX (192000)
+
+
+/*
+ * device channels: 2, 4, 6 (5.1) or 8 (7.1), 0 = as many as the device has
+ * files with more channels are downmixed, levels (linear) of what goes into the
+ * front pair: center, surround, LFE
+ * mode: 0 = normal, 1 = mono sum, 2 = left/right swap, see ":channels <normal|mono|swap>"
+ */
+#define CFG_OUTPUT_CHANNELS   (2)
+#define CFG_DOWNMIX_CENTER    (0.7071)
+#define CFG_DOWNMIX_SURROUND  (0.7071)
+#define CFG_DOWNMIX_LFE       (0.0)
+#define CFG_CHANNEL_MODE      (0)
+
+
+/*
+ * or a whole downmix matrix, replaces the levels above for files with
+ * CFG_DOWNMIX_MATRIX_IN channels going to a device with (matrix size / that) channels:
+ * a row per device channel, a column per file channel, both in their layout order
+ * (5.1: FL FR FC LFE BL BR), gains are linear
+ * 0 = off, the levels are used for everything
+ */
+#define CFG_DOWNMIX_MATRIX_IN (0)
+#define CFG_DOWNMIX_MATRIX {				\
+	/* FL   FR      FC      LFE     BL      BR */	\
+	1.0,    0.0,    0.7071, 0.0,    0.7071, 0.0,	\
+	0.0,    1.0,    0.7071, 0.0,    0.0,    0.7071,	\
+}
+
+
+/*
+ * per device callback, ms: shorter makes the fade on quit (player_close() waits for one
+ * callback) come sooner, longer is safer against underruns on a busy system
+ */
+#define CFG_AUDIO_BUFFER_MS (93)
+
+
+/*
+ * real-time mode: the player buffers are locked in memory, the decoder and the
+ * mixer threads run under a real-time policy with their stacks faulted in;
+ * needs RLIMIT_MEMLOCK and RLIMIT_RTPRIO (e.g. the "audio" group), logged otherwise
+ * enable; 1 = true, otherwise false
+ * policy: 0 = SCHED_FIFO, 1 = SCHED_RR
+ * priority: of the decoders, the mixer gets one more
+ * cpu: all of them pinned to it, -1 = any
+ */
+#define CFG_RT_ENABLE   (0)
+#define CFG_RT_POLICY   (0)
+#define CFG_RT_PRIORITY (40)
+#define CFG_RT_CPU      (-1)
+
+
+/*
+ * visualisation row above the footer, see "v" and ":viz <spectrum|meter|off>"
+ * mode: 0 = hidden, 1 = spectrum, 2 = peak/RMS meter
+ * fps: redraw rate limit
+ * nice: analysis thread priority
+ */
+#define CFG_VIZ_MODE (0)
+#define CFG_VIZ_FPS  (30)
+#define CFG_VIZ_NICE (10)
+
+
+/*
+ * background jobs
+ * nice: worker threads priority
+ * throttle: sleep between two units of work while playing (ms)
+ */
+#define CFG_JOB_NICE              (19)
+#define CFG_JOB_THROTTLE_SLEEP_MS (20)
+
+
+/*
+ * EBU R128 loudness analysis of tracks without ReplayGain tags
+ * enable; 1 = true, otherwise false
+ * cache file: relative to "$XDG_CACHE_HOME/moedance/"
+ */
+#define CFG_ANALYSIS_ENABLE      (1)
+#define CFG_ANALYSIS_THREADS_NUM (2)
+#define CFG_ANALYSIS_CACHE_FILE  "loudness"
+
+
+/*
+ * exact durations of VBR MP3s without a Xing or VBRI header (estimated from the
+ * bitrate otherwise, minutes off): every frame header counted in the background, once,
+ * kept in the library index
+ * enable; 1 = true, otherwise false
+ */
+#define CFG_DURATION_EXACT_ENABLE      (1)
+#define CFG_DURATION_EXACT_THREADS_NUM (2)
+
+
+/*
+ * the playlist is there before its metadata: what the library index does not know is
+ * probed in the background, the rows on screen first, and redrawn at most every
+ * CFG_LOAD_REDRAW_MS as it comes in; playback does not wait for it
+ * enable; 1 = true, otherwise false
+ */
+#define CFG_LOAD_BACKGROUND_ENABLE (1)
+#define CFG_LOAD_REDRAW_MS         (100)
+
+
+/*
+ * waveform seek bar in the footer, computed once per track in the background
+ * enable; 1 = true, otherwise false
+ * cache dir: relative to "$XDG_CACHE_HOME/moedance/"
+ */
+#define CFG_WAVE_ENABLE    (1)
+#define CFG_WAVE_CACHE_DIR "waves"
 
 
 #endif
@@ -0,0 +1,264 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/opt.h>
+#include <libavutil/channel_layout.h>
+
+#include "decode.h"
+#include "util.h"
+
+
+static int _av_init(Decode *d, const char file[]);
+static int _swr_init(Decode *d, int channels_max);
+static int _feed(Decode *d);
+static int _convert(Decode *d, const uint8_t **data, int count);
+
+
+/*
+ * public
+ */
+int
+decode_open(Decode *d, const char file[], int channels_max)
+{
+	memset(d, 0, sizeof(*d));
+
+	d->pkt = av_packet_alloc();
+	if (d->pkt == NULL) {
+		log_err(0, "decode: decode_open: av_packet_alloc: failed");
+		return -1;
+	}
+
+	d->frame = av_frame_alloc();
+	if (d->frame == NULL) {
+		log_err(0, "decode: decode_open: av_frame_alloc: failed");
+		goto err0;
+	}
+
+	if (_av_init(d, file) < 0)
+		goto err1;
+
+	if (_swr_init(d, channels_max) < 0)
+		goto err2;
+
+	return 0;
+
+err2:
+	swr_free(&d->swr);
+	avcodec_free_context(&d->codec);
+	avformat_close_input(&d->format);
+err1:
+	av_frame_free(&d->frame);
+err0:
+	av_packet_free(&d->pkt);
+	return -1;
+}
+
+
+void
+decode_close(Decode *d)
+{
+	swr_free(&d->swr);
+	avcodec_free_context(&d->codec);
+	avformat_close_input(&d->format);
+	av_frame_free(&d->frame);
+	av_packet_free(&d->pkt);
+	free(d->buffer);
+}
+
+
+/*
+ * returns: > 0: frames count, 0: end of file, < 0: error
+ */
+int
+decode_read(Decode *d, const float **frames)
+{
+	for (;;) {
+		int ret = avcodec_receive_frame(d->codec, d->frame);
+		if (ret == 0) {
+			ret = _convert(d, (const uint8_t **)d->frame->extended_data, d->frame->nb_samples);
+			if (ret == 0)
+				continue;
+
+			*frames = d->buffer;
+			return ret;
+		}
+
+		if (ret == AVERROR_EOF) {
+			/* drain the resampler */
+			ret = _convert(d, NULL, 0);
+			if (ret > 0)
+				*frames = d->buffer;
+
+			return ret;
+		}
+
+		if (ret != AVERROR(EAGAIN)) {
+			log_err(0, "decode: decode_read: avcodec_receive_frame: %s", av_err2str(ret));
+			return -1;
+		}
+
+		if (_feed(d) < 0)
+			return -1;
+	}
+}
+
+
+/*
+ * private
+ */
+static int
+_av_init(Decode *d, const char file[])
+{
+	int ret = avformat_open_input(&d->format, file, NULL, NULL);
+	if (ret < 0) {
+		log_err(0, "decode: _av_init: avformat_open_input: %s: %s", av_err2str(ret), file);
+		return -1;
+	}
+
+	ret = avformat_find_stream_info(d->format, NULL);
+	if (ret < 0) {
+		log_err(0, "decode: _av_init: avformat_find_stream_info: %s", av_err2str(ret));
+		goto err0;
+	}
+
+	const AVCodec *codec = NULL;
+	ret = av_find_best_stream(d->format, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+	if ((ret < 0) || (codec == NULL)) {
+		log_err(0, "decode: _av_init: av_find_best_stream: no decoder found: %s", file);
+		goto err0;
+	}
+
+	d->index = (unsigned)ret;
+	d->codec = avcodec_alloc_context3(codec);
+	if (d->codec == NULL) {
+		log_err(0, "decode: _av_init: avcodec_alloc_context3: failed");
+		goto err0;
+	}
+
+	ret = avcodec_parameters_to_context(d->codec, d->format->streams[d->index]->codecpar);
+	if (ret < 0) {
+		log_err(0, "decode: _av_init: avcodec_parameters_to_context: %s", av_err2str(ret));
+		goto err1;
+	}
+
+	ret = avcodec_open2(d->codec, codec, NULL);
+	if (ret < 0) {
+		log_err(0, "decode: _av_init: avcodec_open2: %s", av_err2str(ret));
+		goto err1;
+	}
+
+	return 0;
+
+err1:
+	avcodec_free_context(&d->codec);
+err0:
+	avformat_close_input(&d->format);
+	return -1;
+}
+
+
+static int
+_swr_init(Decode *d, int channels_max)
+{
+	d->swr = swr_alloc();
+	if (d->swr == NULL) {
+		log_err(0, "decode: _swr_init: swr_alloc: failed");
+		return -1;
+	}
+
+	int channels = d->codec->ch_layout.nb_channels;
+	if ((channels <= 0) || (channels > channels_max))
+		channels = channels_max;
+
+	d->channels = channels;
+	d->rate = d->codec->sample_rate;
+
+	AVChannelLayout chan;
+	av_channel_layout_default(&chan, channels);
+	av_opt_set_chlayout(d->swr, "out_chlayout", &chan, 0);
+	av_opt_set_int(d->swr, "out_sample_fmt", AV_SAMPLE_FMT_FLT, 0);
+	av_opt_set_int(d->swr, "out_sample_rate", d->rate, 0);
+	av_opt_set_chlayout(d->swr, "in_chlayout", &d->codec->ch_layout, 0);
+	av_opt_set_int(d->swr, "in_sample_fmt", d->codec->sample_fmt, 0);
+	av_opt_set_int(d->swr, "in_sample_rate", d->rate, 0);
+
+	const int ret = swr_init(d->swr);
+	if (ret < 0) {
+		log_err(0, "decode: _swr_init: swr_init: %s", av_err2str(ret));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static int
+_feed(Decode *d)
+{
+	if (d->is_eof) {
+		/* already flushed, the decoder must not ask for more */
+		return -1;
+	}
+
+	AVPacket *const pkt = d->pkt;
+	for (;;) {
+		int ret = av_read_frame(d->format, pkt);
+		if (ret < 0) {
+			if (ret != AVERROR_EOF)
+				log_err(0, "decode: _feed: av_read_frame: %s", av_err2str(ret));
+
+			/* treat read errors like EOF: keep what has been decoded so far */
+			d->is_eof = 1;
+			return avcodec_send_packet(d->codec, NULL);
+		}
+
+		if ((unsigned)pkt->stream_index != d->index) {
+			av_packet_unref(pkt);
+			continue;
+		}
+
+		ret = avcodec_send_packet(d->codec, pkt);
+		av_packet_unref(pkt);
+		if (ret == AVERROR_INVALIDDATA)
+			continue;
+
+		if (ret < 0) {
+			log_err(0, "decode: _feed: avcodec_send_packet: %s", av_err2str(ret));
+			return -1;
+		}
+
+		return 0;
+	}
+}
+
+
+static int
+_convert(Decode *d, const uint8_t **data, int count)
+{
+	const int out_len = swr_get_out_samples(d->swr, count);
+	if (out_len <= 0)
+		return 0;
+
+	if (out_len > d->buffer_len) {
+		const size_t size = (size_t)out_len * (size_t)d->channels * sizeof(float);
+		float *const buffer = realloc(d->buffer, size);
+		if (buffer == NULL) {
+			log_err(errno, "decode: _convert: realloc");
+			return -1;
+		}
+
+		d->buffer = buffer;
+		d->buffer_len = out_len;
+	}
+
+	uint8_t *out = (uint8_t *)d->buffer;
+	const int ret = swr_convert(d->swr, &out, d->buffer_len, data, count);
+	if (ret < 0) {
+		log_err(0, "decode: _convert: swr_convert: %s", av_err2str(ret));
+		return -1;
+	}
+
+	return ret;
+}
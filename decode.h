@@ -0,0 +1,37 @@
+#ifndef __DECODE_H__
+#define __DECODE_H__
+
+
+#include <stdint.h>
+
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libswresample/swresample.h>
+
+
+/*
+ * Decode: a file to interleaved float frames at the source rate.
+ * Used by the background passes; playback has its own path in player.c.
+ */
+typedef struct decode {
+	unsigned         index;
+	int              is_eof;
+	int              rate;
+	int              channels;
+	AVPacket        *pkt;
+	AVFrame         *frame;
+	AVFormatContext *format;
+	AVCodecContext  *codec;
+	SwrContext      *swr;
+	float           *buffer;
+	int              buffer_len;	/* in frames */
+} Decode;
+
+
+int  decode_open(Decode *d, const char file[], int channels_max);
+void decode_close(Decode *d);
+int  decode_read(Decode *d, const float **frames);
+
+
+#endif
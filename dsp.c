@@ -0,0 +1,258 @@
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+#include "dsp.h"
+#include "util.h"
+
+
+static inline DspV4 _load(const float src[]);
+static inline void  _store(float dst[], DspV4 v);
+
+
+#define _PI (3.14159265358979323846)
+
+
+/*
+ * public
+ */
+void
+dsp_chain_init(DspChain *d)
+{
+	d->len = 0;
+}
+
+
+int
+dsp_chain_append(DspChain *d, DspFunc func, void *udata)
+{
+	if (d->len >= (int)LEN(d->stages)) {
+		log_err(0, "dsp: dsp_chain_append: too many stages");
+		return -1;
+	}
+
+	d->stages[d->len++] = (DspStage) { .func = func, .udata = udata };
+	return 0;
+}
+
+
+void
+dsp_chain_run(DspChain *d, float frames[], size_t count)
+{
+	for (int i = 0; i < d->len; i++)
+		d->stages[i].func(d->stages[i].udata, frames, count);
+}
+
+
+/*
+ * dst[i] = a[i] * ga(i) + b[i] * gb(i), gains are linearly ramped over 'len' samples
+ * 'dst' may alias 'a' or 'b'
+ */
+void
+dsp_mix_ramp(float dst[], const float a[], const float b[], size_t len,
+	     float ga, float ga_end, float gb, float gb_end)
+{
+	if (len == 0)
+		return;
+
+	const float sa = (ga_end - ga) / (float)len;
+	const float sb = (gb_end - gb) / (float)len;
+	DspV4 vga = { ga, ga + sa, ga + (2 * sa), ga + (3 * sa) };
+	DspV4 vgb = { gb, gb + sb, gb + (2 * sb), gb + (3 * sb) };
+	const DspV4 vsa = { 4 * sa, 4 * sa, 4 * sa, 4 * sa };
+	const DspV4 vsb = { 4 * sb, 4 * sb, 4 * sb, 4 * sb };
+
+	size_t i = 0;
+	for (; (i + 4) <= len; i += 4) {
+		_store(&dst[i], (_load(&a[i]) * vga) + (_load(&b[i]) * vgb));
+		vga += vsa;
+		vgb += vsb;
+	}
+
+	for (; i < len; i++)
+		dst[i] = (a[i] * (ga + (sa * (float)i))) + (b[i] * (gb + (sb * (float)i)));
+}
+
+
+float
+dsp_dot(const float a[], const float b[], size_t len)
+{
+	DspV4 acc = { 0 };
+	size_t i = 0;
+	for (; (i + 4) <= len; i += 4)
+		acc += _load(&a[i]) * _load(&b[i]);
+
+	float ret = acc[0] + acc[1] + acc[2] + acc[3];
+	for (; i < len; i++)
+		ret += a[i] * b[i];
+
+	return ret;
+}
+
+
+/*
+ * cascade of 'len' biquads (transposed direct form II), both channels at once
+ * a frame goes through every band before the next one is loaded
+ * stride: samples per frame, the pair is frames[0] and frames[1]
+ */
+void
+dsp_biquad_stereo(float frames[], size_t count, size_t stride, const DspBiquad bq[],
+		  DspBiquadState st[], int len)
+{
+	if (len <= 0)
+		return;
+
+	DspBiquadState z[len];
+	memcpy(z, st, sizeof(z));
+
+	for (size_t i = 0; i < count; i++) {
+		DspV2 x;
+		memcpy(&x, &frames[i * stride], sizeof(x));
+
+		for (int j = 0; j < len; j++) {
+			const DspBiquad *const b = &bq[j];
+			const DspV2 y = (b->b0 * x) + z[j].z1;
+			z[j].z1 = (b->b1 * x) - (b->a1 * y) + z[j].z2;
+			z[j].z2 = (b->b2 * x) - (b->a2 * y);
+			x = y;
+		}
+
+		memcpy(&frames[i * stride], &x, sizeof(x));
+	}
+
+	memcpy(st, z, sizeof(z));
+}
+
+
+/*
+ * every channel gets the average of all of them
+ */
+void
+dsp_mono(float frames[], size_t count, unsigned channels)
+{
+	const float scale = 1.0f / (float)channels;
+	for (size_t i = 0; i < count; i++) {
+		float *const frm = &frames[i * channels];
+		float sum = 0.0f;
+		for (unsigned j = 0; j < channels; j++)
+			sum += frm[j];
+
+		sum *= scale;
+		for (unsigned j = 0; j < channels; j++)
+			frm[j] = sum;
+	}
+}
+
+
+/*
+ * mask: bit n swaps channels 2n and 2n + 1
+ */
+void
+dsp_swap_pairs(float frames[], size_t count, unsigned channels, unsigned mask)
+{
+	for (size_t i = 0; i < count; i++) {
+		float *const frm = &frames[i * channels];
+		for (unsigned j = 0; j < (channels / 2); j++) {
+			if ((mask & (1u << j)) == 0)
+				continue;
+
+			const float tmp = frm[j * 2];
+			frm[j * 2] = frm[(j * 2) + 1];
+			frm[(j * 2) + 1] = tmp;
+		}
+	}
+}
+
+
+/*
+ * in-place radix-2 complex FFT, 'len' must be a power of 2
+ */
+void
+dsp_fft(float re[], float im[], size_t len)
+{
+	assert((len & (len - 1)) == 0);
+
+	/* bit reversal */
+	for (size_t i = 1, j = 0; i < len; i++) {
+		size_t bit = len >> 1;
+		for (; j & bit; bit >>= 1)
+			j ^= bit;
+
+		j ^= bit;
+		if (i < j) {
+			const float tr = re[i];
+			const float ti = im[i];
+			re[i] = re[j];
+			im[i] = im[j];
+			re[j] = tr;
+			im[j] = ti;
+		}
+	}
+
+	for (size_t size = 2; size <= len; size <<= 1) {
+		const size_t half = size >> 1;
+		const double step = (-2.0 * _PI) / (double)size;
+		for (size_t k = 0; k < half; k++) {
+			const float wr = (float)cos(step * (double)k);
+			const float wi = (float)sin(step * (double)k);
+			for (size_t i = k; i < len; i += size) {
+				const size_t j = i + half;
+				const float tr = (re[j] * wr) - (im[j] * wi);
+				const float ti = (re[j] * wi) + (im[j] * wr);
+				re[j] = re[i] - tr;
+				im[j] = im[i] - ti;
+				re[i] += tr;
+				im[i] += ti;
+			}
+		}
+	}
+}
+
+
+/*
+ * true-peak interpolator (BS.1770 annex 2): windowed-sinc, split into 'os' polyphase
+ * branches of 'taps' coefficients, coefs[p * taps + j] applies to the sample 'j' frames
+ * old; the branches land between 'taps / 2 - 1' and 'taps / 2' frames back
+ */
+void
+dsp_tp_design(float coefs[], int os, int taps)
+{
+	const int len = taps * os;
+	const double center = (double)(len - 1) / 2.0;
+	for (int p = 0; p < os; p++) {
+		float *const c = &coefs[p * taps];
+		double sum = 0.0;
+		for (int j = 0; j < taps; j++) {
+			const double n = (double)(j * os + p);
+			const double x = (n - center) / (double)os;
+			const double sinc = (fabs(x) < 1e-9)? 1.0 : (sin(_PI * x) / (_PI * x));
+			const double win = 0.42 - 0.5 * cos(2.0 * _PI * n / (len - 1)) +
+					   0.08 * cos(4.0 * _PI * n / (len - 1));
+
+			c[j] = (float)(sinc * win);
+			sum += sinc * win;
+		}
+
+		for (int j = 0; j < taps; j++)
+			c[j] = (float)(c[j] / sum);
+	}
+}
+
+
+/*
+ * private
+ */
+static inline DspV4
+_load(const float src[])
+{
+	DspV4 ret;
+	memcpy(&ret, src, sizeof(ret));
+	return ret;
+}
+
+
+static inline void
+_store(float dst[], DspV4 v)
+{
+	memcpy(dst, &v, sizeof(v));
+}
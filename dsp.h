@@ -0,0 +1,79 @@
+#ifndef __DSP_H__
+#define __DSP_H__
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define DSP_CHAIN_STAGES_MAX (8)
+#define DSP_CHANNELS_MAX     (8)	/* even: stages work on channel pairs */
+#define DSP_TP_TAPS          (12)	/* per polyphase branch */
+
+
+/*
+ * 4 x float SIMD lanes (SSE on x86, NEON on ARM) through GCC/Clang vector extensions
+ */
+typedef float DspV4 __attribute__((vector_size(16)));
+
+/*
+ * one stereo frame: { left, right }
+ */
+typedef float DspV2 __attribute__((vector_size(8)));
+
+/*
+ * integer lanes, same width as DspV4: comparison masks, conversions, RNG
+ */
+typedef int32_t  DspV4i __attribute__((vector_size(16)));
+typedef uint32_t DspV4u __attribute__((vector_size(16)));
+
+
+/*
+ * normalized biquad (a0 == 1), coefficients are broadcast to both channels
+ */
+typedef struct dsp_biquad {
+	DspV2 b0;
+	DspV2 b1;
+	DspV2 b2;
+	DspV2 a1;
+	DspV2 a2;
+} DspBiquad;
+
+typedef struct dsp_biquad_state {
+	DspV2 z1;
+	DspV2 z2;
+} DspBiquadState;
+
+
+/*
+ * DspChain: ordered stages, each one processes interleaved float frames in place
+ */
+typedef void (*DspFunc)(void *udata, float frames[], size_t count);
+
+typedef struct dsp_stage {
+	DspFunc  func;
+	void    *udata;
+} DspStage;
+
+typedef struct dsp_chain {
+	int      len;
+	DspStage stages[DSP_CHAIN_STAGES_MAX];
+} DspChain;
+
+
+void dsp_chain_init(DspChain *d);
+int  dsp_chain_append(DspChain *d, DspFunc func, void *udata);
+void dsp_chain_run(DspChain *d, float frames[], size_t count);
+
+void  dsp_mix_ramp(float dst[], const float a[], const float b[], size_t len,
+		   float ga, float ga_end, float gb, float gb_end);
+float dsp_dot(const float a[], const float b[], size_t len);
+void  dsp_biquad_stereo(float frames[], size_t count, size_t stride, const DspBiquad bq[],
+			DspBiquadState st[], int len);
+void  dsp_mono(float frames[], size_t count, unsigned channels);
+void  dsp_swap_pairs(float frames[], size_t count, unsigned channels, unsigned mask);
+void  dsp_fft(float re[], float im[], size_t len);
+void  dsp_tp_design(float coefs[], int os, int taps);
+
+
+#endif
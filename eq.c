@@ -0,0 +1,303 @@
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "eq.h"
+#include "util.h"
+
+
+#define _DIRTY    (1 << 8)
+#define _PI       (3.14159265358979323846)
+
+
+static void _process_block(Eq *e, float frames[], size_t count);
+static void _params_update(EqParams *params, unsigned rate);
+static void _biquad_calc(DspBiquad *bq, const EqBand *band, unsigned rate);
+static int  _band_parse(EqBand *band, char token[]);
+
+
+/*
+ * public
+ */
+int
+eq_init(Eq *e, unsigned rate, unsigned channels, size_t frames_max)
+{
+	assert(((channels % 2) == 0) && (channels <= DSP_CHANNELS_MAX));
+	e->scratch = malloc(frames_max * channels * sizeof(float));
+	if (e->scratch == NULL) {
+		log_err(errno, "eq: eq_init: malloc: scratch");
+		return -1;
+	}
+
+	atomic_store(&e->rate, rate);
+	e->channels = channels;
+	e->frames_max = frames_max;
+	e->front = 0;
+	e->back = 2;
+	atomic_store(&e->middle, 1);
+	for (int i = 0; i < (int)LEN(e->params); i++) {
+		e->params[i].len = 0;
+		e->params[i].rate = rate;
+	}
+
+	memset(e->state, 0, sizeof(e->state));
+	return 0;
+}
+
+
+void
+eq_deinit(Eq *e)
+{
+	free(e->scratch);
+}
+
+
+/*
+ * len: 0 = bypass
+ */
+int
+eq_set(Eq *e, const EqBand bands[], int len)
+{
+	if ((len < 0) || (len > EQ_BANDS_MAX))
+		return -1;
+
+	EqParams *const params = &e->params[e->back];
+	memcpy(params->bands, bands, (size_t)len * sizeof(EqBand));
+	params->len = len;
+	_params_update(params, atomic_load(&e->rate));
+	e->back = atomic_exchange(&e->middle, e->back | _DIRTY) & ~_DIRTY;
+	return 0;
+}
+
+
+/*
+ * audio thread only, e.g. the device was reopened at another rate
+ */
+void
+eq_set_rate(Eq *e, unsigned rate)
+{
+	atomic_store(&e->rate, rate);
+	memset(e->state, 0, sizeof(e->state));
+}
+
+
+void
+eq_process(void *udata, float frames[], size_t count)
+{
+	Eq *const e = (Eq *)udata;
+	while (count > 0) {
+		const size_t len = (count > e->frames_max)? e->frames_max : count;
+		_process_block(e, frames, len);
+
+		frames += len * e->channels;
+		count -= len;
+	}
+}
+
+
+/*
+ * file: one preset per line, '#': comment
+ *	<name> <type>:<freq>:<gain>:<q> ...
+ *	type: "peak", "lowshelf", "highshelf"
+ * name: "off" = no bands
+ */
+int
+eq_preset_load(const char file[], const char name[], EqBand bands[], int *len)
+{
+	*len = 0;
+	if (strcmp(name, "off") == 0)
+		return 0;
+
+	FILE *const f = fopen(file, "r");
+	if (f == NULL) {
+		log_err(errno, "eq: eq_preset_load: fopen: %s", file);
+		return -1;
+	}
+
+	int ret = -1;
+	char *line = NULL;
+	size_t line_size = 0;
+	while (getline(&line, &line_size, f) > 0) {
+		char *save;
+		const char *const token = strtok_r(line, " \t\n", &save);
+		if ((token == NULL) || (token[0] == '#') || (strcmp(token, name) != 0))
+			continue;
+
+		char *band;
+		while ((band = strtok_r(NULL, " \t\n", &save)) != NULL) {
+			if (*len >= EQ_BANDS_MAX) {
+				log_err(0, "eq: eq_preset_load: %s: too many bands", name);
+				goto out0;
+			}
+
+			if (_band_parse(&bands[*len], band) < 0) {
+				log_err(0, "eq: eq_preset_load: %s: invalid band: \"%s\"", name, band);
+				goto out0;
+			}
+
+			(*len)++;
+		}
+
+		ret = 0;
+		goto out0;
+	}
+
+	log_err(0, "eq: eq_preset_load: %s: not found", name);
+
+out0:
+	free(line);
+	fclose(f);
+	return ret;
+}
+
+
+/*
+ * private
+ */
+static void
+_process_block(Eq *e, float frames[], size_t count)
+{
+	const unsigned ch = e->channels;
+	const unsigned rate = atomic_load_explicit(&e->rate, memory_order_relaxed);
+	if ((atomic_load(&e->middle) & _DIRTY) == 0) {
+		EqParams *const params = &e->params[e->front];
+		if (params->rate != rate)
+			_params_update(params, rate);
+
+		for (unsigned i = 0; i < (ch / 2); i++)
+			dsp_biquad_stereo(&frames[i * 2], count, ch, params->bq, e->state[i], params->len);
+
+		return;
+	}
+
+	/* the UI may overwrite the old slot as soon as it is swapped out */
+	EqParams old;
+	memcpy(&old, &e->params[e->front], sizeof(old));
+	e->front = atomic_exchange(&e->middle, e->front) & ~_DIRTY;
+
+	/* either one may be from before eq_set_rate() */
+	EqParams *const new = &e->params[e->front];
+	if (old.rate != rate)
+		_params_update(&old, rate);
+	if (new->rate != rate)
+		_params_update(new, rate);
+
+	float *const scratch = e->scratch;
+	memcpy(scratch, frames, count * ch * sizeof(float));
+	memcpy(e->state_old, e->state, sizeof(e->state));
+	for (unsigned i = 0; i < (ch / 2); i++) {
+		dsp_biquad_stereo(&scratch[i * 2], count, ch, old.bq, e->state_old[i], old.len);
+
+		/* shared bands keep going from where the old filters are, new ones start at rest */
+		for (int j = old.len; j < new->len; j++)
+			e->state[i][j] = (DspBiquadState) { 0 };
+
+		dsp_biquad_stereo(&frames[i * 2], count, ch, new->bq, e->state[i], new->len);
+	}
+
+	dsp_mix_ramp(frames, frames, scratch, count * ch, 0.0f, 1.0f, 1.0f, 0.0f);
+}
+
+
+static void
+_params_update(EqParams *params, unsigned rate)
+{
+	for (int i = 0; i < params->len; i++)
+		_biquad_calc(&params->bq[i], &params->bands[i], rate);
+
+	params->rate = rate;
+}
+
+
+/*
+ * RBJ audio EQ cookbook
+ */
+static void
+_biquad_calc(DspBiquad *bq, const EqBand *band, unsigned rate)
+{
+	const double nyq = (double)rate / 2.0;
+	const double freq = (band->freq < 1.0)? 1.0 : ((band->freq > (nyq * 0.99))? (nyq * 0.99) : band->freq);
+	const double q = (band->q < 0.05)? 0.05 : band->q;
+	const double a = pow(10.0, band->gain / 40.0);
+	const double w0 = (2.0 * _PI * freq) / (double)rate;
+	const double cw = cos(w0);
+	const double alpha = sin(w0) / (2.0 * q);
+	const double sa = 2.0 * sqrt(a) * alpha;
+
+	double b0, b1, b2, a0, a1, a2;
+	switch (band->type) {
+	case EQ_BAND_TYPE_LOW_SHELF:
+		b0 = a * ((a + 1.0) - ((a - 1.0) * cw) + sa);
+		b1 = 2.0 * a * ((a - 1.0) - ((a + 1.0) * cw));
+		b2 = a * ((a + 1.0) - ((a - 1.0) * cw) - sa);
+		a0 = (a + 1.0) + ((a - 1.0) * cw) + sa;
+		a1 = -2.0 * ((a - 1.0) + ((a + 1.0) * cw));
+		a2 = (a + 1.0) + ((a - 1.0) * cw) - sa;
+		break;
+	case EQ_BAND_TYPE_HIGH_SHELF:
+		b0 = a * ((a + 1.0) + ((a - 1.0) * cw) + sa);
+		b1 = -2.0 * a * ((a - 1.0) + ((a + 1.0) * cw));
+		b2 = a * ((a + 1.0) + ((a - 1.0) * cw) - sa);
+		a0 = (a + 1.0) - ((a - 1.0) * cw) + sa;
+		a1 = 2.0 * ((a - 1.0) - ((a + 1.0) * cw));
+		a2 = (a + 1.0) - ((a - 1.0) * cw) - sa;
+		break;
+	default:
+		b0 = 1.0 + (alpha * a);
+		b1 = -2.0 * cw;
+		b2 = 1.0 - (alpha * a);
+		a0 = 1.0 + (alpha / a);
+		a1 = -2.0 * cw;
+		a2 = 1.0 - (alpha / a);
+		break;
+	}
+
+	const float fb0 = (float)(b0 / a0);
+	const float fb1 = (float)(b1 / a0);
+	const float fb2 = (float)(b2 / a0);
+	const float fa1 = (float)(a1 / a0);
+	const float fa2 = (float)(a2 / a0);
+	bq->b0 = (DspV2) { fb0, fb0 };
+	bq->b1 = (DspV2) { fb1, fb1 };
+	bq->b2 = (DspV2) { fb2, fb2 };
+	bq->a1 = (DspV2) { fa1, fa1 };
+	bq->a2 = (DspV2) { fa2, fa2 };
+}
+
+
+/*
+ * token: "<type>:<freq>:<gain>:<q>"
+ */
+static int
+_band_parse(EqBand *band, char token[])
+{
+	char *const sep = strchr(token, ':');
+	if (sep == NULL)
+		return -1;
+
+	*sep = '\0';
+	if (strcasecmp(token, "peak") == 0)
+		band->type = EQ_BAND_TYPE_PEAK;
+	else if (strcasecmp(token, "lowshelf") == 0)
+		band->type = EQ_BAND_TYPE_LOW_SHELF;
+	else if (strcasecmp(token, "highshelf") == 0)
+		band->type = EQ_BAND_TYPE_HIGH_SHELF;
+	else
+		return -1;
+
+	int n = 0;
+	if (sscanf(sep + 1, "%lf:%lf:%lf%n", &band->freq, &band->gain, &band->q, &n) != 3)
+		return -1;
+
+	if (sep[1 + n] != '\0')
+		return -1;
+
+	if ((band->freq <= 0.0) || (band->q <= 0.0))
+		return -1;
+
+	return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef __EQ_H__
+#define __EQ_H__
+
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "dsp.h"
+
+
+#define EQ_BANDS_MAX  (10)
+#define EQ_NAME_SIZE  (32)
+
+
+typedef enum eq_band_type {
+	EQ_BAND_TYPE_PEAK,
+	EQ_BAND_TYPE_LOW_SHELF,
+	EQ_BAND_TYPE_HIGH_SHELF,
+} EqBandType;
+
+typedef struct eq_band {
+	EqBandType type;
+	double     freq;	/* Hz */
+	double     gain;	/* dB */
+	double     q;
+} EqBand;
+
+typedef struct eq_params {
+	int       len;
+	unsigned  rate;			/* 'bq' is for */
+	EqBand    bands[EQ_BANDS_MAX];
+	DspBiquad bq[EQ_BANDS_MAX];
+} EqParams;
+
+/*
+ * Eq: parametric equalizer, a DspChain stage, one DspV2 per channel pair
+ *
+ * eq_set() is called from the UI thread, eq_process() from the audio thread. The
+ * parameters are triple buffered: both sides only swap their own slot with 'middle',
+ * no locks and no allocation involved. The first block after a change is rendered
+ * with both the old and the new filters and crossfaded, so there is no click.
+ * After eq_set_rate() the audio thread recomputes its own slot before using it.
+ */
+typedef struct eq {
+	atomic_uint     rate;
+	unsigned        channels;
+	size_t          frames_max;
+	int             back;		/* UI thread only */
+	int             front;		/* audio thread only */
+	atomic_int      middle;		/* index | dirty flag */
+	EqParams        params[3];
+	DspBiquadState  state[DSP_CHANNELS_MAX / 2][EQ_BANDS_MAX];	/* per channel pair */
+	DspBiquadState  state_old[DSP_CHANNELS_MAX / 2][EQ_BANDS_MAX];
+	float          *scratch;
+} Eq;
+
+
+int  eq_init(Eq *e, unsigned rate, unsigned channels, size_t frames_max);
+void eq_deinit(Eq *e);
+int  eq_set(Eq *e, const EqBand bands[], int len);
+void eq_set_rate(Eq *e, unsigned rate);
+void eq_process(void *udata, float frames[], size_t count);
+
+int  eq_preset_load(const char file[], const char name[], EqBand bands[], int *len);
+
+
+#endif
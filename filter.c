@@ -0,0 +1,291 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/samplefmt.h>
+
+#include "filter.h"
+#include "util.h"
+
+
+static int  _graph_rebuild(Filter *f, const AVCodecContext *codec);
+static int  _graph_build(Filter *f, const char desc[]);
+static void _graph_free(Filter *f);
+static int  _format_is_equal(const Filter *f, const AVCodecContext *codec);
+
+
+/*
+ * public
+ */
+int
+filter_desc_init(FilterDesc *d)
+{
+	if (mtx_init(&d->mutex, mtx_plain) != thrd_success) {
+		log_err(0, "filter: filter_desc_init: mtx_init: failed");
+		return -1;
+	}
+
+	atomic_store(&d->gen, 0);
+	d->value[0] = '\0';
+	return 0;
+}
+
+
+void
+filter_desc_deinit(FilterDesc *d)
+{
+	mtx_destroy(&d->mutex);
+}
+
+
+void
+filter_desc_set(FilterDesc *d, const char value[])
+{
+	mtx_lock(&d->mutex); /* LOCK */
+	cstr_copy_n(d->value, sizeof(d->value), value, strlen(value));
+	atomic_fetch_add(&d->gen, 1);
+	mtx_unlock(&d->mutex); /* UNLOCK */
+}
+
+
+int
+filter_init(Filter *f)
+{
+	memset(f, 0, sizeof(*f));
+	f->frame = av_frame_alloc();
+	if (f->frame == NULL) {
+		log_err(0, "filter: filter_init: av_frame_alloc: failed");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+void
+filter_deinit(Filter *f)
+{
+	_graph_free(f);
+	av_frame_free(&f->frame);
+}
+
+
+/*
+ * (re)builds the graph if the description or the decoder output format changed
+ *
+ * returns: 0: unchanged, 1: the output format may have changed, -1: error (no graph)
+ */
+int
+filter_update(Filter *f, FilterDesc *d, const AVCodecContext *codec)
+{
+	const unsigned gen = atomic_load(&d->gen);
+	if (gen == f->gen) {
+		if (f->graph == NULL)
+			return 0;
+
+		if (_format_is_equal(f, codec))
+			return 0;
+	}
+
+	mtx_lock(&d->mutex); /* LOCK */
+	memcpy(f->desc, d->value, sizeof(f->desc));
+	f->gen = atomic_load(&d->gen);
+	mtx_unlock(&d->mutex); /* UNLOCK */
+
+	return _graph_rebuild(f, codec);
+}
+
+
+/*
+ * a new track or a seek: a fresh graph, from the cached description unless it changed
+ *
+ * returns: as filter_update()
+ */
+int
+filter_restart(Filter *f, FilterDesc *d, const AVCodecContext *codec)
+{
+	if (atomic_load(&d->gen) != f->gen)
+		return filter_update(f, d, codec);
+
+	return _graph_rebuild(f, codec);
+}
+
+
+int
+filter_is_active(const Filter *f)
+{
+	return (f->graph != NULL);
+}
+
+
+/*
+ * the frame data is referenced, not copied; NULL: end of the track, filter_receive()
+ * then gives what the filters held back
+ */
+int
+filter_send(Filter *f, AVFrame *frame)
+{
+	/* the graph runs on its own sample clock, independent of the stream time base */
+	if (frame != NULL) {
+		frame->pts = f->pts;
+		f->pts += frame->nb_samples;
+	}
+
+	const int ret = av_buffersrc_add_frame_flags(f->src, frame, AV_BUFFERSRC_FLAG_KEEP_REF);
+	if (ret < 0) {
+		log_err(0, "filter: filter_send: av_buffersrc_add_frame_flags: %s", av_err2str(ret));
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * returns: a filtered frame, valid until the next call; NULL: needs more input
+ */
+AVFrame *
+filter_receive(Filter *f)
+{
+	av_frame_unref(f->frame);
+
+	const int ret = av_buffersink_get_frame(f->sink, f->frame);
+	if (ret >= 0)
+		return f->frame;
+
+	if ((ret != AVERROR(EAGAIN)) && (ret != AVERROR_EOF))
+		log_err(0, "filter: filter_receive: av_buffersink_get_frame: %s", av_err2str(ret));
+
+	return NULL;
+}
+
+
+void
+filter_get_output(const Filter *f, AVChannelLayout *layout, int *format, int *rate)
+{
+	av_buffersink_get_ch_layout(f->sink, layout);
+	*format = av_buffersink_get_format(f->sink);
+	*rate = av_buffersink_get_sample_rate(f->sink);
+}
+
+
+/*
+ * private
+ */
+static int
+_graph_rebuild(Filter *f, const AVCodecContext *codec)
+{
+	_graph_free(f);
+	if (f->desc[0] == '\0')
+		return 1;
+
+	f->rate = codec->sample_rate;
+	f->format = codec->sample_fmt;
+	if (av_channel_layout_copy(&f->layout, &codec->ch_layout) < 0) {
+		log_err(0, "filter: _graph_rebuild: av_channel_layout_copy: failed");
+		return -1;
+	}
+
+	if (_graph_build(f, f->desc) < 0) {
+		_graph_free(f);
+		return -1;
+	}
+
+#ifdef DEBUG
+	log_info("filter: _graph_rebuild: \"%s\": %d Hz", f->desc, f->rate);
+#endif
+	return 1;
+}
+
+
+static int
+_graph_build(Filter *f, const char desc[])
+{
+	char layout[64];
+	if (av_channel_layout_describe(&f->layout, layout, sizeof(layout)) < 0) {
+		log_err(0, "filter: _graph_build: av_channel_layout_describe: failed");
+		return -1;
+	}
+
+	char args[256];
+	snprintf(args, sizeof(args), "sample_rate=%d:sample_fmt=%s:channel_layout=%s:time_base=1/%d",
+		 f->rate, av_get_sample_fmt_name(f->format), layout, f->rate);
+
+	f->graph = avfilter_graph_alloc();
+	if (f->graph == NULL) {
+		log_err(0, "filter: _graph_build: avfilter_graph_alloc: failed");
+		return -1;
+	}
+
+	/* single threaded: it already runs in its own decoder thread */
+	f->graph->nb_threads = 1;
+
+	int ret = avfilter_graph_create_filter(&f->src, avfilter_get_by_name("abuffer"), "in",
+					       args, NULL, f->graph);
+	if (ret < 0) {
+		log_err(0, "filter: _graph_build: avfilter_graph_create_filter: abuffer: %s", av_err2str(ret));
+		return -1;
+	}
+
+	ret = avfilter_graph_create_filter(&f->sink, avfilter_get_by_name("abuffersink"), "out",
+					   NULL, NULL, f->graph);
+	if (ret < 0) {
+		log_err(0, "filter: _graph_build: avfilter_graph_create_filter: abuffersink: %s", av_err2str(ret));
+		return -1;
+	}
+
+	AVFilterInOut *outputs = avfilter_inout_alloc();
+	AVFilterInOut *inputs = avfilter_inout_alloc();
+	if ((outputs == NULL) || (inputs == NULL)) {
+		log_err(0, "filter: _graph_build: avfilter_inout_alloc: failed");
+		ret = -1;
+		goto out0;
+	}
+
+	outputs->name = av_strdup("in");
+	outputs->filter_ctx = f->src;
+	outputs->pad_idx = 0;
+	outputs->next = NULL;
+	inputs->name = av_strdup("out");
+	inputs->filter_ctx = f->sink;
+	inputs->pad_idx = 0;
+	inputs->next = NULL;
+
+	ret = avfilter_graph_parse_ptr(f->graph, desc, &inputs, &outputs, NULL);
+	if (ret < 0) {
+		log_err(0, "filter: _graph_build: avfilter_graph_parse_ptr: \"%s\": %s", desc, av_err2str(ret));
+		goto out0;
+	}
+
+	ret = avfilter_graph_config(f->graph, NULL);
+	if (ret < 0)
+		log_err(0, "filter: _graph_build: avfilter_graph_config: \"%s\": %s", desc, av_err2str(ret));
+
+out0:
+	avfilter_inout_free(&inputs);
+	avfilter_inout_free(&outputs);
+	return (ret < 0)? -1 : 0;
+}
+
+
+static void
+_graph_free(Filter *f)
+{
+	av_frame_unref(f->frame);
+	avfilter_graph_free(&f->graph);
+	av_channel_layout_uninit(&f->layout);
+	f->src = NULL;
+	f->sink = NULL;
+	f->pts = 0;
+}
+
+
+static int
+_format_is_equal(const Filter *f, const AVCodecContext *codec)
+{
+	return ((f->rate == codec->sample_rate) && (f->format == (int)codec->sample_fmt) &&
+		(av_channel_layout_compare(&f->layout, &codec->ch_layout) == 0));
+}
@@ -0,0 +1,60 @@
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+
+#include <stdatomic.h>
+#include <threads.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavfilter/avfilter.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/frame.h>
+
+
+#define FILTER_DESC_SIZE (512)
+
+
+/*
+ * FilterDesc: the user defined graph string, shared by every decoder ("" = none)
+ * 'gen' is bumped on each change, so readers only lock when it moved
+ */
+typedef struct filter_desc {
+	atomic_uint gen;
+	mtx_t       mutex;
+	char        value[FILTER_DESC_SIZE];
+} FilterDesc;
+
+/*
+ * Filter: abuffer -> <FilterDesc> -> abuffersink, owned by a decoder thread
+ * The description outlives a track; the graph is built again for each track and seek,
+ * so nothing it held back (a look-ahead, an echo tail) comes out in the next one.
+ */
+typedef struct filter {
+	unsigned         gen;
+	char             desc[FILTER_DESC_SIZE];	/* of 'gen' */
+	int              rate;
+	int              format;
+	AVChannelLayout  layout;
+	int64_t          pts;
+	AVFilterGraph   *graph;
+	AVFilterContext *src;
+	AVFilterContext *sink;
+	AVFrame         *frame;
+} Filter;
+
+
+int      filter_desc_init(FilterDesc *d);
+void     filter_desc_deinit(FilterDesc *d);
+void     filter_desc_set(FilterDesc *d, const char value[]);
+
+int      filter_init(Filter *f);
+void     filter_deinit(Filter *f);
+int      filter_update(Filter *f, FilterDesc *d, const AVCodecContext *codec);
+int      filter_restart(Filter *f, FilterDesc *d, const AVCodecContext *codec);
+int      filter_is_active(const Filter *f);
+int      filter_send(Filter *f, AVFrame *frame);
+AVFrame *filter_receive(Filter *f);
+void     filter_get_output(const Filter *f, AVChannelLayout *layout, int *format, int *rate);
+
+
+#endif
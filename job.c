@@ -0,0 +1,127 @@
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/resource.h>
+
+#include "job.h"
+#include "util.h"
+#include "config.h"
+
+
+static int _worker_thrd(void *udata);
+
+
+/*
+ * public
+ */
+int
+job_start(Job *j, void *items[], int len, int thrds_num, JobFunc func, void *udata)
+{
+	if (thrds_num <= 0)
+		thrds_num = 1;
+	if (thrds_num > JOB_THREADS_MAX)
+		thrds_num = JOB_THREADS_MAX;
+	if (thrds_num > len)
+		thrds_num = len;
+
+	atomic_store(&j->is_alive, 1);
+	atomic_store(&j->is_throttled, 0);
+	atomic_store(&j->next, 0);
+	atomic_store(&j->done, 0);
+	j->len = len;
+	j->items = items;
+	j->func = func;
+	j->udata = udata;
+	j->thrds_len = 0;
+
+	for (int i = 0; i < thrds_num; i++) {
+		if (thrd_create(&j->thrds[i], _worker_thrd, j) != thrd_success) {
+			log_err(0, "job: job_start: thrd_create[%d]", i);
+			break;
+		}
+
+		j->thrds_len++;
+	}
+
+	if (j->thrds_len == 0) {
+		atomic_store(&j->is_alive, 0);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+void
+job_stop(Job *j)
+{
+	atomic_store(&j->is_alive, 0);
+	for (int i = 0; i < j->thrds_len; i++)
+		thrd_join(j->thrds[i], NULL);
+
+	j->thrds_len = 0;
+}
+
+
+/*
+ * called by JobFunc between units of work
+ * returns: 0: continue, -1: cancelled
+ */
+int
+job_yield(Job *j)
+{
+	if (atomic_load_explicit(&j->is_throttled, memory_order_relaxed)) {
+		const struct timespec ts = {
+			.tv_nsec = CFG_JOB_THROTTLE_SLEEP_MS * 1000000L,
+		};
+
+		thrd_sleep(&ts, NULL);
+	}
+
+	return (atomic_load(&j->is_alive) != 0)? 0 : -1;
+}
+
+
+void
+job_set_throttle(Job *j, int enable)
+{
+	atomic_store(&j->is_throttled, enable);
+}
+
+
+/*
+ * returns: done items count
+ */
+int
+job_get_progress(Job *j, int *total)
+{
+	*total = j->len;
+	return atomic_load(&j->done);
+}
+
+
+/*
+ * private
+ */
+static int
+_worker_thrd(void *udata)
+{
+	Job *const j = (Job *)udata;
+
+	/* linux: the nice value is per-thread */
+	if (setpriority(PRIO_PROCESS, 0, CFG_JOB_NICE) < 0)
+		log_err(errno, "job: _worker_thrd: setpriority");
+
+	while (atomic_load(&j->is_alive)) {
+		const int idx = atomic_fetch_add(&j->next, 1);
+		if (idx >= j->len)
+			break;
+
+		j->func(j, j->items[idx], j->udata);
+		atomic_fetch_add(&j->done, 1);
+	}
+
+	return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef __JOB_H__
+#define __JOB_H__
+
+
+#include <stdatomic.h>
+#include <threads.h>
+
+
+#define JOB_THREADS_MAX (8)
+
+
+/*
+ * Job: a bounded, low priority worker pool over a fixed list of items
+ */
+typedef struct job Job;
+typedef void (*JobFunc)(Job *j, void *item, void *udata);
+
+struct job {
+	atomic_int   is_alive;
+	atomic_int   is_throttled;
+	atomic_int   next;
+	atomic_int   done;
+	int          len;
+	void       **items;
+	JobFunc      func;
+	void        *udata;
+	int          thrds_len;
+	thrd_t       thrds[JOB_THREADS_MAX];
+};
+
+
+int  job_start(Job *j, void *items[], int len, int thrds_num, JobFunc func, void *udata);
+void job_stop(Job *j);
+int  job_yield(Job *j);
+void job_set_throttle(Job *j, int enable);
+int  job_get_progress(Job *j, int *total);
+
+
+#endif
@@ -70,6 +70,8 @@ _handle_normal(char key)
 	switch (key) {
 	case 'k': return KBD_ARROW_UP;
 	case 'j': return KBD_ARROW_DOWN;
+	case 'h': return KBD_ARROW_LEFT;
+	case 'l': return KBD_ARROW_RIGHT;
 	case CTRL_KEY('u'): return KBD_PAGE_UP;
 	case CTRL_KEY('d'): return KBD_PAGE_DOWN;
 	case 'g': return KBD_HOME;
@@ -84,6 +86,7 @@ _handle_normal(char key)
 	case 'p': return KBD_P;
 	case 'q': return KBD_Q;
 	case 's': return KBD_S;
+	case 'v': return KBD_V;
 	case 'y': return KBD_Y;
 	}
 
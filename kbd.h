@@ -22,6 +22,7 @@ enum {
 	KBD_P,
 	KBD_Q,
 	KBD_S,
+	KBD_V,
 	KBD_Y,
 
 	KBD_UNKNOWN,
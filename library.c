@@ -0,0 +1,542 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <zlib.h>
+
+#include "library.h"
+#include "playlist.h"
+#include "config.h"
+
+
+#define _MAGIC   "MDLB"
+#define _VERSION (2)	/* bumped with every layout change: older files are dropped */
+
+
+typedef struct library_header {
+	char     magic[4];
+	uint32_t version;
+	uint32_t count;
+	uint32_t crc;		/* zlib crc32 of the records and the pool */
+	uint64_t pool_size;
+} LibraryHeader;
+
+/*
+ * strings: offsets into the pool, NUL-terminated; 0 is the empty string
+ */
+struct library_record {
+	int64_t  size;
+	int64_t  mtime;		/* ns */
+	uint64_t ino;
+	int64_t  duration;
+	uint32_t path;
+	uint32_t title;
+	uint32_t artist;
+	uint32_t album;
+	uint32_t genre;
+	uint32_t has_replaygain;
+	uint32_t is_duration_estimated;
+	uint32_t reserved;	/* no padding: every byte is in the checksum */
+};
+
+/*
+ * a save, as it goes to the file: the header, the records, the pool
+ */
+struct library_image {
+	size_t  size;
+	uint8_t data[];
+};
+
+
+static int         _file_set(Library *l);
+static void        _load(Library *l);
+static int         _saver_start(Library *l);
+static int         _saver_thrd(void *udata);
+static void        _write(const Library *l, const LibraryImage *img);
+static int         _validate(const Library *l);
+static const char *_str(const Library *l, uint32_t offt);
+static int         _item_cmp(const void *a, const void *b);
+static uint32_t    _pool_add(char pool[], size_t *len, const char str[]);
+
+
+/*
+ * public
+ */
+/*
+ * for the current working directory, see playlist_init(); no index file: an empty
+ * library that is not saved either
+ */
+int
+library_init(Library *l)
+{
+	l->data = NULL;
+	l->size = 0;
+	l->records = NULL;
+	l->count = 0;
+	l->pool = NULL;
+	l->pool_size = 0;
+	l->has_saver = 0;
+	l->image = NULL;
+
+	if (str_init_alloc(&l->file, 256) < 0) {
+		log_err(errno, "library: library_init: str_init_alloc");
+		return -1;
+	}
+
+	/* no persistence, but keep going */
+	if (_file_set(l) < 0) {
+		str_set_n(&l->file, NULL, 0);
+		return 0;
+	}
+
+	_load(l);
+
+	/* read only */
+	if (_saver_start(l) < 0)
+		str_set_n(&l->file, NULL, 0);
+
+	return 0;
+}
+
+
+void
+library_deinit(Library *l)
+{
+	if (l->has_saver) {
+		mtx_lock(&l->mutex); /* LOCK */
+		l->is_alive = 0;
+		cnd_signal(&l->cond);
+		mtx_unlock(&l->mutex); /* UNLOCK */
+
+		thrd_join(l->saver, NULL);
+		cnd_destroy(&l->cond);
+		mtx_destroy(&l->mutex);
+	}
+
+	if (l->data != NULL)
+		munmap(l->data, l->size);
+
+	str_deinit(&l->file);
+}
+
+
+uint32_t
+library_count(const Library *l)
+{
+	return l->count;
+}
+
+
+/*
+ * returns: 0: up to date, 'item' points into the mapping; -1: unknown or changed,
+ * it has to be probed
+ */
+int
+library_fill(const Library *l, PlaylistItem *item)
+{
+	size_t lo = 0;
+	size_t hi = l->count;
+	while (lo < hi) {
+		const size_t mid = lo + ((hi - lo) / 2);
+		const LibraryRecord *const r = &l->records[mid];
+		const int cmp = strcmp(item->file_path, _str(l, r->path));
+		if (cmp < 0) {
+			hi = mid;
+			continue;
+		}
+
+		if (cmp > 0) {
+			lo = mid + 1;
+			continue;
+		}
+
+		if ((r->size != item->size) || (r->mtime != item->mtime) || (r->ino != item->ino))
+			return -1;
+
+		item->title = _str(l, r->title);
+		item->artist = _str(l, r->artist);
+		item->album = _str(l, r->album);
+		item->genre = _str(l, r->genre);
+		item->duration = r->duration;
+		item->is_duration_estimated = (r->is_duration_estimated != 0);
+		item->has_replaygain = (r->has_replaygain != 0);
+		return 0;
+	}
+
+	return -1;
+}
+
+
+/*
+ * replaces the index with 'items', whatever else it held is dropped; only copied here,
+ * the saver writes it
+ */
+int
+library_save(Library *l, PlaylistItem *const items[], size_t len)
+{
+	if (l->has_saver == 0)
+		return 0;
+
+	if (len > UINT32_MAX) {
+		log_err(0, "library: library_save: too many items: %zu", len);
+		return -1;
+	}
+
+	PlaylistItem **const sorted = malloc((len + 1) * sizeof(PlaylistItem *));
+	if (sorted == NULL) {
+		log_err(errno, "library: library_save: malloc: sorted");
+		return -1;
+	}
+
+	size_t pool_size = 1;
+	for (size_t i = 0; i < len; i++) {
+		sorted[i] = items[i];
+		pool_size += strlen(items[i]->file_path) + strlen(items[i]->title) + strlen(items[i]->artist) +
+			     strlen(items[i]->album) + strlen(items[i]->genre) + 5;
+	}
+
+	qsort(sorted, len, sizeof(PlaylistItem *), _item_cmp);
+
+	int ret = -1;
+	if (pool_size > UINT32_MAX) {
+		log_err(0, "library: library_save: string pool too large: %zu", pool_size);
+		goto out0;
+	}
+
+	const size_t records_size = len * sizeof(LibraryRecord);
+	LibraryImage *const img = malloc(sizeof(LibraryImage) + sizeof(LibraryHeader) + records_size + pool_size);
+	if (img == NULL) {
+		log_err(errno, "library: library_save: malloc");
+		goto out0;
+	}
+
+	LibraryHeader *const hdr = (LibraryHeader *)img->data;
+	LibraryRecord *const records = (LibraryRecord *)&img->data[sizeof(LibraryHeader)];
+	char *const pool = (char *)&img->data[sizeof(LibraryHeader) + records_size];
+
+	size_t pool_len = 0;
+	pool[pool_len++] = '\0';
+	for (size_t i = 0; i < len; i++) {
+		const PlaylistItem *const item = sorted[i];
+		records[i] = (LibraryRecord) {
+			.size = item->size,
+			.mtime = item->mtime,
+			.ino = item->ino,
+			.duration = item->duration,
+			.path = _pool_add(pool, &pool_len, item->file_path),
+			.title = _pool_add(pool, &pool_len, item->title),
+			.artist = _pool_add(pool, &pool_len, item->artist),
+			.album = _pool_add(pool, &pool_len, item->album),
+			.genre = _pool_add(pool, &pool_len, item->genre),
+			.has_replaygain = (uint32_t)(item->has_replaygain != 0),
+			.is_duration_estimated = (uint32_t)(item->is_duration_estimated != 0),
+			.reserved = 0,
+		};
+	}
+
+	uLong crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, (const Bytef *)records, (uInt)records_size);
+	crc = crc32(crc, (const Bytef *)pool, (uInt)pool_len);
+
+	*hdr = (LibraryHeader) {
+		.version = _VERSION,
+		.count = (uint32_t)len,
+		.crc = (uint32_t)crc,
+		.pool_size = pool_len,
+	};
+
+	memcpy(hdr->magic, _MAGIC, sizeof(hdr->magic));
+	img->size = sizeof(LibraryHeader) + records_size + pool_len;
+
+	/* one still waiting is older: dropped */
+	mtx_lock(&l->mutex); /* LOCK */
+	free(l->image);
+	l->image = img;
+	cnd_signal(&l->cond);
+	mtx_unlock(&l->mutex); /* UNLOCK */
+
+	ret = 0;
+
+out0:
+	free(sorted);
+	return ret;
+}
+
+
+/*
+ * private
+ */
+/*
+ * one file per root, named after a hash of its absolute path
+ */
+static int
+_file_set(Library *l)
+{
+	char cwd[PATH_MAX];
+	if (getcwd(cwd, sizeof(cwd)) == NULL) {
+		log_err(errno, "library: _file_set: getcwd");
+		return -1;
+	}
+
+	if (file_cache_path(&l->file, CFG_LIBRARY_CACHE_DIR) == NULL) {
+		log_err(errno, "library: _file_set: file_cache_path");
+		return -1;
+	}
+
+	if ((mkdir(l->file.cstr, 0755) < 0) && (errno != EEXIST)) {
+		log_err(errno, "library: _file_set: mkdir: %s", l->file.cstr);
+		return -1;
+	}
+
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const char *p = cwd; *p != '\0'; p++) {
+		hash ^= (uint8_t)*p;
+		hash *= 0x100000001b3ull;
+	}
+
+	if (str_append_fmt(&l->file, "/%016" PRIx64, hash) == NULL) {
+		log_err(errno, "library: _file_set: str_append_fmt");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * one mmap(), checked as a whole before anything points into it
+ */
+static void
+_load(Library *l)
+{
+	const int fd = open(l->file.cstr, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			log_err(errno, "library: _load: open: %s", l->file.cstr);
+
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		log_err(errno, "library: _load: fstat: %s", l->file.cstr);
+		goto out0;
+	}
+
+	const size_t size = (size_t)st.st_size;
+	if (size < sizeof(LibraryHeader))
+		goto err0;
+
+	void *const data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		log_err(errno, "library: _load: mmap: %s", l->file.cstr);
+		goto out0;
+	}
+
+	l->data = data;
+	l->size = size;
+
+	LibraryHeader hdr;
+	memcpy(&hdr, l->data, sizeof(hdr));
+	if ((memcmp(hdr.magic, _MAGIC, sizeof(hdr.magic)) != 0) || (hdr.version != _VERSION))
+		goto err1;
+
+	const size_t records_size = (size_t)hdr.count * sizeof(LibraryRecord);
+	if ((hdr.pool_size == 0) || (size != (sizeof(hdr) + records_size + hdr.pool_size)))
+		goto err1;
+
+	uLong crc = crc32(0L, Z_NULL, 0);
+	crc = crc32(crc, l->data + sizeof(hdr), (uInt)(size - sizeof(hdr)));
+	if ((uint32_t)crc != hdr.crc)
+		goto err1;
+
+	l->records = (const LibraryRecord *)(l->data + sizeof(hdr));
+	l->count = hdr.count;
+	l->pool = (const char *)(l->data + sizeof(hdr) + records_size);
+	l->pool_size = (size_t)hdr.pool_size;
+	if (_validate(l) < 0)
+		goto err2;
+
+#ifdef DEBUG
+	log_info("library: _load: %" PRIu32 " items, %zu bytes", l->count, size);
+#endif
+	close(fd);
+	return;
+
+err2:
+	l->records = NULL;
+	l->count = 0;
+	l->pool = NULL;
+	l->pool_size = 0;
+err1:
+	munmap(l->data, l->size);
+	l->data = NULL;
+	l->size = 0;
+err0:
+	log_err(0, "library: _load: %s: stale or damaged, starting over", l->file.cstr);
+out0:
+	close(fd);
+}
+
+
+static int
+_saver_start(Library *l)
+{
+	if (mtx_init(&l->mutex, mtx_plain) != thrd_success) {
+		log_err(0, "library: _saver_start: mtx_init: failed");
+		return -1;
+	}
+
+	if (cnd_init(&l->cond) != thrd_success) {
+		log_err(0, "library: _saver_start: cnd_init: failed");
+		goto err0;
+	}
+
+	l->is_alive = 1;
+	if (thrd_create(&l->saver, _saver_thrd, l) != thrd_success) {
+		log_err(0, "library: _saver_start: thrd_create: failed");
+		goto err1;
+	}
+
+	l->has_saver = 1;
+	return 0;
+
+err1:
+	cnd_destroy(&l->cond);
+err0:
+	mtx_destroy(&l->mutex);
+	return -1;
+}
+
+
+/*
+ * the newest save at a time, until library_deinit() and nothing is left
+ */
+static int
+_saver_thrd(void *udata)
+{
+	Library *const l = (Library *)udata;
+
+	mtx_lock(&l->mutex); /* LOCK */
+	for (;;) {
+		while (l->is_alive && (l->image == NULL))
+			cnd_wait(&l->cond, &l->mutex);
+
+		LibraryImage *const img = l->image;
+		if (img == NULL)
+			break;
+
+		l->image = NULL;
+		mtx_unlock(&l->mutex); /* UNLOCK */
+
+		_write(l, img);
+		free(img);
+
+		mtx_lock(&l->mutex); /* LOCK */
+	}
+
+	mtx_unlock(&l->mutex); /* UNLOCK */
+	return 0;
+}
+
+
+/*
+ * on disk before the rename: a crash leaves the old index or the new one
+ */
+static void
+_write(const Library *l, const LibraryImage *img)
+{
+	char tmp[PATH_MAX];
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", l->file.cstr) >= (int)sizeof(tmp)) {
+		log_err(ENAMETOOLONG, "library: _write: snprintf");
+		return;
+	}
+
+	FILE *const file = fopen(tmp, "wb");
+	if (file == NULL) {
+		log_err(errno, "library: _write: fopen: %s", tmp);
+		return;
+	}
+
+	const int is_ok = ((fwrite(img->data, 1, img->size, file) == img->size) &&
+			   (fflush(file) == 0) && (fsync(fileno(file)) == 0));
+
+	if ((fclose(file) != 0) || (is_ok == 0)) {
+		log_err(errno, "library: _write: fwrite: %s", tmp);
+		unlink(tmp);
+		return;
+	}
+
+	if (rename(tmp, l->file.cstr) < 0) {
+		log_err(errno, "library: _write: rename: %s", l->file.cstr);
+		unlink(tmp);
+		return;
+	}
+
+#ifdef DEBUG
+	log_info("library: _write: %" PRIu32 " items, %zu bytes", ((const LibraryHeader *)img->data)->count, img->size);
+#endif
+}
+
+
+/*
+ * the checksum says the file is what was written, not that it was written right
+ */
+static int
+_validate(const Library *l)
+{
+	if (l->pool[l->pool_size - 1] != '\0')
+		return -1;
+
+	for (uint32_t i = 0; i < l->count; i++) {
+		const LibraryRecord *const r = &l->records[i];
+		if ((r->path >= l->pool_size) || (r->title >= l->pool_size) || (r->artist >= l->pool_size) ||
+		    (r->album >= l->pool_size) || (r->genre >= l->pool_size))
+			return -1;
+
+		if ((i > 0) && (strcmp(_str(l, l->records[i - 1].path), _str(l, r->path)) >= 0))
+			return -1;
+	}
+
+	return 0;
+}
+
+
+static const char *
+_str(const Library *l, uint32_t offt)
+{
+	assert(offt < l->pool_size);
+	return &l->pool[offt];
+}
+
+
+static int
+_item_cmp(const void *a, const void *b)
+{
+	const PlaylistItem *const _a = *(PlaylistItem *const *)a;
+	const PlaylistItem *const _b = *(PlaylistItem *const *)b;
+	return strcmp(_a->file_path, _b->file_path);
+}
+
+
+static uint32_t
+_pool_add(char pool[], size_t *len, const char str[])
+{
+	if (*str == '\0')
+		return 0;
+
+	const size_t str_len = strlen(str) + 1;
+	const uint32_t ret = (uint32_t)*len;
+	memcpy(&pool[*len], str, str_len);
+	*len += str_len;
+	return ret;
+}
@@ -0,0 +1,53 @@
+#ifndef __LIBRARY_H__
+#define __LIBRARY_H__
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include "util.h"
+
+
+struct playlist_item;
+
+typedef struct library_record LibraryRecord;
+typedef struct library_image  LibraryImage;
+
+/*
+ * Library: what the last run probed, so only new or changed files are opened again;
+ * one index file per root directory in "$XDG_CACHE_HOME/moedance/CFG_LIBRARY_CACHE_DIR/",
+ * keyed by path (relative to the root), size, mtime and inode.
+ * Versioned and checksummed: anything that does not add up is an empty library, the
+ * next save replaces it (atomically, write + rename).
+ *
+ * The file is mapped read-only and stays mapped until library_deinit(): the items
+ * library_fill() found point into its string pool, nothing is copied.
+ * Saves are written by a thread of their own, one at a time, the newest waiting one
+ * replaces an older one; library_deinit() writes what is still waiting.
+ */
+typedef struct library {
+	uint8_t             *data;	/* the mapping, NULL: empty */
+	size_t               size;
+	const LibraryRecord *records;	/* sorted by path */
+	uint32_t             count;
+	const char          *pool;
+	size_t               pool_size;
+	Str                  file;
+	int                  has_saver;	/* 0: nothing is saved */
+	int                  is_alive;	/* of the saver, under 'mutex' */
+	mtx_t                mutex;
+	cnd_t                cond;
+	thrd_t               saver;
+	LibraryImage        *image;	/* the next save to write, NULL: none */
+} Library;
+
+
+int      library_init(Library *l);
+void     library_deinit(Library *l);
+uint32_t library_count(const Library *l);
+int      library_fill(const Library *l, struct playlist_item *item);
+int      library_save(Library *l, struct playlist_item *const items[], size_t len);
+
+
+#endif
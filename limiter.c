@@ -0,0 +1,278 @@
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "limiter.h"
+#include "util.h"
+
+
+#define _HEADROOM   (0.5f)	/* -6 dB: inter-sample peaks stay well below that */
+#define _GR_MIN_DB  (0.01)
+#define _TP_MARGIN  (0.2)	/* dB, 4x detection reads up to that low below ~16 kHz */
+
+/* where the oversampled peak of the newest frame lands, see dsp_tp_design() */
+#define _TP_AGE     ((DSP_TP_TAPS / 2) - 2)
+
+
+static float _peak_sq(Limiter *l, const float frame[]);
+static float _hold_push(Limiter *l, float val);
+static void  _process(Limiter *l, float frames[], size_t count);
+static void  _bypass(Limiter *l, float frames[], size_t count);
+
+
+/*
+ * public
+ */
+int
+limiter_init(Limiter *l, unsigned rate, unsigned channels, double ceiling_db,
+	     int lookahead_ms, int release_ms, Stats *stats)
+{
+	assert((channels > 0) && (channels <= DSP_CHANNELS_MAX));
+	memset(l, 0, sizeof(*l));
+	l->channels = channels;
+	l->ceiling = (float)pow(10.0, (ceiling_db - _TP_MARGIN) / 20.0);
+	l->ceiling_sq = l->ceiling * l->ceiling;
+	l->bypass = l->ceiling * _HEADROOM;
+	l->release = (float)(1.0 - exp(-1000.0 / ((double)release_ms * (double)rate)));
+	l->lookahead = ((size_t)rate * (size_t)lookahead_ms) / 1000;
+	if (l->lookahead < 1)
+		l->lookahead = 1;
+
+	l->latency = l->lookahead + _TP_AGE;
+	l->gain = 1.0f;
+	l->stats = stats;
+
+	l->delay = calloc(l->latency * channels, sizeof(float));
+	l->avg = malloc(l->lookahead * sizeof(float));
+	l->hold_val = malloc(l->lookahead * sizeof(float));
+	l->hold_idx = malloc(l->lookahead * sizeof(size_t));
+	if ((l->delay == NULL) || (l->avg == NULL) || (l->hold_val == NULL) || (l->hold_idx == NULL)) {
+		log_err(errno, "limiter: limiter_init: malloc");
+		limiter_deinit(l);
+		return -1;
+	}
+
+	for (size_t i = 0; i < l->lookahead; i++)
+		l->avg[i] = 1.0f;
+
+	float coefs[LIMITER_OS * DSP_TP_TAPS];
+	dsp_tp_design(coefs, LIMITER_OS, DSP_TP_TAPS);
+	for (int j = 0; j < DSP_TP_TAPS; j++) {
+		for (int p = 0; p < LIMITER_OS; p++)
+			l->coefs[j][p] = coefs[(p * DSP_TP_TAPS) + j];
+	}
+
+	return 0;
+}
+
+
+void
+limiter_deinit(Limiter *l)
+{
+	free(l->delay);
+	free(l->avg);
+	free(l->hold_val);
+	free(l->hold_idx);
+}
+
+
+/*
+ * frames, the position clock adds it to what the device has to play
+ */
+size_t
+limiter_latency(const Limiter *l)
+{
+	return l->latency;
+}
+
+
+void
+limiter_process(void *udata, float frames[], size_t count)
+{
+	Limiter *const l = (Limiter *)udata;
+	if (l->unity >= l->lookahead) {
+		float peak = 0.0f;
+		for (size_t i = 0; i < (count * l->channels); i++) {
+			const float x = fabsf(frames[i]);
+			if (x > peak)
+				peak = x;
+		}
+
+		if (peak <= l->bypass) {
+			_bypass(l, frames, count);
+			return;
+		}
+	}
+
+	_process(l, frames, count);
+}
+
+
+/*
+ * private
+ */
+static void
+_process(Limiter *l, float frames[], size_t count)
+{
+	const size_t la = l->lookahead;
+	const unsigned ch = l->channels;
+	const float scale = 1.0f / (float)la;
+
+	/* summed again per block: no drift */
+	float sum = 0.0f;
+	for (size_t i = 0; i < la; i++)
+		sum += l->avg[i];
+
+	/*
+	 * the detector is vectorized across the oversampling branches, the gain path is not:
+	 * the hold, the release and the average each need the previous frame's result
+	 */
+	float gain_min = 1.0f;
+	for (size_t i = 0; i < count; i++) {
+		float *const frm = &frames[i * ch];
+		const float pk = _peak_sq(l, frm);
+		const float req = (pk > l->ceiling_sq)? (l->ceiling / sqrtf(pk)) : 1.0f;
+		const float hold = _hold_push(l, req);
+
+		/* attack at once (smoothed by the moving average), exponential release */
+		float g = l->gain;
+		if (hold < g) {
+			g = hold;
+		} else {
+			g += (hold - g) * l->release;
+			if ((1.0f - g) < 1e-6f)
+				g = 1.0f;
+		}
+
+		l->gain = g;
+		l->unity = (g == 1.0f)? (l->unity + 1) : 0;
+		sum += g - l->avg[l->avg_pos];
+		l->avg[l->avg_pos] = g;
+		l->avg_pos = (l->avg_pos + 1) % la;
+
+		/* exact unity: lets the bypass take over seamlessly */
+		const float out = (l->unity >= la)? 1.0f : (sum * scale);
+		if (out < gain_min)
+			gain_min = out;
+
+		float *const d = &l->delay[l->delay_pos * ch];
+		for (unsigned j = 0; j < ch; j++) {
+			const float x = frm[j];
+			frm[j] = d[j] * out;
+			d[j] = x;
+		}
+
+		l->delay_pos = (l->delay_pos + 1) % l->latency;
+	}
+
+	if (gain_min < 1.0f) {
+		const double gr = -20.0 * log10((double)gain_min);
+		if (gr >= _GR_MIN_DB)
+			stats_gauge_add(l->stats, STATS_GAUGE_LIMITER, gr);
+	}
+}
+
+
+/*
+ * unity gain: the delay line and the peak detector history only
+ */
+static void
+_bypass(Limiter *l, float frames[], size_t count)
+{
+	const unsigned ch = l->channels;
+	for (size_t i = 0; i < count; i++) {
+		float *const frm = &frames[i * ch];
+		float *const d = &l->delay[l->delay_pos * ch];
+		const size_t pos = l->hist_pos;
+		for (unsigned c = 0; c < ch; c++) {
+			const float x = frm[c];
+			l->hist[c][pos] = x;
+			l->hist[c][pos + DSP_TP_TAPS] = x;
+			frm[c] = d[c];
+			d[c] = x;
+		}
+
+		l->hist_pos = (pos + 1) % DSP_TP_TAPS;
+		l->delay_pos = (l->delay_pos + 1) % l->latency;
+	}
+
+	/* the hold queue only ever saw 1.0, the moving average is all 1.0 */
+	l->unity += count;
+	l->frame += count;
+	l->hold_head = 0;
+	l->hold_len = 1;
+	l->hold_val[0] = 1.0f;
+	l->hold_idx[0] = l->frame - 1;
+}
+
+
+/*
+ * returns: the squared oversampled peak of the newest frame, all channels
+ */
+static float
+_peak_sq(Limiter *l, const float frame[])
+{
+	const size_t pos = l->hist_pos;
+	l->hist_pos = (pos + 1) % DSP_TP_TAPS;
+
+	DspV4 acc = { 0 };
+	for (unsigned c = 0; c < l->channels; c++) {
+		/* mirrored history: the newest DSP_TP_TAPS samples are always contiguous */
+		float *const h = l->hist[c];
+		h[pos] = frame[c];
+		h[pos + DSP_TP_TAPS] = frame[c];
+
+		const float *const w = &h[pos + 1];
+		DspV4 a = { 0 };
+		for (int j = 0; j < DSP_TP_TAPS; j++)
+			a += l->coefs[j] * w[DSP_TP_TAPS - 1 - j];
+
+		/* per lane max: a mask blend */
+		const DspV4 sq = a * a;
+		const DspV4i gt = (sq > acc);
+		acc = (DspV4)(((DspV4i)sq & gt) | ((DspV4i)acc & ~gt));
+	}
+
+	float ret = 0.0f;
+	for (int p = 0; p < LIMITER_OS; p++) {
+		if (acc[p] > ret)
+			ret = acc[p];
+	}
+
+	return ret;
+}
+
+
+/*
+ * sliding minimum over the last 'lookahead' frames
+ */
+static float
+_hold_push(Limiter *l, float val)
+{
+	const size_t la = l->lookahead;
+	const size_t frame = l->frame++;
+
+	/* drop larger values from the back */
+	while (l->hold_len > 0) {
+		const size_t back = (l->hold_head + l->hold_len - 1) % la;
+		if (l->hold_val[back] < val)
+			break;
+
+		l->hold_len--;
+	}
+
+	/* and expired ones from the front */
+	if ((l->hold_len > 0) && ((frame - l->hold_idx[l->hold_head]) >= la)) {
+		l->hold_head = (l->hold_head + 1) % la;
+		l->hold_len--;
+	}
+
+	const size_t tail = (l->hold_head + l->hold_len) % la;
+	l->hold_val[tail] = val;
+	l->hold_idx[tail] = frame;
+	l->hold_len++;
+	return l->hold_val[l->hold_head];
+}
+
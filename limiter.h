@@ -0,0 +1,59 @@
+#ifndef __LIMITER_H__
+#define __LIMITER_H__
+
+
+#include <stddef.h>
+
+#include "dsp.h"
+#include "stats.h"
+
+
+#define LIMITER_OS (4)
+
+
+/*
+ * Limiter: look-ahead true-peak limiter, a DspChain stage, one gain for all channels
+ *
+ * Peaks are detected on a 4x oversampled signal (polyphase FIR, one branch per
+ * vector lane). The required gain goes through a minimum hold and a moving average,
+ * both 'lookahead' frames long, so the gain is already down when the peak leaves the
+ * delay line: the output never exceeds the ceiling, without hard edges. The release
+ * is exponential. The latency is fixed: limiter_latency() frames.
+ *
+ * A block whose sample peak is far enough below the ceiling, while nothing is being
+ * limited, only goes through the delay line.
+ */
+typedef struct limiter {
+	unsigned  channels;
+	float     ceiling;
+	float     ceiling_sq;
+	float     bypass;		/* sample peak */
+	float     release;		/* per frame */
+	size_t    lookahead;
+	size_t    latency;
+	DspV4     coefs[DSP_TP_TAPS];	/* lane: branch */
+	float     hist[DSP_CHANNELS_MAX][DSP_TP_TAPS * 2];
+	size_t    hist_pos;
+	float    *delay;		/* interleaved, 'latency' frames */
+	size_t    delay_pos;
+	float     gain;			/* after the release */
+	size_t    unity;		/* frames in a row at 1.0 */
+	float    *avg;			/* 'lookahead' gains */
+	size_t    avg_pos;
+	float    *hold_val;		/* monotonic queue */
+	size_t   *hold_idx;
+	size_t    hold_head;
+	size_t    hold_len;
+	size_t    frame;
+	Stats    *stats;
+} Limiter;
+
+
+int    limiter_init(Limiter *l, unsigned rate, unsigned channels, double ceiling_db,
+		    int lookahead_ms, int release_ms, Stats *stats);
+void   limiter_deinit(Limiter *l);
+size_t limiter_latency(const Limiter *l);
+void   limiter_process(void *udata, float frames[], size_t count);
+
+
+#endif
@@ -0,0 +1,352 @@
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "loudness.h"
+#include "util.h"
+
+
+#define _PI                  (3.14159265358979323846)
+#define _ABS_GATE_LUFS       (-70.0)
+#define _REL_GATE_LU         (-10.0)
+#define _LRA_REL_GATE_LU     (-20.0)
+#define _LRA_PERCENTILE_LOW  (0.10)
+#define _LRA_PERCENTILE_HIGH (0.95)
+
+
+static void   _filters_init(Loudness *l, int rate);
+static void   _true_peak_init(Loudness *l, int rate);
+static double _true_peak(Loudness *l, int ch, float sample);
+static int    _sub_block_end(Loudness *l);
+static int    _energies_push(LoudnessEnergies *e, double value);
+static double _energy_to_lufs(double energy);
+static double _integrated(const LoudnessEnergies *e);
+static double _range(const LoudnessEnergies *e);
+static int    _double_cmp(const void *a, const void *b);
+
+
+/*
+ * public
+ */
+int
+loudness_init(Loudness *l, int rate, int channels)
+{
+	if ((rate <= 0) || (channels <= 0) || (channels > LOUDNESS_CHANNELS_MAX)) {
+		log_err(0, "loudness: loudness_init: invalid format: %d Hz, %d channel(s)", rate, channels);
+		return -1;
+	}
+
+	memset(l, 0, sizeof(*l));
+	l->channels = channels;
+	l->sub_len = (size_t)rate / 10;
+
+	/* BS.1770: LFE is ignored, surrounds get +1.5 dB (5.1: FL FR FC LFE BL BR) */
+	for (int i = 0; i < channels; i++)
+		l->weights[i] = 1.0;
+
+	if (channels == 6) {
+		l->weights[3] = 0.0;
+		l->weights[4] = 1.41;
+		l->weights[5] = 1.41;
+	}
+
+	_filters_init(l, rate);
+	_true_peak_init(l, rate);
+	return 0;
+}
+
+
+void
+loudness_deinit(Loudness *l)
+{
+	free(l->momentary.items);
+	free(l->short_term.items);
+}
+
+
+int
+loudness_add(Loudness *l, const float frames[], size_t count)
+{
+	const int chans = l->channels;
+	const double *const pb = l->pre_b;
+	const double *const pa = l->pre_a;
+	const double *const rb = l->rlb_b;
+	const double *const ra = l->rlb_a;
+
+	for (size_t i = 0; i < count; i++) {
+		const float *const frame = &frames[i * (size_t)chans];
+		double sum = 0.0;
+		for (int c = 0; c < chans; c++) {
+			const double x = frame[c];
+			double *const pz = l->pre_z[c];
+			double *const rz = l->rlb_z[c];
+
+			/* K-weighting: shelving pre-filter + RLB high-pass (transposed DF-II) */
+			const double y0 = pb[0] * x + pz[0];
+			pz[0] = pb[1] * x - pa[1] * y0 + pz[1];
+			pz[1] = pb[2] * x - pa[2] * y0;
+
+			const double y1 = rb[0] * y0 + rz[0];
+			rz[0] = rb[1] * y0 - ra[1] * y1 + rz[1];
+			rz[1] = rb[2] * y0 - ra[2] * y1;
+
+			sum += l->weights[c] * y1 * y1;
+
+			const double peak = _true_peak(l, c, frame[c]);
+			if (peak > l->tp_peak)
+				l->tp_peak = peak;
+		}
+
+		l->tp_pos = (l->tp_pos + 1) % LOUDNESS_TP_TAPS;
+		l->sub_sum += sum;
+		if (++l->sub_pos < l->sub_len)
+			continue;
+
+		if (_sub_block_end(l) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+void
+loudness_get(Loudness *l, LoudnessResult *res)
+{
+	res->integrated = _integrated(&l->momentary);
+	res->range = _range(&l->short_term);
+	res->true_peak = (l->tp_peak > 0.0)? (20.0 * log10(l->tp_peak)) : -HUGE_VAL;
+}
+
+
+/*
+ * private
+ */
+static void
+_filters_init(Loudness *l, int rate)
+{
+	/* BS.1770-4 pre-filter, re-derived for the given rate (same as libebur128) */
+	const double f0 = 1681.974450955533;
+	const double g = 3.999843853973347;
+	const double q = 0.7071752369554196;
+
+	double k = tan(_PI * f0 / (double)rate);
+	const double vh = pow(10.0, g / 20.0);
+	const double vb = pow(vh, 0.4996667741545416);
+	double a0 = 1.0 + k / q + k * k;
+
+	l->pre_b[0] = (vh + vb * k / q + k * k) / a0;
+	l->pre_b[1] = 2.0 * (k * k - vh) / a0;
+	l->pre_b[2] = (vh - vb * k / q + k * k) / a0;
+	l->pre_a[0] = 1.0;
+	l->pre_a[1] = 2.0 * (k * k - 1.0) / a0;
+	l->pre_a[2] = (1.0 - k / q + k * k) / a0;
+
+	/* RLB high-pass */
+	const double f1 = 38.13547087602444;
+	const double q1 = 0.5003270373238773;
+
+	k = tan(_PI * f1 / (double)rate);
+	a0 = 1.0 + k / q1 + k * k;
+
+	l->rlb_b[0] = 1.0;
+	l->rlb_b[1] = -2.0;
+	l->rlb_b[2] = 1.0;
+	l->rlb_a[0] = 1.0;
+	l->rlb_a[1] = 2.0 * (k * k - 1.0) / a0;
+	l->rlb_a[2] = (1.0 - k / q1 + k * k) / a0;
+}
+
+
+static void
+_true_peak_init(Loudness *l, int rate)
+{
+	/* BS.1770 annex 2: oversample to >= 192 kHz before taking the peak */
+	int os = 1;
+	if (rate < 96000)
+		os = 4;
+	else if (rate < 192000)
+		os = 2;
+
+	l->tp_os = os;
+	if (os == 1)
+		return;
+
+	dsp_tp_design(&l->tp_coefs[0][0], os, LOUDNESS_TP_TAPS);
+}
+
+
+static double
+_true_peak(Loudness *l, int ch, float sample)
+{
+	double peak = fabs(sample);
+	if (l->tp_os == 1)
+		return peak;
+
+	/* mirrored history: the newest LOUDNESS_TP_TAPS samples are always contiguous */
+	float *const hist = l->tp_hist[ch];
+	const unsigned pos = l->tp_pos;
+	hist[pos] = sample;
+	hist[pos + LOUDNESS_TP_TAPS] = sample;
+
+	const float *const win = &hist[pos + 1];
+	for (int p = 0; p < l->tp_os; p++) {
+		const float *const coefs = l->tp_coefs[p];
+		float acc = 0.0f;
+		for (int j = 0; j < LOUDNESS_TP_TAPS; j++)
+			acc += coefs[j] * win[LOUDNESS_TP_TAPS - 1 - j];
+
+		if (fabsf(acc) > peak)
+			peak = fabsf(acc);
+	}
+
+	return peak;
+}
+
+
+static int
+_sub_block_end(Loudness *l)
+{
+	l->subs[l->subs_count % LOUDNESS_SUBS_SIZE] = l->sub_sum / (double)l->sub_len;
+	l->subs_count++;
+	l->sub_sum = 0.0;
+	l->sub_pos = 0;
+
+	const unsigned count = l->subs_count;
+	if (count >= 4) {
+		double sum = 0.0;
+		for (unsigned i = count - 4; i < count; i++)
+			sum += l->subs[i % LOUDNESS_SUBS_SIZE];
+
+		if (_energies_push(&l->momentary, sum / 4.0) < 0)
+			return -1;
+	}
+
+	if (count >= LOUDNESS_SUBS_SIZE) {
+		double sum = 0.0;
+		for (unsigned i = 0; i < LOUDNESS_SUBS_SIZE; i++)
+			sum += l->subs[i];
+
+		if (_energies_push(&l->short_term, sum / LOUDNESS_SUBS_SIZE) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+static int
+_energies_push(LoudnessEnergies *e, double value)
+{
+	if (e->len == e->size) {
+		const size_t new_size = (e->size == 0)? 1024 : (e->size * 2);
+		double *const new_items = realloc(e->items, new_size * sizeof(double));
+		if (new_items == NULL) {
+			log_err(errno, "loudness: _energies_push: realloc");
+			return -1;
+		}
+
+		e->items = new_items;
+		e->size = new_size;
+	}
+
+	e->items[e->len++] = value;
+	return 0;
+}
+
+
+static double
+_energy_to_lufs(double energy)
+{
+	return -0.691 + 10.0 * log10(energy);
+}
+
+
+static double
+_integrated(const LoudnessEnergies *e)
+{
+	const double abs_gate = pow(10.0, (_ABS_GATE_LUFS + 0.691) / 10.0);
+	double sum = 0.0;
+	size_t num = 0;
+	for (size_t i = 0; i < e->len; i++) {
+		if (e->items[i] <= abs_gate)
+			continue;
+
+		sum += e->items[i];
+		num++;
+	}
+
+	if (num == 0)
+		return -HUGE_VAL;
+
+	const double rel_gate = (sum / (double)num) * pow(10.0, _REL_GATE_LU / 10.0);
+	sum = 0.0;
+	num = 0;
+	for (size_t i = 0; i < e->len; i++) {
+		if ((e->items[i] <= abs_gate) || (e->items[i] <= rel_gate))
+			continue;
+
+		sum += e->items[i];
+		num++;
+	}
+
+	if (num == 0)
+		return -HUGE_VAL;
+
+	return _energy_to_lufs(sum / (double)num);
+}
+
+
+static double
+_range(const LoudnessEnergies *e)
+{
+	const double abs_gate = pow(10.0, (_ABS_GATE_LUFS + 0.691) / 10.0);
+	double sum = 0.0;
+	size_t num = 0;
+	for (size_t i = 0; i < e->len; i++) {
+		if (e->items[i] <= abs_gate)
+			continue;
+
+		sum += e->items[i];
+		num++;
+	}
+
+	if (num == 0)
+		return 0.0;
+
+	double *const gated = malloc(num * sizeof(double));
+	if (gated == NULL) {
+		log_err(errno, "loudness: _range: malloc");
+		return 0.0;
+	}
+
+	const double rel_gate = (sum / (double)num) * pow(10.0, _LRA_REL_GATE_LU / 10.0);
+	num = 0;
+	for (size_t i = 0; i < e->len; i++) {
+		if ((e->items[i] > abs_gate) && (e->items[i] > rel_gate))
+			gated[num++] = e->items[i];
+	}
+
+	double ret = 0.0;
+	if (num > 0) {
+		qsort(gated, num, sizeof(double), _double_cmp);
+
+		const size_t lo = (size_t)(((double)(num - 1) * _LRA_PERCENTILE_LOW) + 0.5);
+		const size_t hi = (size_t)(((double)(num - 1) * _LRA_PERCENTILE_HIGH) + 0.5);
+		ret = _energy_to_lufs(gated[hi]) - _energy_to_lufs(gated[lo]);
+	}
+
+	free(gated);
+	return ret;
+}
+
+
+static int
+_double_cmp(const void *a, const void *b)
+{
+	const double x = *(const double *)a;
+	const double y = *(const double *)b;
+	return (x > y) - (x < y);
+}
@@ -0,0 +1,63 @@
+#ifndef __LOUDNESS_H__
+#define __LOUDNESS_H__
+
+
+#include <stddef.h>
+
+#include "dsp.h"
+
+
+/*
+ * EBU R128 / ITU-R BS.1770 loudness meter
+ */
+#define LOUDNESS_CHANNELS_MAX (6)
+#define LOUDNESS_TP_TAPS      DSP_TP_TAPS
+#define LOUDNESS_TP_OS_MAX    (4)
+#define LOUDNESS_SUBS_SIZE    (30)	/* 3 s of 100 ms sub-blocks */
+
+
+typedef struct loudness_result {
+	double integrated;	/* LUFS */
+	double range;		/* LU */
+	double true_peak;	/* dBTP */
+} LoudnessResult;
+
+typedef struct loudness_energies {
+	size_t  len;
+	size_t  size;
+	double *items;
+} LoudnessEnergies;
+
+typedef struct loudness {
+	int              channels;
+	double           weights[LOUDNESS_CHANNELS_MAX];
+	double           pre_b[3];
+	double           pre_a[3];
+	double           rlb_b[3];
+	double           rlb_a[3];
+	double           pre_z[LOUDNESS_CHANNELS_MAX][2];
+	double           rlb_z[LOUDNESS_CHANNELS_MAX][2];
+
+	size_t           sub_len;	/* frames per 100 ms */
+	size_t           sub_pos;
+	double           sub_sum;
+	double           subs[LOUDNESS_SUBS_SIZE];
+	unsigned         subs_count;
+	LoudnessEnergies momentary;	/* 400 ms blocks */
+	LoudnessEnergies short_term;	/* 3 s blocks */
+
+	int              tp_os;
+	unsigned         tp_pos;
+	double           tp_peak;
+	float            tp_coefs[LOUDNESS_TP_OS_MAX][LOUDNESS_TP_TAPS];
+	float            tp_hist[LOUDNESS_CHANNELS_MAX][LOUDNESS_TP_TAPS * 2];
+} Loudness;
+
+
+int  loudness_init(Loudness *l, int rate, int channels);
+void loudness_deinit(Loudness *l);
+int  loudness_add(Loudness *l, const float frames[], size_t count);
+void loudness_get(Loudness *l, LoudnessResult *res);
+
+
+#endif
@@ -1,8 +1,11 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "moedance.h"
+#include "playlist.h"
+#include "stats.h"
 #include "config.h"
 
 
@@ -28,7 +31,53 @@ static void
 _print_help(const char app_name[])
 {
 	printf("Moedance - A pretty and simple music player\n"
-	       "\nUsage: %s [PATH]\n", app_name);
+	       "\nUsage: %s [PATH]\n"
+	       "       %s -r [PATH]    probe every file, rebuild the library index and exit\n",
+	       app_name, app_name);
+}
+
+
+/*
+ * no UI: the full scan a library index saves on every later start
+ */
+static int
+_rebuild_library(const char path[])
+{
+	/* log_file_init() takes stdout over */
+	const int out = dup(STDOUT_FILENO);
+	if (out < 0) {
+		perror("main: _rebuild_library: dup");
+		return EXIT_FAILURE;
+	}
+
+	if (log_file_init(CFG_LOG_FILE) < 0) {
+		close(out);
+		return EXIT_FAILURE;
+	}
+
+	int ret = EXIT_FAILURE;
+	Playlist playlist;
+	if (playlist_init(&playlist, path) < 0) {
+		dprintf(out, "main: _rebuild_library: playlist_init: \"%s\": %s\n", path, strerror(errno));
+		goto out0;
+	}
+
+	const PlaylistItem **items;
+	const int64_t start = stats_now_ns();
+	const int len = playlist_load(&playlist, PLAYLIST_LOAD_REBUILD, &items);
+	if (len < 0) {
+		dprintf(out, "main: _rebuild_library: failed, see \"%s\"\n", CFG_LOG_FILE);
+	} else {
+		dprintf(out, "%d file(s) indexed in %.2f s\n", len, (double)(stats_now_ns() - start) / 1e9);
+		ret = EXIT_SUCCESS;
+	}
+
+	playlist_deinit(&playlist);
+
+out0:
+	log_file_deinit();
+	close(out);
+	return ret;
 }
 
 
@@ -51,8 +100,17 @@ main(int argc, char *argv[])
 			return EXIT_SUCCESS;
 		}
 
+		if (strcmp(argv[1], "-r") == 0)
+			return _rebuild_library(_load_default_path(buffer, sizeof(buffer)));
+
 		path = argv[1];
 		break;
+	case 3:
+		if (strcmp(argv[1], "-r") == 0)
+			return _rebuild_library(argv[2]);
+
+		_print_help(argv[0]);
+		return ret;
 	default:
 		_print_help(argv[0]);
 		return ret;
@@ -18,6 +18,8 @@
 #include "moedance.h"
 #include "kbd.h"
 #include "cmd.h"
+#include "bench.h"
+#include "stats.h"
 #include "config.h"
 
 
@@ -36,6 +38,9 @@ enum {
 enum {
 	_EVENT_KBD = 0,
 	_EVENT_TIMER,
+	_EVENT_VIZ,
+	_EVENT_WATCH,
+	_EVENT_LOAD,
 
 	_EVENT_END,
 };
@@ -46,10 +51,20 @@ static void _signal_handler(int sig);
 static int  _timerfd_init(time_t timeout_s);
 
 static void _set_playlist(Moedance *m);
+static void _playlist_update(Moedance *m);
+static void _load_update(Moedance *m);
+static int  _load_wait_ms(const Moedance *m);
+static void _analysis_start(Moedance *m);
+static void _analysis_update(Moedance *m);
+static void _durations_start(Moedance *m);
+static void _durations_update(Moedance *m);
+static void _wave_load(Moedance *m, const PlaylistItem *item);
+static void _wave_update(Moedance *m);
 
 static int  _event_loop(Moedance *m);
 static void _event_kbd_handler(Moedance *m, int fd);
 static void _event_timerfd_handler(Moedance *m, int fd);
+static void _event_viz_handler(Moedance *m);
 
 static void _tui_refresh(Moedance *m);
 static void _tui_quit_dialog(Moedance *m);
@@ -62,12 +77,26 @@ static void _tui_command_end(Moedance *m, int set_footer);
 static void _handle_command(Moedance *m);
 static int  _handle_command_sleep(Moedance *m, Cmd *cmd);
 static int  _handle_command_repeat(Moedance *m, Cmd *cmd);
-
-static void _player_play(Moedance *m);
+static int  _handle_command_crossfade(Moedance *m, Cmd *cmd);
+static int  _handle_command_eq(Moedance *m, Cmd *cmd);
+static int  _handle_command_bench(Moedance *m, Cmd *cmd);
+static int  _handle_command_filter(Moedance *m, Cmd *cmd);
+static int  _handle_command_stats(Moedance *m, Cmd *cmd);
+static int  _handle_command_speed(Moedance *m, Cmd *cmd);
+static int  _handle_command_viz(Moedance *m, Cmd *cmd);
+static int  _handle_command_channels(Moedance *m, Cmd *cmd);
+static int  _handle_command_resampler(Moedance *m, Cmd *cmd);
+static int  _handle_command_rescan(Moedance *m, Cmd *cmd);
+static int  _eq_preset_set(Moedance *m, const char name[]);
+static int  _viz_set_mode(Moedance *m, VizMode mode);
+
+static void _player_play(Moedance *m, int fade_ms);
 static void _player_stop(Moedance *m);
 static void _player_toggle(Moedance *m);
-static void _player_next(Moedance *m);
-static void _player_prev(Moedance *m);
+static void _player_next(Moedance *m, int fade_ms);
+static void _player_prev(Moedance *m, int fade_ms);
+static void _player_seek(Moedance *m, int64_t step_s);
+static void _player_crossfade(Moedance *m);
 static void _player_error(Moedance *m);
 
 
@@ -95,6 +124,8 @@ moedance_init(Moedance *m, const char root_dir[])
 	m->flags = 0;
 	m->root_dir = root_dir;
 	m->sleep_s = 0;
+	m->load_update_ns = 0;
+	m->crossfade_s = CFG_CROSSFADE_S;
 	_moe = m;
 	return 0;
 }
@@ -125,12 +156,48 @@ moedance_run(Moedance *m)
 	tui_draw(&m->tui);
 	_set_playlist(m);
 
-	ret = player_init(&m->player);
+	ret = player_init(&m->player, PLAYER_OUTPUT_DEVICE);
+	if (ret < 0)
+		goto out2;
+
+	if (_eq_preset_set(m, CFG_EQ_PRESET) < 0)
+		log_err(0, "moedance: moedance_run: _eq_preset_set: %s: failed", CFG_EQ_PRESET);
+
+	player_set_filter(&m->player, CFG_FILTER);
+
+	ret = viz_init(&m->viz, &m->player);
 	if (ret < 0)
 		goto out2;
 
+	if (_viz_set_mode(m, CFG_VIZ_MODE) < 0)
+		log_err(0, "moedance: moedance_run: _viz_set_mode: %d: failed", CFG_VIZ_MODE);
+
+	ret = wave_init(&m->wave);
+	if (ret < 0)
+		goto out3;
+
+	ret = analysis_init(&m->analysis);
+	if (ret < 0)
+		goto out4;
+
+	_analysis_start(m);
 	ret = _event_loop(m);
 
+	/* the terminal comes back at once, the fade and the device teardown overlap the rest */
+	player_close(&m->player);
+	tui_deinit(&m->tui);
+	analysis_deinit(&m->analysis);
+	wave_deinit(&m->wave);
+	viz_deinit(&m->viz);
+	player_deinit(&m->player);
+	log_file_deinit();
+	return ret;
+
+out4:
+	tui_set_wave(&m->tui, NULL, 0, 0);
+	wave_deinit(&m->wave);
+out3:
+	viz_deinit(&m->viz);
 out2:
 	player_deinit(&m->player);
 out1:
@@ -226,11 +293,181 @@ _set_playlist(Moedance *m)
 	_tui_loading_dialog(m);
 
 	const PlaylistItem **items;
-	const int items_len = playlist_load(&m->playlist, &items);
-	if (items_len < 0)
-		tui_show_dialog(&m->tui, "Failed to load file(s) from the given dir!", TUI_DIALOG_TYPE_ERROR);
+	int items_len;
+	if (CFG_LOAD_BACKGROUND_ENABLE == 1)
+		items_len = playlist_load_start(&m->playlist, &items);
 	else
-		tui_set_playlist(&m->tui, items, items_len);
+		items_len = playlist_load(&m->playlist, PLAYLIST_LOAD_INDEX, &items);
+
+	if (items_len < 0) {
+		tui_show_dialog(&m->tui, "Failed to load file(s) from the given dir!", TUI_DIALOG_TYPE_ERROR);
+		return;
+	}
+
+	tui_set_playlist(&m->tui, items, items_len);
+	m->load_update_ns = stats_now_ns();
+	_durations_start(m);
+#if (CFG_WATCH_ENABLE == 1)
+	if (playlist_watch(&m->playlist) < 0)
+		log_err(0, "moedance: _set_playlist: playlist_watch: failed");
+#endif
+}
+
+
+/*
+ * what changed on disk, merged: playback and the cursor carry on where they were
+ */
+static void
+_playlist_update(Moedance *m)
+{
+	const PlaylistItem **items;
+	const int items_len = playlist_update(&m->playlist, &items);
+	if (items_len < 0)
+		return;
+
+	tui_update_playlist(&m->tui, items, items_len);
+	_durations_start(m);
+	_analysis_start(m);
+}
+
+
+/*
+ * the probed items as they come in, only their rows redrawn; the footer's progress is
+ * the load's until it is done, the durations and the analysis start after it
+ */
+static void
+_load_update(Moedance *m)
+{
+	int len;
+	const int top = tui_playlist_get_view(&m->tui, &len);
+	playlist_load_set_view(&m->playlist, top, len);
+
+	int first = 0;
+	int last = -1;
+	int done = 0;
+	int total = 0;
+	const int changed = playlist_load_update(&m->playlist, &first, &last, &done, &total);
+	if (changed < 0)
+		return;
+
+	m->load_update_ns = stats_now_ns();
+	if (changed > 0)
+		tui_update_items(&m->tui, first, last);
+
+	if (done < total) {
+		tui_set_progress(&m->tui, "Loading", done, total);
+		return;
+	}
+
+	tui_set_progress(&m->tui, NULL, 0, 0);
+	_durations_start(m);
+	_analysis_start(m);
+}
+
+
+/*
+ * returns: how long the next redraw waits, 0: it may come now
+ */
+static int
+_load_wait_ms(const Moedance *m)
+{
+	const int64_t elapsed_ms = (stats_now_ns() - m->load_update_ns) / 1000000;
+	if (elapsed_ms >= CFG_LOAD_REDRAW_MS)
+		return 0;
+
+	return (int)(CFG_LOAD_REDRAW_MS - elapsed_ms);
+}
+
+
+static void
+_analysis_start(Moedance *m)
+{
+#if (CFG_ANALYSIS_ENABLE == 1)
+	/* the items are still being probed: again once the load is done */
+	if (m->playlist.load.is_running)
+		return;
+
+	const PlaylistItem **const items = (const PlaylistItem **)m->playlist.items;
+	if (analysis_start(&m->analysis, items, m->playlist.items_len) < 0)
+		log_err(0, "moedance: _analysis_start: analysis_start: failed");
+#else
+	(void)m;
+#endif
+}
+
+
+static void
+_analysis_update(Moedance *m)
+{
+	int total = 0;
+	const int done = analysis_update(&m->analysis, &total);
+	if (done < 0) {
+		if ((m->playlist.durations.is_running == 0) && (m->playlist.load.is_running == 0))
+			tui_set_progress(&m->tui, NULL, 0, 0);
+
+		return;
+	}
+
+	analysis_set_throttle(&m->analysis, player_item_is_playing(&m->player));
+	tui_set_progress(&m->tui, "R128", done, total);
+}
+
+
+static void
+_durations_start(Moedance *m)
+{
+	if (playlist_durations_start(&m->playlist) < 0)
+		log_err(0, "moedance: _durations_start: playlist_durations_start: failed");
+}
+
+
+/*
+ * the rows show the exact durations as they come in; the footer shares its progress
+ * with the analysis, which goes first
+ */
+static void
+_durations_update(Moedance *m)
+{
+	int done = 0;
+	int total = 0;
+	const int changed = playlist_durations_update(&m->playlist, &done, &total);
+	if (changed < 0)
+		return;
+
+	if (changed > 0)
+		tui_draw(&m->tui);
+
+	playlist_durations_set_throttle(&m->playlist, player_item_is_playing(&m->player));
+	if (m->analysis.is_running == 0)
+		tui_set_progress(&m->tui, (done < total)? "Durations" : NULL, done, total);
+}
+
+
+/*
+ * the footer shows nothing until the summary is there
+ */
+static void
+_wave_load(Moedance *m, const PlaylistItem *item)
+{
+#if (CFG_WAVE_ENABLE == 1)
+	tui_set_wave(&m->tui, NULL, 0, 0);
+
+	const WaveData *const data = wave_load(&m->wave, item->file_path);
+	if (data != NULL)
+		tui_set_wave(&m->tui, data->peaks, data->len, WAVE_BUCKET_MS);
+#else
+	(void)m;
+	(void)item;
+#endif
+}
+
+
+static void
+_wave_update(Moedance *m)
+{
+	const WaveData *const data = wave_update(&m->wave);
+	if (data != NULL)
+		tui_set_wave(&m->tui, data->peaks, data->len, WAVE_BUCKET_MS);
 }
 
 
@@ -248,14 +485,31 @@ _event_loop(Moedance *m)
 	pfds[_EVENT_KBD].events = POLLIN;
 	pfds[_EVENT_TIMER].fd = tfd;
 	pfds[_EVENT_TIMER].events = POLLIN;
-
+	pfds[_EVENT_VIZ].events = POLLIN;
+	pfds[_EVENT_WATCH].fd = playlist_watch_get_fd(&m->playlist);
+	pfds[_EVENT_WATCH].events = POLLIN;
+	pfds[_EVENT_LOAD].events = POLLIN;
 
 	/* flush input buffer */
 	stream_in_flush(pfds[_EVENT_KBD].fd);
 
 	SET(m->flags, _FLAG_ALIVE);
 	while (ISSET(m->flags, _FLAG_ALIVE)) {
-		int ret = poll(pfds, LEN(pfds), -1);
+		/* -1 (hidden): ignored by poll() */
+		pfds[_EVENT_VIZ].fd = viz_get_fd(&m->viz);
+
+		/* the rows are redrawn every CFG_LOAD_REDRAW_MS at most, the items wait */
+		int timeout = -1;
+		pfds[_EVENT_LOAD].fd = playlist_load_get_fd(&m->playlist);
+		if (pfds[_EVENT_LOAD].fd >= 0) {
+			timeout = _load_wait_ms(m);
+			if (timeout > 0)
+				pfds[_EVENT_LOAD].fd = -1;
+			else
+				timeout = -1;
+		}
+
+		int ret = poll(pfds, LEN(pfds), timeout);
 		if (ret < 0) {
 			if (errno == EINTR)
 				continue;
@@ -287,11 +541,19 @@ _event_loop(Moedance *m)
 			case _EVENT_TIMER:
 				_event_timerfd_handler(m, pfds[i].fd);
 				break;
+			case _EVENT_VIZ:
+				_event_viz_handler(m);
+				break;
+			case _EVENT_WATCH:
+				playlist_watch_read(&m->playlist);
+				break;
+			case _EVENT_LOAD:
+				_load_update(m);
+				break;
 			}
 		}
 	}
 
-	tui_show_dialog(&m->tui, "Please wait...", TUI_DIALOG_TYPE_INFO);
 	ret = 0;
 
 out0:
@@ -397,18 +659,21 @@ out0:
 	switch (kbd) {
 	case KBD_ARROW_UP: tui_playlist_cursor_up(&m->tui); break;
 	case KBD_ARROW_DOWN: tui_playlist_cursor_down(&m->tui); break;
+	case KBD_ARROW_LEFT: _player_seek(m, -CFG_SEEK_STEP_S); break;
+	case KBD_ARROW_RIGHT: _player_seek(m, CFG_SEEK_STEP_S); break;
 	case KBD_HOME: tui_playlist_top(&m->tui); break;
 	case KBD_END: tui_playlist_bottom(&m->tui); break;
 	case KBD_PAGE_UP: tui_playlist_page_up(&m->tui); break;
 	case KBD_PAGE_DOWN: tui_playlist_page_down(&m->tui); break;
 	case KBD_SLASH: _tui_playlist_find_begin(m); break;
 	case KBD_SPACE: _player_toggle(m); break;
-	case KBD_ENTER: _player_play(m); break;
+	case KBD_ENTER: _player_play(m, CFG_FADE_MANUAL_MS); break;
 	case KBD_COLON: _tui_command_begin(m);  break;
 	case KBD_C: tui_playlist_curr(&m->tui); break;
-	case KBD_N: _player_next(m); break;
-	case KBD_P: _player_prev(m); break;
+	case KBD_N: _player_next(m, CFG_FADE_MANUAL_MS); break;
+	case KBD_P: _player_prev(m, CFG_FADE_MANUAL_MS); break;
 	case KBD_S: _player_stop(m); break;
+	case KBD_V: _viz_set_mode(m, (viz_get_mode(&m->viz) + 1) % VIZ_MODE_END); break;
 	case KBD_Q:
 		SET(m->flags, _FLAG_KEY_QUIT);
 		_tui_quit_dialog(m);
@@ -434,11 +699,19 @@ _event_timerfd_handler(Moedance *m, int fd)
 
 	if (ISSET(m->flags, _FLAG_STARTED)) {
 		if (player_item_is_stopped(&m->player))
-			_player_next(m);
+			_player_next(m, 0);
+		else
+			_player_crossfade(m);
 
 		tui_set_duration(&m->tui, player_item_get_time(&m->player));
 	}
 
+	_load_update(m);
+	_durations_update(m);
+	_analysis_update(m);
+	_wave_update(m);
+	_playlist_update(m);
+
 	if (ISSET(m->flags, _FLAG_KEY_QUIT))
 		_tui_quit_dialog(m);
 
@@ -454,6 +727,21 @@ _event_timerfd_handler(Moedance *m, int fd)
 }
 
 
+/*
+ * a new visualisation frame, only its row is redrawn
+ */
+static void
+_event_viz_handler(Moedance *m)
+{
+	VizResult res;
+	viz_set_bands(&m->viz, m->tui.width);
+	if (viz_read(&m->viz, &res) < 0)
+		return;
+
+	tui_draw_viz(&m->tui, &res);
+}
+
+
 static void
 _tui_refresh(Moedance *m)
 {
@@ -553,6 +841,36 @@ _handle_command(Moedance *m)
 	case CMD_TYPE_REPEAT:
 		ret = _handle_command_repeat(m, &cmd);
 		break;
+	case CMD_TYPE_CROSSFADE:
+		ret = _handle_command_crossfade(m, &cmd);
+		break;
+	case CMD_TYPE_EQ:
+		ret = _handle_command_eq(m, &cmd);
+		break;
+	case CMD_TYPE_BENCH:
+		ret = _handle_command_bench(m, &cmd);
+		break;
+	case CMD_TYPE_FILTER:
+		ret = _handle_command_filter(m, &cmd);
+		break;
+	case CMD_TYPE_STATS:
+		ret = _handle_command_stats(m, &cmd);
+		break;
+	case CMD_TYPE_SPEED:
+		ret = _handle_command_speed(m, &cmd);
+		break;
+	case CMD_TYPE_VIZ:
+		ret = _handle_command_viz(m, &cmd);
+		break;
+	case CMD_TYPE_CHANNELS:
+		ret = _handle_command_channels(m, &cmd);
+		break;
+	case CMD_TYPE_RESAMPLER:
+		ret = _handle_command_resampler(m, &cmd);
+		break;
+	case CMD_TYPE_RESCAN:
+		ret = _handle_command_rescan(m, &cmd);
+		break;
 	}
 
 	int set_footer = 0;
@@ -649,8 +967,280 @@ _handle_command_repeat(Moedance *m, Cmd *cmd)
 }
 
 
+static int
+_handle_command_crossfade(Moedance *m, Cmd *cmd)
+{
+	if (cmd->args_len == 0)
+		return -2;
+
+	char buffer[32];
+	SpaceTokenizer *const st = &cmd->args[0];
+	if (st->len >= LEN(buffer))
+		return -2;
+
+	int64_t val = 0;
+	cstr_copy_n(buffer, LEN(buffer), st->value, st->len);
+	if (cstr_to_int64(buffer, &val) < 0)
+		return -2;
+
+	if ((val < 0) || (val > CFG_CROSSFADE_MAX_S))
+		return -2;
+
+	m->crossfade_s = (int)val;
+	return 0;
+}
+
+
+static int
+_handle_command_eq(Moedance *m, Cmd *cmd)
+{
+	if (cmd->args_len == 0)
+		return -2;
+
+	char buffer[EQ_NAME_SIZE];
+	SpaceTokenizer *const st = &cmd->args[0];
+	if (st->len >= LEN(buffer))
+		return -2;
+
+	cstr_copy_n(buffer, LEN(buffer), st->value, st->len);
+	return _eq_preset_set(m, buffer);
+}
+
+
+static int
+_handle_command_bench(Moedance *m, Cmd *cmd)
+{
+	if (cmd->args_len == 0)
+		return -2;
+
+	char buffer[32];
+	SpaceTokenizer *const st = &cmd->args[0];
+	if (st->len >= LEN(buffer))
+		return -2;
+
+	cstr_copy_n(buffer, LEN(buffer), st->value, st->len);
+	tui_show_dialog(&m->tui, "Benchmarking...", TUI_DIALOG_TYPE_INFO);
+	if (bench_run(buffer) < 0)
+		return -2;
+
+	tui_show_dialog(&m->tui, "Done: see log file.", TUI_DIALOG_TYPE_INFO);
+	return 0;
+}
+
+
+/*
+ * ":filter <graph>", ":filter off"
+ */
+static int
+_handle_command_filter(Moedance *m, Cmd *cmd)
+{
+	if (cmd->args_len == 0)
+		return -2;
+
+	char buffer[FILTER_DESC_SIZE];
+	SpaceTokenizer *const st = &cmd->args[0];
+	if (st->len >= LEN(buffer))
+		return -2;
+
+	cstr_copy_n(buffer, LEN(buffer), st->value, st->len);
+	if (strcmp(buffer, "off") == 0)
+		buffer[0] = '\0';
+
+	player_set_filter(&m->player, buffer);
+	return 0;
+}
+
+
+/*
+ * ":stats", ":stats reset"
+ */
+static int
+_handle_command_stats(Moedance *m, Cmd *cmd)
+{
+	int reset = 0;
+	if (cmd->args_len > 0) {
+		if (strncmp(cmd->args[0].value, "reset", cmd->args[0].len) != 0)
+			return -2;
+
+		reset = 1;
+	}
+
+	player_stats_log(&m->player, reset);
+	tui_show_dialog(&m->tui, "Stats: see log file.", TUI_DIALOG_TYPE_INFO);
+	return 0;
+}
+
+
+/*
+ * ":speed 0.5" .. ":speed 2", ":speed" = 1.0
+ */
+static int
+_handle_command_speed(Moedance *m, Cmd *cmd)
+{
+	double val = 1.0;
+	if (cmd->args_len > 0) {
+		char buffer[32];
+		SpaceTokenizer *const st = &cmd->args[0];
+		if (st->len >= LEN(buffer))
+			return -2;
+
+		char *end;
+		cstr_copy_n(buffer, LEN(buffer), st->value, st->len);
+		errno = 0;
+		val = strtod(buffer, &end);
+		if ((errno != 0) || (end == buffer) || (*end != '\0'))
+			return -2;
+	}
+
+	if ((val < STRETCH_SPEED_MIN) || (val > STRETCH_SPEED_MAX))
+		return -2;
+
+	player_set_speed(&m->player, val);
+	return 0;
+}
+
+
+/*
+ * ":viz spectrum", ":viz meter", ":viz off"
+ */
+static int
+_handle_command_viz(Moedance *m, Cmd *cmd)
+{
+	if (cmd->args_len == 0)
+		return -2;
+
+	VizMode mode;
+	const SpaceTokenizer *const st = &cmd->args[0];
+	if (strncmp(st->value, "spectrum", st->len) == 0)
+		mode = VIZ_MODE_SPECTRUM;
+	else if (strncmp(st->value, "meter", st->len) == 0)
+		mode = VIZ_MODE_METER;
+	else if (strncmp(st->value, "off", st->len) == 0)
+		mode = VIZ_MODE_OFF;
+	else
+		return -2;
+
+	return _viz_set_mode(m, mode);
+}
+
+
+/*
+ * ":channels normal", ":channels mono", ":channels swap"
+ */
+static int
+_handle_command_channels(Moedance *m, Cmd *cmd)
+{
+	if (cmd->args_len == 0)
+		return -2;
+
+	PlayerChannelMode mode;
+	const SpaceTokenizer *const st = &cmd->args[0];
+	if (strncmp(st->value, "normal", st->len) == 0)
+		mode = PLAYER_CHANNEL_MODE_NORMAL;
+	else if (strncmp(st->value, "mono", st->len) == 0)
+		mode = PLAYER_CHANNEL_MODE_MONO;
+	else if (strncmp(st->value, "swap", st->len) == 0)
+		mode = PLAYER_CHANNEL_MODE_SWAP;
+	else
+		return -2;
+
+	player_set_channel_mode(&m->player, mode);
+	return 0;
+}
+
+
+/*
+ * ":resampler best", ":resampler swr 16 0.95", no argument: "default"
+ */
+static int
+_handle_command_resampler(Moedance *m, Cmd *cmd)
+{
+	char buffer[64] = "default";
+	if (cmd->args_len > 0) {
+		/* the arguments as typed: they all point into the query */
+		const SpaceTokenizer *const first = &cmd->args[0];
+		const SpaceTokenizer *const last = &cmd->args[cmd->args_len - 1];
+		const size_t len = (size_t)((last->value + last->len) - first->value);
+		if (len >= LEN(buffer))
+			return -2;
+
+		cstr_copy_n(buffer, LEN(buffer), first->value, len);
+	}
+
+	ResampleParams params;
+	if (resample_params_from_str(&params, buffer) < 0)
+		return -2;
+
+	player_set_resampler(&m->player, &params);
+	return 0;
+}
+
+
+/*
+ * ":rescan": the whole tree listed again in the background, everything carries on
+ * meanwhile; the new list comes in like a watch update, see _playlist_update()
+ */
+static int
+_handle_command_rescan(Moedance *m, Cmd *cmd)
+{
+	if (cmd->args_len > 0)
+		return -2;
+
+	if (playlist_rescan(&m->playlist) < 0) {
+		tui_show_dialog(&m->tui, "Busy, try again later.", TUI_DIALOG_TYPE_INFO);
+		return 0;
+	}
+
+	tui_show_dialog(&m->tui, "Rescanning...", TUI_DIALOG_TYPE_INFO);
+	return 0;
+}
+
+
+/*
+ * returns: -3: failed to load
+ */
+static int
+_eq_preset_set(Moedance *m, const char name[])
+{
+	char buffer[256];
+	Str path;
+	str_init(&path, buffer, sizeof(buffer));
+	if (file_config_path(&path, CFG_EQ_PRESETS_FILE) == NULL) {
+		log_err(errno, "moedance: _eq_preset_set: file_config_path");
+		return -3;
+	}
+
+	int len;
+	EqBand bands[EQ_BANDS_MAX];
+	if (eq_preset_load(path.cstr, name, bands, &len) < 0)
+		return -3;
+
+	if (player_set_eq(&m->player, bands, len) < 0)
+		return -3;
+
+	return 0;
+}
+
+
+/*
+ * returns: -3: failed to start
+ */
+static int
+_viz_set_mode(Moedance *m, VizMode mode)
+{
+	viz_set_bands(&m->viz, m->tui.width);
+	if (viz_set_mode(&m->viz, mode) < 0) {
+		tui_set_viz(&m->tui, 0);
+		return -3;
+	}
+
+	tui_set_viz(&m->tui, mode != VIZ_MODE_OFF);
+	return 0;
+}
+
+
 static void
-_player_play(Moedance *m)
+_player_play(Moedance *m, int fade_ms)
 {
 	const PlaylistItem *const item = tui_playlist_play(&m->tui);
 	if (item == NULL) {
@@ -658,12 +1248,13 @@ _player_play(Moedance *m)
 		return;
 	}
 
-	if (player_item_play(&m->player, item->file_path) < 0) {
+	if (player_item_play(&m->player, item->file_path, fade_ms) < 0) {
 		_player_error(m);
 		return;
 	}
 
 	SET(m->flags, _FLAG_STARTED);
+	_wave_load(m, item);
 }
 
 
@@ -686,12 +1277,13 @@ _player_toggle(Moedance *m)
 	}
 
 	if (ISSET(m->flags, _FLAG_STARTED) == 0) {
-		if (player_item_play(&m->player, item->file_path) < 0) {
+		if (player_item_play(&m->player, item->file_path, 0) < 0) {
 			_player_error(m);
 			return;
 		}
 
 		SET(m->flags, _FLAG_STARTED);
+		_wave_load(m, item);
 		return;
 	}
 
@@ -700,7 +1292,7 @@ _player_toggle(Moedance *m)
 
 
 static void
-_player_next(Moedance *m)
+_player_next(Moedance *m, int fade_ms)
 {
 	const PlaylistItem *const item = tui_playlist_next(&m->tui);
 	if (item == NULL) {
@@ -708,17 +1300,18 @@ _player_next(Moedance *m)
 		return;
 	}
 	
-	if (player_item_play(&m->player, item->file_path) < 0) {
+	if (player_item_play(&m->player, item->file_path, fade_ms) < 0) {
 		_player_error(m);
 		return;
 	}
 
 	SET(m->flags, _FLAG_STARTED);
+	_wave_load(m, item);
 }
 
 
 static void
-_player_prev(Moedance *m)
+_player_prev(Moedance *m, int fade_ms)
 {
 	const PlaylistItem *const item = tui_playlist_prev(&m->tui);
 	if (item == NULL) {
@@ -726,12 +1319,54 @@ _player_prev(Moedance *m)
 		return;
 	}
 
-	if (player_item_play(&m->player, item->file_path) < 0) {
+	if (player_item_play(&m->player, item->file_path, fade_ms) < 0) {
 		_player_error(m);
 		return;
 	}
 
 	SET(m->flags, _FLAG_STARTED);
+	_wave_load(m, item);
+}
+
+
+/*
+ * relative to the current position, past the end: the next item follows as usual
+ */
+static void
+_player_seek(Moedance *m, int64_t step_s)
+{
+	if (ISSET(m->flags, _FLAG_STARTED) == 0)
+		return;
+
+	int64_t pos = player_item_get_time(&m->player) + step_s;
+	if (pos < 0)
+		pos = 0;
+
+	if (player_item_seek(&m->player, pos) < 0)
+		return;
+
+	tui_set_duration(&m->tui, pos);
+}
+
+
+/*
+ * starts the next item 'crossfade_s' before the end of the current one
+ */
+static void
+_player_crossfade(Moedance *m)
+{
+	if ((m->crossfade_s <= 0) || (player_item_is_playing(&m->player) == 0))
+		return;
+
+	const PlaylistItem *const item = tui_playlist_get_playing(&m->tui);
+	if ((item == NULL) || (item->duration <= m->crossfade_s))
+		return;
+
+	const int64_t elapsed = player_item_get_time(&m->player);
+	if ((item->duration - elapsed) > m->crossfade_s)
+		return;
+
+	_player_next(m, m->crossfade_s * 1000);
 }
 
 
@@ -9,6 +9,9 @@
 #include "tui.h"
 #include "player.h"
 #include "playlist.h"
+#include "analysis.h"
+#include "viz.h"
+#include "wave.h"
 
 
 typedef struct moedance {
@@ -16,8 +19,13 @@ typedef struct moedance {
 	Tui           tui;
 	Player        player;
 	Playlist      playlist;
+	Analysis      analysis;
+	Viz           viz;
+	Wave          wave;
 	const char   *root_dir;
 	int64_t       sleep_s;
+	int64_t       load_update_ns;	/* the last redraw of the probed items */
+	int           crossfade_s;
 	mtx_t         mutex;
 } Moedance;
 
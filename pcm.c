@@ -0,0 +1,368 @@
+#include <assert.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "pcm.h"
+
+
+#define _ERR_MAX  (2.0f)	/* LSB, keeps the shaping loop stable while clipping */
+
+
+typedef struct pcm_spec {
+	const char *name;
+	size_t      size;		/* bytes per sample */
+	float       scale;
+	float       lo;
+	float       hi;
+} PcmSpec;
+
+
+static void   _encode(Pcm *p, uint8_t dst[], const float src[], size_t count);
+static void   _encode_shaped(Pcm *p, uint8_t dst[], const float src[], size_t count);
+static DspV4  _tpdf(Pcm *p);
+static DspV4  _clamp(DspV4 v, float lo, float hi);
+static DspV4i _round(DspV4 v);
+static void   _store(PcmFormat format, uint8_t dst[], DspV4i q, int len);
+static void   _store_s24(uint8_t dst[], int32_t val);
+static float  _load_s24(const uint8_t src[]);
+static void   _scale(PcmFormat format, uint8_t sample[], double gain);
+
+
+static const PcmSpec _specs[PCM_FORMAT_END] = {
+	[PCM_FORMAT_F32] = { "f32", 4, 1.0f, -1.0f, 1.0f },
+	/* hi: the largest float below 2^31 */
+	[PCM_FORMAT_S32] = { "s32", 4, 2147483648.0f, -2147483648.0f, 2147483520.0f },
+	[PCM_FORMAT_S24] = { "s24", 3, 8388608.0f, -8388608.0f, 8388607.0f },
+	[PCM_FORMAT_S16] = { "s16", 2, 32768.0f, -32768.0f, 32767.0f },
+};
+
+/* error feedback, Wannamaker's 3 tap "minimally audible" filter for 44.1 kHz */
+static const float _shape[PCM_SHAPE_TAPS] = { 1.623f, -0.982f, 0.109f };
+
+
+/*
+ * public
+ */
+int
+pcm_format_from_str(const char str[])
+{
+	for (int i = 0; i < PCM_FORMAT_END; i++) {
+		if (strcmp(_specs[i].name, str) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+
+const char *
+pcm_format_str(PcmFormat format)
+{
+	assert((unsigned)format < PCM_FORMAT_END);
+	return _specs[format].name;
+}
+
+
+size_t
+pcm_format_size(PcmFormat format)
+{
+	assert((unsigned)format < PCM_FORMAT_END);
+	return _specs[format].size;
+}
+
+
+void
+pcm_init(Pcm *p, PcmFormat format, PcmDither dither, unsigned channels)
+{
+	assert((unsigned)format < PCM_FORMAT_END);
+	assert(((channels % 2) == 0) && (channels <= DSP_CHANNELS_MAX));
+	p->format = format;
+	p->channels = channels;
+	p->dither = ((format == PCM_FORMAT_S24) || (format == PCM_FORMAT_S16))? dither : PCM_DITHER_NONE;
+	p->seed = (DspV4u) { 0x9e3779b9u, 0x7f4a7c15u, 0x85ebca6bu, 0xc2b2ae35u };
+	memset(p->err, 0, sizeof(p->err));
+}
+
+
+/*
+ * count: frames
+ */
+void
+pcm_encode(Pcm *p, void *dst, const float src[], size_t count)
+{
+	switch (p->dither) {
+	case PCM_DITHER_SHAPED:
+		_encode_shaped(p, dst, src, count);
+		break;
+	default:
+		if (p->format == PCM_FORMAT_F32)
+			memcpy(dst, src, count * p->channels * sizeof(float));
+		else
+			_encode(p, dst, src, count);
+		break;
+	}
+}
+
+
+/*
+ * count: frames
+ */
+void
+pcm_decode(PcmFormat format, unsigned channels, float dst[], const void *src, size_t count)
+{
+	const uint8_t *const s = (const uint8_t *)src;
+	const size_t len = count * channels;
+	const float scale = 1.0f / _specs[format].scale;
+	switch (format) {
+	case PCM_FORMAT_F32:
+		memcpy(dst, src, len * sizeof(float));
+		break;
+	case PCM_FORMAT_S32:
+		for (size_t i = 0; i < len; i++) {
+			int32_t val;
+			memcpy(&val, &s[i * sizeof(val)], sizeof(val));
+			dst[i] = (float)val * scale;
+		}
+		break;
+	case PCM_FORMAT_S24:
+		for (size_t i = 0; i < len; i++)
+			dst[i] = _load_s24(&s[i * 3]) * scale;
+		break;
+	case PCM_FORMAT_S16:
+		for (size_t i = 0; i < len; i++) {
+			int16_t val;
+			memcpy(&val, &s[i * sizeof(val)], sizeof(val));
+			dst[i] = (float)val * scale;
+		}
+		break;
+	default:
+		assert(0);
+	}
+}
+
+
+/*
+ * linear, from 1.0 down to the last frame, in place, no dither: 'count' is a few ms
+ */
+void
+pcm_fade_out(PcmFormat format, unsigned channels, void *frames, size_t count)
+{
+	assert((unsigned)format < PCM_FORMAT_END);
+	uint8_t *const f = (uint8_t *)frames;
+	const size_t size = _specs[format].size;
+	for (size_t i = 0; i < count; i++) {
+		const double gain = (double)(count - i - 1) / (double)count;
+		for (unsigned j = 0; j < channels; j++)
+			_scale(format, &f[((i * channels) + j) * size], gain);
+	}
+}
+
+
+/*
+ * private
+ */
+static void
+_encode(Pcm *p, uint8_t dst[], const float src[], size_t count)
+{
+	const PcmSpec *const spec = &_specs[p->format];
+	const int is_dither = (p->dither != PCM_DITHER_NONE);
+	const size_t len = count * p->channels;
+	size_t i = 0;
+	for (; (i + 4) <= len; i += 4) {
+		DspV4 x;
+		memcpy(&x, &src[i], sizeof(x));
+
+		x *= spec->scale;
+		if (is_dither)
+			x += _tpdf(p);
+
+		_store(p->format, &dst[i * spec->size], _round(_clamp(x, spec->lo, spec->hi)), 4);
+	}
+
+	if (i == len)
+		return;
+
+	DspV4 x = { 0.0f };
+	memcpy(&x, &src[i], (len - i) * sizeof(float));
+
+	x *= spec->scale;
+	if (is_dither)
+		x += _tpdf(p);
+
+	_store(p->format, &dst[i * spec->size], _round(_clamp(x, spec->lo, spec->hi)), (int)(len - i));
+}
+
+
+/*
+ * one frame at a time: each sample depends on the errors of the previous ones
+ */
+static void
+_encode_shaped(Pcm *p, uint8_t dst[], const float src[], size_t count)
+{
+	const PcmSpec *const spec = &_specs[p->format];
+	const unsigned ch = p->channels;
+	for (size_t i = 0; i < count; i++) {
+		for (unsigned j = 0; j < (ch / 2); j++) {
+			const size_t offt = (i * ch) + (j * 2);
+			DspV2 *const e = p->err[j];
+			DspV2 x;
+			memcpy(&x, &src[offt], sizeof(x));
+
+			const DspV2 v = (x * spec->scale) -
+					((e[0] * _shape[0]) + (e[1] * _shape[1]) + (e[2] * _shape[2]));
+
+			/* lanes 2, 3: unused */
+			const DspV4 w = { v[0], v[1], 0.0f, 0.0f };
+			const DspV4i q = _round(_clamp(w + _tpdf(p), spec->lo, spec->hi));
+			const DspV4 err = _clamp(__builtin_convertvector(q, DspV4) - w, -_ERR_MAX, _ERR_MAX);
+
+			e[2] = e[1];
+			e[1] = e[0];
+			e[0] = (DspV2) { err[0], err[1] };
+			_store(p->format, &dst[offt * spec->size], q, 2);
+		}
+	}
+}
+
+
+/*
+ * xorshift32 per lane, the difference of both 16 bit halves: triangular in (-1, 1)
+ */
+static DspV4
+_tpdf(Pcm *p)
+{
+	DspV4u s = p->seed;
+	s ^= s << 13;
+	s ^= s >> 17;
+	s ^= s << 5;
+	p->seed = s;
+
+	const DspV4i a = (DspV4i)(s & 0xffffu);
+	const DspV4i b = (DspV4i)(s >> 16);
+	return __builtin_convertvector(a - b, DspV4) * (1.0f / 65536.0f);
+}
+
+
+/*
+ * masks and bit casts: no vector ternary in C
+ */
+static DspV4
+_clamp(DspV4 v, float lo, float hi)
+{
+	const DspV4 vlo = { lo, lo, lo, lo };
+	const DspV4 vhi = { hi, hi, hi, hi };
+	const DspV4i over = (v > vhi);
+	const DspV4i under = (v < vlo);
+
+	DspV4i ret = (DspV4i)v;
+	ret = (ret & ~over) | ((DspV4i)vhi & over);
+	ret = (ret & ~under) | ((DspV4i)vlo & under);
+	return (DspV4)ret;
+}
+
+
+/*
+ * to nearest, halves away from zero: the conversion alone truncates
+ */
+static DspV4i
+_round(DspV4 v)
+{
+	const DspV4 half = { 0.5f, 0.5f, 0.5f, 0.5f };
+	DspV4i ret = __builtin_convertvector(v, DspV4i);
+	const DspV4 rem = v - __builtin_convertvector(ret, DspV4);
+
+	/* masks are -1 */
+	ret -= (rem >= half);
+	ret += (rem <= -half);
+	return ret;
+}
+
+
+static void
+_store(PcmFormat format, uint8_t dst[], DspV4i q, int len)
+{
+	switch (format) {
+	case PCM_FORMAT_S32:
+		memcpy(dst, &q, (size_t)len * sizeof(int32_t));
+		break;
+	case PCM_FORMAT_S24:
+		for (int i = 0; i < len; i++)
+			_store_s24(&dst[i * 3], q[i]);
+		break;
+	case PCM_FORMAT_S16:
+		for (int i = 0; i < len; i++) {
+			const int16_t val = (int16_t)q[i];
+			memcpy(&dst[i * (int)sizeof(val)], &val, sizeof(val));
+		}
+		break;
+	default:
+		assert(0);
+	}
+}
+
+
+/*
+ * native byte order, like paInt24
+ */
+static void
+_store_s24(uint8_t dst[], int32_t val)
+{
+	const uint32_t u = (uint32_t)val;
+#if (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	dst[0] = (uint8_t)(u >> 16);
+	dst[1] = (uint8_t)(u >> 8);
+	dst[2] = (uint8_t)u;
+#else
+	dst[0] = (uint8_t)u;
+	dst[1] = (uint8_t)(u >> 8);
+	dst[2] = (uint8_t)(u >> 16);
+#endif
+}
+
+
+static float
+_load_s24(const uint8_t src[])
+{
+#if (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+	const uint32_t u = ((uint32_t)src[0] << 16) | ((uint32_t)src[1] << 8) | src[2];
+#else
+	const uint32_t u = ((uint32_t)src[2] << 16) | ((uint32_t)src[1] << 8) | src[0];
+#endif
+	/* sign extension */
+	return (float)((int32_t)(u ^ 0x800000u) - 0x800000);
+}
+
+
+static void
+_scale(PcmFormat format, uint8_t sample[], double gain)
+{
+	switch (format) {
+	case PCM_FORMAT_F32: {
+		float val;
+		memcpy(&val, sample, sizeof(val));
+		val = (float)((double)val * gain);
+		memcpy(sample, &val, sizeof(val));
+		break;
+	}
+	case PCM_FORMAT_S32: {
+		int32_t val;
+		memcpy(&val, sample, sizeof(val));
+		val = (int32_t)lrint((double)val * gain);
+		memcpy(sample, &val, sizeof(val));
+		break;
+	}
+	case PCM_FORMAT_S24:
+		_store_s24(sample, (int32_t)lrint((double)_load_s24(sample) * gain));
+		break;
+	case PCM_FORMAT_S16: {
+		int16_t val;
+		memcpy(&val, sample, sizeof(val));
+		val = (int16_t)lrint((double)val * gain);
+		memcpy(sample, &val, sizeof(val));
+		break;
+	}
+	default:
+		assert(0);
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef __PCM_H__
+#define __PCM_H__
+
+
+#include <stddef.h>
+
+#include "dsp.h"
+
+
+#define PCM_SHAPE_TAPS (3)
+
+
+typedef enum pcm_format {
+	PCM_FORMAT_F32,
+	PCM_FORMAT_S32,
+	PCM_FORMAT_S24,		/* packed, 3 bytes */
+	PCM_FORMAT_S16,
+
+	PCM_FORMAT_END,
+} PcmFormat;
+
+typedef enum pcm_dither {
+	PCM_DITHER_NONE,
+	PCM_DITHER_TPDF,
+	PCM_DITHER_SHAPED,	/* TPDF + error feedback noise shaping */
+
+	PCM_DITHER_END,
+} PcmDither;
+
+/*
+ * Pcm: interleaved float -> device sample format
+ *
+ * Dither only applies where the depth is actually reduced: s24 and s16, float has a
+ * 24 bit mantissa. Without noise shaping 2 frames go through one DspV4 at a time,
+ * the shaping filter needs the previous error, so it runs one frame at a time, one
+ * DspV2 per channel pair.
+ */
+typedef struct pcm {
+	PcmFormat format;
+	PcmDither dither;
+	unsigned  channels;
+	DspV4u    seed;
+	DspV2     err[DSP_CHANNELS_MAX / 2][PCM_SHAPE_TAPS];	/* newest first, lane: channel */
+} Pcm;
+
+
+int         pcm_format_from_str(const char str[]);
+const char *pcm_format_str(PcmFormat format);
+size_t      pcm_format_size(PcmFormat format);
+
+void pcm_init(Pcm *p, PcmFormat format, PcmDither dither, unsigned channels);
+void pcm_encode(Pcm *p, void *dst, const float src[], size_t count);
+void pcm_fade_out(PcmFormat format, unsigned channels, void *frames, size_t count);
+void pcm_decode(PcmFormat format, unsigned channels, float dst[], const void *src, size_t count);
+
+
+#endif
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,113 +10,381 @@
 #include <threads.h>
 
 #include "player.h"
+#include "dsp.h"
 #include "util.h"
+#include "config.h"
 
 
-#define _AUDIO_CHANNELS_COUNT		(2)
-#define _AUDIO_SAMPLE_FORMAT		paFloat32
-#define _AUDIO_SAMPLE_RATE		(44100)
-#define _AUDIO_FRAME_BUFFER_SIZE	(4096)
-#define _AUDIO_WAIT_TIME_MS		(100)
-#define _FILE_SAMPLE_RATE		_AUDIO_SAMPLE_RATE
+#define _AUDIO_SAMPLE_RATE		PLAYER_SAMPLE_RATE
+#define _AUDIO_BUFFER_MS		CFG_AUDIO_BUFFER_MS
+#define _AUDIO_WAIT_TIME_MS		(20)
+#define _DECODE_RETRIES			(32)	/* damaged packets in a row before the track is given up */
+#define _CONCEAL_MAX_MS			(1000)	/* per gap: a broken duration field is not trusted */
 #define _FILE_SAMPLE_FORMAT		AV_SAMPLE_FMT_FLT
 #define _SWR_BUFFER_SIZE		(1024 * 1024)
-#define _RING_BUFFER_SIZE		(1024 * 32)
-#define _RING_BUFFER_ELEM_SIZE		(_AUDIO_CHANNELS_COUNT * sizeof(float))
+#define _RING_BUFFER_MS			(740)
+#define _RING_BUFFER_ELEM_SIZE(ch)	((size_t)(ch) * sizeof(float))
+#define _RING_BUFFER_FILL_MS		(280)
+#define _CONTEXT_BUFFER_MS		(370)
+#define _MIXER_FRAMES			(1024)
+#define _MIXER_WAIT_TIME_MS		(5)
+#define _CLOSE_FADE_MS			(5)
+#define _CLOSE_TIMEOUT_MS		(_AUDIO_BUFFER_MS + 20)	/* one period and a margin, the stream is aborted then */
+#define _TAP_MS				(370)
+#define _TAP_CHUNK			(256)
+#define _PI				(3.14159265358979323846)
+#define _MS_FRAMES(rate, ms)		(((size_t)(rate) * (size_t)(ms)) / 1000)
+#define _MIX_BUFFER_SIZE(ch, fs)	((_RING_BUFFER_ELEM_SIZE(ch) * _MIXER_FRAMES * 2) + ((fs) * _MIXER_FRAMES))
+
+/* the rings are sized for it, in time: the same latency at every rate */
+#if (CFG_HIRES_ENABLE == 1)
+#define _RATE_MAX			CFG_HIRES_RATE_MAX
+#else
+#define _RATE_MAX			_AUDIO_SAMPLE_RATE
+#endif
 
 
 /*
  * PlayerContext
  */
-static int  _context_init(PlayerContext *c, uint8_t swr_buffer[], PaUtilRingBuffer *buffer);
-static int  _context_av_init(PlayerContext *c);
-static int  _context_swr_init(PlayerContext *c);
-static void _context_deinit(PlayerContext *c);
-static void _context_writer(PlayerContext *p);
+static int      _context_alloc(PlayerContext *c, Player *p);
+static void     _context_free(PlayerContext *c);
+static int      _context_init(PlayerContext *c);
+static void     _context_rate_init(PlayerContext *c);
+static unsigned _context_rate(PlayerContext *c);
+static int      _context_av_init(PlayerContext *c);
+static int      _context_interrupt(void *udata);
+static int      _context_swr_init(PlayerContext *c);
+static void     _context_swr_matrix(SwrContext *swr, int in, unsigned out);
+static void     _context_deinit(PlayerContext *c);
+static int      _context_writer(PlayerContext *c);
+static int      _context_error(PlayerContext *c, const char what[], int err);
+static int      _context_conceal(PlayerContext *c, size_t count);
+static int      _context_filter(PlayerContext *c, AVFrame *frame);
+static int      _context_convert(PlayerContext *c, const AVFrame *frame);
+static void     _context_wait(PlayerContext *c);
+static void     _context_seek(PlayerContext *c);
+static int      _context_start(PlayerContext *c, const char file[], int64_t start_s);
+static void     _context_cancel(PlayerContext *c);
+static void     _context_stop(PlayerContext *c);
+static int      _context_is_done(PlayerContext *c);
 
 
 /*
  * Player
  */
-static int  _open_device(Player *p);
-static void _close_device(Player *p);
-static int  _stream_cb(const void *input, void *output, unsigned long count,
-		       const PaStreamCallbackTimeInfo *time_info,
-		       PaStreamCallbackFlags flags, void *udata);
-static int  _file_reader_thrd(void *udata);
+static int    _open_device(Player *p);
+static int    _channels_pick(int max);
+static void   _probe_rates(Player *p);
+static void   _stream_params(const Player *p, PaStreamParameters *param);
+static int    _start_device(Player *p);
+static void   _stop_device(Player *p, int is_abort);
+static void   _close_device(Player *p);
+static void   _buffers_lock(Player *p, int lock);
+static int    _rate_switch(Player *p, unsigned rate);
+static int    _rate_index(unsigned rate);
+static size_t _ring_frames(int ms);
+static void   _channel_mode_process(void *udata, float frames[], size_t count);
+static int    _stream_cb(const void *input, void *output, unsigned long count,
+			 const PaStreamCallbackTimeInfo *time_info,
+			 PaStreamCallbackFlags flags, void *udata);
+static int    _null_thrd(void *udata);
+static int    _closer_thrd(void *udata);
+static int    _file_reader_thrd(void *udata);
+static int    _mixer_thrd(void *udata);
+static size_t _mixer_run(Player *p);
+static int    _mixer_rate(Player *p, PlayerContext *in, PlayerContext *out, size_t queued);
+static void   _mixer_rate_switch(Player *p, PlayerContext *in, unsigned rate);
+static size_t _mixer_fade(Player *p, PlayerContext *in, PlayerContext *out, size_t count);
+static size_t _mixer_read(Player *p, PlayerContext *c, float dst[], size_t count);
+static void   _clock_push(Player *p, PlayerContext *c);
+
+
+/* probed in this order, the device gets the source rate when it is in here */
+static const unsigned _rates[] = { 44100, 48000, 88200, 96000, 176400, 192000, 352800, 384000 };
+
+static const PaSampleFormat _pa_formats[PCM_FORMAT_END] = {
+	[PCM_FORMAT_F32] = paFloat32,
+	[PCM_FORMAT_S32] = paInt32,
+	[PCM_FORMAT_S24] = paInt24,
+	[PCM_FORMAT_S16] = paInt16,
+};
+
+/* see CFG_DOWNMIX_MATRIX_IN */
+static const double _downmix_matrix[] = CFG_DOWNMIX_MATRIX;
 
 
 /*
  * Public
  */
+/*
+ * output: PLAYER_OUTPUT_NULL plays to nowhere at the device pace, for measurements
+ */
 int
-player_init(Player *p)
+player_init(Player *p, PlayerOutput output)
 {
 	memset(p, 0, sizeof(*p));
 	atomic_store(&p->is_paused, 1);
-	atomic_store(&p->context.is_active, 0);
-	atomic_store(&p->context.is_stopped, 1);
+	atomic_store(&p->is_alive, 1);
+	atomic_store(&p->is_flushing, 0);
+	atomic_store(&p->is_closing, 0);
+	atomic_store(&p->is_faded, 0);
+	atomic_store(&p->null_alive, 0);
+	atomic_store(&p->speed, 1000);
+	atomic_store(&p->tap_enabled, 0);
+	atomic_store(&p->channel_mode, CFG_CHANNEL_MODE);
+	atomic_store(&p->frames_played, 0);
+	atomic_store(&p->frames_written, 0);
+	atomic_store(&p->rates, 0);
+	p->output = output;
+	p->rate = _AUDIO_SAMPLE_RATE;
+	p->fill = _MS_FRAMES(p->rate, _RING_BUFFER_FILL_MS);
+	stats_init(&p->stats);
+
+	if (mtx_init(&p->mutex, mtx_plain) != thrd_success) {
+		log_err(0, "player: player_init: mtx_init: failed");
+		return -1;
+	}
+
+	if (filter_desc_init(&p->filter_desc) < 0) {
+		mtx_destroy(&p->mutex);
+		return -1;
+	}
+
+	ResampleParams resample;
+	if (resample_params_from_str(&resample, CFG_RESAMPLER) < 0) {
+		log_err(0, "player: player_init: invalid resampler: \"%s\", using default", CFG_RESAMPLER);
+		resample_params_from_str(&resample, "default");
+	}
+
+	if (resample_desc_init(&p->resample_desc, &resample) < 0) {
+		filter_desc_deinit(&p->filter_desc);
+		mtx_destroy(&p->mutex);
+		return -1;
+	}
+
+	/* the channel count sizes everything below */
+	if (_open_device(p) < 0)
+		goto err0;
+
+	int format = pcm_format_from_str(CFG_OUTPUT_FORMAT);
+	if (format < 0) {
+		log_err(0, "player: player_init: invalid output format: \"%s\", using f32", CFG_OUTPUT_FORMAT);
+		format = PCM_FORMAT_F32;
+	}
 
-	uint8_t *const buffer = malloc(_RING_BUFFER_ELEM_SIZE * _RING_BUFFER_SIZE);
+	pcm_init(&p->pcm, (PcmFormat)format, (PcmDither)CFG_OUTPUT_DITHER, p->channels);
+	p->frame_size = pcm_format_size(p->pcm.format) * p->channels;
+	_probe_rates(p);
+
+	const size_t ring_size = _ring_frames(_RING_BUFFER_MS);
+	uint8_t *const buffer = malloc(p->frame_size * ring_size);
 	if (buffer == NULL) {
 		log_err(errno, "player: player_init: malloc: ring buffer");
-		return -1;
+		goto err1;
 	}
-	
-	long ret = PaUtil_InitializeRingBuffer(&p->buffer, _RING_BUFFER_ELEM_SIZE,
-					       _RING_BUFFER_SIZE, buffer);
+
+	long ret = PaUtil_InitializeRingBuffer(&p->buffer, (ring_buffer_size_t)p->frame_size,
+					       (ring_buffer_size_t)ring_size, buffer);
 	if (ret < 0) {
 		log_err(0, "player: player_init: PaUtil_InitializeRingBuffer: invalid buffer size");
-		goto err0;
+		goto err2;
 	}
-	
-	uint8_t *const swr_buffer = malloc(_SWR_BUFFER_SIZE);
-	if (swr_buffer == NULL) {
-		log_err(errno, "player: player_init: malloc: swr buffer");
-		goto err0;
+
+	/* in + out, then the device format */
+	p->mix_buffer = malloc(_MIX_BUFFER_SIZE(p->channels, p->frame_size));
+	if (p->mix_buffer == NULL) {
+		log_err(errno, "player: player_init: malloc: mix buffer");
+		goto err2;
+	}
+
+	p->out_buffer = (uint8_t *)(p->mix_buffer + (_MIXER_FRAMES * p->channels * 2));
+
+	const size_t tap_size = _ring_frames(_TAP_MS);
+	uint8_t *const tap = malloc(p->frame_size * tap_size);
+	if (tap == NULL) {
+		log_err(errno, "player: player_init: malloc: tap");
+		goto err3;
 	}
 
-	ret = _open_device(p);
+	ret = PaUtil_InitializeRingBuffer(&p->tap, (ring_buffer_size_t)p->frame_size,
+					  (ring_buffer_size_t)tap_size, tap);
+	if (ret < 0) {
+		log_err(0, "player: player_init: PaUtil_InitializeRingBuffer: tap: invalid buffer size");
+		goto err4;
+	}
+
+	if (_context_alloc(&p->contexts[0], p) < 0)
+		goto err4;
+
+	if (_context_alloc(&p->contexts[1], p) < 0)
+		goto err5;
+
+	if (eq_init(&p->eq, p->rate, p->channels, _MIXER_FRAMES) < 0)
+		goto err6;
+
+	dsp_chain_init(&p->chain);
+	if (dsp_chain_append(&p->chain, eq_process, &p->eq) < 0)
+		goto err7;
+
+	if (dsp_chain_append(&p->chain, _channel_mode_process, p) < 0)
+		goto err7;
+
+	if (limiter_init(&p->limiter, p->rate, p->channels, CFG_LIMITER_CEILING_DB,
+			 CFG_LIMITER_LOOKAHEAD_MS, CFG_LIMITER_RELEASE_MS, &p->stats) < 0)
+		goto err7;
+
+	/* last: nothing may push the output over the ceiling again */
+#if (CFG_LIMITER_ENABLE == 1)
+	if (dsp_chain_append(&p->chain, limiter_process, &p->limiter) < 0)
+		goto err8;
+
+	p->latency = limiter_latency(&p->limiter);
+#endif
+
+	if (CFG_RT_ENABLE == 1)
+		_buffers_lock(p, 1);
+
+	ret = _start_device(p);
 	if (ret < 0)
-		goto err1;
+		goto err8;
+
+	if (thrd_create(&p->mixer, _mixer_thrd, p) != thrd_success) {
+		log_err(0, "player: player_init: thrd_create: mixer");
+		goto err9;
+	}
 
-	p->swr_buffer = swr_buffer;
 	return 0;
 
+err9:
+	_stop_device(p, 1);
+err8:
+	limiter_deinit(&p->limiter);
+err7:
+	eq_deinit(&p->eq);
+err6:
+	_context_free(&p->contexts[1]);
+err5:
+	_context_free(&p->contexts[0]);
+err4:
+	free(tap);
+err3:
+	free(p->mix_buffer);
+err2:
+	free(buffer);
 err1:
-	free(swr_buffer);
+	_close_device(p);
 err0:
-	free(buffer);
+	resample_desc_deinit(&p->resample_desc);
+	filter_desc_deinit(&p->filter_desc);
+	mtx_destroy(&p->mutex);
 	return -1;
 }
 
 
+/*
+ * non-blocking: the decoders are told to stop, what the device plays next fades out
+ * within _CLOSE_FADE_MS and the stream is stopped by a thread of its own, so the
+ * caller can tear down everything else meanwhile; player_deinit() waits for it
+ */
+void
+player_close(Player *p)
+{
+	if (atomic_exchange(&p->is_closing, 1))
+		return;
+
+	_context_cancel(&p->contexts[0]);
+	_context_cancel(&p->contexts[1]);
+	atomic_store(&p->is_alive, 0);
+
+	if (thrd_create(&p->closer, _closer_thrd, p) != thrd_success) {
+		log_err(0, "player: player_close: thrd_create: closing in place");
+		_closer_thrd(p);
+		return;
+	}
+
+	p->has_closer = 1;
+}
+
+
 void
 player_deinit(Player *p)
 {
-	atomic_store(&p->is_paused, 1);
-	Pa_StopStream(p->stream);
-	Pa_CloseStream(p->stream);
+	player_close(p);
+	if (p->has_closer) {
+		thrd_join(p->closer, NULL);
+		p->has_closer = 0;
+	}
 
+	_context_stop(&p->contexts[0]);
+	_context_stop(&p->contexts[1]);
 	_close_device(p);
+	if (CFG_RT_ENABLE == 1)
+		_buffers_lock(p, 0);
+	_context_free(&p->contexts[0]);
+	_context_free(&p->contexts[1]);
+	eq_deinit(&p->eq);
+	limiter_deinit(&p->limiter);
 	free(p->buffer.buffer);
-	free(p->swr_buffer);
+	free(p->tap.buffer);
+	free(p->mix_buffer);
+	resample_desc_deinit(&p->resample_desc);
+	filter_desc_deinit(&p->filter_desc);
+	mtx_destroy(&p->mutex);
 }
 
 
+/*
+ * fade_ms: crossfade the current item out while 'file' fades in; 0: cut
+ */
 int
-player_item_play(Player *p, const char file[])
+player_item_play(Player *p, const char file[], int fade_ms)
 {
-	PlayerContext *const c = &p->context;
-	if (atomic_load(&c->is_stopped) == 0)
-		player_item_stop(p);
+	/* only this thread writes 'current' */
+	const int curr = p->current;
+	PlayerContext *const c_curr = &p->contexts[curr];
+	PlayerContext *const c_next = &p->contexts[curr ^ 1];
+
+	/* the next slot may still be fading out: drop it */
+	_context_stop(c_next);
+
+	mtx_lock(&p->mutex); /* LOCK */
+	p->fade_len = 0;
+	PaUtil_FlushRingBuffer(&c_next->buffer);
+	stretch_reset(&c_next->stretch);
+	c_next->frames_src = 0.0;
+	c_next->is_refused = 0;
+	atomic_store(&c_next->rate, 0);
+	mtx_unlock(&p->mutex); /* UNLOCK */
+
+	const int is_playing = player_item_is_playing(p);
+	if ((fade_ms <= 0) || (is_playing == 0)) {
+		const int is_done = _context_is_done(c_curr);
+		_context_stop(c_curr);
+
+		mtx_lock(&p->mutex); /* LOCK */
+		PaUtil_FlushRingBuffer(&c_curr->buffer);
+		stretch_reset(&c_curr->stretch);
+
+		/* cut: whatever is still queued belongs to the old item */
+		if (is_done == 0)
+			atomic_store(&p->is_flushing, 1);
+
+		mtx_unlock(&p->mutex); /* UNLOCK */
+		fade_ms = 0;
+	}
 
-	c->file = file;
-	if (thrd_create(&c->thrd, _file_reader_thrd, p) != thrd_success) {
-		log_err(0, "player: player_item_play: thrd_create: failed");
+	if (_context_start(c_next, file, 0) < 0)
 		return -1;
-	}
 
+	mtx_lock(&p->mutex); /* LOCK */
+	p->current = curr ^ 1;
+	p->item_gen++;
+	p->fade_pos = 0;
+	p->fade_len = _MS_FRAMES(p->rate, fade_ms);
+	mtx_unlock(&p->mutex); /* UNLOCK */
+
+	atomic_store(&p->is_paused, 0);
 	return 0;
 }
 
@@ -123,19 +392,24 @@ player_item_play(Player *p, const char file[])
 void
 player_item_stop(Player *p)
 {
-	PlayerContext *const c = &p->context;
-	if (atomic_load(&c->is_active) == 0)
-		return;
-
-	atomic_store(&c->is_active, 0);
-	thrd_join(c->thrd, NULL);
+	_context_stop(&p->contexts[0]);
+	_context_stop(&p->contexts[1]);
+
+	mtx_lock(&p->mutex); /* LOCK */
+	p->fade_len = 0;
+	PaUtil_FlushRingBuffer(&p->contexts[0].buffer);
+	PaUtil_FlushRingBuffer(&p->contexts[1].buffer);
+	stretch_reset(&p->contexts[0].stretch);
+	stretch_reset(&p->contexts[1].stretch);
+	atomic_store(&p->is_flushing, 1);
+	mtx_unlock(&p->mutex); /* UNLOCK */
 }
 
 
 void
 player_item_toggle(Player *p)
 {
-	if (atomic_load(&p->context.is_active) == 0) {
+	if (player_item_is_stopped(p)) {
 		atomic_store(&p->is_paused, 1);
 		return;
 	}
@@ -147,11 +421,83 @@ player_item_toggle(Player *p)
 }
 
 
+/*
+ * pos_s: from the start of the current item; its decoder restarts there and whatever
+ * is queued is dropped, a crossfade in progress is cut
+ */
+int
+player_item_seek(Player *p, int64_t pos_s)
+{
+	const int curr = p->current;
+	PlayerContext *const c = &p->contexts[curr];
+	PlayerContext *const c_out = &p->contexts[curr ^ 1];
+	if ((c->file == NULL) || _context_is_done(c))
+		return -1;
+
+	if (pos_s < 0)
+		pos_s = 0;
+
+	_context_stop(c_out);
+	_context_stop(c);
+
+	mtx_lock(&p->mutex); /* LOCK */
+	p->fade_len = 0;
+	PaUtil_FlushRingBuffer(&c_out->buffer);
+	PaUtil_FlushRingBuffer(&c->buffer);
+	stretch_reset(&c_out->stretch);
+	stretch_reset(&c->stretch);
+	atomic_store(&p->is_flushing, 1);
+
+	/* the clock restarts at the target once the flush went through */
+	p->item_gen++;
+	c->frames_src = (double)(pos_s * (int64_t)_context_rate(c));
+	c->is_refused = 0;
+	atomic_store(&c->frames_total, (size_t)c->frames_src);
+	_clock_push(p, c);
+	mtx_unlock(&p->mutex); /* UNLOCK */
+
+	return _context_start(c, c->file, pos_s);
+}
+
+
+/*
+ * in source time: what the device played, mapped back through the clock marks the
+ * mixer left behind, so speed changes and crossfades still add up
+ */
 int64_t
 player_item_get_time(Player *p)
 {
-	const size_t frm = atomic_load(&p->context.frames_total);
-	return (int64_t)((double)(frm / _AUDIO_SAMPLE_RATE));
+	const size_t played = atomic_load(&p->frames_played);
+	size_t frm = 0;
+
+	mtx_lock(&p->mutex); /* LOCK */
+
+	const unsigned gen = p->item_gen;
+	const unsigned len = (p->clock_head < PLAYER_CLOCK_MARKS)? p->clock_head : PLAYER_CLOCK_MARKS;
+	const PlayerClockMark *next = NULL;
+	for (unsigned i = 0; i < len; i++) {
+		const PlayerClockMark *const m = &p->clock[(p->clock_head - 1 - i) % PLAYER_CLOCK_MARKS];
+		if (m->out_end > played) {
+			next = m;
+			continue;
+		}
+
+		const size_t base = (m->gen == gen)? m->src_end : 0;
+		if (next == NULL) {
+			frm = base;
+		} else if (next->gen == gen) {
+			/* somewhere inside the next block */
+			const double ratio = (double)(next->src_end - base) / (double)(next->out_end - m->out_end);
+			frm = base + (size_t)((double)(played - m->out_end) * ratio);
+		}
+
+		break;
+	}
+
+	/* source frames, at the rate the decoder hands them over */
+	const unsigned rate = _context_rate(&p->contexts[p->current]);
+	mtx_unlock(&p->mutex); /* UNLOCK */
+	return (int64_t)(frm / rate);
 }
 
 
@@ -159,14 +505,166 @@ int
 player_item_is_playing(Player *p)
 {
 	return ((atomic_load(&p->is_paused) == 0) &&
-		(atomic_load(&p->context.is_stopped) == 0));
+		(player_item_is_stopped(p) == 0));
 }
 
 
 int
 player_item_is_stopped(Player *p)
 {
-	return atomic_load(&p->context.is_stopped);
+	return _context_is_done(&p->contexts[p->current]);
+}
+
+
+/*
+ * lock-free, takes effect on the next mixed block
+ */
+int
+player_set_eq(Player *p, const EqBand bands[], int len)
+{
+	return eq_set(&p->eq, bands, len);
+}
+
+
+/*
+ * desc: avfilter graph, "" = none; picked up by the decoders on their next frame
+ */
+void
+player_set_filter(Player *p, const char desc[])
+{
+	filter_desc_set(&p->filter_desc, desc);
+}
+
+
+/*
+ * picked up by the decoders on their next frame, like the filter
+ */
+void
+player_set_resampler(Player *p, const ResampleParams *params)
+{
+	resample_desc_set(&p->resample_desc, params);
+}
+
+
+/*
+ * 0.5 .. 2.0, pitch preserved; 1.0 bypasses the time stretch
+ */
+void
+player_set_speed(Player *p, double speed)
+{
+	if (speed < STRETCH_SPEED_MIN)
+		speed = STRETCH_SPEED_MIN;
+	else if (speed > STRETCH_SPEED_MAX)
+		speed = STRETCH_SPEED_MAX;
+
+	atomic_store(&p->speed, (int)lround(speed * 1000.0));
+}
+
+
+double
+player_get_speed(Player *p)
+{
+	return (double)atomic_load(&p->speed) / 1000.0;
+}
+
+
+/*
+ * the device rate, what player_tap_read() returns runs at it
+ */
+unsigned
+player_get_rate(Player *p)
+{
+	mtx_lock(&p->mutex); /* LOCK */
+	const unsigned ret = p->rate;
+	mtx_unlock(&p->mutex); /* UNLOCK */
+	return ret;
+}
+
+
+/*
+ * lock-free, takes effect on the next mixed block
+ */
+void
+player_set_channel_mode(Player *p, PlayerChannelMode mode)
+{
+	if ((unsigned)mode >= PLAYER_CHANNEL_MODE_END)
+		mode = PLAYER_CHANNEL_MODE_NORMAL;
+
+	atomic_store(&p->channel_mode, (int)mode);
+}
+
+
+void
+player_stats_log(Player *p, int reset)
+{
+	stats_log(&p->stats);
+	if (reset)
+		stats_reset(&p->stats);
+}
+
+
+/*
+ * the stream callback copies its output into the tap while enabled, frames that do
+ * not fit are dropped; disabled: a single atomic load per callback
+ */
+void
+player_tap_enable(Player *p, int enable)
+{
+	if (enable) {
+		/* consumer side: drops whatever was left from the last time */
+		PaUtil_AdvanceRingBufferReadIndex(&p->tap, PaUtil_GetRingBufferReadAvailable(&p->tap));
+	}
+
+	atomic_store(&p->tap_enabled, enable);
+}
+
+
+size_t
+player_tap_available(Player *p)
+{
+	return (size_t)PaUtil_GetRingBufferReadAvailable(&p->tap);
+}
+
+
+/*
+ * single consumer, stereo float whatever the device format is; dst == NULL: skips
+ * 'count' frames
+ */
+size_t
+player_tap_read(Player *p, float dst[], size_t count)
+{
+	if (dst == NULL) {
+		const ring_buffer_size_t avail = PaUtil_GetRingBufferReadAvailable(&p->tap);
+		if ((ring_buffer_size_t)count > avail)
+			count = (size_t)avail;
+
+		PaUtil_AdvanceRingBufferReadIndex(&p->tap, (ring_buffer_size_t)count);
+		return count;
+	}
+
+	if ((p->pcm.format == PCM_FORMAT_F32) && (p->channels == 2))
+		return (size_t)PaUtil_ReadRingBuffer(&p->tap, dst, (ring_buffer_size_t)count);
+
+	/* back to float, front left and right only, in chunks */
+	uint8_t chunk[_TAP_CHUNK * sizeof(float) * DSP_CHANNELS_MAX];
+	float frames[_TAP_CHUNK * DSP_CHANNELS_MAX];
+	const unsigned ch = p->channels;
+	size_t ret = 0;
+	while (ret < count) {
+		const size_t len = ((count - ret) < _TAP_CHUNK)? (count - ret) : _TAP_CHUNK;
+		const size_t rd = (size_t)PaUtil_ReadRingBuffer(&p->tap, chunk, (ring_buffer_size_t)len);
+		pcm_decode(p->pcm.format, ch, frames, chunk, rd);
+		for (size_t i = 0; i < rd; i++) {
+			dst[(ret + i) * 2] = frames[i * ch];
+			dst[((ret + i) * 2) + 1] = frames[(i * ch) + 1];
+		}
+
+		ret += rd;
+		if (rd < len)
+			break;
+	}
+
+	return ret;
 }
 
 
@@ -174,7 +672,92 @@ player_item_is_stopped(Player *p)
  * Private
  */
 static int
-_context_init(PlayerContext *c, uint8_t swr_buffer[], PaUtilRingBuffer *buffer)
+_context_alloc(PlayerContext *c, Player *p)
+{
+	atomic_store(&c->is_active, 0);
+	atomic_store(&c->is_stopped, 1);
+	atomic_store(&c->frames_total, 0);
+	c->has_thrd = 0;
+	c->file = NULL;
+	c->start_s = 0;
+	c->frames_src = 0.0;
+	c->is_refused = 0;
+	c->channels = p->channels;
+	atomic_store(&c->rate, 0);
+	c->rates = &p->rates;
+	c->filter_desc = &p->filter_desc;
+	c->resample_desc = &p->resample_desc;
+	c->resample_gen = 0;
+	c->stats = &p->stats;
+
+	const size_t size = _ring_frames(_CONTEXT_BUFFER_MS);
+	uint8_t *const buffer = malloc(_RING_BUFFER_ELEM_SIZE(c->channels) * size);
+	if (buffer == NULL) {
+		log_err(errno, "player: _context_alloc: malloc: ring buffer");
+		return -1;
+	}
+
+	long ret = PaUtil_InitializeRingBuffer(&c->buffer, (ring_buffer_size_t)_RING_BUFFER_ELEM_SIZE(c->channels),
+					       (ring_buffer_size_t)size, buffer);
+	if (ret < 0) {
+		log_err(0, "player: _context_alloc: PaUtil_InitializeRingBuffer: invalid buffer size");
+		goto err0;
+	}
+
+	c->swr_buffer = malloc(_SWR_BUFFER_SIZE);
+	if (c->swr_buffer == NULL) {
+		log_err(errno, "player: _context_alloc: malloc: swr buffer");
+		goto err0;
+	}
+
+	if (filter_init(&c->filter) < 0)
+		goto err1;
+
+	/* moved along with the device, see _rate_switch() */
+	if (stretch_init(&c->stretch, c->channels, p->rate) < 0)
+		goto err2;
+
+	if (mtx_init(&c->wait_mutex, mtx_plain) != thrd_success) {
+		log_err(0, "player: _context_alloc: mtx_init: failed");
+		goto err3;
+	}
+
+	if (cnd_init(&c->wait_cond) != thrd_success) {
+		log_err(0, "player: _context_alloc: cnd_init: failed");
+		goto err4;
+	}
+
+	return 0;
+
+err4:
+	mtx_destroy(&c->wait_mutex);
+err3:
+	stretch_deinit(&c->stretch);
+err2:
+	filter_deinit(&c->filter);
+err1:
+	free(c->swr_buffer);
+err0:
+	free(buffer);
+	return -1;
+}
+
+
+static void
+_context_free(PlayerContext *c)
+{
+	cnd_destroy(&c->wait_cond);
+	mtx_destroy(&c->wait_mutex);
+	stretch_deinit(&c->stretch);
+	filter_deinit(&c->filter);
+	free(c->buffer.buffer);
+	free(c->swr_buffer);
+	free(c->file);
+}
+
+
+static int
+_context_init(PlayerContext *c)
 {
 	if (c->file == NULL) {
 		log_err(0, "player: _context_init: file == NULL");
@@ -186,28 +769,30 @@ _context_init(PlayerContext *c, uint8_t swr_buffer[], PaUtilRingBuffer *buffer)
 		log_err(0, "player: _context_init: av_packet_alloc: failed");
 		return -1;
 	}
-	
+
 	AVFrame *frame = av_frame_alloc();
 	if (frame == NULL) {
 		log_err(0, "player: _context_init: av_frame_alloc: failed");
 		goto err0;
 	}
-	
+
 	int ret = _context_av_init(c);
 	if (ret < 0)
 		goto err1;
-	
+
+	/* a failing graph is logged and skipped, the track still plays */
+	filter_restart(&c->filter, c->filter_desc, c->codec);
+
+	/* before any frame: the mixer goes by it */
+	_context_rate_init(c);
 	ret = _context_swr_init(c);
 	if (ret < 0)
 		goto err2;
-	
+
 	c->pkt = pkt;
 	c->frame = frame;
-	c->swr_buffer = swr_buffer;
-	c->buffer = buffer;
-	atomic_store(&c->frames_total, 0);
 	return 0;
-	
+
 err2:
 	avcodec_free_context(&c->codec);
 	avformat_close_input(&c->format);
@@ -219,26 +804,63 @@ err0:
 }
 
 
+/*
+ * the source rate if the device supports it, PLAYER_SAMPLE_RATE otherwise; what the
+ * filter graph does to the rate is left to the resampler
+ */
+static void
+_context_rate_init(PlayerContext *c)
+{
+	const unsigned rate = (unsigned)c->codec->sample_rate;
+	const int idx = _rate_index(rate);
+	if ((idx >= 0) && (atomic_load(c->rates) & (1u << idx)))
+		atomic_store(&c->rate, rate);
+	else
+		atomic_store(&c->rate, _AUDIO_SAMPLE_RATE);
+}
+
+
+/*
+ * output frames per second, PLAYER_SAMPLE_RATE until the decoder knows
+ */
+static unsigned
+_context_rate(PlayerContext *c)
+{
+	const unsigned ret = atomic_load(&c->rate);
+	return (ret != 0)? ret : _AUDIO_SAMPLE_RATE;
+}
+
+
 static int
 _context_av_init(PlayerContext *c)
 {
+	/* blocking I/O (a slow mount, a stream) gives up as soon as the context is stopped */
+	c->format = avformat_alloc_context();
+	if (c->format == NULL) {
+		log_err(0, "player: _context_av_init: avformat_alloc_context: failed");
+		return -1;
+	}
+
+	c->format->interrupt_callback = (AVIOInterruptCB) { .callback = _context_interrupt, .opaque = c };
+
+	/* frees the context on failure */
 	int ret = avformat_open_input(&c->format, c->file, NULL, NULL);
 	if (ret < 0) {
 		log_err(0, "player: _context_av_init: avformat_open_input: %s: %s", av_err2str(ret), c->file);
 		return -1;
 	}
-	
+
 	ret = avformat_find_stream_info(c->format, NULL);
 	if (ret < 0) {
 		log_err(0, "player: _context_av_init: avformat_find_stream_info: %s", av_err2str(ret));
 		goto err0;
 	}
-	
+
 	int is_ok = 0;
 	for (unsigned i = 0; i < c->format->nb_streams; i++) {
 		if (c->format->streams[i]->codecpar->codec_type != AVMEDIA_TYPE_AUDIO)
 			continue;
-		
+
 		c->index = i;
 		is_ok = 1;
 		break;
@@ -256,19 +878,19 @@ _context_av_init(PlayerContext *c)
 		log_err(0, "player: _context_av_init: avcodec_alloc_context3: failed");
 		goto err0;
 	}
-	
+
 	ret = avcodec_parameters_to_context(c->codec, cpar);
 	if (ret < 0) {
 		log_err(0, "player: _context_av_init: avcodec_parameters_to_context: %s", av_err2str(ret));
 		goto err1;
 	}
-	
+
 	ret = avcodec_open2(c->codec, codec, NULL);
 	if (ret < 0) {
 		log_err(0, "player: _context_av_init: avcodec_open2: %s", av_err2str(ret));
 		goto err1;
 	}
-	
+
 	return 0;
 
 err1:
@@ -279,38 +901,106 @@ err0:
 }
 
 
+/*
+ * AVIOInterruptCB
+ */
+static int
+_context_interrupt(void *udata)
+{
+	PlayerContext *const c = (PlayerContext *)udata;
+	return (atomic_load(&c->is_active) == 0);
+}
+
+
+/*
+ * input: the filter graph output if there is one, the decoder output otherwise
+ */
 static int
 _context_swr_init(PlayerContext *c)
 {
-	c->swr = swr_alloc();
-	if (c->swr == NULL) {
+	SwrContext *swr = swr_alloc();
+	if (swr == NULL) {
 		log_err(0, "player: _context_swr_init: swr_alloc: failed");
 		return -1;
 	}
-	
+
+	/* native when the device has as many channels, downmixed (or spread) otherwise */
 	AVChannelLayout chan;
-	av_channel_layout_default(&chan, _AUDIO_CHANNELS_COUNT);
-	av_opt_set_chlayout(c->swr, "out_chlayout", &chan, 0);
-	av_opt_set_int(c->swr, "out_sample_fmt", _FILE_SAMPLE_FORMAT, 0);
-	av_opt_set_int(c->swr, "out_sample_rate", _FILE_SAMPLE_RATE, 0);
-	av_opt_set_chlayout(c->swr, "in_chlayout", &c->codec->ch_layout, 0);
-	av_opt_set_int(c->swr, "in_sample_fmt", c->codec->sample_fmt, 0);
-	av_opt_set_int(c->swr, "in_sample_rate", c->codec->sample_rate, 0);
-
-	const int ret = swr_init(c->swr);
+	av_channel_layout_default(&chan, (int)c->channels);
+	av_opt_set_chlayout(swr, "out_chlayout", &chan, 0);
+	av_opt_set_double(swr, "center_mix_level", CFG_DOWNMIX_CENTER, 0);
+	av_opt_set_double(swr, "surround_mix_level", CFG_DOWNMIX_SURROUND, 0);
+	av_opt_set_double(swr, "lfe_mix_level", CFG_DOWNMIX_LFE, 0);
+	av_opt_set_int(swr, "out_sample_fmt", _FILE_SAMPLE_FORMAT, 0);
+	av_opt_set_int(swr, "out_sample_rate", atomic_load(&c->rate), 0);
+
+	/* a failure leaves the engine defaults */
+	ResampleParams params;
+	c->resample_gen = resample_desc_get(c->resample_desc, &params);
+	resample_apply(swr, &params);
+
+	if (filter_is_active(&c->filter)) {
+		AVChannelLayout in_chan;
+		int in_fmt, in_rate;
+		filter_get_output(&c->filter, &in_chan, &in_fmt, &in_rate);
+		av_opt_set_chlayout(swr, "in_chlayout", &in_chan, 0);
+		av_opt_set_int(swr, "in_sample_fmt", in_fmt, 0);
+		av_opt_set_int(swr, "in_sample_rate", in_rate, 0);
+		_context_swr_matrix(swr, in_chan.nb_channels, c->channels);
+		av_channel_layout_uninit(&in_chan);
+	} else {
+		av_opt_set_chlayout(swr, "in_chlayout", &c->codec->ch_layout, 0);
+		av_opt_set_int(swr, "in_sample_fmt", c->codec->sample_fmt, 0);
+		av_opt_set_int(swr, "in_sample_rate", c->codec->sample_rate, 0);
+		_context_swr_matrix(swr, c->codec->ch_layout.nb_channels, c->channels);
+	}
+
+	int ret = swr_init(swr);
+	if ((ret < 0) && (params.engine != RESAMPLE_ENGINE_SWR)) {
+		/* not built in */
+		log_err(0, "player: _context_swr_init: swr_init: %s: falling back to swr", av_err2str(ret));
+		av_opt_set(swr, "resampler", "swr", 0);
+		ret = swr_init(swr);
+	}
+
 	if (ret < 0) {
 		log_err(0, "player: _context_swr_init: swr_init: %s", av_err2str(ret));
+		swr_free(&swr);
 		return -1;
 	}
 
+	/* replaced only now: a failure leaves the context as it was */
+	swr_free(&c->swr);
+	c->swr = swr;
 	return 0;
 }
 
 
+/*
+ * CFG_DOWNMIX_MATRIX in place of the mix levels, for the layouts it was written for
+ */
+static void
+_context_swr_matrix(SwrContext *swr, int in, unsigned out)
+{
+	const size_t len = LEN(_downmix_matrix);
+	if ((CFG_DOWNMIX_MATRIX_IN <= 0) || (in != CFG_DOWNMIX_MATRIX_IN))
+		return;
+
+	if (((len % (size_t)in) != 0) || ((len / (size_t)in) != out))
+		return;
+
+	const int ret = swr_set_matrix(swr, _downmix_matrix, in);
+	if (ret < 0)
+		log_err(0, "player: _context_swr_matrix: swr_set_matrix: %s", av_err2str(ret));
+}
+
+
 static void
 _context_deinit(PlayerContext *c)
 {
-	swr_close(c->swr);
+	if (c->swr != NULL)
+		swr_close(c->swr);
+
 	avcodec_free_context(&c->codec);
 	avformat_close_input(&c->format);
 
@@ -320,118 +1010,645 @@ _context_deinit(PlayerContext *c)
 }
 
 
-static void
+/*
+ * returns: -1: the track is given up
+ */
+static int
 _context_writer(PlayerContext *c)
 {
 	AVCodecContext *const codec = c->codec;
 	AVFrame *const frm = c->frame;
-	SwrContext *const swr = c->swr;
-	uint8_t *const buffer = c->swr_buffer;
-	uint8_t *swr_buffer = buffer;
 
 
 	while (atomic_load(&c->is_active)) {
 		int ret = avcodec_receive_frame(codec, frm);
 		if (AVERROR(ret) == EAGAIN)
-			return;
+			return 0;
 
 		if (ret < 0) {
-			log_err(0, "player: _context_writer: avcodec_receive_frame: %s", av_err2str(ret));
+			if (_context_error(c, "_context_writer: avcodec_receive_frame", ret) < 0)
+				return -1;
+
+			/* a frame lost: one codec frame, where the codec has a fixed size */
+			if (codec->frame_size > 0) {
+				_context_conceal(c, (size_t)av_rescale(codec->frame_size, _context_rate(c),
+								       codec->sample_rate));
+			}
+
+			continue;
+		}
+
+		c->retries = 0;
+
+		/* ":filter" or ":resampler" changed, or the stream format moved */
+		const int is_changed = (filter_update(&c->filter, c->filter_desc, codec) != 0) ||
+				       (atomic_load(&c->resample_desc->gen) != c->resample_gen);
+
+		/* the old one may not fit the filter's output anymore: the track is given up */
+		if (is_changed && (_context_swr_init(c) < 0))
+			return -1;
+
+		if (filter_is_active(&c->filter))
+			ret = _context_filter(c, frm);
+		else
+			ret = _context_convert(c, frm);
+
+		if (ret < 0)
+			return 0;
+	}
+
+	return 0;
+}
+
+
+/*
+ * AVERROR_INVALIDDATA is a damaged packet or frame: counted and skipped, up to
+ * _DECODE_RETRIES in a row; anything else ends the track as before. In real-time mode
+ * nothing is logged here, the decoder's summary after the track has it all.
+ *
+ * returns: -1: give the track up
+ */
+static int
+_context_error(PlayerContext *c, const char what[], int err)
+{
+	const int is_quiet = (CFG_RT_ENABLE == 1);
+	if (err != AVERROR_INVALIDDATA) {
+		c->error = err;
+		c->error_what = what;
+		if (is_quiet == 0)
+			log_err(0, "player: %s: %s", what, av_err2str(err));
+
+		return -1;
+	}
+
+	c->errors++;
+	if (++c->retries > _DECODE_RETRIES) {
+		c->error = err;
+		c->error_what = what;
+		if (is_quiet == 0)
+			log_err(0, "player: %s: %u damaged packets in a row, giving up", what, _DECODE_RETRIES);
+
+		return -1;
+	}
+
+#ifdef DEBUG
+	if (is_quiet == 0)
+		log_info("player: %s: %s: skipped", what, av_err2str(err));
+#endif
+	return 0;
+}
+
+
+/*
+ * 'count' output frames of silence in place of what was skipped, so the rest of the
+ * track stays on time; it does not go through the filter graph
+ *
+ * returns: -1: stopped while waiting for the mixer
+ */
+static int
+_context_conceal(PlayerContext *c, size_t count)
+{
+	const size_t max = _MS_FRAMES(_context_rate(c), _CONCEAL_MAX_MS);
+	if (count > max)
+		count = max;
+
+	const size_t elem_size = _RING_BUFFER_ELEM_SIZE(c->channels);
+	const size_t chunk = _SWR_BUFFER_SIZE / elem_size;
+	c->concealed += count;
+	while (count > 0) {
+		size_t len = (size_t)PaUtil_GetRingBufferWriteAvailable(&c->buffer);
+		if (len == 0) {
+			if (atomic_load(&c->is_active) == 0)
+				return -1;
+
+			_context_wait(c);
+			continue;
+		}
+
+		if (len > count)
+			len = count;
+		if (len > chunk)
+			len = chunk;
+
+		memset(c->swr_buffer, 0, len * elem_size);
+		PaUtil_WriteRingBuffer(&c->buffer, c->swr_buffer, (ring_buffer_size_t)len);
+		count -= len;
+	}
+
+	return 0;
+}
+
+
+static int
+_context_filter(PlayerContext *c, AVFrame *frame)
+{
+	/* graph time only, waiting for the mixer is not counted */
+	int64_t start = stats_now_ns();
+	if (filter_send(&c->filter, frame) < 0)
+		return 0;
+
+	int64_t elapsed = 0;
+	for (;;) {
+		const AVFrame *const out = filter_receive(&c->filter);
+		elapsed += stats_now_ns() - start;
+		if (out == NULL)
 			break;
+
+		if (_context_convert(c, out) < 0)
+			return -1;
+
+		start = stats_now_ns();
+	}
+
+	stats_timer_add(c->stats, STATS_TIMER_FILTER, elapsed);
+	return 0;
+}
+
+
+/*
+ * returns: -1: stopped while waiting for the mixer
+ */
+static int
+_context_convert(PlayerContext *c, const AVFrame *frame)
+{
+	SwrContext *const swr = c->swr;
+	uint8_t *const buffer = c->swr_buffer;
+	uint8_t *swr_buffer = buffer;
+	const int swr_len = (int)(_SWR_BUFFER_SIZE / _RING_BUFFER_ELEM_SIZE(c->channels));
+
+	int ret = swr_convert(swr, &swr_buffer, swr_len, (const uint8_t **)frame->data, frame->nb_samples);
+	while (ret > 0) {
+		if (PaUtil_GetRingBufferWriteAvailable(&c->buffer) < ret) {
+			if (atomic_load(&c->is_active) == 0)
+				return -1;
+
+			// the mixer drains it
+			_context_wait(c);
+			continue;
 		}
 
-		ret = swr_convert(swr, &swr_buffer, _SWR_BUFFER_SIZE,
-				  (const uint8_t **)frm->data, frm->nb_samples);
+		PaUtil_WriteRingBuffer(&c->buffer, buffer, ret);
 
-		while (ret > 0) {
-			if (PaUtil_GetRingBufferWriteAvailable(c->buffer) < ret) {
-				if (atomic_load(&c->is_active) == 0)
-					return;
+		// flushing...
+		ret = swr_convert(swr, &swr_buffer, swr_len, NULL, 0);
+	}
 
-				// maybe this is not a good idea...
-				Pa_Sleep(_AUDIO_WAIT_TIME_MS);
-				continue;
-			}
+	if (ret < 0)
+		log_err(0, "player: _context_convert: swr_convert: %s", av_err2str(ret));
+
+	return 0;
+}
+
+
+/*
+ * up to _AUDIO_WAIT_TIME_MS for the mixer to make room, cut short by _context_cancel()
+ */
+static void
+_context_wait(PlayerContext *c)
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	ts.tv_nsec += _AUDIO_WAIT_TIME_MS * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000L;
+	}
+
+	mtx_lock(&c->wait_mutex); /* LOCK */
+	if (atomic_load(&c->is_active))
+		cnd_timedwait(&c->wait_cond, &c->wait_mutex, &ts);
+
+	mtx_unlock(&c->wait_mutex); /* UNLOCK */
+}
+
+
+/*
+ * lands on the closest point at or before 'start_s' the demuxer can seek to
+ */
+static void
+_context_seek(PlayerContext *c)
+{
+	const int64_t ts = c->start_s * AV_TIME_BASE;
+	const int ret = avformat_seek_file(c->format, -1, INT64_MIN, ts, ts, 0);
+	if (ret < 0) {
+		log_err(0, "player: _context_seek: avformat_seek_file: %s", av_err2str(ret));
+		return;
+	}
+
+	avcodec_flush_buffers(c->codec);
+}
 
-			PaUtil_WriteRingBuffer(c->buffer, buffer, ret);
 
-			// flushing...
-			ret = swr_convert(swr, &swr_buffer, _SWR_BUFFER_SIZE, NULL, 0);
+static int
+_context_start(PlayerContext *c, const char file[], int64_t start_s)
+{
+	/* a copy: the playlist may be replaced (and freed) while this plays */
+	if (file != c->file) {
+		char *const copy = strdup(file);
+		if (copy == NULL) {
+			log_err(errno, "player: _context_start: strdup");
+			return -1;
 		}
 
-		if (ret < 0)
-			log_err(0, "player: _context_writer: swr_convert: %s", av_err2str(ret));
+		free(c->file);
+		c->file = copy;
 	}
+
+	c->start_s = start_s;
+	atomic_store(&c->frames_total, (size_t)start_s * _context_rate(c));
+	atomic_store(&c->is_active, 1);
+	atomic_store(&c->is_stopped, 0);
+	if (thrd_create(&c->thrd, _file_reader_thrd, c) != thrd_success) {
+		log_err(0, "player: _context_start: thrd_create: failed");
+		atomic_store(&c->is_active, 0);
+		atomic_store(&c->is_stopped, 1);
+		return -1;
+	}
+
+	c->has_thrd = 1;
+	return 0;
+}
+
+
+/*
+ * the decoder thread leaves at its next check, a wait for the mixer or blocking I/O
+ * included; nothing is joined
+ */
+static void
+_context_cancel(PlayerContext *c)
+{
+	atomic_store(&c->is_active, 0);
+
+	mtx_lock(&c->wait_mutex); /* LOCK */
+	cnd_broadcast(&c->wait_cond);
+	mtx_unlock(&c->wait_mutex); /* UNLOCK */
+}
+
+
+static void
+_context_stop(PlayerContext *c)
+{
+	_context_cancel(c);
+	if (c->has_thrd == 0)
+		return;
+
+	thrd_join(c->thrd, NULL);
+	c->has_thrd = 0;
+}
+
+
+/*
+ * the decoder is gone and the mixer took every frame it left behind
+ */
+static int
+_context_is_done(PlayerContext *c)
+{
+	return ((atomic_load(&c->is_stopped) != 0) &&
+		(PaUtil_GetRingBufferReadAvailable(&c->buffer) == 0));
 }
 
 
 /*
  * Player
  */
+/*
+ * picks the device and the channel count, the stream is opened by _start_device()
+ */
 static int
 _open_device(Player *p)
 {
+	if (p->output == PLAYER_OUTPUT_NULL) {
+		p->device = paNoDevice;
+		p->channels = (unsigned)_channels_pick(DSP_CHANNELS_MAX);
+		return 0;
+	}
+
 	PaError pe = Pa_Initialize();
 	if (pe != paNoError) {
 		log_err(0, "player: _open_device: Pa_Initialize: %s", Pa_GetErrorText(pe));
 		return -1;
 	}
-	
+
 	const int host_api = Pa_GetDefaultHostApi();
 	if (host_api < 0) {
 		log_err(0, "player: _open_device: Pa_GetDefaultHostApi: invalid index");
 		goto err0;
 	}
-	
+
 	const PaHostApiInfo *const host_api_info = Pa_GetHostApiInfo(host_api);
 	if (host_api_info == NULL) {
 		log_err(0, "player: _open_device: Pa_GetHostApiInfo: invalid index");
 		goto err0;
 	}
-	
+
 	const int device = host_api_info->defaultOutputDevice;
 	const PaDeviceInfo *const device_info = Pa_GetDeviceInfo(device);
 	if (device_info == NULL) {
 		log_err(0, "player: _open_device: Pa_GetDeviceInfo: invalid index");
 		goto err0;
 	}
-	
-	const PaStreamParameters param = {
-		.device = device,
-		.channelCount = _AUDIO_CHANNELS_COUNT,
-		.sampleFormat = _AUDIO_SAMPLE_FORMAT,
+
+	const int channels = _channels_pick(device_info->maxOutputChannels);
+	p->device = device;
+	p->channels = (unsigned)channels;
+#ifdef DEBUG
+	log_info("player: _open_device: %s: %d channel(s)", device_info->name, channels);
+#endif
+	return 0;
+
+err0:
+	Pa_Terminate();
+	return -1;
+}
+
+
+/*
+ * CFG_OUTPUT_CHANNELS, 0: as many as the device has; pairs only, at least stereo
+ */
+static int
+_channels_pick(int max)
+{
+	int ret = (CFG_OUTPUT_CHANNELS > 0)? CFG_OUTPUT_CHANNELS : max;
+	if (ret > max)
+		ret = max;
+	if (ret > DSP_CHANNELS_MAX)
+		ret = DSP_CHANNELS_MAX;
+
+	ret &= ~1;
+	if (ret < 2)
+		ret = 2;
+
+	return ret;
+}
+
+
+/*
+ * PLAYER_SAMPLE_RATE is taken for granted: _start_device() fails loudly otherwise
+ */
+static void
+_probe_rates(Player *p)
+{
+	unsigned rates = 1u << _rate_index(_AUDIO_SAMPLE_RATE);
+#if (CFG_HIRES_ENABLE == 1)
+	PaStreamParameters param = { 0 };
+	if (p->output == PLAYER_OUTPUT_DEVICE)
+		_stream_params(p, &param);
+
+	for (size_t i = 0; (i < LEN(_rates)) && (_rates[i] <= _RATE_MAX); i++) {
+		/* the null output takes any */
+		if ((p->output == PLAYER_OUTPUT_NULL) ||
+		    (Pa_IsFormatSupported(NULL, &param, (double)_rates[i]) == paFormatIsSupported))
+			rates |= 1u << i;
+	}
+#endif
+
+	atomic_store(&p->rates, rates);
+#ifdef DEBUG
+	log_info("player: _probe_rates: mask: %#x, max: %u Hz", rates, (unsigned)_RATE_MAX);
+#endif
+}
+
+
+static void
+_stream_params(const Player *p, PaStreamParameters *param)
+{
+	const PaDeviceInfo *const device_info = Pa_GetDeviceInfo(p->device);
+	*param = (PaStreamParameters) {
+		.device = p->device,
+		.channelCount = (int)p->channels,
+		.sampleFormat = _pa_formats[p->pcm.format],
 		.suggestedLatency = device_info->defaultLowOutputLatency,
 	};
+}
+
 
-	pe = Pa_OpenStream(&p->stream, NULL, &param, _AUDIO_SAMPLE_RATE,
-			   _AUDIO_FRAME_BUFFER_SIZE, paClipOff | paDitherOff,
-			   _stream_cb, p);
+/*
+ * at p->rate
+ */
+static int
+_start_device(Player *p)
+{
+	if (p->output == PLAYER_OUTPUT_NULL) {
+		atomic_store(&p->null_alive, 1);
+		if (thrd_create(&p->null_thrd, _null_thrd, p) != thrd_success) {
+			log_err(0, "player: _start_device: thrd_create: null output");
+			return -1;
+		}
+
+		p->is_started = 1;
+		return 0;
+	}
+
+	PaStreamParameters param;
+	_stream_params(p, &param);
+
+	PaError pe = Pa_OpenStream(&p->stream, NULL, &param, (double)p->rate,
+				   (unsigned long)_MS_FRAMES(p->rate, _AUDIO_BUFFER_MS),
+				   paClipOff | paDitherOff, _stream_cb, p);
 	if (pe != paNoError) {
-		log_err(0, "player: _open_device: Pa_OpenStream: %s", Pa_GetErrorText(pe));
-		goto err0;
+		log_err(0, "player: _start_device: Pa_OpenStream: %u Hz: %s", p->rate, Pa_GetErrorText(pe));
+		p->stream = NULL;
+		return -1;
 	}
-	
+
 	pe = Pa_StartStream(p->stream);
 	if (pe != paNoError) {
-		log_err(0, "player: _open_device: Pa_StartStream: %s", Pa_GetErrorText(pe));
+		log_err(0, "player: _start_device: Pa_StartStream: %s", Pa_GetErrorText(pe));
+		Pa_CloseStream(p->stream);
+		p->stream = NULL;
+		return -1;
+	}
+
+	p->is_started = 1;
+	return 0;
+}
+
+
+/*
+ * is_abort: drops what the device still has queued instead of playing it out
+ */
+static void
+_stop_device(Player *p, int is_abort)
+{
+	/* not started: lost by a failed rate switch */
+	if (p->is_started == 0)
+		return;
+
+	p->is_started = 0;
+	if (p->output == PLAYER_OUTPUT_NULL) {
+		atomic_store(&p->null_alive, 0);
+		thrd_join(p->null_thrd, NULL);
+		return;
+	}
+
+	if (is_abort)
+		Pa_AbortStream(p->stream);
+	else
+		Pa_StopStream(p->stream);
+
+	Pa_CloseStream(p->stream);
+	p->stream = NULL;
+}
+
+
+static void
+_close_device(Player *p)
+{
+	if (p->output == PLAYER_OUTPUT_DEVICE)
+		Pa_Terminate();
+}
+
+
+/*
+ * real-time mode: everything between the decoders and the device stays resident;
+ * the DSP stages keep their own (small, touched every block) allocations
+ */
+static void
+_buffers_lock(Player *p, int lock)
+{
+	const struct { const void *addr; size_t size; } bufs[] = {
+		{ p->buffer.buffer, (size_t)(p->buffer.bufferSize * p->buffer.elementSizeBytes) },
+		{ p->tap.buffer, (size_t)(p->tap.bufferSize * p->tap.elementSizeBytes) },
+		{ p->mix_buffer, _MIX_BUFFER_SIZE(p->channels, p->frame_size) },
+		{ p->contexts[0].buffer.buffer,
+		  (size_t)(p->contexts[0].buffer.bufferSize * p->contexts[0].buffer.elementSizeBytes) },
+		{ p->contexts[1].buffer.buffer,
+		  (size_t)(p->contexts[1].buffer.bufferSize * p->contexts[1].buffer.elementSizeBytes) },
+		{ p->contexts[0].swr_buffer, _SWR_BUFFER_SIZE },
+		{ p->contexts[1].swr_buffer, _SWR_BUFFER_SIZE },
+	};
+
+	for (size_t i = 0; i < LEN(bufs); i++) {
+		if (lock)
+			rt_lock(bufs[i].addr, bufs[i].size);
+		else
+			rt_unlock(bufs[i].addr, bufs[i].size);
+	}
+}
+
+
+/*
+ * the device ring is empty: the stream is reopened at 'rate' and the rate dependent
+ * stages follow; their state (a few ms of the last item in the limiter) is dropped.
+ * A rate the device refuses is not tried again.
+ * Runs without p->mutex, only the swaps take it: the stream is the mixer's alone (the
+ * closer joins it first), so the UI calls do not wait out the reopen.
+ */
+static int
+_rate_switch(Player *p, unsigned rate)
+{
+	const int idx = _rate_index(rate);
+	if ((idx < 0) || ((atomic_load(&p->rates) & (1u << idx)) == 0))
+		return -1;
+
+	Limiter limiter;
+	if (limiter_init(&limiter, rate, p->channels, CFG_LIMITER_CEILING_DB, CFG_LIMITER_LOOKAHEAD_MS,
+			 CFG_LIMITER_RELEASE_MS, &p->stats) < 0)
+		return -1;
+
+	Stretch stretch[2];
+	if (stretch_init(&stretch[0], p->channels, rate) < 0)
+		goto err0;
+
+	if (stretch_init(&stretch[1], p->channels, rate) < 0)
 		goto err1;
+
+	_stop_device(p, 0);
+
+	/* only the mixer writes it: read here without the lock */
+	const unsigned old = p->rate;
+	mtx_lock(&p->mutex); /* LOCK */
+	p->rate = rate;
+	mtx_unlock(&p->mutex); /* UNLOCK */
+	if (_start_device(p) < 0) {
+		atomic_fetch_and(&p->rates, ~(1u << idx));
+		mtx_lock(&p->mutex); /* LOCK */
+		p->rate = old;
+		mtx_unlock(&p->mutex); /* UNLOCK */
+		if (_start_device(p) < 0)
+			log_err(0, "player: _rate_switch: no device left");
+
+		goto err2;
+	}
+
+	mtx_lock(&p->mutex); /* LOCK */
+	/* in place: the chain holds the addresses */
+	limiter_deinit(&p->limiter);
+	p->limiter = limiter;
+	for (int i = 0; i < 2; i++) {
+		stretch_deinit(&p->contexts[i].stretch);
+		p->contexts[i].stretch = stretch[i];
 	}
 
+	eq_set_rate(&p->eq, rate);
+	p->fill = _MS_FRAMES(rate, _RING_BUFFER_FILL_MS);
+#if (CFG_LIMITER_ENABLE == 1)
+	p->latency = limiter_latency(&p->limiter);
+#endif
+	mtx_unlock(&p->mutex); /* UNLOCK */
+#ifdef DEBUG
+	log_info("player: _rate_switch: %u -> %u Hz", old, rate);
+#endif
 	return 0;
 
+err2:
+	stretch_deinit(&stretch[1]);
 err1:
-	Pa_CloseStream(p->stream);
+	stretch_deinit(&stretch[0]);
 err0:
-	Pa_Terminate();
+	limiter_deinit(&limiter);
 	return -1;
 }
 
 
+/*
+ * returns: the bit in Player.rates, -1: not a rate the device gets
+ */
+static int
+_rate_index(unsigned rate)
+{
+	for (size_t i = 0; i < LEN(_rates); i++) {
+		if (_rates[i] == rate)
+			return (int)i;
+	}
+
+	return -1;
+}
+
+
+/*
+ * ring capacity for 'ms' at the highest rate, a power of two (PaUtilRingBuffer)
+ */
+static size_t
+_ring_frames(int ms)
+{
+	const size_t frames = _MS_FRAMES(_RATE_MAX, ms);
+	size_t ret = 1;
+	while (ret < frames)
+		ret <<= 1;
+
+	return ret;
+}
+
+
+/*
+ * DspChain stage, before the limiter: it has to see the final mix
+ */
 static void
-_close_device(Player *p)
+_channel_mode_process(void *udata, float frames[], size_t count)
 {
-	Pa_Terminate();
-	(void)p;
+	Player *const p = (Player *)udata;
+	switch (atomic_load_explicit(&p->channel_mode, memory_order_relaxed)) {
+	case PLAYER_CHANNEL_MODE_MONO:
+		dsp_mono(frames, count, p->channels);
+		break;
+	case PLAYER_CHANNEL_MODE_SWAP:
+		/* 5.1, 7.1: the second pair is center + LFE */
+		dsp_swap_pairs(frames, count, p->channels, (p->channels >= 6)? ~2u : ~0u);
+		break;
+	default:
+		break;
+	}
 }
 
 
@@ -443,85 +1660,438 @@ _stream_cb(const void *input, void *output, unsigned long count,
 	Player *const p = (Player *)udata;
 	size_t silent_offt = 0;
 	size_t silent_size = 0;
+	long rd = 0;
+#ifdef DEBUG
+	const long switches = rt_switches();
+#endif
+
+	if (atomic_exchange(&p->is_flushing, 0)) {
+		// drop everything queued before the cut
+		const ring_buffer_size_t rd = PaUtil_GetRingBufferReadAvailable(&p->buffer);
+		PaUtil_AdvanceRingBufferReadIndex(&p->buffer, rd);
+		atomic_fetch_add(&p->frames_played, (size_t)rd);
+	}
 
 	if (atomic_load(&p->is_paused) == 0) {
-		const long rd = PaUtil_ReadRingBuffer(&p->buffer, output, count);
-		if (rd > 0) {
-			const size_t old = atomic_load(&p->context.frames_total);
-			atomic_store(&p->context.frames_total, old + (size_t) rd);
-		}
+		rd = PaUtil_ReadRingBuffer(&p->buffer, output, count);
+		if (rd > 0)
+			atomic_fetch_add(&p->frames_played, (size_t)rd);
 
-		silent_offt = (rd * _RING_BUFFER_ELEM_SIZE);
-		silent_size = (count - rd) * _RING_BUFFER_ELEM_SIZE;
+		silent_offt = (rd * p->frame_size);
+		silent_size = (count - rd) * p->frame_size;
 	} else {
 		// shut up!
-		silent_size = (count * _RING_BUFFER_ELEM_SIZE);
+		silent_size = (count * p->frame_size);
 	}
 
 	memset(((char *)output) + silent_offt, 0, silent_size);
 
+	/* player_close(): the first buffer after it fades out, silence until the stream stops */
+	int ret = paContinue;
+	if (atomic_load(&p->is_closing)) {
+		if (atomic_load(&p->is_faded) == 0) {
+			size_t len = _MS_FRAMES(p->rate, _CLOSE_FADE_MS);
+			if (len > (size_t)rd)
+				len = (size_t)rd;
+
+			pcm_fade_out(p->pcm.format, p->channels, output, len);
+			memset(((char *)output) + (len * p->frame_size), 0, (count - len) * p->frame_size);
+			atomic_store(&p->is_faded, 1);
+		} else {
+			memset(output, 0, count * p->frame_size);
+		}
+
+		ret = paComplete;
+	}
+
+	/* no locks, no allocation: a full tap just drops the rest */
+	if (atomic_load_explicit(&p->tap_enabled, memory_order_relaxed))
+		PaUtil_WriteRingBuffer(&p->tap, output, (ring_buffer_size_t)count);
+
+#ifdef DEBUG
+	/* nothing in here may block: a voluntary context switch says something did */
+	const long blocked = rt_switches() - switches;
+	if (blocked > 0)
+		stats_gauge_add(&p->stats, STATS_GAUGE_RT_BLOCK, (double)blocked);
+#endif
+
 	(void)input;
 	(void)time_info;
 	(void)flags;
-	return paContinue;
+	return ret;
 }
 
 
+/*
+ * PLAYER_OUTPUT_NULL: the callback, one device buffer per period, until it completes
+ */
 static int
-_file_reader_thrd(void *udata)
+_null_thrd(void *udata)
 {
 	Player *const p = (Player *)udata;
-	PlayerContext *const c = &p->context;
+	const unsigned long count = (unsigned long)_MS_FRAMES(p->rate, _AUDIO_BUFFER_MS);
+	void *const output = malloc(count * p->frame_size);
+	if (output == NULL) {
+		log_err(errno, "player: _null_thrd: malloc: output");
+		return -1;
+	}
 
-	atomic_store(&p->is_paused, 0);
-	atomic_store(&c->is_active, 1);
-	atomic_store(&c->is_stopped, 0);
-	int ret = _context_init(c, p->swr_buffer, &p->buffer);
+	const int64_t period = ((int64_t)count * 1000000000) / (int64_t)p->rate;
+	int64_t next = stats_now_ns();
+	while (atomic_load(&p->null_alive)) {
+		if (_stream_cb(NULL, output, count, NULL, 0, p) != paContinue)
+			break;
+
+		next += period;
+		const int64_t wait = next - stats_now_ns();
+		if (wait > 0) {
+			const struct timespec ts = { .tv_sec = wait / 1000000000, .tv_nsec = wait % 1000000000 };
+			thrd_sleep(&ts, NULL);
+		}
+	}
+
+	free(output);
+	return 0;
+}
+
+
+/*
+ * player_close(): the mixer goes first (it may be switching the device), then the
+ * callback gets up to _CLOSE_TIMEOUT_MS to fade out before the stream stops
+ */
+static int
+_closer_thrd(void *udata)
+{
+	Player *const p = (Player *)udata;
+	thrd_join(p->mixer, NULL);
+
+	const int64_t deadline = stats_now_ns() + ((int64_t)_CLOSE_TIMEOUT_MS * 1000000);
+	while (p->is_started && (atomic_load(&p->is_faded) == 0) && (stats_now_ns() < deadline))
+		Pa_Sleep(1);
+
+	/* faded: the device plays out its own buffers, the fade included */
+	_stop_device(p, atomic_load(&p->is_faded) == 0);
+	return 0;
+}
+
+
+static int
+_file_reader_thrd(void *udata)
+{
+	PlayerContext *const c = (PlayerContext *)udata;
+	if (CFG_RT_ENABLE == 1)
+		rt_thread_setup("decoder", CFG_RT_POLICY, CFG_RT_PRIORITY, CFG_RT_CPU);
+
+	int ret = _context_init(c);
 	if (ret < 0)
 		goto out0;
 
+	if (c->start_s > 0)
+		_context_seek(c);
+
 
 	AVFormatContext *const ctx = c->format;
 	AVCodecContext *const codec = c->codec;
 	AVPacket *const pkt = c->pkt;
+	const AVRational time_base = ctx->streams[c->index]->time_base;
+	c->errors = 0;
+	c->retries = 0;
+	c->concealed = 0;
+	c->error = 0;
+	c->error_what = NULL;
 	while (atomic_load(&c->is_active)) {
 		ret = av_read_frame(ctx, pkt);
-		if (ret < 0) {
-			log_err(0, "player: _file_thrd: av_read_frame: %s", av_err2str(ret));
+		if ((ret == AVERROR_EOF) || (atomic_load(&c->is_active) == 0))
 			break;
+
+		/* the demuxer resyncs on the next read */
+		if (ret < 0) {
+			if (_context_error(c, "_file_thrd: av_read_frame", ret) < 0)
+				break;
+
+			continue;
 		}
-		
+
 		if ((unsigned)pkt->stream_index != c->index) {
 			av_packet_unref(pkt);
 			continue;
 		}
 
 		ret = avcodec_send_packet(codec, pkt);
+		const int64_t duration = pkt->duration;
+		av_packet_unref(pkt);
 		if (ret != 0) {
-			log_err(0, "player: _file_thrd: avcodec_send_packet: %s", av_err2str(ret));
-			break;
+			if (_context_error(c, "_file_thrd: avcodec_send_packet", ret) < 0)
+				break;
+
+			if (duration > 0)
+				_context_conceal(c, (size_t)av_rescale_q(duration, time_base,
+									 (AVRational) { 1, (int)_context_rate(c) }));
+
+			continue;
 		}
-		
-		av_packet_unref(pkt);
 
-		_context_writer(c);
+		if (_context_writer(c) < 0)
+			break;
 	}
 
-	while (atomic_load(&c->is_active)) {
-		// make sure there is no data left
-		if (PaUtil_GetRingBufferReadAvailable(&p->buffer) == 0)
-			break;
-		
-		Pa_Sleep(_AUDIO_WAIT_TIME_MS);
+	/* greppable: bad rips show up here, the totals in ":stats" */
+	if (c->errors > 0) {
+		stats_gauge_add(c->stats, STATS_GAUGE_DECODE, (double)c->errors);
+		log_err(0, "player: _file_thrd: %u decode error(s), %.1f ms concealed: %s", c->errors,
+			((double)c->concealed * 1000.0) / (double)_context_rate(c), c->file);
 	}
 
-	PaUtil_FlushRingBuffer(&p->buffer);
+	/* logged by _context_error() otherwise */
+	if ((CFG_RT_ENABLE == 1) && (c->error != 0))
+		log_err(0, "player: %s: %s: given up: %s", c->error_what, av_err2str(c->error), c->file);
+
+	/* the end of the track: what the graph held back goes into the ring too */
+	if ((ret == AVERROR_EOF) && atomic_load(&c->is_active) && filter_is_active(&c->filter))
+		_context_filter(c, NULL);
+
+	// no draining here: the mixer takes the rest of the ring at its own pace
 	_context_deinit(c);
 
 out0:
 	atomic_store(&c->is_active, 0);
-	atomic_store(&p->is_paused, 0);
 	atomic_store(&c->is_stopped, 1);
-	atomic_store(&c->frames_total, 0);
 	return 0;
 }
+
+
+static int
+_mixer_thrd(void *udata)
+{
+	Player *const p = (Player *)udata;
+	/* above the decoders: it must never wait for one that is busy decoding */
+	if (CFG_RT_ENABLE == 1)
+		rt_thread_setup("mixer", CFG_RT_POLICY, CFG_RT_PRIORITY + 1, CFG_RT_CPU);
+
+	while (atomic_load(&p->is_alive)) {
+		if (_mixer_run(p) == 0)
+			Pa_Sleep(_MIXER_WAIT_TIME_MS);
+	}
+
+	return 0;
+}
+
+
+/*
+ * keeps the device ring at _RING_BUFFER_FILL_MS, so a fade or a cut is heard
+ * shortly after it was requested
+ *
+ * returns: written frames
+ */
+static size_t
+_mixer_run(Player *p)
+{
+	if (atomic_load(&p->is_flushing))
+		return 0;
+
+	const size_t queued = (size_t)PaUtil_GetRingBufferReadAvailable(&p->buffer);
+	const int64_t start = stats_now_ns();
+	mtx_lock(&p->mutex); /* LOCK */
+
+	PlayerContext *const in = &p->contexts[p->current];
+	PlayerContext *const out = &p->contexts[p->current ^ 1];
+	const int is_rate = (queued < p->fill)? _mixer_rate(p, in, out, queued) : -1;
+	if (is_rate != 0) {
+		const unsigned rate = atomic_load(&in->rate);
+		mtx_unlock(&p->mutex); /* UNLOCK */
+		if (is_rate > 0)
+			_mixer_rate_switch(p, in, rate);
+
+		return 0;
+	}
+
+	size_t count = p->fill - queued;
+	if (count > _MIXER_FRAMES)
+		count = _MIXER_FRAMES;
+
+	size_t written;
+	if (p->fade_len > 0) {
+		written = _mixer_fade(p, in, out, count);
+	} else {
+		written = _mixer_read(p, in, p->mix_buffer, count);
+	}
+
+	if (written > 0) {
+		dsp_chain_run(&p->chain, p->mix_buffer, written);
+
+		/* our own conversion: PortAudio's one would be a hidden copy without dither */
+		const void *frames = p->mix_buffer;
+		if (p->pcm.format != PCM_FORMAT_F32) {
+			pcm_encode(&p->pcm, p->out_buffer, p->mix_buffer, written);
+			frames = p->out_buffer;
+		}
+
+		PaUtil_WriteRingBuffer(&p->buffer, frames, (ring_buffer_size_t)written);
+		atomic_fetch_add(&p->frames_written, written);
+		_clock_push(p, in);
+	}
+
+	mtx_unlock(&p->mutex); /* UNLOCK */
+
+	if (written > 0)
+		stats_timer_add(&p->stats, STATS_TIMER_MIXER, stats_now_ns() - start);
+
+	return written;
+}
+
+
+/*
+ * the current item runs at another rate: a fade plays out (the item counts as
+ * silence), then the device ring, then the device follows
+ *
+ * returns: 0: go on mixing, -1: not yet, 1: the device follows, see _mixer_rate_switch()
+ */
+static int
+_mixer_rate(Player *p, PlayerContext *in, PlayerContext *out, size_t queued)
+{
+	const unsigned rate = atomic_load(&in->rate);
+	if ((rate == 0) || (rate == p->rate))
+		return 0;
+
+	if (p->fade_len > 0) {
+		if (_context_is_done(out) == 0)
+			return 0;
+
+		p->fade_len = 0;
+	}
+
+	if (queued > 0)
+		return -1;
+
+	return 1;
+}
+
+
+/*
+ * without the lock; an item the device refuses is dropped, logged once: the next ticks
+ * come back here until the queue moves on
+ */
+static void
+_mixer_rate_switch(Player *p, PlayerContext *in, unsigned rate)
+{
+	if (_rate_switch(p, rate) == 0)
+		return;
+
+	mtx_lock(&p->mutex); /* LOCK */
+	/* not replaced meanwhile */
+	if ((in == &p->contexts[p->current]) && (atomic_load(&in->rate) == rate)) {
+		if (in->is_refused == 0) {
+			log_err(0, "player: _mixer_rate_switch: %u Hz: unsupported, item dropped", rate);
+			in->is_refused = 1;
+		}
+
+		atomic_store(&in->is_active, 0);
+		PaUtil_AdvanceRingBufferReadIndex(&in->buffer, PaUtil_GetRingBufferReadAvailable(&in->buffer));
+	}
+
+	mtx_unlock(&p->mutex); /* UNLOCK */
+}
+
+
+/*
+ * equal-power crossfade: in * sin(x * pi/2) + out * cos(x * pi/2), x: 0 -> 1
+ * a context that has nothing to give (yet) counts as silence
+ */
+static size_t
+_mixer_fade(Player *p, PlayerContext *in, PlayerContext *out, size_t count)
+{
+	const size_t remn = p->fade_len - p->fade_pos;
+	if (count > remn)
+		count = remn;
+
+	float *const buf_in = p->mix_buffer;
+	const unsigned ch = p->channels;
+	float *const buf_out = p->mix_buffer + (_MIXER_FRAMES * ch);
+	const size_t rd_in = _mixer_read(p, in, buf_in, count);
+	const size_t rd_out = _mixer_read(p, out, buf_out, count);
+	const size_t len = (rd_in > rd_out)? rd_in : rd_out;
+	if (len == 0)
+		return 0;
+
+	memset(&buf_in[rd_in * ch], 0, (len - rd_in) * _RING_BUFFER_ELEM_SIZE(ch));
+	memset(&buf_out[rd_out * ch], 0, (len - rd_out) * _RING_BUFFER_ELEM_SIZE(ch));
+
+	const double x0 = (double)p->fade_pos / (double)p->fade_len;
+	const double x1 = (double)(p->fade_pos + len) / (double)p->fade_len;
+	dsp_mix_ramp(buf_in, buf_in, buf_out, len * ch,
+		     (float)sin(x0 * _PI / 2.0), (float)sin(x1 * _PI / 2.0),
+		     (float)cos(x0 * _PI / 2.0), (float)cos(x1 * _PI / 2.0));
+
+	p->fade_pos += len;
+	if (p->fade_pos >= p->fade_len) {
+		// faded out: the decoder thread is joined by the next player_item_play()
+		p->fade_len = 0;
+		atomic_store(&out->is_active, 0);
+		PaUtil_AdvanceRingBufferReadIndex(&out->buffer, PaUtil_GetRingBufferReadAvailable(&out->buffer));
+		stretch_reset(&out->stretch);
+	}
+
+	return len;
+}
+
+
+/*
+ * source frames from the context ring, through the time stretch unless it is idle
+ * (speed 1.0: a plain ring read)
+ */
+static size_t
+_mixer_read(Player *p, PlayerContext *c, float dst[], size_t count)
+{
+	/* not at the device rate (yet), see _mixer_rate() */
+	if (atomic_load(&c->rate) != p->rate)
+		return 0;
+
+	Stretch *const s = &c->stretch;
+	const double speed = (double)atomic_load(&p->speed) / 1000.0;
+	if (s->speed != speed)
+		stretch_set_speed(s, speed);
+
+	size_t ret = 0;
+	while (ret < count) {
+		if (stretch_is_idle(s)) {
+			const size_t rd = (size_t)PaUtil_ReadRingBuffer(&c->buffer, &dst[ret * c->channels],
+									(ring_buffer_size_t)(count - ret));
+			c->frames_src += (double)rd;
+			ret += rd;
+			break;
+		}
+
+		const size_t rd = stretch_read(s, &dst[ret * c->channels], count - ret);
+		c->frames_src += (double)rd * s->speed;
+		ret += rd;
+		if (ret == count)
+			break;
+
+		const size_t want = stretch_want(s);
+		if (want == 0)
+			continue;
+
+		float *const feed = stretch_feed_ptr(s, want);
+		const size_t fed = (size_t)PaUtil_ReadRingBuffer(&c->buffer, feed, (ring_buffer_size_t)want);
+		stretch_feed_commit(s, fed);
+		if (fed < want)
+			break;
+	}
+
+	atomic_store(&c->frames_total, (size_t)c->frames_src);
+	return ret;
+}
+
+
+static void
+_clock_push(Player *p, PlayerContext *c)
+{
+	p->clock[p->clock_head % PLAYER_CLOCK_MARKS] = (PlayerClockMark) {
+		/* the DSP latency: heard that much later */
+		.out_end = atomic_load(&p->frames_written) + p->latency,
+		.src_end = atomic_load(&c->frames_total),
+		.gen = p->item_gen,
+	};
+
+	p->clock_head++;
+}
@@ -15,41 +15,149 @@
 #include <libswresample/swresample.h>
 
 #include "pa/pa_ringbuffer.h"
+#include "dsp.h"
+#include "eq.h"
+#include "filter.h"
+#include "limiter.h"
+#include "pcm.h"
+#include "resample.h"
+#include "rt.h"
+#include "stats.h"
+#include "stretch.h"
+
+
+#define PLAYER_CLOCK_MARKS (64)
+#define PLAYER_SAMPLE_RATE (44100)	/* the fallback, see CFG_HIRES_ENABLE */
+
+
+typedef enum player_channel_mode {
+	PLAYER_CHANNEL_MODE_NORMAL,
+	PLAYER_CHANNEL_MODE_MONO,	/* every speaker plays the sum */
+	PLAYER_CHANNEL_MODE_SWAP,	/* left <-> right */
+
+	PLAYER_CHANNEL_MODE_END,
+} PlayerChannelMode;
+
+typedef enum player_output {
+	PLAYER_OUTPUT_DEVICE,		/* PortAudio's default output */
+	PLAYER_OUTPUT_NULL,		/* no device, a thread runs the callback in real time */
+} PlayerOutput;
 
 
 typedef struct player_context {
 	atomic_int        is_active;
 	atomic_int        is_stopped;
+	int               has_thrd;
 	unsigned          index;
+	unsigned          channels;
+	atomic_uint       rate;		/* output, 0: not known yet */
+	atomic_uint      *rates;		/* Player.rates */
 	AVPacket         *pkt;
 	AVFrame          *frame;
 	AVFormatContext  *format;
 	AVCodecContext   *codec;
 	SwrContext       *swr;
 	uint8_t          *swr_buffer;
-	PaUtilRingBuffer *buffer;
-	atomic_size_t     frames_total;
-	const char       *file;
+	PaUtilRingBuffer  buffer;
+	atomic_size_t     frames_total;	/* source frames handed to the device ring */
+	double            frames_src;	/* mixer only */
+	int               is_refused;	/* under Player.mutex: dropped for its rate, logged */
+	char             *file;		/* its own copy, NULL: none */
+	int64_t           start_s;	/* seek target, applied by the decoder thread */
+	Stretch           stretch;
+	Filter            filter;
+	FilterDesc       *filter_desc;
+	ResampleDesc     *resample_desc;
+	unsigned          resample_gen;	/* decoder thread, of what swr was set up with */
+	unsigned          errors;	/* decoder thread, this track: damaged packets and frames */
+	unsigned          retries;	/* decoder thread, errors in a row */
+	size_t            concealed;	/* decoder thread, this track: frames of silence in their place */
+	int               error;	/* decoder thread, what gave this track up, 0: nothing */
+	const char       *error_what;
+	Stats            *stats;
+	mtx_t             wait_mutex;
+	cnd_t             wait_cond;	/* signaled by _context_stop(): no waiting out a full ring */
 	thrd_t            thrd;
 } PlayerContext;
 
+/*
+ * position of the current item (source frames) once 'out_end' frames were played
+ */
+typedef struct player_clock_mark {
+	size_t   out_end;
+	size_t   src_end;
+	unsigned gen;
+} PlayerClockMark;
+
 typedef struct player {
 	atomic_int        is_paused;
+	atomic_int        is_alive;
+	atomic_int        is_flushing;
+	atomic_int        speed;		/* permille */
+	atomic_int        tap_enabled;
+	atomic_int        channel_mode;
+	atomic_int        is_closing;		/* player_close(): the callback fades out */
+	atomic_int        is_faded;
+	PlayerOutput      output;
 	PaStream         *stream;
-	PaUtilRingBuffer  buffer;
-	PlayerContext     context;
-	uint8_t          *swr_buffer;
+	int               is_started;		/* the stream, or the null output thread */
+	atomic_int        null_alive;
+	int               device;
+	unsigned          channels;		/* device, even */
+	unsigned          rate;			/* device, follows the current item */
+	atomic_uint       rates;		/* the device supports, see _rates[] */
+	size_t            fill;			/* device ring target, frames */
+	PaUtilRingBuffer  buffer;		/* device format */
+	PaUtilRingBuffer  tap;			/* SPSC: what the device got, see player_tap_read() */
+	Pcm               pcm;
+	size_t            frame_size;		/* device format, bytes */
+	PlayerContext     contexts[2];
+	int               current;
+	unsigned          item_gen;
+	unsigned          clock_head;
+	PlayerClockMark   clock[PLAYER_CLOCK_MARKS];
+	size_t            fade_pos;
+	size_t            fade_len;
+	atomic_size_t     frames_played;
+	atomic_size_t     frames_written;
+	float            *mix_buffer;
+	uint8_t          *out_buffer;		/* mix_buffer in the device format */
+	DspChain          chain;
+	Eq                eq;
+	Limiter           limiter;
+	size_t            latency;		/* frames, DSP stages */
+	FilterDesc        filter_desc;
+	ResampleDesc      resample_desc;
+	Stats             stats;
+	mtx_t             mutex;
+	thrd_t            mixer;
+	thrd_t            null_thrd;
+	thrd_t            closer;
+	int               has_closer;
 } Player;
 
 
-int     player_init(Player *p);
-void    player_deinit(Player *p);
-int     player_item_play(Player *p, const char file[]);
-void    player_item_stop(Player *p);
-void    player_item_toggle(Player *p);
-int64_t player_item_get_time(Player *p);
-int     player_item_is_playing(Player *p);
-int     player_item_is_stopped(Player *p);
+int      player_init(Player *p, PlayerOutput output);
+void     player_close(Player *p);
+void     player_deinit(Player *p);
+int      player_item_play(Player *p, const char file[], int fade_ms);
+void     player_item_stop(Player *p);
+void     player_item_toggle(Player *p);
+int      player_item_seek(Player *p, int64_t pos_s);
+int64_t  player_item_get_time(Player *p);
+int      player_item_is_playing(Player *p);
+int      player_item_is_stopped(Player *p);
+int      player_set_eq(Player *p, const EqBand bands[], int len);
+void     player_set_filter(Player *p, const char desc[]);
+void     player_set_resampler(Player *p, const ResampleParams *params);
+void     player_set_speed(Player *p, double speed);
+void     player_set_channel_mode(Player *p, PlayerChannelMode mode);
+double   player_get_speed(Player *p);
+unsigned player_get_rate(Player *p);
+void     player_stats_log(Player *p, int reset);
+void     player_tap_enable(Player *p, int enable);
+size_t   player_tap_available(Player *p);
+size_t   player_tap_read(Player *p, float dst[], size_t count);
 
 
 #endif
@@ -1,45 +1,178 @@
 #include <assert.h>
 #include <ctype.h>
-#include <dirent.h>
 #include <errno.h>
 #include <limits.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <strings.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <unistd.h>
 #include <threads.h>
 
 #include <libavformat/avformat.h>
 
-#include <sys/stat.h>
+#include <sys/eventfd.h>
 #include <sys/sysinfo.h>
 
 #include "playlist.h"
+#include "library.h"
+#include "scan.h"
+#include "stats.h"
+#include "tags.h"
+#include "uring.h"
 #include "util.h"
 #include "config.h"
 
 
+#define _ARENA_BLOCK   (64 * 1024)
+#define _IO_BUFFER     (32 * 1024)
+#define _HEADS_SIZE    ((size_t)CFG_SCAN_HEADER_KB * 1024)
+#define _META_BATCH    (32)	/* items taken at a time, one io_uring round */
+#define _META_THRDS    (32)
+#define _COMPACT_MIN   (1024)	/* replaced items in the store before a merge copies the list */
+
+
+enum {
+	_UPDATE_IDLE,
+	_UPDATE_RUNNING,
+	_UPDATE_DONE,
+};
+
+enum {
+	_LOAD_PENDING,
+	_LOAD_TAKEN,
+	_LOAD_DONE,
+	_LOAD_APPLIED,
+};
+
+enum {
+	_DURATION_PENDING,
+	_DURATION_DONE,
+	_DURATION_FAILED,
+};
+
+
 static const char *_allowed_file_types[] = CFG_FILE_TYPES;
 
 
-typedef struct item_chunk {
-	int            thrd_ok;
-	int            len;
-	PlaylistItem **list;
-	thrd_t         thrd;
-} ItemChunk;
+/*
+ * the items are moved as it grows: nothing points at them until the walk is done
+ */
+typedef struct item_array {
+	PlaylistItem *items;
+	size_t        len;
+} ItemArray;
+
+typedef struct item_meta {
+	char title[PLAYLIST_ITEM_TITLE_SIZE];
+	char artist[PLAYLIST_ITEM_ARTIST_SIZE];
+	char album[PLAYLIST_ITEM_ALBUM_SIZE];
+	char genre[PLAYLIST_ITEM_GENRE_SIZE];
+} ItemMeta;
+
+/*
+ * libav reading a file whose first bytes are in memory already: the probe and most
+ * headers do not reach the disk again, the rest is pread() when asked for
+ */
+typedef struct item_io {
+	const char    *path;
+	const uint8_t *head;
+	size_t         head_len;
+	int64_t        size;
+	int64_t        pos;
+	int            fd;	/* -1: not needed so far */
+} ItemIo;
+
+typedef struct item_worker {
+	struct item_pool *pool;
+	int               thrd_ok;
+	thrd_t            thrd;
+	size_t            count;
+	int64_t           elapsed;	/* ns */
+} ItemWorker;
+
+/*
+ * one item to probe: a worker fills 'staged' (its strings in 'meta'), the item itself
+ * is only written once that is done, by the thread the playlist belongs to
+ */
+typedef struct item_load {
+	PlaylistItem *item;
+	PlaylistItem  staged;
+	ItemMeta      meta;
+	int           pos;	/* in the playlist */
+	atomic_int    state;	/* _LOAD_* */
+} ItemLoad;
 
+/*
+ * the items are handed out '_META_BATCH' at a time, whoever is free takes the next
+ * ones: a folder of large files keeps one thread busy, not the rest waiting for it;
+ * the rows on screen go first, see playlist_load_set_view()
+ */
+typedef struct item_pool {
+	ItemLoad         *loads;	/* by 'pos' */
+	size_t            len;
+	size_t            applied;
+	atomic_size_t     next;
+	atomic_size_t     done;
+	atomic_int        is_alive;
+	const atomic_int *stop;		/* NULL: none; set: as 'is_alive' cleared */
+	atomic_int        view_first;
+	atomic_int        view_last;	/* < view_first: nothing on screen */
+	int               fd;		/* eventfd, told about every batch; -1: none */
+	int               thrds_num;
+	ItemWorker        workers[_META_THRDS];
+} ItemPool;
 
-static int  _verify(const char *name);
-static int  _item_new(PlaylistItem **new_item, const char path[], int path_len);
-static void _item_new_load(PlaylistItem *item);
-static int  _item_new_load_thrd(void *udata);
-static int  _sort_dir_cb(const struct dirent **a, const struct dirent **b);
-static void _load_files(Str *str, ArrayPtr *file_arr, const char path[], int max_depth);
-static int  _load_files_meta(ArrayPtr *file_arr);
-static void _cstr_copy(char dest[], size_t size, const char src[]);
+/*
+ * written by a job thread, applied to 'item' by playlist_durations_update()
+ */
+struct playlist_duration {
+	PlaylistItem *item;
+	int64_t       duration;
+	atomic_int    state;	/* _DURATION_* */
+};
+
+
+static int            _verify(const char *name);
+static void           _item_new(PlaylistItem *item, const ScanFile *file);
+static void           _item_new_load(PlaylistItem *item, ItemMeta *meta, const uint8_t head[], size_t head_len);
+static int            _item_new_load_tags(PlaylistItem *item, ItemMeta *meta, const uint8_t head[], size_t head_len);
+static int            _item_new_load_heads(Uring *ring, uint8_t data[], PlaylistItem *items[], ItemMeta *metas[],
+					   int len);
+static ItemPool      *_item_pool_new(ArrayPtr *blocks, PlaylistItem *items[], const int pos[], int len, int fd,
+				     const atomic_int *stop);
+static int            _item_pool_start(ItemPool *pool, int is_caller);
+static void           _item_pool_join(ItemPool *pool);
+static int            _item_pool_take(ItemPool *pool, ItemLoad *batch[]);
+static size_t         _item_pool_apply(ItemPool *pool, int *first, int *last);
+static void           _item_worker_run(ItemWorker *w);
+static int            _item_worker_thrd(void *udata);
+static AVIOContext   *_item_io_new(ItemIo *io);
+static void           _item_io_free(AVIOContext *pb, ItemIo *io);
+static int            _item_io_read(void *udata, uint8_t buf[], int size);
+static int64_t        _item_io_seek(void *udata, int64_t offt, int whence);
+static int            _item_path_cmp(const void *a, const void *b);
+static int            _item_order_cmp(const void *a, const void *b);
+static void           _load_files(ItemArray *arr, Arena *arena, const char path[], int max_depth, int is_tree,
+				  const atomic_int *stop);
+static int            _load_files_meta(ArrayPtr *blocks, PlaylistItem *items[], int len, const atomic_int *stop);
+static int            _load_list(Playlist *p);
+static void           _load_done(Playlist *p);
+static int            _load_files_library(Playlist *p, PlaylistLoadMode mode, PlaylistItem *items[], int len);
+static int            _update_thrd(void *udata);
+static PlaylistItem **_update_merge(Playlist *p, PlaylistItem scanned[], int scanned_len, int *len);
+static int            _update_compact(Playlist *p, PlaylistItem *list[], int len);
+static PlaylistItem **_update_rescan(Playlist *p, int *len);
+static void           _store_init(PlaylistStore *s);
+static void           _store_deinit(PlaylistStore *s);
+static void           _duration_run(Job *j, void *item, void *udata);
+static int            _durations_apply(Playlist *p);
+static int            _path_depth(const char path[]);
+static int            _path_is_changed(const ArrayPtr *changes, const char path[]);
+static void           _cstr_copy(char dest[], size_t size, const char src[]);
 
 
 /*
@@ -59,48 +192,468 @@ playlist_init(Playlist *p, const char root_dir[])
 
 	p->items = NULL;
 	p->items_len = 0;
+	p->items_prev = NULL;
+	p->probed = 0;
+	p->has_library = 0;
+	p->has_watch = 0;
+	atomic_init(&p->update.state, _UPDATE_IDLE);
+	atomic_init(&p->update.is_stopped, 0);
+	array_ptr_init(&p->update.changes);
+	p->update.items = NULL;
+	p->update.items_len = 0;
+	p->load.is_running = 0;
+	p->load.fd = -1;
+	p->load.pool = NULL;
+	p->durations.is_running = 0;
+	p->durations.entries = NULL;
+	p->durations.ptrs = NULL;
+	p->durations.len = 0;
+	p->update.is_rescan = 0;
+	p->update.is_compact = 0;
+	p->store_items = 0;
+	_store_init(&p->update.store);
+	_store_init(&p->store);
+	_store_init(&p->store_prev);
 	return 0;
 }
 
 
+/*
+ * once per Playlist, playlist_update() after that
+ */
 int
-playlist_load(Playlist *p, const PlaylistItem **items[])
+playlist_load(Playlist *p, PlaylistLoadMode mode, const PlaylistItem **items[])
 {
-	Str str;
-	if (str_init_alloc(&str, 4096) < 0) {
-		log_err(errno, "playlist: _load_files_recurse: str_init_alloc");
+	if (_load_list(p) < 0)
+		return -1;
+
+#if (CFG_LIBRARY_ENABLE == 0)
+	mode = PLAYLIST_LOAD_PROBE;
+#endif
+	if (_load_files_library(p, mode, p->items, p->items_len) < 0)
 		return -1;
-	}
 
-	ArrayPtr arr;
-	array_ptr_init(&arr);
+	*items = (const PlaylistItem **)p->items;
+	return p->items_len;
+}
+
 
-	_load_files(&str, &arr, ".", CFG_DIR_RECURSIVE_SIZE);
-	if (_load_files_meta(&arr) < 0) {
-		str_deinit(&str);
-		array_ptr_deinit(&arr);
+/*
+ * playlist_load() without the wait: the list is there at once, what the library index
+ * does not know shows its file name until probed in the background, see
+ * playlist_load_update(); the rows on screen first, see playlist_load_set_view()
+ */
+int
+playlist_load_start(Playlist *p, const PlaylistItem **items[])
+{
+	if (_load_list(p) < 0)
 		return -1;
+
+	const int len = p->items_len;
+	PlaylistItem **const probe = malloc(((size_t)len + 1) * sizeof(PlaylistItem *));
+	int *const pos = malloc(((size_t)len + 1) * sizeof(int));
+	if ((probe == NULL) || (pos == NULL)) {
+		log_err(errno, "playlist: playlist_load_start: malloc");
+		goto err0;
 	}
 
-	/* transfer the ownership */
-	p->items = (PlaylistItem **)arr.items;
-	p->items_len = (int)arr.len;
+	int probe_len = 0;
+	for (int i = 0; i < len; i++) {
+		if ((CFG_LIBRARY_ENABLE == 0) || (library_fill(&p->library, p->items[i]) < 0)) {
+			probe[probe_len] = p->items[i];
+			pos[probe_len] = i;
+			probe_len++;
+		}
+	}
+
+#ifdef DEBUG
+	log_info("playlist: playlist_load_start: %d files, %d to probe", len, probe_len);
+#endif
+	p->probed = (size_t)probe_len;
+	if (probe_len == 0) {
+		_load_done(p);
+		goto out0;
+	}
+
+	/* no eventfd: playlist_load_update() still gets there, a tick later */
+	const int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (fd < 0)
+		log_err(errno, "playlist: playlist_load_start: eventfd");
+
+	ItemPool *const pool = _item_pool_new(&p->store.blocks, probe, pos, probe_len, fd, NULL);
+	if (pool == NULL) {
+		if (fd >= 0)
+			close(fd);
+
+		goto err0;
+	}
+
+	p->load.pool = pool;
+	p->load.fd = fd;
+	p->load.is_running = 1;
 
-	str_deinit(&str);
+	/* no threads: the old way */
+	if (_item_pool_start(pool, 0) < 0) {
+		_item_worker_run(&pool->workers[0]);
+		_item_pool_apply(pool, &(int) { 0 }, &(int) { 0 });
+		_load_done(p);
+	}
 
+out0:
+	free(pos);
+	free(probe);
 	*items = (const PlaylistItem **)p->items;
-	return p->items_len;
+	return len;
+
+err0:
+	free(pos);
+	free(probe);
+	return -1;
+}
+
+
+/*
+ * returns: -1: nothing running, readable when probed items are ready to be applied
+ */
+int
+playlist_load_get_fd(const Playlist *p)
+{
+	return (p->load.is_running)? p->load.fd : -1;
+}
+
+
+/*
+ * the rows on screen: probed before the rest, wherever they are
+ */
+void
+playlist_load_set_view(Playlist *p, int first, int len)
+{
+	if (p->load.is_running == 0)
+		return;
+
+	atomic_store(&p->load.pool->view_first, first);
+	atomic_store(&p->load.pool->view_last, first + len - 1);
+}
+
+
+/*
+ * the probed items are written here, from the caller's thread: nothing else ever sees
+ * one half done; the index is saved once all of them are
+ * returns: how many changed, their positions in 'first' .. 'last'; -1: nothing running
+ */
+int
+playlist_load_update(Playlist *p, int *first, int *last, int *done, int *total)
+{
+	PlaylistLoad *const l = &p->load;
+	if (l->is_running == 0)
+		return -1;
+
+	/* the count is in the pool, the descriptor is only a wake up */
+	uint64_t val;
+	if ((l->fd >= 0) && (read(l->fd, &val, sizeof(val)) < 0) && (errno != EAGAIN))
+		log_err(errno, "playlist: playlist_load_update: read");
+
+	ItemPool *const pool = l->pool;
+	const size_t count = _item_pool_apply(pool, first, last);
+	*done = (int)pool->applied;
+	*total = (int)pool->len;
+	if (pool->applied == pool->len)
+		_load_done(p);
+
+	return (int)count;
 }
 
 
 void
 playlist_deinit(Playlist *p)
 {
-	PlaylistItem **const items = p->items;
-	for (int i = 0; i < p->items_len; i++)
-		free(items[i]);
+	PlaylistLoad *const l = &p->load;
+	if (l->is_running) {
+		atomic_store(&l->pool->is_alive, 0);
+		_item_pool_join(l->pool);
+		free(l->pool);
+		if (l->fd >= 0)
+			close(l->fd);
+
+		l->is_running = 0;
+	}
+
+	PlaylistUpdate *const u = &p->update;
+	if (atomic_load(&u->state) != _UPDATE_IDLE) {
+		atomic_store(&u->is_stopped, 1);
+		thrd_join(u->thrd, NULL);
+		atomic_store(&u->state, _UPDATE_IDLE);
+	}
+
+	playlist_durations_stop(p);
+	free(u->items);
+	watch_changes_free(&u->changes);
+	if (p->has_watch)
+		watch_deinit(&p->watch);
 
 	free(p->items);
+	free(p->items_prev);
+	_store_deinit(&u->store);
+	_store_deinit(&p->store_prev);
+	_store_deinit(&p->store);
+	if (p->has_library)
+		library_deinit(&p->library);
+}
+
+
+/*
+ * live updates: whatever changes below the root is merged in by playlist_update()
+ */
+int
+playlist_watch(Playlist *p)
+{
+	if (watch_init(&p->watch, ".", CFG_DIR_RECURSIVE_SIZE) < 0)
+		return -1;
+
+	p->has_watch = 1;
+	return 0;
+}
+
+
+/*
+ * returns: -1: not watching
+ */
+int
+playlist_watch_get_fd(const Playlist *p)
+{
+	return (p->has_watch)? watch_get_fd(&p->watch) : -1;
+}
+
+
+void
+playlist_watch_read(Playlist *p)
+{
+	if (p->has_watch)
+		watch_read(&p->watch);
+}
+
+
+/*
+ * every now and then, from the event loop: merges the settled changes in the background
+ * and hands the result over once it is there
+ * returns: the new item count, -1: nothing new (or still loading)
+ * The replaced list stays valid until the next update, its items until playlist_deinit().
+ */
+int
+playlist_update(Playlist *p, const PlaylistItem **items[])
+{
+	/* the changes wait: the merge reads the items being applied */
+	if (p->load.is_running)
+		return -1;
+
+	PlaylistUpdate *const u = &p->update;
+	switch (atomic_load(&u->state)) {
+	case _UPDATE_RUNNING:
+		return -1;
+	case _UPDATE_DONE:
+		thrd_join(u->thrd, NULL);
+
+		/* before the state goes idle: nothing applied, nothing saved over the new index */
+		if (u->is_rescan || u->is_compact)
+			playlist_durations_stop(p);
+
+		watch_changes_free(&u->changes);
+		atomic_store(&u->state, _UPDATE_IDLE);
+		if (u->items == NULL) {
+			_store_deinit(&u->store);
+			_store_init(&u->store);
+			return -1;
+		}
+
+		/* the caller moved on from these with the last handover */
+		free(p->items_prev);
+		_store_deinit(&p->store_prev);
+		_store_init(&p->store_prev);
+
+		p->items_prev = p->items;
+		p->items = u->items;
+		p->items_len = u->items_len;
+		u->items = NULL;
+		if (u->is_rescan || u->is_compact) {
+			p->store_prev = p->store;
+			p->store = u->store;
+			p->store_items = (size_t)p->items_len;
+			_store_init(&u->store);
+		}
+
+		*items = (const PlaylistItem **)p->items;
+		return p->items_len;
+	}
+
+	if (p->has_watch == 0)
+		return -1;
+
+	if (watch_take(&p->watch, CFG_WATCH_SETTLE_MS, CFG_WATCH_DELAY_MAX_MS, &u->changes) == 0)
+		return -1;
+
+	u->is_rescan = 0;
+	atomic_store(&u->state, _UPDATE_RUNNING);
+	if (thrd_create(&u->thrd, _update_thrd, p) != thrd_success) {
+		log_err(0, "playlist: playlist_update: thrd_create");
+		watch_changes_free(&u->changes);
+		atomic_store(&u->state, _UPDATE_IDLE);
+	}
+
+	return -1;
+}
+
+
+/*
+ * the whole tree listed again in the background, into a store of its own: the current
+ * list stays as it is meanwhile, playlist_update() hands the new one over. The replaced
+ * store goes with the handover after that, by then nothing looks at it anymore: the
+ * caller switched lists, the player holds copies of the paths.
+ * returns: 0: started, -1: busy (loading or updating) or failed
+ */
+int
+playlist_rescan(Playlist *p)
+{
+	PlaylistUpdate *const u = &p->update;
+	if (p->load.is_running || (atomic_load(&u->state) != _UPDATE_IDLE))
+		return -1;
+
+	u->is_rescan = 1;
+	atomic_store(&u->state, _UPDATE_RUNNING);
+	if (thrd_create(&u->thrd, _update_thrd, p) != thrd_success) {
+		log_err(0, "playlist: playlist_rescan: thrd_create");
+		atomic_store(&u->state, _UPDATE_IDLE);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * the items with an estimated duration are counted frame by frame on job threads,
+ * what was there before is stopped (its results kept); again after every load or
+ * update, an item is only ever counted once
+ */
+int
+playlist_durations_start(Playlist *p)
+{
+	if (CFG_DURATION_EXACT_ENABLE != 1)
+		return 0;
+
+	/* the estimates are not all there yet: again once playlist_load_update() is done */
+	if (p->load.is_running)
+		return 0;
+
+	playlist_durations_stop(p);
+
+	PlaylistDurations *const d = &p->durations;
+	int len = 0;
+	for (int i = 0; i < p->items_len; i++) {
+		if (p->items[i]->is_duration_estimated)
+			len++;
+	}
+
+	if (len == 0)
+		return 0;
+
+	d->entries = malloc((size_t)len * sizeof(*d->entries));
+	d->ptrs = malloc((size_t)len * sizeof(*d->ptrs));
+	if ((d->entries == NULL) || (d->ptrs == NULL)) {
+		log_err(errno, "playlist: playlist_durations_start: malloc: %d items", len);
+		goto err0;
+	}
+
+	/* in playlist order: the top of the list first */
+	int j = 0;
+	for (int i = 0; i < p->items_len; i++) {
+		if (p->items[i]->is_duration_estimated == 0)
+			continue;
+
+		struct playlist_duration *const e = &d->entries[j];
+		e->item = p->items[i];
+		e->duration = 0;
+		atomic_init(&e->state, _DURATION_PENDING);
+		d->ptrs[j++] = e;
+	}
+
+	d->len = len;
+	d->first = 0;
+	d->applied = 0;
+	if (job_start(&d->job, d->ptrs, len, CFG_DURATION_EXACT_THREADS_NUM, _duration_run, NULL) < 0)
+		goto err0;
+
+	d->is_running = 1;
+	return 0;
+
+err0:
+	free(d->entries);
+	free(d->ptrs);
+	d->entries = NULL;
+	d->ptrs = NULL;
+	return -1;
+}
+
+
+/*
+ * what is done so far is applied and saved, unless an update is running
+ */
+void
+playlist_durations_stop(Playlist *p)
+{
+	PlaylistDurations *const d = &p->durations;
+	if (d->is_running == 0)
+		return;
+
+	job_stop(&d->job);
+
+	/* the update thread reads the items: counted again next time */
+	if (atomic_load(&p->update.state) == _UPDATE_IDLE) {
+		_durations_apply(p);
+		if ((CFG_LIBRARY_ENABLE == 1) && (d->applied > 0))
+			library_save(&p->library, p->items, (size_t)p->items_len);
+	}
+
+	free(d->entries);
+	free(d->ptrs);
+	d->entries = NULL;
+	d->ptrs = NULL;
+	d->len = 0;
+	d->is_running = 0;
+}
+
+
+void
+playlist_durations_set_throttle(Playlist *p, int enable)
+{
+	if (p->durations.is_running)
+		job_set_throttle(&p->durations.job, enable);
+}
+
+
+/*
+ * from the event loop: the finished ones are written to their items, not while an
+ * update is reading them
+ * returns: how many items changed, -1: idle
+ */
+int
+playlist_durations_update(Playlist *p, int *done, int *total)
+{
+	PlaylistDurations *const d = &p->durations;
+	if (d->is_running == 0)
+		return -1;
+
+	*done = job_get_progress(&d->job, total);
+	if (atomic_load(&p->update.state) != _UPDATE_IDLE)
+		return 0;
+
+	const int applied = d->applied;
+	if (*done < *total) {
+		_durations_apply(p);
+		return d->applied - applied;
+	}
+
+	playlist_durations_stop(p);
+	return d->applied - applied;
 }
 
 
@@ -127,21 +680,17 @@ _verify(const char *name)
 }
 
 
-static int
-_item_new(PlaylistItem **new_item, const char path[], int path_len)
+static void
+_item_new(PlaylistItem *item, const ScanFile *file)
 {
-	const size_t path_len_n = ((size_t)path_len) + 1;
-	PlaylistItem *const item = malloc(sizeof(PlaylistItem) + path_len_n);
-	if (item == NULL) {
-		log_err(errno, "playlist: _item_new: item: malloc: \"%s\"", path);
-		return -1;
-	}
-
-	cstr_copy_n(item->file_path, path_len_n, path, path_len);
+	item->file_path = file->path;
 
 #if (CFG_PLAYLIST_SHOW_FULL_PATH != 0)
 	/* skip './' */
-	item->name = item->file_path + 2;
+	if (strncmp(item->file_path, "./", 2) == 0)
+		item->name = item->file_path + 2;
+	else
+		item->name = item->file_path;
 #else
 	const char *const name = strrchr(item->file_path, '/');
 	if (name != NULL)
@@ -150,30 +699,68 @@ _item_new(PlaylistItem **new_item, const char path[], int path_len)
 		item->name = item->file_path;
 #endif
 
-	item->title[0] = '\0';
-	item->artist[0] = '\0';
-	item->album[0] = '\0';
-	item->genre[0] = '\0';
+	item->title = "";
+	item->artist = "";
+	item->album = "";
+	item->genre = "";
 	item->duration = 0;
-	*new_item = item;
-	return 0;
+	item->is_duration_estimated = 0;
+	item->has_replaygain = 0;
+	item->size = file->size;
+	item->mtime = file->mtime;
+	item->ino = file->ino;
 }
 
 
+/*
+ * the strings go to 'meta', 'item' already points at it; 'head': the first bytes of the
+ * file, NULL: libav opens it
+ */
 static void
-_item_new_load(PlaylistItem *item)
+_item_new_load(PlaylistItem *item, ItemMeta *meta, const uint8_t head[], size_t head_len)
 {
 	int ret;
 	AVFormatContext *ctx = NULL;
+	AVIOContext *pb = NULL;
+	ItemIo io = {
+		.path = item->file_path,
+		.head = head,
+		.head_len = head_len,
+		.size = item->size,
+		.pos = 0,
+		.fd = -1,
+	};
+
+	if ((CFG_TAGS_NATIVE_ENABLE == 1) && (_item_new_load_tags(item, meta, head, head_len) == 0))
+		return;
+
 #ifdef DEBUG
-	log_info("playlist: _item_new_load: \"%s\"", item->file_path);
+	log_info("playlist: _item_new_load: \"%s\"%s", item->file_path, (head != NULL)? ": from memory" : "");
 #endif
 
+	if (head != NULL) {
+		ctx = avformat_alloc_context();
+		if (ctx == NULL) {
+			log_err(0, "playlist: _item_new_load: avformat_alloc_context: failed");
+			return;
+		}
+
+		pb = _item_io_new(&io);
+		if (pb == NULL) {
+			avformat_free_context(ctx);
+			return;
+		}
+
+		ctx->pb = pb;
+		ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+	}
+
+	/* frees 'ctx' on failure, never 'pb' */
 	ret = avformat_open_input(&ctx, item->file_path, NULL, NULL);
 	if (ret < 0) {
 		log_err(0, "playlist: _item_new_load: avformat_open_input: \"%s\": %s",
 			item->file_path, av_err2str(ret));
-		return;
+		goto out1;
 	}
 
 	if (ctx->probe_score <= CFG_PROBE_SCORE_MIN) {
@@ -193,203 +780,1154 @@ _item_new_load(PlaylistItem *item)
 #if (CFG_META_TITLE_ENABLE == 1)
 	ent = av_dict_get(ctx->metadata, "title", NULL, 0);
 	if (ent != NULL)
-		_cstr_copy(item->title, PLAYLIST_ITEM_TITLE_SIZE, ent->value);
+		_cstr_copy(meta->title, PLAYLIST_ITEM_TITLE_SIZE, ent->value);
 #endif
 #if (CFG_META_ARTIST_ENABLE == 1)
 	ent = av_dict_get(ctx->metadata, "artist", NULL, 0);
 	if (ent != NULL)
-		_cstr_copy(item->artist, PLAYLIST_ITEM_ARTIST_SIZE, ent->value);
+		_cstr_copy(meta->artist, PLAYLIST_ITEM_ARTIST_SIZE, ent->value);
 #endif
 #if (CFG_META_ALBUM_ENABLE == 1)
 	ent = av_dict_get(ctx->metadata, "album", NULL, 0);
 	if (ent != NULL)
-		_cstr_copy(item->album, PLAYLIST_ITEM_ALBUM_SIZE, ent->value);
+		_cstr_copy(meta->album, PLAYLIST_ITEM_ALBUM_SIZE, ent->value);
 #endif
 #if (CFG_META_GENRE_ENABLE == 1)
 	ent = av_dict_get(ctx->metadata, "genre", NULL, 0);
 	if (ent != NULL)
-		_cstr_copy(item->genre, PLAYLIST_ITEM_GENRE_SIZE, ent->value);
+		_cstr_copy(meta->genre, PLAYLIST_ITEM_GENRE_SIZE, ent->value);
 #endif
 
 	(void)ent;
 	item->duration = ctx->duration / AV_TIME_BASE;
+	item->is_duration_estimated = ((ctx->duration_estimation_method == AVFMT_DURATION_FROM_BITRATE) &&
+				       (strcmp(ctx->iformat->name, "mp3") == 0));
+	item->has_replaygain = ((av_dict_get(ctx->metadata, "REPLAYGAIN_TRACK_GAIN", NULL, 0) != NULL) ||
+				(av_dict_get(ctx->metadata, "R128_TRACK_GAIN", NULL, 0) != NULL));
 
 out0:
 	avformat_close_input(&ctx);
+out1:
+	_item_io_free(pb, &io);
 }
 
 
+/*
+ * no libav at all for the common formats; returns: -1: not read, libav's turn
+ */
 static int
-_item_new_load_thrd(void *udata)
+_item_new_load_tags(PlaylistItem *item, ItemMeta *meta, const uint8_t head[], size_t head_len)
 {
-	ItemChunk *const chunk = (ItemChunk *)udata;
-	for (int i = 0; i < chunk->len; i++)
-		_item_new_load(chunk->list[i]);
+	Tags tags;
+	if (tags_read(&tags, item->file_path, item->size, head, head_len) < 0)
+		return -1;
+
+#ifdef DEBUG
+	log_info("playlist: _item_new_load_tags: \"%s\"", item->file_path);
+#endif
+
+#if (CFG_META_TITLE_ENABLE == 1)
+	_cstr_copy(meta->title, PLAYLIST_ITEM_TITLE_SIZE, tags.title);
+#endif
+#if (CFG_META_ARTIST_ENABLE == 1)
+	_cstr_copy(meta->artist, PLAYLIST_ITEM_ARTIST_SIZE, tags.artist);
+#endif
+#if (CFG_META_ALBUM_ENABLE == 1)
+	_cstr_copy(meta->album, PLAYLIST_ITEM_ALBUM_SIZE, tags.album);
+#endif
+#if (CFG_META_GENRE_ENABLE == 1)
+	_cstr_copy(meta->genre, PLAYLIST_ITEM_GENRE_SIZE, tags.genre);
+#endif
 
+	(void)meta;
+	item->duration = tags.duration;
+	item->is_duration_estimated = tags.is_estimated;
+	item->has_replaygain = tags.has_replaygain;
 	return 0;
 }
 
 
+/*
+ * the files opened, read and closed in one io_uring round each, then probed from
+ * memory; returns: -1: the ring failed, nothing was probed
+ */
 static int
-_sort_dir_cb(const struct dirent **a, const struct dirent **b)
+_item_new_load_heads(Uring *ring, uint8_t data[], PlaylistItem *items[], ItemMeta *metas[], int len)
 {
-	return cstr_cmp_vers((*a)->d_name, (*b)->d_name);
+	const char *paths[_META_BATCH];
+	uint8_t *bufs[_META_BATCH];
+	int res[_META_BATCH];
+	for (int i = 0; i < len; i++) {
+		paths[i] = items[i]->file_path;
+		bufs[i] = &data[(size_t)i * _HEADS_SIZE];
+	}
+
+	if (uring_read_heads(ring, paths, (size_t)len, bufs, _HEADS_SIZE, res) < 0)
+		return -1;
+
+	/* could not be read: libav tries and says why */
+	for (int i = 0; i < len; i++) {
+		const uint8_t *const head = (res[i] > 0)? bufs[i] : NULL;
+		_item_new_load(items[i], metas[i], head, (head != NULL)? (size_t)res[i] : 0);
+	}
+
+	return 0;
 }
 
 
-static void
-_load_files(Str *str, ArrayPtr *file_arr, const char path[], int max_depth)
+/*
+ * the probes' strings are kept with the playlist, the pool itself goes after the load;
+ * 'pos': where the items are in the playlist, NULL: in that order
+ */
+static ItemPool *
+_item_pool_new(ArrayPtr *blocks, PlaylistItem *items[], const int pos[], int len, int fd,
+	       const atomic_int *stop)
 {
-	int num;
-	struct stat st;
-	struct dirent **list;
-	PlaylistItem *new_item;
-	ArrayPtr dir_arr;
-	char *dir_name;
+	ItemPool *const pool = malloc(sizeof(ItemPool));
+	if (pool == NULL) {
+		log_err(errno, "playlist: _item_pool_new: malloc");
+		return NULL;
+	}
 
+	/* one allocation for all of them */
+	ItemLoad *const loads = calloc((size_t)len, sizeof(ItemLoad));
+	if (loads == NULL) {
+		log_err(errno, "playlist: _item_pool_new: calloc: %d items", len);
+		goto err0;
+	}
 
-	if (file_arr->len == (INT_MAX - 1)) {
-		log_err(errno, "playlist: _load_files: too many files!: max: %zu", (INT_MAX - 1));
-		return;
+	if (array_ptr_append(blocks, loads) < 0) {
+		log_err(errno, "playlist: _item_pool_new: array_ptr_append");
+		free(loads);
+		goto err0;
 	}
 
-	num = scandir(path, &list, NULL, _sort_dir_cb);
-	if (num < 0) {
-		log_err(errno, "playlist: _load_files: scandir: %s", path);
-		return;
+	for (int i = 0; i < len; i++) {
+		ItemLoad *const l = &loads[i];
+		l->item = items[i];
+		l->staged = *items[i];
+		l->staged.title = l->meta.title;
+		l->staged.artist = l->meta.artist;
+		l->staged.album = l->meta.album;
+		l->staged.genre = l->meta.genre;
+		l->pos = (pos != NULL)? pos[i] : i;
+		atomic_init(&l->state, _LOAD_PENDING);
 	}
 
-	array_ptr_init(&dir_arr);
-	for (int i = 0; i < num; i++) {
-		const char *const name = list[i]->d_name;
-		if (name[0] == '.') {
-			free(list[i]);
-			continue;
-		}
+	pool->loads = loads;
+	pool->len = (size_t)len;
+	pool->applied = 0;
+	pool->fd = fd;
+	atomic_init(&pool->next, 0);
+	atomic_init(&pool->done, 0);
+	atomic_init(&pool->is_alive, 1);
+	pool->stop = stop;
+	atomic_init(&pool->view_first, 0);
+	atomic_init(&pool->view_last, -1);
+
+	/* waiting on the disk more than decoding: more threads than CPUs */
+	int thrds_num = CFG_FILE_META_THREADS_NUM;
+	if (thrds_num <= 0)
+		thrds_num = get_nprocs() * 2;
+	if (thrds_num > _META_THRDS)
+		thrds_num = _META_THRDS;
+
+	const int batches = (len + (_META_BATCH - 1)) / _META_BATCH;
+	if (thrds_num > batches)
+		thrds_num = batches;
+
+	pool->thrds_num = thrds_num;
+	for (int i = 0; i < thrds_num; i++) {
+		pool->workers[i] = (ItemWorker) {
+			.pool = pool,
+			.thrd_ok = 0,
+			.count = 0,
+			.elapsed = 0,
+		};
+	}
 
-		const char *const fname = str_set_fmt(str, "%s/%s", path, name);
-		if (fname == NULL) {
-			log_err(errno, "playlist: _load_files: str_set_fmt");
-			free(list[i]);
-			continue;
-		}
+	return pool;
 
-		if (stat(str->cstr, &st) < 0) {
-			log_err(errno, "playlist: _load_files: stat: %s", fname);
-			free(list[i]);
-			continue;
-		}
+err0:
+	free(pool);
+	return NULL;
+}
 
-		switch (st.st_mode & S_IFMT) {
-		case S_IFDIR:
-			/* be aware! */
-			if (max_depth == 0) {
-				log_err(0, "playlist: _load_files: %s: too deep!", fname);
-				for (; i < num; i++)
-					free(list[i]);
-
-				free(list);
-				array_ptr_deinit(&dir_arr);
-				return;
-			}
 
-			dir_name = str_dup(str);
-			if (dir_name == NULL) {
-				log_err(errno, "playlist: _load_files: str_dup: %s", fname);
-				break;
-			}
+/*
+ * 'is_caller': it is the first worker, and back once everything is taken; otherwise
+ * returns at once
+ * returns: -1: no thread could be started, nothing is done
+ */
+static int
+_item_pool_start(ItemPool *pool, int is_caller)
+{
+	int started = 0;
+	for (int i = (is_caller)? 1 : 0; i < pool->thrds_num; i++) {
+		ItemWorker *const w = &pool->workers[i];
+		if (thrd_create(&w->thrd, _item_worker_thrd, w) != thrd_success) {
+			log_err(0, "playlist: _item_pool_start: thrd_create[%d]", i);
+			continue;
+		}
 
-			if (array_ptr_append(&dir_arr, dir_name) < 0) {
-				log_err(errno, "playlist: _load_files: array_ptr_append: %s", dir_name);
-				free(dir_name);
-			}
+		w->thrd_ok = 1;
+		started++;
+	}
 
-			break;
-		case S_IFREG:
-			if (_verify(str->cstr) < 0)
-				break;
+	/* what a failed thrd_create() leaves, the caller does */
+	if (is_caller)
+		_item_worker_run(&pool->workers[0]);
+	else if (started == 0)
+		return -1;
 
-			if (_item_new(&new_item, fname, (int)str->len) < 0)
-				break;
+	return 0;
+}
 
-			if (array_ptr_append(file_arr, new_item) < 0) {
-				log_err(errno, "playlist: _load_files: array_ptr_append: %s", fname);
-				free(new_item);
-			}
 
+static void
+_item_pool_join(ItemPool *pool)
+{
+	for (int i = 0; i < pool->thrds_num; i++) {
+		if (pool->workers[i].thrd_ok)
+			thrd_join(pool->workers[i].thrd, NULL);
+
+		pool->workers[i].thrd_ok = 0;
+	}
+
+#ifdef DEBUG
+	for (int i = 0; i < pool->thrds_num; i++) {
+		log_info("playlist: _item_pool_join: worker[%d]: %zu items, %.3f ms", i, pool->workers[i].count,
+			 (double)pool->workers[i].elapsed / 1e6);
+	}
+#endif
+}
+
+
+/*
+ * the pending ones on screen first, then the next batch in playlist order
+ * returns: how many are in 'batch', 0: nothing left (or stopped)
+ */
+static int
+_item_pool_take(ItemPool *pool, ItemLoad *batch[])
+{
+	if (atomic_load(&pool->is_alive) == 0)
+		return 0;
+
+	if ((pool->stop != NULL) && atomic_load(pool->stop))
+		return 0;
+
+	int len = 0;
+	const int first = atomic_load(&pool->view_first);
+	const int last = atomic_load(&pool->view_last);
+	if (first <= last) {
+		size_t lo = 0;
+		size_t hi = pool->len;
+		while (lo < hi) {
+			const size_t mid = lo + ((hi - lo) / 2);
+			if (pool->loads[mid].pos < first)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		for (size_t i = lo; (i < pool->len) && (pool->loads[i].pos <= last) && (len < _META_BATCH); i++) {
+			ItemLoad *const l = &pool->loads[i];
+			int state = _LOAD_PENDING;
+			if ((atomic_load(&l->state) == _LOAD_PENDING) &&
+			    atomic_compare_exchange_strong(&l->state, &state, _LOAD_TAKEN))
+				batch[len++] = l;
+		}
+
+		if (len > 0)
+			return len;
+	}
+
+	/* some of the batch may be taken already: on to the next one then */
+	for (;;) {
+		const size_t start = atomic_fetch_add(&pool->next, _META_BATCH);
+		if (start >= pool->len)
+			return 0;
+
+		const size_t end = ((pool->len - start) < _META_BATCH)? pool->len : (start + _META_BATCH);
+		for (size_t i = start; i < end; i++) {
+			ItemLoad *const l = &pool->loads[i];
+			int state = _LOAD_PENDING;
+			if (atomic_compare_exchange_strong(&l->state, &state, _LOAD_TAKEN))
+				batch[len++] = l;
+		}
+
+		if (len > 0)
+			return len;
+	}
+}
+
+
+/*
+ * the probed items written over their playlist items, from the playlist's thread
+ * returns: how many, their positions in 'first' .. 'last'
+ */
+static size_t
+_item_pool_apply(ItemPool *pool, int *first, int *last)
+{
+	*first = INT_MAX;
+	*last = -1;
+
+	size_t count = 0;
+	const size_t done = atomic_load(&pool->done);
+	for (size_t i = 0; (i < pool->len) && (pool->applied < done); i++) {
+		ItemLoad *const l = &pool->loads[i];
+		if (atomic_load(&l->state) != _LOAD_DONE)
+			continue;
+
+		/* the rest is the same, and read by the player meanwhile */
+		PlaylistItem *const item = l->item;
+		item->title = l->staged.title;
+		item->artist = l->staged.artist;
+		item->album = l->staged.album;
+		item->genre = l->staged.genre;
+		item->duration = l->staged.duration;
+		item->is_duration_estimated = l->staged.is_duration_estimated;
+		item->has_replaygain = l->staged.has_replaygain;
+		atomic_store(&l->state, _LOAD_APPLIED);
+		if (l->pos < *first)
+			*first = l->pos;
+		if (l->pos > *last)
+			*last = l->pos;
+
+		pool->applied++;
+		count++;
+	}
+
+	return count;
+}
+
+
+/*
+ * a ring of its own if io_uring is enabled, plain probes if it is not there (or fails)
+ */
+static void
+_item_worker_run(ItemWorker *w)
+{
+	ItemPool *const pool = w->pool;
+	const int64_t start = stats_now_ns();
+
+	Uring ring;
+	uint8_t *data = NULL;
+	if ((CFG_SCAN_URING_ENABLE == 1) && (uring_init(&ring, _META_BATCH) == 0)) {
+		data = malloc(_META_BATCH * _HEADS_SIZE);
+		if (data == NULL) {
+			log_err(errno, "playlist: _item_worker_run: malloc");
+			uring_deinit(&ring);
+		}
+	}
+
+	ItemLoad *batch[_META_BATCH];
+	PlaylistItem *items[_META_BATCH];
+	ItemMeta *metas[_META_BATCH];
+	for (;;) {
+		const int len = _item_pool_take(pool, batch);
+		if (len == 0)
 			break;
+
+		for (int i = 0; i < len; i++) {
+			items[i] = &batch[i]->staged;
+			metas[i] = &batch[i]->meta;
+		}
+
+		if ((data != NULL) && (_item_new_load_heads(&ring, data, items, metas, len) < 0)) {
+			uring_deinit(&ring);
+			free(data);
+			data = NULL;
+		}
+
+		if (data == NULL) {
+			for (int i = 0; i < len; i++)
+				_item_new_load(items[i], metas[i], NULL, 0);
 		}
 
-		free(list[i]);
+		/* the results before the count: whoever sees one sees the other */
+		for (int i = 0; i < len; i++)
+			atomic_store(&batch[i]->state, _LOAD_DONE);
+
+		atomic_fetch_add(&pool->done, (size_t)len);
+		if ((pool->fd >= 0) && (write(pool->fd, &(uint64_t) { (uint64_t)len }, sizeof(uint64_t)) < 0))
+			log_err(errno, "playlist: _item_worker_run: write");
+
+		w->count += (size_t)len;
 	}
 
-	free(list);
-	for (size_t i = 0; i < dir_arr.len; i++) {
-		dir_name = (char *)dir_arr.items[i];
+	if (data != NULL) {
+		uring_deinit(&ring);
+		free(data);
+	}
+
+	w->elapsed = stats_now_ns() - start;
+}
+
+
+static int
+_item_worker_thrd(void *udata)
+{
+	_item_worker_run((ItemWorker *)udata);
+	return 0;
+}
+
+
+static AVIOContext *
+_item_io_new(ItemIo *io)
+{
+	uint8_t *const buffer = av_malloc(_IO_BUFFER);
+	if (buffer == NULL) {
+		log_err(ENOMEM, "playlist: _item_io_new: av_malloc");
+		return NULL;
+	}
 
-		/* be aware! */
-		_load_files(str, file_arr, dir_name, max_depth - 1);
-		free(dir_name);
+	AVIOContext *const pb = avio_alloc_context(buffer, _IO_BUFFER, 0, io, _item_io_read, NULL, _item_io_seek);
+	if (pb == NULL) {
+		log_err(ENOMEM, "playlist: _item_io_new: avio_alloc_context");
+		av_free(buffer);
+		return NULL;
 	}
 
-	array_ptr_deinit(&dir_arr);
+	return pb;
 }
 
 
+static void
+_item_io_free(AVIOContext *pb, ItemIo *io)
+{
+	if (pb != NULL) {
+		av_freep(&pb->buffer);
+		avio_context_free(&pb);
+	}
+
+	if (io->fd >= 0)
+		close(io->fd);
+}
+
+
+static int
+_item_io_read(void *udata, uint8_t buf[], int size)
+{
+	ItemIo *const io = (ItemIo *)udata;
+	if (io->pos >= io->size)
+		return AVERROR_EOF;
+
+	if ((size_t)io->pos < io->head_len) {
+		size_t len = io->head_len - (size_t)io->pos;
+		if (len > (size_t)size)
+			len = (size_t)size;
+
+		memcpy(buf, &io->head[io->pos], len);
+		io->pos += (int64_t)len;
+		return (int)len;
+	}
+
+	if (io->fd < 0) {
+		io->fd = open(io->path, O_RDONLY | O_CLOEXEC);
+		if (io->fd < 0)
+			return AVERROR(errno);
+	}
+
+	const ssize_t rd = pread(io->fd, buf, (size_t)size, (off_t)io->pos);
+	if (rd < 0)
+		return AVERROR(errno);
+	if (rd == 0)
+		return AVERROR_EOF;
+
+	io->pos += rd;
+	return (int)rd;
+}
+
+
+static int64_t
+_item_io_seek(void *udata, int64_t offt, int whence)
+{
+	ItemIo *const io = (ItemIo *)udata;
+	switch (whence & ~AVSEEK_FORCE) {
+	case AVSEEK_SIZE: return io->size;
+	case SEEK_SET: break;
+	case SEEK_CUR: offt += io->pos; break;
+	case SEEK_END: offt += io->size; break;
+	default: return AVERROR(EINVAL);
+	}
+
+	if (offt < 0)
+		return AVERROR(EINVAL);
+
+	io->pos = offt;
+	return offt;
+}
+
+
+static int
+_item_path_cmp(const void *a, const void *b)
+{
+	const PlaylistItem *const _a = *(PlaylistItem *const *)a;
+	const PlaylistItem *const _b = *(PlaylistItem *const *)b;
+	return strcmp(_a->file_path, _b->file_path);
+}
+
+
+/*
+ * the order of scan_files(): by version within a directory, its files before its
+ * subdirectories
+ */
 static int
-_load_files_meta(ArrayPtr *file_arr)
+_item_order_cmp(const void *a, const void *b)
 {
-	if (file_arr->len == 0)
+	const char *const x = (*(PlaylistItem *const *)a)->file_path;
+	const char *const y = (*(PlaylistItem *const *)b)->file_path;
+
+	/* the first path component they differ in */
+	size_t start = 0;
+	size_t i = 0;
+	for (; (x[i] != '\0') && (x[i] == y[i]); i++) {
+		if (x[i] == '/')
+			start = i + 1;
+	}
+
+	if (x[i] == y[i])
 		return 0;
 
-	int nprocs = CFG_FILE_META_THREADS_NUM;
+	const char *const x_end = strchr(&x[start], '/');
+	const char *const y_end = strchr(&y[start], '/');
+	if ((x_end == NULL) != (y_end == NULL))
+		return (x_end == NULL)? -1 : 1;
+
+	char x_name[NAME_MAX + 1];
+	char y_name[NAME_MAX + 1];
+	const size_t x_len = (x_end != NULL)? (size_t)(x_end - &x[start]) : strlen(&x[start]);
+	const size_t y_len = (y_end != NULL)? (size_t)(y_end - &y[start]) : strlen(&y[start]);
+	cstr_copy_n(x_name, sizeof(x_name), &x[start], x_len);
+	cstr_copy_n(y_name, sizeof(y_name), &y[start], y_len);
+	return cstr_cmp_vers(x_name, y_name);
+}
+
+
+/*
+ * appends the files below 'path' ('is_tree' 0: in it only) in the order of a walk
+ */
+static void
+_load_files(ItemArray *arr, Arena *arena, const char path[], int max_depth, int is_tree,
+	    const atomic_int *stop)
+{
+	int nprocs = CFG_DIR_THREADS_NUM;
 	if (nprocs <= 0)
 		nprocs = get_nprocs();
-	if (nprocs <= 0)
-		nprocs = 1;
-	
-	ItemChunk *const chunks = malloc((size_t)nprocs * sizeof(ItemChunk));
-	if (chunks == NULL) {
-		log_err(0, "playlist: _load_files_meta: malloc");
+
+	const Scan scan = {
+		.thrds_num = nprocs,
+		.max_depth = max_depth,
+		.is_tree = is_tree,
+		.filter = _verify,
+#if (CFG_SCAN_URING_ENABLE == 1)
+		.backend = SCAN_BACKEND_URING,
+#else
+		.backend = SCAN_BACKEND_PLAIN,
+#endif
+		.arena = arena,
+		.stop = stop,
+	};
+
+	ScanFile *files;
+	const int len = scan_files(&scan, path, &files);
+	if (len <= 0)
+		return;
+
+	if ((size_t)len > ((INT_MAX - 1) - arr->len)) {
+		log_err(0, "playlist: _load_files: too many files!: max: %d", (INT_MAX - 1));
+		goto out0;
+	}
+
+	PlaylistItem *const items = realloc(arr->items, (arr->len + (size_t)len) * sizeof(PlaylistItem));
+	if (items == NULL) {
+		log_err(errno, "playlist: _load_files: realloc: %zu items", arr->len + (size_t)len);
+		goto out0;
+	}
+
+	for (int i = 0; i < len; i++)
+		_item_new(&items[arr->len + (size_t)i], &files[i]);
+
+	arr->items = items;
+	arr->len += (size_t)len;
+
+out0:
+	free(files);
+}
+
+
+static int
+_load_files_meta(ArrayPtr *blocks, PlaylistItem *items[], int len, const atomic_int *stop)
+{
+	if (len == 0)
+		return 0;
+
+	ItemPool *const pool = _item_pool_new(blocks, items, NULL, len, -1, stop);
+	if (pool == NULL)
+		return -1;
+
+	int first;
+	int last;
+	_item_pool_start(pool, 1);
+	_item_pool_join(pool);
+	_item_pool_apply(pool, &first, &last);
+	free(pool);
+	return 0;
+}
+
+
+/*
+ * the library index opened, the tree listed: p->items, nothing probed yet
+ */
+static int
+_load_list(Playlist *p)
+{
+	/* relative to the root, and it logs: not before the log file is there */
+	if (library_init(&p->library) < 0)
+		return -1;
+
+	p->has_library = 1;
+
+	ItemArray arr = { .items = NULL, .len = 0 };
+	_load_files(&arr, &p->store.arena, ".", CFG_DIR_RECURSIVE_SIZE, 1, NULL);
+
+	if ((arr.items != NULL) && (array_ptr_append(&p->store.blocks, arr.items) < 0)) {
+		log_err(errno, "playlist: _load_list: array_ptr_append");
+		free(arr.items);
+		return -1;
+	}
+
+	p->store_items = arr.len;
+
+	PlaylistItem **const list = malloc((arr.len + 1) * sizeof(PlaylistItem *));
+	if (list == NULL) {
+		log_err(errno, "playlist: _load_list: malloc: list");
+		return -1;
+	}
+
+	for (size_t i = 0; i < arr.len; i++)
+		list[i] = &arr.items[i];
+
+	p->items = list;
+	p->items_len = (int)arr.len;
+	return 0;
+}
+
+
+/*
+ * after playlist_load_start(): everything is applied, the index saved if anything changed
+ */
+static void
+_load_done(Playlist *p)
+{
+	PlaylistLoad *const l = &p->load;
+	if (l->is_running) {
+		_item_pool_join(l->pool);
+		free(l->pool);
+		if (l->fd >= 0)
+			close(l->fd);
+
+		l->pool = NULL;
+		l->fd = -1;
+		l->is_running = 0;
+	}
+
+	/* new, changed or removed files */
+	if ((CFG_LIBRARY_ENABLE != 0) &&
+	    ((p->probed > 0) || (library_count(&p->library) != (uint32_t)p->items_len)))
+		library_save(&p->library, p->items, (size_t)p->items_len);
+}
+
+
+/*
+ * only what the library index does not know (or knows an older version of) is
+ * probed, the index is rewritten if anything changed
+ */
+static int
+_load_files_library(Playlist *p, PlaylistLoadMode mode, PlaylistItem *items[], int len)
+{
+	if (mode != PLAYLIST_LOAD_INDEX) {
+		p->probed = (size_t)len;
+		if (_load_files_meta(&p->store.blocks, items, len, NULL) < 0)
+			return -1;
+
+		if (mode == PLAYLIST_LOAD_REBUILD)
+			library_save(&p->library, items, (size_t)len);
+
+		return 0;
+	}
+
+	PlaylistItem **const probe = malloc(((size_t)len + 1) * sizeof(PlaylistItem *));
+	if (probe == NULL) {
+		log_err(errno, "playlist: _load_files_library: malloc: probe");
 		return -1;
 	}
 
-	const int len = (int)file_arr->len;
-	if (nprocs > len)
-		nprocs = len;
+	int probe_len = 0;
+	for (int i = 0; i < len; i++) {
+		if (library_fill(&p->library, items[i]) < 0)
+			probe[probe_len++] = items[i];
+	}
+
+#ifdef DEBUG
+	log_info("playlist: _load_files_library: %d files, %d to probe", len, probe_len);
+#endif
+	p->probed = (size_t)probe_len;
+	const int ret = _load_files_meta(&p->store.blocks, probe, probe_len, NULL);
 
-	const int each = (len / nprocs);
-	for (int i = 0; i < nprocs; i++) {
-		ItemChunk *const chunk = &chunks[i];
-		chunk->list = (PlaylistItem **)&file_arr->items[i * each];
-		chunk->len = each;
+	/* new, changed or removed files */
+	if ((ret == 0) && ((probe_len > 0) || (library_count(&p->library) != (uint32_t)len)))
+		library_save(&p->library, items, (size_t)len);
+
+	free(probe);
+	return ret;
+}
+
+
+/*
+ * the changed directories are listed again: what is known already (same path, size,
+ * mtime and inode) is kept as it is, the rest comes from the index or is probed
+ */
+static int
+_update_thrd(void *udata)
+{
+	Playlist *const p = (Playlist *)udata;
+	PlaylistUpdate *const u = &p->update;
+	u->items = NULL;
+	u->is_compact = 0;
+	if (u->is_rescan) {
+		u->items = _update_rescan(p, &u->items_len);
+		goto out0;
 	}
 
-	// remaining item(s)
-	const int total = (each * nprocs);
-	if (total < len) {
-		ItemChunk *const chunk = &chunks[nprocs - 1];
-		chunk->len += (len - total);
+	ItemArray arr = { .items = NULL, .len = 0 };
+	for (size_t i = 0; i < u->changes.len; i++) {
+		const WatchChange *const c = u->changes.items[i];
+		const int max_depth = CFG_DIR_RECURSIVE_SIZE - _path_depth(c->path);
+		if (max_depth >= 0)
+			_load_files(&arr, &p->store.arena, c->path, max_depth, c->is_tree, &u->is_stopped);
 	}
 
-	for (int i = 0; i < nprocs; i++) {
-		ItemChunk *const chunk = &chunks[i];
-		chunk->thrd_ok = 1;
-		if (thrd_create(&chunk->thrd, _item_new_load_thrd, chunk) != thrd_success) {
-			log_err(0, "playlist: _load_files_meta: thrd_create[%d]", i);
-			chunk->thrd_ok = 0;
+	/* nothing of a cut short listing is merged */
+	if (atomic_load(&u->is_stopped)) {
+		free(arr.items);
+		goto out0;
+	}
+
+	if ((arr.items != NULL) && (array_ptr_append(&p->store.blocks, arr.items) < 0)) {
+		log_err(errno, "playlist: _update_thrd: array_ptr_append");
+		free(arr.items);
+		goto out0;
+	}
+
+	p->store_items += arr.len;
+
+	u->items = _update_merge(p, arr.items, (int)arr.len, &u->items_len);
+
+out0:
+	atomic_store(&u->state, _UPDATE_DONE);
+	return 0;
+}
+
+
+/*
+ * the current list without what was in the changed directories, with what is in them now
+ */
+static PlaylistItem **
+_update_merge(Playlist *p, PlaylistItem scanned[], int scanned_len, int *len)
+{
+	const size_t items_len = (size_t)p->items_len;
+	PlaylistItem **const known = malloc((items_len + 1) * sizeof(PlaylistItem *));
+	PlaylistItem **const fresh = malloc(((size_t)scanned_len + 1) * sizeof(PlaylistItem *));
+	PlaylistItem **const probe = malloc(((size_t)scanned_len + 1) * sizeof(PlaylistItem *));
+	PlaylistItem **list = malloc((items_len + (size_t)scanned_len + 1) * sizeof(PlaylistItem *));
+	if ((known == NULL) || (fresh == NULL) || (probe == NULL) || (list == NULL)) {
+		log_err(errno, "playlist: _update_merge: malloc");
+		free(list);
+		list = NULL;
+		goto out0;
+	}
+
+	if (items_len > 0)
+		memcpy(known, p->items, items_len * sizeof(PlaylistItem *));
+
+	qsort(known, items_len, sizeof(PlaylistItem *), _item_path_cmp);
+
+	int added = 0;
+	int probe_len = 0;
+	for (int i = 0; i < scanned_len; i++) {
+		PlaylistItem *const item = &scanned[i];
+		PlaylistItem *const *const hit = bsearch(&item, known, items_len, sizeof(PlaylistItem *),
+							 _item_path_cmp);
+		if ((hit != NULL) && ((*hit)->size == item->size) && ((*hit)->mtime == item->mtime) &&
+		    ((*hit)->ino == item->ino)) {
+			fresh[i] = *hit;
+			continue;
+		}
+
+		fresh[i] = item;
+		added++;
+		if (library_fill(&p->library, item) < 0)
+			probe[probe_len++] = item;
+	}
+
+	p->probed = (size_t)probe_len;
+	_load_files_meta(&p->store.blocks, probe, probe_len, &p->update.is_stopped);
+	if (atomic_load(&p->update.is_stopped)) {
+		free(list);
+		list = NULL;
+		goto out0;
+	}
+
+	qsort(fresh, (size_t)scanned_len, sizeof(PlaylistItem *), _item_order_cmp);
+
+	/* both in order already */
+	int list_len = 0;
+	size_t i = 0;
+	int j = 0;
+	while ((i < items_len) || (j < scanned_len)) {
+		if ((i < items_len) && _path_is_changed(&p->update.changes, p->items[i]->file_path)) {
+			i++;
+			continue;
 		}
+
+		if ((j == scanned_len) || ((i < items_len) && (_item_order_cmp(&p->items[i], &fresh[j]) < 0)))
+			list[list_len++] = p->items[i++];
+		else
+			list[list_len++] = fresh[j++];
+	}
+
+#ifdef DEBUG
+	log_info("playlist: _update_merge: %zu changes: %d scanned, %d new, %d probed: %zu -> %d items",
+		 p->update.changes.len, scanned_len, added, probe_len, items_len, list_len);
+#endif
+	*len = list_len;
+	if ((added > 0) || ((size_t)list_len != items_len))
+		library_save(&p->library, list, (size_t)list_len);
+
+	/* the store stays within about twice the list: what merges replaced goes now and then */
+	const size_t replaced = p->store_items - (size_t)list_len;
+	if ((replaced > (size_t)list_len) && (replaced > _COMPACT_MIN))
+		p->update.is_compact = (_update_compact(p, list, list_len) == 0);
+
+out0:
+	free(probe);
+	free(fresh);
+	free(known);
+	return list;
+}
+
+
+/*
+ * the merged list copied into the update's store, the way a rescan leaves it: the
+ * playlist's store goes with the handover, the replaced items in it too
+ * returns: 0: 'list' points into the update's store only, -1: 'list' as it was
+ */
+static int
+_update_compact(Playlist *p, PlaylistItem *list[], int len)
+{
+	PlaylistStore *const s = &p->update.store;
+	PlaylistItem *const items = malloc(((size_t)len + 1) * sizeof(PlaylistItem));
+	PlaylistItem **const copy = malloc(((size_t)len + 1) * sizeof(PlaylistItem *));
+	if ((items == NULL) || (copy == NULL) || (array_ptr_append(&s->blocks, items) < 0)) {
+		log_err(errno, "playlist: _update_compact: malloc: %d items", len);
+		free(copy);
+		free(items);
+		return -1;
 	}
 
-	for (int i = 0; i < nprocs; i++) {
-		ItemChunk *const chunk = &chunks[i];
-		if (chunk->thrd_ok == 0)
+	int copy_len = 0;
+	for (int i = 0; i < len; i++) {
+		const PlaylistItem *const hit = list[i];
+		PlaylistItem *const item = &items[i];
+		char *const path = arena_strdup_n(&s->arena, hit->file_path, strlen(hit->file_path));
+		if (path == NULL) {
+			log_err(errno, "playlist: _update_compact: arena_strdup_n: %s", hit->file_path);
+			goto err0;
+		}
+
+		*item = *hit;
+		item->file_path = path;
+		item->name = path + (hit->name - hit->file_path);
+
+		/* the strings stay in the mapped index, the rest are copied */
+		if (library_fill(&p->library, item) == 0) {
+			item->duration = hit->duration;
+			item->is_duration_estimated = hit->is_duration_estimated;
 			continue;
-		
-		thrd_join(chunk->thrd, NULL);
+		}
+
+		copy[copy_len++] = item;
+	}
+
+	ItemMeta *metas = NULL;
+	if (copy_len > 0) {
+		metas = calloc((size_t)copy_len, sizeof(ItemMeta));
+		if ((metas == NULL) || (array_ptr_append(&s->blocks, metas) < 0)) {
+			log_err(errno, "playlist: _update_compact: calloc: %d items", copy_len);
+			free(metas);
+			goto err0;
+		}
+	}
+
+	for (int i = 0; i < copy_len; i++) {
+		PlaylistItem *const item = copy[i];
+		ItemMeta *const meta = &metas[i];
+		_cstr_copy(meta->title, sizeof(meta->title), item->title);
+		_cstr_copy(meta->artist, sizeof(meta->artist), item->artist);
+		_cstr_copy(meta->album, sizeof(meta->album), item->album);
+		_cstr_copy(meta->genre, sizeof(meta->genre), item->genre);
+		item->title = meta->title;
+		item->artist = meta->artist;
+		item->album = meta->album;
+		item->genre = meta->genre;
+	}
+
+#ifdef DEBUG
+	log_info("playlist: _update_compact: %zu items in the store: %d copied, %d of them strings too",
+		 p->store_items, len, copy_len);
+#endif
+	for (int i = 0; i < len; i++)
+		list[i] = &items[i];
+
+	free(copy);
+	return 0;
+
+err0:
+	free(copy);
+	_store_deinit(s);
+	_store_init(s);
+	return -1;
+}
+
+
+/*
+ * everything listed again into the update's store: what is known already (same path,
+ * size, mtime and inode) takes the current item's metadata, its strings from the index
+ * or copied; the rest comes from the index or is probed. Nothing points into the
+ * playlist's store afterwards.
+ */
+static PlaylistItem **
+_update_rescan(Playlist *p, int *len)
+{
+	PlaylistStore *const s = &p->update.store;
+	ItemArray arr = { .items = NULL, .len = 0 };
+	_load_files(&arr, &s->arena, ".", CFG_DIR_RECURSIVE_SIZE, 1, &p->update.is_stopped);
+	if (atomic_load(&p->update.is_stopped)) {
+		free(arr.items);
+		return NULL;
+	}
+
+	if ((arr.items != NULL) && (array_ptr_append(&s->blocks, arr.items) < 0)) {
+		log_err(errno, "playlist: _update_rescan: array_ptr_append");
+		free(arr.items);
+		return NULL;
+	}
+
+	const size_t items_len = (size_t)p->items_len;
+	PlaylistItem **const known = malloc((items_len + 1) * sizeof(PlaylistItem *));
+	PlaylistItem **const probe = malloc((arr.len + 1) * sizeof(PlaylistItem *));
+	PlaylistItem **const copy = malloc((arr.len + 1) * sizeof(PlaylistItem *));
+	const PlaylistItem **const hits = malloc((arr.len + 1) * sizeof(PlaylistItem *));
+	PlaylistItem **list = malloc((arr.len + 1) * sizeof(PlaylistItem *));
+	if ((known == NULL) || (probe == NULL) || (copy == NULL) || (hits == NULL) || (list == NULL)) {
+		log_err(errno, "playlist: _update_rescan: malloc");
+		free(list);
+		list = NULL;
+		goto out0;
+	}
+
+	if (items_len > 0)
+		memcpy(known, p->items, items_len * sizeof(PlaylistItem *));
+
+	qsort(known, items_len, sizeof(PlaylistItem *), _item_path_cmp);
+
+	int added = 0;
+	int probe_len = 0;
+	int copy_len = 0;
+	for (size_t i = 0; i < arr.len; i++) {
+		PlaylistItem *const item = &arr.items[i];
+		PlaylistItem *const *const hit = bsearch(&item, known, items_len, sizeof(PlaylistItem *),
+							 _item_path_cmp);
+		const int is_known = (hit != NULL) && ((*hit)->size == item->size) &&
+				     ((*hit)->mtime == item->mtime) && ((*hit)->ino == item->ino);
+
+		list[i] = item;
+		if (library_fill(&p->library, item) == 0) {
+			/* counted since the index was mapped */
+			if (is_known) {
+				item->duration = (*hit)->duration;
+				item->is_duration_estimated = (*hit)->is_duration_estimated;
+			} else {
+				added++;
+			}
+
+			continue;
+		}
+
+		if (is_known) {
+			copy[copy_len] = item;
+			hits[copy_len] = *hit;
+			copy_len++;
+			continue;
+		}
+
+		probe[probe_len++] = item;
+		added++;
+	}
+
+	ItemMeta *metas = NULL;
+	if (copy_len > 0) {
+		metas = calloc((size_t)copy_len, sizeof(ItemMeta));
+		if ((metas == NULL) || (array_ptr_append(&s->blocks, metas) < 0)) {
+			log_err(errno, "playlist: _update_rescan: calloc: %d items", copy_len);
+			free(metas);
+			free(list);
+			list = NULL;
+			goto out0;
+		}
+	}
+
+	for (int i = 0; i < copy_len; i++) {
+		PlaylistItem *const item = copy[i];
+		const PlaylistItem *const hit = hits[i];
+		ItemMeta *const meta = &metas[i];
+		_cstr_copy(meta->title, sizeof(meta->title), hit->title);
+		_cstr_copy(meta->artist, sizeof(meta->artist), hit->artist);
+		_cstr_copy(meta->album, sizeof(meta->album), hit->album);
+		_cstr_copy(meta->genre, sizeof(meta->genre), hit->genre);
+		item->title = meta->title;
+		item->artist = meta->artist;
+		item->album = meta->album;
+		item->genre = meta->genre;
+		item->duration = hit->duration;
+		item->is_duration_estimated = hit->is_duration_estimated;
+		item->has_replaygain = hit->has_replaygain;
+	}
+
+	p->probed = (size_t)probe_len;
+	_load_files_meta(&s->blocks, probe, probe_len, &p->update.is_stopped);
+	if (atomic_load(&p->update.is_stopped)) {
+		free(list);
+		list = NULL;
+		goto out0;
+	}
+
+#ifdef DEBUG
+	log_info("playlist: _update_rescan: %zu scanned, %d new, %d probed, %d copied: %zu -> %zu items",
+		 arr.len, added, probe_len, copy_len, items_len, arr.len);
+#endif
+	*len = (int)arr.len;
+	if ((added > 0) || (arr.len != items_len))
+		library_save(&p->library, list, arr.len);
+
+out0:
+	free(hits);
+	free(copy);
+	free(probe);
+	free(known);
+	return list;
+}
+
+
+static void
+_duration_run(Job *j, void *item, void *udata)
+{
+	struct playlist_duration *const e = (struct playlist_duration *)item;
+	if (job_yield(j) < 0)
+		return;
+
+	int state = _DURATION_FAILED;
+	if (tags_mp3_duration(e->item->file_path, e->item->size, &e->duration) == 0)
+		state = _DURATION_DONE;
+
+#ifdef DEBUG
+	log_info("playlist: _duration_run: \"%s\": %s: %" PRId64 " s", e->item->file_path,
+		 (state == _DURATION_DONE)? "done" : "failed", e->duration);
+#endif
+	atomic_store(&e->state, state);
+	(void)udata;
+}
+
+
+/*
+ * a failed one is not tried again either: the estimate is as good as it gets
+ * returns: how many items changed
+ */
+static int
+_durations_apply(Playlist *p)
+{
+	PlaylistDurations *const d = &p->durations;
+	const int applied = d->applied;
+	int i = d->first;
+	for (; i < d->len; i++) {
+		struct playlist_duration *const e = &d->entries[i];
+		const int state = atomic_load(&e->state);
+		if (state == _DURATION_PENDING)
+			break;
+
+		if (state == _DURATION_DONE) {
+			e->item->duration = e->duration;
+			d->applied++;
+		}
+
+		e->item->is_duration_estimated = 0;
+	}
+
+	d->first = i;
+	return d->applied - applied;
+}
+
+
+static void
+_store_init(PlaylistStore *s)
+{
+	array_ptr_init(&s->blocks);
+	arena_init(&s->arena, _ARENA_BLOCK);
+}
+
+
+static void
+_store_deinit(PlaylistStore *s)
+{
+	for (size_t i = 0; i < s->blocks.len; i++)
+		free(s->blocks.items[i]);
+
+	array_ptr_deinit(&s->blocks);
+	arena_deinit(&s->arena);
+}
+
+
+/*
+ * levels below the root: "./a" 1
+ */
+static int
+_path_depth(const char path[])
+{
+	int depth = 0;
+	for (const char *p = path + 1; *p != '\0'; p++) {
+		if (*p == '/')
+			depth++;
+	}
+
+	return depth;
+}
+
+
+static int
+_path_is_changed(const ArrayPtr *changes, const char path[])
+{
+	for (size_t i = 0; i < changes->len; i++) {
+		const WatchChange *const c = changes->items[i];
+		const size_t len = strlen(c->path);
+		if ((strncmp(path, c->path, len) != 0) || (path[len] != '/'))
+			continue;
+
+		if (c->is_tree || (strchr(&path[len + 1], '/') == NULL))
+			return 1;
 	}
 
-	free(chunks);
 	return 0;
 }
 
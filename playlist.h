@@ -2,7 +2,15 @@
 #define __PLAYLIST_H__
 
 
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <threads.h>
+
+#include "job.h"
+#include "library.h"
+#include "watch.h"
+#include "util.h"
 
 
 #define PLAYLIST_ITEM_TITLE_SIZE  (64)
@@ -11,25 +19,123 @@
 #define PLAYLIST_ITEM_GENRE_SIZE  (64)
 
 
+typedef enum playlist_load_mode {
+	PLAYLIST_LOAD_INDEX,	/* probe what the library index does not know, save it */
+	PLAYLIST_LOAD_PROBE,	/* probe everything, no index: what it costs without one */
+	PLAYLIST_LOAD_REBUILD,	/* probe everything, replace the index */
+} PlaylistLoadMode;
+
+
+/*
+ * strings: into the mapped library index, the playlist's own storage otherwise; never
+ * NULL, "" when unknown
+ */
 typedef struct playlist_item {
 	const char *name;
-	char        title[PLAYLIST_ITEM_TITLE_SIZE];
-	char        artist[PLAYLIST_ITEM_ARTIST_SIZE];
-	char        album[PLAYLIST_ITEM_ALBUM_SIZE];
-	char        genre[PLAYLIST_ITEM_GENRE_SIZE];
+	const char *file_path;
+	const char *title;
+	const char *artist;
+	const char *album;
+	const char *genre;
 	int64_t     duration;
-	char        file_path[];
+	int         is_duration_estimated;	/* from the bitrate, see playlist_durations_start() */
+	int         has_replaygain;
+	int64_t     size;		/* of the file, these three key the library index */
+	int64_t     mtime;		/* ns */
+	uint64_t    ino;
 } PlaylistItem;
 
-typedef struct playlist {
+/*
+ * where the items live: their arrays and the probed ones' strings in 'blocks', their paths
+ * in 'arena'; freed as a whole
+ */
+typedef struct playlist_store {
+	ArrayPtr blocks;
+	Arena    arena;
+} PlaylistStore;
+
+/*
+ * merging what the watch saw, or listing everything again, in the background, see
+ * playlist_update() and playlist_rescan()
+ */
+typedef struct playlist_update {
+	atomic_int     state;
+	atomic_int     is_stopped;	/* playlist_deinit(): the scan and the probes end early */
+	thrd_t         thrd;
+	int            is_rescan;
+	int            is_compact;	/* the merge copied its list into 'store' */
+	ArrayPtr       changes;	/* WatchChange */
+	PlaylistStore  store;		/* a rescan's or compacting merge's, apart from the playlist's */
+	PlaylistItem **items;		/* the result, NULL: failed */
 	int            items_len;
-	PlaylistItem **items;
+} PlaylistUpdate;
+
+/*
+ * probing what the library index does not know, in the background, see
+ * playlist_load_start(); the items are only written from the caller's thread, in
+ * playlist_load_update()
+ */
+typedef struct playlist_load {
+	int               is_running;
+	int               fd;		/* eventfd, -1: none */
+	struct item_pool *pool;
+} PlaylistLoad;
+
+/*
+ * exact durations where they were estimated, counted in the background; the items are
+ * only written from the caller's thread, in playlist_durations_update()
+ */
+typedef struct playlist_durations {
+	int                       is_running;
+	Job                       job;
+	struct playlist_duration *entries;
+	void                    **ptrs;	/* entries, for the job */
+	int                       len;
+	int                       first;	/* the ones before it are applied */
+	int                       applied;
+} PlaylistDurations;
+
+/*
+ * a load takes a handful of allocations whatever the item count: the items are one
+ * array, their paths an arena, the strings of probed items one more array; an update
+ * adds its own. Items live as long as their store: the playlist's until a rescan
+ * replaces it, one more update after that (the previous list), see playlist_rescan().
+ * A merge replaces it the same way once it holds more replaced items than listed ones.
+ */
+typedef struct playlist {
+	int                 items_len;
+	PlaylistItem      **items;
+	PlaylistItem      **items_prev;	/* before the last update */
+	PlaylistStore       store;
+	PlaylistStore       store_prev;	/* replaced by the last rescan, 'items_prev' in it */
+	size_t              store_items;	/* in 'store': the list's, and what merges replaced */
+	size_t              probed;	/* by the last load or update */
+	int                 has_library;
+	Library             library;
+	int                 has_watch;
+	Watch               watch;
+	PlaylistLoad        load;
+	PlaylistUpdate      update;
+	PlaylistDurations   durations;
 } Playlist;
 
 
 int  playlist_init(Playlist *p, const char root_dir[]);
-int  playlist_load(Playlist *p, const PlaylistItem **items[]);
+int  playlist_load(Playlist *p, PlaylistLoadMode mode, const PlaylistItem **items[]);
+int  playlist_load_start(Playlist *p, const PlaylistItem **items[]);
+int  playlist_load_get_fd(const Playlist *p);
+void playlist_load_set_view(Playlist *p, int first, int len);
+int  playlist_load_update(Playlist *p, int *first, int *last, int *done, int *total);
 void playlist_deinit(Playlist *p);
+int  playlist_watch(Playlist *p);
+int  playlist_watch_get_fd(const Playlist *p);
+void playlist_watch_read(Playlist *p);
+int  playlist_update(Playlist *p, const PlaylistItem **items[]);
+int  playlist_rescan(Playlist *p);
+int  playlist_durations_start(Playlist *p);
+void playlist_durations_stop(Playlist *p);
+void playlist_durations_set_throttle(Playlist *p, int enable);
+int  playlist_durations_update(Playlist *p, int *done, int *total);
 
 
 #endif
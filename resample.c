@@ -0,0 +1,217 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libavutil/opt.h>
+
+#include "resample.h"
+#include "util.h"
+
+
+#define _FILTER_SIZE      (32)	/* libswresample's default */
+#define _FILTER_SIZE_MIN  (2)
+#define _FILTER_SIZE_MAX  (256)
+#define _SOXR_PRECISION   (28.0)	/* bits, soxr's "very high quality" */
+
+
+typedef struct resample_preset {
+	const char     *name;
+	ResampleParams  params;
+} ResamplePreset;
+
+
+static int _engine_from_str(const char str[], unsigned len);
+static int _number_from_str(const SpaceTokenizer *st, double *val);
+
+
+static const char *const _engines[RESAMPLE_ENGINE_END] = {
+	[RESAMPLE_ENGINE_SWR] = "swr",
+	[RESAMPLE_ENGINE_SOXR] = "soxr",
+};
+
+static const ResamplePreset _presets[] = {
+	{ "cheap", { RESAMPLE_ENGINE_SWR, 8, 0.90 } },
+	{ "default", { RESAMPLE_ENGINE_SWR, _FILTER_SIZE, 0.0 } },
+	{ "best", { RESAMPLE_ENGINE_SOXR, 0, 0.0 } },
+};
+
+
+/*
+ * public
+ */
+/*
+ * str: "<cheap|default|best>" or "<swr|soxr> [filter_size [cutoff]]"
+ */
+int
+resample_params_from_str(ResampleParams *p, const char str[])
+{
+	SpaceTokenizer st;
+	const char *next = space_tokenizer_next(&st, str);
+	if (next == NULL)
+		return -1;
+
+	for (size_t i = 0; i < LEN(_presets); i++) {
+		if ((strlen(_presets[i].name) == st.len) && (strncmp(_presets[i].name, st.value, st.len) == 0)) {
+			if (*next != '\0')
+				return -1;
+
+			*p = _presets[i].params;
+			return 0;
+		}
+	}
+
+	const int engine = _engine_from_str(st.value, st.len);
+	if (engine < 0)
+		return -1;
+
+	ResampleParams ret = { .engine = (ResampleEngine)engine, .filter_size = _FILTER_SIZE, .cutoff = 0.0 };
+	if ((next = space_tokenizer_next(&st, next)) != NULL) {
+		double val;
+		if ((_number_from_str(&st, &val) < 0) || (val < _FILTER_SIZE_MIN) || (val > _FILTER_SIZE_MAX) ||
+		    (val != (double)(int)val))
+			return -1;
+
+		ret.filter_size = (int)val;
+		if ((next = space_tokenizer_next(&st, next)) != NULL) {
+			if ((_number_from_str(&st, &val) < 0) || (val <= 0.0) || (val > 1.0))
+				return -1;
+
+			ret.cutoff = val;
+			if (*next != '\0')
+				return -1;
+		}
+	}
+
+	*p = ret;
+	return 0;
+}
+
+
+const char *
+resample_params_str(const ResampleParams *p, char buffer[], size_t size)
+{
+	assert((unsigned)p->engine < RESAMPLE_ENGINE_END);
+	char cutoff[16] = "default";
+	if (p->cutoff > 0.0)
+		snprintf(cutoff, sizeof(cutoff), "%.3f", p->cutoff);
+
+	if (p->engine == RESAMPLE_ENGINE_SOXR)
+		snprintf(buffer, size, "%s, cutoff: %s", _engines[p->engine], cutoff);
+	else
+		snprintf(buffer, size, "%s, %d taps, cutoff: %s", _engines[p->engine], p->filter_size, cutoff);
+
+	return buffer;
+}
+
+
+/*
+ * before swr_init(); an engine that was not built in fails there
+ */
+int
+resample_apply(SwrContext *swr, const ResampleParams *p)
+{
+	assert((unsigned)p->engine < RESAMPLE_ENGINE_END);
+	int ret = av_opt_set(swr, "resampler", _engines[p->engine], 0);
+	if (ret < 0)
+		goto err0;
+
+	if (p->engine == RESAMPLE_ENGINE_SOXR)
+		ret = av_opt_set_double(swr, "precision", _SOXR_PRECISION, 0);
+	else
+		ret = av_opt_set_int(swr, "filter_size", p->filter_size, 0);
+
+	if (ret < 0)
+		goto err0;
+
+	if (p->cutoff > 0.0) {
+		ret = av_opt_set_double(swr, "cutoff", p->cutoff, 0);
+		if (ret < 0)
+			goto err0;
+	}
+
+	return 0;
+
+err0:
+	log_err(0, "resample: resample_apply: av_opt_set: %s", av_err2str(ret));
+	return -1;
+}
+
+
+int
+resample_desc_init(ResampleDesc *d, const ResampleParams *params)
+{
+	if (mtx_init(&d->mutex, mtx_plain) != thrd_success) {
+		log_err(0, "resample: resample_desc_init: mtx_init: failed");
+		return -1;
+	}
+
+	atomic_store(&d->gen, 0);
+	d->params = *params;
+	return 0;
+}
+
+
+void
+resample_desc_deinit(ResampleDesc *d)
+{
+	mtx_destroy(&d->mutex);
+}
+
+
+void
+resample_desc_set(ResampleDesc *d, const ResampleParams *params)
+{
+	mtx_lock(&d->mutex); /* LOCK */
+	d->params = *params;
+	atomic_fetch_add(&d->gen, 1);
+	mtx_unlock(&d->mutex); /* UNLOCK */
+}
+
+
+/*
+ * returns: the generation 'params' belongs to
+ */
+unsigned
+resample_desc_get(ResampleDesc *d, ResampleParams *params)
+{
+	mtx_lock(&d->mutex); /* LOCK */
+	*params = d->params;
+	const unsigned ret = atomic_load(&d->gen);
+	mtx_unlock(&d->mutex); /* UNLOCK */
+	return ret;
+}
+
+
+/*
+ * private
+ */
+static int
+_engine_from_str(const char str[], unsigned len)
+{
+	for (int i = 0; i < RESAMPLE_ENGINE_END; i++) {
+		if ((strlen(_engines[i]) == len) && (strncmp(_engines[i], str, len) == 0))
+			return i;
+	}
+
+	return -1;
+}
+
+
+static int
+_number_from_str(const SpaceTokenizer *st, double *val)
+{
+	char buffer[32];
+	if (st->len >= LEN(buffer))
+		return -1;
+
+	char *end;
+	cstr_copy_n(buffer, LEN(buffer), st->value, st->len);
+	errno = 0;
+	*val = strtod(buffer, &end);
+	if ((errno != 0) || (end == buffer) || (*end != '\0'))
+		return -1;
+
+	return 0;
+}
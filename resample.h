@@ -0,0 +1,50 @@
+#ifndef __RESAMPLE_H__
+#define __RESAMPLE_H__
+
+
+#include <stddef.h>
+#include <stdatomic.h>
+#include <threads.h>
+
+#include <libswresample/swresample.h>
+
+
+typedef enum resample_engine {
+	RESAMPLE_ENGINE_SWR,
+	RESAMPLE_ENGINE_SOXR,		/* if libswresample was built with it */
+
+	RESAMPLE_ENGINE_END,
+} ResampleEngine;
+
+
+/*
+ * filter_size: swr only, taps per phase
+ * cutoff: of the output Nyquist frequency, 0.0: the engine's default
+ */
+typedef struct resample_params {
+	ResampleEngine engine;
+	int            filter_size;
+	double         cutoff;
+} ResampleParams;
+
+/*
+ * ResampleDesc: the ":resampler" setting, shared by every decoder like FilterDesc
+ */
+typedef struct resample_desc {
+	atomic_uint    gen;
+	mtx_t          mutex;
+	ResampleParams params;
+} ResampleDesc;
+
+
+int         resample_params_from_str(ResampleParams *p, const char str[]);
+const char *resample_params_str(const ResampleParams *p, char buffer[], size_t size);
+int         resample_apply(SwrContext *swr, const ResampleParams *p);
+
+int         resample_desc_init(ResampleDesc *d, const ResampleParams *params);
+void        resample_desc_deinit(ResampleDesc *d);
+void        resample_desc_set(ResampleDesc *d, const ResampleParams *params);
+unsigned    resample_desc_get(ResampleDesc *d, ResampleParams *params);
+
+
+#endif
@@ -0,0 +1,117 @@
+/* sched_setaffinity(), RUSAGE_THREAD */
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include "rt.h"
+#include "util.h"
+
+
+static void _stack_prefault(void);
+
+
+static const int _policies[RT_POLICY_END] = {
+	[RT_POLICY_FIFO] = SCHED_FIFO,
+	[RT_POLICY_RR] = SCHED_RR,
+};
+
+
+/*
+ * public
+ */
+/*
+ * keeps 'addr' resident: no page fault on the audio path once it was touched
+ */
+int
+rt_lock(const void *addr, size_t size)
+{
+	if (mlock(addr, size) < 0) {
+		log_err(errno, "rt: rt_lock: mlock: %zu bytes", size);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+void
+rt_unlock(const void *addr, size_t size)
+{
+	munlock(addr, size);
+}
+
+
+/*
+ * the calling thread: scheduling policy and priority, pinned to 'cpu' (-1: any),
+ * the top of its stack faulted in
+ */
+int
+rt_thread_setup(const char name[], RtPolicy policy, int priority, int cpu)
+{
+	assert((unsigned)policy < RT_POLICY_END);
+	int ret = 0;
+	const int pol = _policies[policy];
+	const int prio_min = sched_get_priority_min(pol);
+	const int prio_max = sched_get_priority_max(pol);
+	if (priority < prio_min)
+		priority = prio_min;
+	else if (priority > prio_max)
+		priority = prio_max;
+
+	const struct sched_param param = { .sched_priority = priority };
+	const int err = pthread_setschedparam(pthread_self(), pol, &param);
+	if (err != 0) {
+		log_err(err, "rt: rt_thread_setup: %s: pthread_setschedparam: %d", name, priority);
+		ret = -1;
+	}
+
+	if (cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+			log_err(errno, "rt: rt_thread_setup: %s: sched_setaffinity: cpu %d", name, cpu);
+			ret = -1;
+		}
+	}
+
+	_stack_prefault();
+#ifdef DEBUG
+	log_info("rt: rt_thread_setup: %s: policy: %d, priority: %d, cpu: %d", name, pol, priority, cpu);
+#endif
+	return ret;
+}
+
+
+/*
+ * voluntary context switches of the calling thread so far: one more across a
+ * section that must not block means it did
+ */
+long
+rt_switches(void)
+{
+	struct rusage ru;
+	if (getrusage(RUSAGE_THREAD, &ru) < 0)
+		return 0;
+
+	return ru.ru_nvcsw;
+}
+
+
+/*
+ * private
+ */
+static void
+_stack_prefault(void)
+{
+	volatile unsigned char buffer[RT_STACK_PREFAULT];
+	for (size_t i = 0; i < sizeof(buffer); i += 1024)
+		buffer[i] = 0;
+}
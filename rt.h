@@ -0,0 +1,30 @@
+#ifndef __RT_H__
+#define __RT_H__
+
+
+#include <stddef.h>
+
+
+#define RT_STACK_PREFAULT (64 * 1024)
+
+
+typedef enum rt_policy {
+	RT_POLICY_FIFO,
+	RT_POLICY_RR,
+
+	RT_POLICY_END,
+} RtPolicy;
+
+
+/*
+ * real-time helpers, see CFG_RT_ENABLE
+ * Everything here logs and carries on when the system says no (RLIMIT_MEMLOCK,
+ * RLIMIT_RTPRIO, no CAP_SYS_NICE): playback works the same, only less protected.
+ */
+int  rt_lock(const void *addr, size_t size);
+void rt_unlock(const void *addr, size_t size);
+int  rt_thread_setup(const char name[], RtPolicy policy, int priority, int cpu);
+long rt_switches(void);
+
+
+#endif
@@ -0,0 +1,735 @@
+/* d_type, struct statx */
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "scan.h"
+#include "uring.h"
+
+
+#define _ARENA_BLOCK     (64 * 1024)
+#define _DEQUE_SIZE_INIT (64)
+#define _URING_ENTRIES   (128)
+#define _STATX_MASK      (STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME | STATX_INO)
+
+
+/*
+ * filled by the one worker that lists it; the tree is walked once all of them are done
+ */
+typedef struct scan_dir ScanDir;
+struct scan_dir {
+	int        max_depth;
+	ScanFile  *files;	/* in order */
+	size_t     files_len;
+	ScanDir  **subdirs;	/* in order */
+	size_t     subdirs_len;
+	char       path[];
+};
+
+/*
+ * the owner takes from the tail (depth first, what it pushed last), thieves from the head
+ */
+typedef struct scan_deque {
+	mtx_t     mutex;
+	ScanDir **dirs;
+	size_t    head;
+	size_t    tail;
+	size_t    size;
+} ScanDeque;
+
+typedef struct scan_pool ScanPool;
+
+typedef struct scan_worker {
+	ScanPool  *pool;
+	int        index;
+	int        thrd_ok;
+	thrd_t     thrd;
+	Arena      arena;
+	ScanDeque  deque;
+	int        has_ring;
+	Uring      ring;
+	size_t     listed;
+	size_t     stolen;
+	size_t     batched;	/* statx()es through the ring */
+} ScanWorker;
+
+struct scan_pool {
+	const Scan    *scan;
+	atomic_size_t  pending;	/* queued or being listed: none left, all done */
+	atomic_size_t  queued;
+	atomic_size_t  files;
+	mtx_t          mutex;	/* idle workers wait for either */
+	cnd_t          cond;
+	int            workers_len;
+	ScanWorker     workers[SCAN_THREADS_MAX];
+};
+
+/*
+ * is_dir: -1: not known without a stat() (links, some file systems), -2: dropped
+ */
+typedef struct scan_entry {
+	int      is_dir;
+	int64_t  size;		/* files only */
+	int64_t  mtime;
+	uint64_t ino;
+	char     name[];
+} ScanEntry;
+
+
+static ScanDir *_dir_new(const char path[], size_t path_len, int max_depth);
+static void     _dir_list(ScanWorker *w, ScanDir *dir);
+static int      _dir_list_read(ScanWorker *w, ScanDir *dir, int fd, ArrayPtr *entries);
+static void     _dir_stat(ScanWorker *w, ScanDir *dir, int fd, ArrayPtr *entries);
+static int      _dir_stat_ring(ScanWorker *w, ScanDir *dir, int fd, ScanEntry *todo[], size_t len);
+static void     _entry_set(const ScanWorker *w, ScanEntry *e, const struct stat *st);
+static size_t   _dir_flatten(ScanDir *dir, ScanFile files[], size_t len);
+static int      _entry_cmp(const void *a, const void *b);
+static int      _deque_init(ScanDeque *d);
+static void     _deque_deinit(ScanDeque *d);
+static int      _deque_push(ScanDeque *d, ScanDir *dir);
+static ScanDir *_deque_pop(ScanDeque *d);
+static ScanDir *_deque_steal(ScanDeque *d);
+static int      _push(ScanWorker *w, ScanDir *dir);
+static ScanDir *_next(ScanWorker *w);
+static void     _worker_run(ScanWorker *w);
+static int      _worker_thrd(void *udata);
+
+
+/*
+ * public
+ */
+/*
+ * returns: the file count, -1: error; 'files' in order, to be freed, their paths in
+ * 's->arena'
+ */
+int
+scan_files(const Scan *s, const char path[], ScanFile *files[])
+{
+	int thrds_num = s->thrds_num;
+	if (thrds_num <= 0)
+		thrds_num = 1;
+	if (thrds_num > SCAN_THREADS_MAX)
+		thrds_num = SCAN_THREADS_MAX;
+
+	ScanPool pool;
+	pool.scan = s;
+	pool.workers_len = thrds_num;
+	atomic_init(&pool.pending, 0);
+	atomic_init(&pool.queued, 0);
+	atomic_init(&pool.files, 0);
+
+	int ret = -1;
+	if (mtx_init(&pool.mutex, mtx_plain) != thrd_success) {
+		log_err(0, "scan: scan_files: mtx_init: failed");
+		return -1;
+	}
+
+	if (cnd_init(&pool.cond) != thrd_success) {
+		log_err(0, "scan: scan_files: cnd_init: failed");
+		goto out0;
+	}
+
+	int workers_len = 0;
+	for (; workers_len < thrds_num; workers_len++) {
+		ScanWorker *const w = &pool.workers[workers_len];
+		if (_deque_init(&w->deque) < 0)
+			goto out1;
+
+		w->pool = &pool;
+		w->index = workers_len;
+		w->thrd_ok = 0;
+		w->has_ring = 0;
+		w->listed = 0;
+		w->stolen = 0;
+		w->batched = 0;
+		arena_init(&w->arena, _ARENA_BLOCK);
+	}
+
+	ScanDir *const root = _dir_new(path, strlen(path), s->max_depth);
+	if (root == NULL)
+		goto out1;
+
+	if (_push(&pool.workers[0], root) < 0) {
+		free(root);
+		goto out1;
+	}
+
+	/* the caller is the first worker */
+	for (int i = 1; i < thrds_num; i++) {
+		ScanWorker *const w = &pool.workers[i];
+		if (thrd_create(&w->thrd, _worker_thrd, w) != thrd_success) {
+			log_err(0, "scan: scan_files: thrd_create[%d]", i);
+			continue;
+		}
+
+		w->thrd_ok = 1;
+	}
+
+	_worker_run(&pool.workers[0]);
+	for (int i = 1; i < thrds_num; i++) {
+		if (pool.workers[i].thrd_ok)
+			thrd_join(pool.workers[i].thrd, NULL);
+	}
+
+	if ((s->stop != NULL) && atomic_load(s->stop)) {
+		_dir_flatten(root, NULL, 0);
+		goto out1;
+	}
+
+	const size_t total = atomic_load(&pool.files);
+	ScanFile *const out = malloc((total + 1) * sizeof(ScanFile));
+	if (out == NULL)
+		log_err(errno, "scan: scan_files: malloc: %zu files", total);
+
+	const size_t len = _dir_flatten(root, out, 0);
+	if (out != NULL) {
+		if (len > (INT_MAX - 1)) {
+			log_err(0, "scan: scan_files: too many files!: max: %d", (INT_MAX - 1));
+			free(out);
+		} else {
+			*files = out;
+			ret = (int)len;
+		}
+	}
+
+#ifdef DEBUG
+	for (int i = 0; i < thrds_num; i++) {
+		const ScanWorker *const w = &pool.workers[i];
+		log_info("scan: scan_files: worker[%d]: %zu directories listed, %zu stolen, %zu statx batched", i,
+			 w->listed, w->stolen, w->batched);
+	}
+#endif
+
+out1:
+	for (int i = 0; i < workers_len; i++) {
+		ScanWorker *const w = &pool.workers[i];
+		if (ret >= 0)
+			arena_merge(s->arena, &w->arena);
+		else
+			arena_deinit(&w->arena);
+
+		_deque_deinit(&w->deque);
+	}
+
+	cnd_destroy(&pool.cond);
+out0:
+	mtx_destroy(&pool.mutex);
+	return ret;
+}
+
+
+/*
+ * private
+ */
+static ScanDir *
+_dir_new(const char path[], size_t path_len, int max_depth)
+{
+	ScanDir *const dir = malloc(sizeof(ScanDir) + path_len + 1);
+	if (dir == NULL) {
+		log_err(errno, "scan: _dir_new: malloc: %s", path);
+		return NULL;
+	}
+
+	dir->max_depth = max_depth;
+	dir->files = NULL;
+	dir->files_len = 0;
+	dir->subdirs = NULL;
+	dir->subdirs_len = 0;
+	memcpy(dir->path, path, path_len);
+	dir->path[path_len] = '\0';
+	return dir;
+}
+
+
+/*
+ * one open() per directory, its entries are looked up relative to it; d_type saves the
+ * stat() of subdirectories and of the files the filter does not want
+ */
+static void
+_dir_list(ScanWorker *w, ScanDir *dir)
+{
+	const int fd = openat(AT_FDCWD, dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		/* removed meanwhile: nothing to list */
+		if (errno != ENOENT)
+			log_err(errno, "scan: _dir_list: openat: %s", dir->path);
+
+		return;
+	}
+
+	ArrayPtr entries;
+	array_ptr_init(&entries);
+	if (_dir_list_read(w, dir, fd, &entries) < 0)
+		goto out0;
+
+	if (entries.len > 1)
+		qsort(entries.items, entries.len, sizeof(void *), _entry_cmp);
+
+	dir->files = malloc((entries.len + 1) * sizeof(ScanFile));
+	dir->subdirs = malloc((entries.len + 1) * sizeof(ScanDir *));
+	if ((dir->files == NULL) || (dir->subdirs == NULL)) {
+		log_err(errno, "scan: _dir_list: malloc: %s", dir->path);
+		goto out0;
+	}
+
+	char path[PATH_MAX];
+	for (size_t i = 0; i < entries.len; i++) {
+		const ScanEntry *const e = entries.items[i];
+		const int len = snprintf(path, sizeof(path), "%s/%s", dir->path, e->name);
+		if ((len < 0) || (len >= (int)sizeof(path))) {
+			log_err(ENAMETOOLONG, "scan: _dir_list: %s/%s", dir->path, e->name);
+			continue;
+		}
+
+		if (e->is_dir) {
+			/* be aware! */
+			if (dir->max_depth == 0) {
+				log_err(0, "scan: _dir_list: %s: too deep!", path);
+				break;
+			}
+
+			ScanDir *const sub = _dir_new(path, (size_t)len, dir->max_depth - 1);
+			if (sub == NULL)
+				continue;
+
+			dir->subdirs[dir->subdirs_len++] = sub;
+			if (_push(w, sub) < 0) {
+				dir->subdirs_len--;
+				free(sub);
+			}
+
+			continue;
+		}
+
+		const char *const file_path = arena_strdup_n(&w->arena, path, (size_t)len);
+		if (file_path == NULL) {
+			log_err(errno, "scan: _dir_list: arena_strdup_n: %s", path);
+			continue;
+		}
+
+		dir->files[dir->files_len++] = (ScanFile) {
+			.path = file_path,
+			.path_len = (size_t)len,
+			.size = e->size,
+			.mtime = e->mtime,
+			.ino = e->ino,
+		};
+	}
+
+	atomic_fetch_add(&w->pool->files, dir->files_len);
+
+out0:
+	for (size_t i = 0; i < entries.len; i++)
+		free(entries.items[i]);
+
+	array_ptr_deinit(&entries);
+}
+
+
+/*
+ * closes 'fd'
+ */
+static int
+_dir_list_read(ScanWorker *w, ScanDir *dir, int fd, ArrayPtr *entries)
+{
+	const Scan *const s = w->pool->scan;
+	DIR *const d = fdopendir(fd);
+	if (d == NULL) {
+		log_err(errno, "scan: _dir_list_read: fdopendir: %s", dir->path);
+		close(fd);
+		return -1;
+	}
+
+	int ret = 0;
+	struct dirent *ent;
+	while ((ent = readdir(d)) != NULL) {
+		const char *const name = ent->d_name;
+		if (name[0] == '.')
+			continue;
+
+		int is_dir;
+		switch (ent->d_type) {
+		case DT_DIR: is_dir = 1; break;
+		case DT_REG: is_dir = 0; break;
+		case DT_LNK:
+		case DT_UNKNOWN: is_dir = -1; break;
+		default: continue;
+		}
+
+		if ((is_dir == 1) && (s->is_tree == 0))
+			continue;
+
+		if ((is_dir == 0) && (s->filter != NULL) && (s->filter(name) < 0))
+			continue;
+
+		const size_t name_len = strlen(name);
+		ScanEntry *const e = malloc(sizeof(ScanEntry) + name_len + 1);
+		if (e == NULL) {
+			log_err(errno, "scan: _dir_list_read: malloc");
+			ret = -1;
+			break;
+		}
+
+		e->is_dir = is_dir;
+		memcpy(e->name, name, name_len + 1);
+		if (array_ptr_append(entries, e) < 0) {
+			log_err(errno, "scan: _dir_list_read: array_ptr_append");
+			free(e);
+			ret = -1;
+			break;
+		}
+	}
+
+	if (ret == 0)
+		_dir_stat(w, dir, fd, entries);
+
+	w->listed++;
+	closedir(d);
+	return ret;
+}
+
+
+/*
+ * files and unknowns, all of a directory at once: one ring submission, or one
+ * fstatat() each; what turns out to be neither a file nor a directory is dropped
+ */
+static void
+_dir_stat(ScanWorker *w, ScanDir *dir, int fd, ArrayPtr *entries)
+{
+	ScanEntry **const todo = malloc((entries->len + 1) * sizeof(ScanEntry *));
+	if (todo == NULL) {
+		log_err(errno, "scan: _dir_stat: malloc");
+		return;
+	}
+
+	size_t len = 0;
+	for (size_t i = 0; i < entries->len; i++) {
+		ScanEntry *const e = entries->items[i];
+		if (e->is_dir != 1)
+			todo[len++] = e;
+	}
+
+	if ((len > 0) && ((w->has_ring == 0) || (_dir_stat_ring(w, dir, fd, todo, len) < 0))) {
+		for (size_t i = 0; i < len; i++) {
+			struct stat st;
+			if (fstatat(fd, todo[i]->name, &st, 0) < 0) {
+				log_err(errno, "scan: _dir_stat: fstatat: %s/%s", dir->path, todo[i]->name);
+				todo[i]->is_dir = -2;
+				continue;
+			}
+
+			_entry_set(w, todo[i], &st);
+		}
+	}
+
+	free(todo);
+
+	size_t kept = 0;
+	for (size_t i = 0; i < entries->len; i++) {
+		ScanEntry *const e = entries->items[i];
+		if (e->is_dir == -2)
+			free(e);
+		else
+			entries->items[kept++] = e;
+	}
+
+	entries->len = kept;
+}
+
+
+/*
+ * returns: -1: the ring failed, it is not used again
+ */
+static int
+_dir_stat_ring(ScanWorker *w, ScanDir *dir, int fd, ScanEntry *todo[], size_t len)
+{
+	struct statx *const stx = malloc(len * sizeof(struct statx));
+	const char **const names = malloc(len * sizeof(char *));
+	int *const res = malloc(len * sizeof(int));
+
+	int ret = -1;
+	if ((stx == NULL) || (names == NULL) || (res == NULL)) {
+		log_err(errno, "scan: _dir_stat_ring: malloc");
+		goto out0;
+	}
+
+	for (size_t i = 0; i < len; i++)
+		names[i] = todo[i]->name;
+
+	if (uring_statx(&w->ring, fd, names, len, _STATX_MASK, stx, res) < 0) {
+		uring_deinit(&w->ring);
+		w->has_ring = 0;
+		goto out0;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		if (res[i] < 0) {
+			log_err(-res[i], "scan: _dir_stat_ring: statx: %s/%s", dir->path, todo[i]->name);
+			todo[i]->is_dir = -2;
+			continue;
+		}
+
+		const struct statx *const x = &stx[i];
+		const struct stat st = {
+			.st_mode = x->stx_mode,
+			.st_size = (off_t)x->stx_size,
+			.st_mtim = { .tv_sec = (time_t)x->stx_mtime.tv_sec, .tv_nsec = (long)x->stx_mtime.tv_nsec },
+			.st_ino = (ino_t)x->stx_ino,
+		};
+
+		_entry_set(w, todo[i], &st);
+	}
+
+	w->batched += len;
+	ret = 0;
+
+out0:
+	free(res);
+	free(names);
+	free(stx);
+	return ret;
+}
+
+
+static void
+_entry_set(const ScanWorker *w, ScanEntry *e, const struct stat *st)
+{
+	const Scan *const s = w->pool->scan;
+	if (S_ISDIR(st->st_mode)) {
+		e->is_dir = (s->is_tree)? 1 : -2;
+		return;
+	}
+
+	if (S_ISREG(st->st_mode) == 0) {
+		e->is_dir = -2;
+		return;
+	}
+
+	if ((e->is_dir < 0) && (s->filter != NULL) && (s->filter(e->name) < 0)) {
+		e->is_dir = -2;
+		return;
+	}
+
+	e->is_dir = 0;
+	e->size = (int64_t)st->st_size;
+	e->mtime = ((int64_t)st->st_mtim.tv_sec * 1000000000) + (int64_t)st->st_mtim.tv_nsec;
+	e->ino = (uint64_t)st->st_ino;
+}
+
+
+/*
+ * depth first: a directory's files, then each of its subdirectories; frees the tree,
+ * 'files' NULL: only that
+ */
+static size_t
+_dir_flatten(ScanDir *dir, ScanFile files[], size_t len)
+{
+	if ((files != NULL) && (dir->files_len > 0)) {
+		memcpy(&files[len], dir->files, dir->files_len * sizeof(ScanFile));
+		len += dir->files_len;
+	}
+
+	for (size_t i = 0; i < dir->subdirs_len; i++)
+		len = _dir_flatten(dir->subdirs[i], files, len);
+
+	free(dir->subdirs);
+	free(dir->files);
+	free(dir);
+	return len;
+}
+
+
+static int
+_entry_cmp(const void *a, const void *b)
+{
+	const ScanEntry *const x = *(const ScanEntry **)a;
+	const ScanEntry *const y = *(const ScanEntry **)b;
+	return cstr_cmp_vers(x->name, y->name);
+}
+
+
+static int
+_deque_init(ScanDeque *d)
+{
+	if (mtx_init(&d->mutex, mtx_plain) != thrd_success) {
+		log_err(0, "scan: _deque_init: mtx_init: failed");
+		return -1;
+	}
+
+	d->dirs = NULL;
+	d->head = 0;
+	d->tail = 0;
+	d->size = 0;
+	return 0;
+}
+
+
+static void
+_deque_deinit(ScanDeque *d)
+{
+	free(d->dirs);
+	mtx_destroy(&d->mutex);
+}
+
+
+static int
+_deque_push(ScanDeque *d, ScanDir *dir)
+{
+	int ret = 0;
+	mtx_lock(&d->mutex); /* LOCK */
+
+	if (d->tail == d->size) {
+		if (d->head > 0) {
+			memmove(d->dirs, &d->dirs[d->head], (d->tail - d->head) * sizeof(ScanDir *));
+			d->tail -= d->head;
+			d->head = 0;
+		} else {
+			const size_t size = (d->size == 0)? _DEQUE_SIZE_INIT : (d->size * 2);
+			ScanDir **const dirs = realloc(d->dirs, size * sizeof(ScanDir *));
+			if (dirs == NULL) {
+				log_err(errno, "scan: _deque_push: realloc: %zu", size);
+				ret = -1;
+				goto out0;
+			}
+
+			d->dirs = dirs;
+			d->size = size;
+		}
+	}
+
+	d->dirs[d->tail++] = dir;
+
+out0:
+	mtx_unlock(&d->mutex); /* UNLOCK */
+	return ret;
+}
+
+
+static ScanDir *
+_deque_pop(ScanDeque *d)
+{
+	ScanDir *ret = NULL;
+	mtx_lock(&d->mutex); /* LOCK */
+
+	if (d->tail > d->head)
+		ret = d->dirs[--d->tail];
+
+	mtx_unlock(&d->mutex); /* UNLOCK */
+	return ret;
+}
+
+
+static ScanDir *
+_deque_steal(ScanDeque *d)
+{
+	ScanDir *ret = NULL;
+	mtx_lock(&d->mutex); /* LOCK */
+
+	if (d->tail > d->head)
+		ret = d->dirs[d->head++];
+
+	mtx_unlock(&d->mutex); /* UNLOCK */
+	return ret;
+}
+
+
+static int
+_push(ScanWorker *w, ScanDir *dir)
+{
+	ScanPool *const pool = w->pool;
+	atomic_fetch_add(&pool->pending, 1);
+	if (_deque_push(&w->deque, dir) < 0) {
+		atomic_fetch_sub(&pool->pending, 1);
+		return -1;
+	}
+
+	atomic_fetch_add(&pool->queued, 1);
+
+	mtx_lock(&pool->mutex); /* LOCK */
+	cnd_signal(&pool->cond);
+	mtx_unlock(&pool->mutex); /* UNLOCK */
+	return 0;
+}
+
+
+/*
+ * its own deque first, then the others'; returns: NULL: nothing left anywhere
+ */
+static ScanDir *
+_next(ScanWorker *w)
+{
+	ScanPool *const pool = w->pool;
+	for (;;) {
+		ScanDir *dir = _deque_pop(&w->deque);
+		for (int i = 1; (dir == NULL) && (i < pool->workers_len); i++) {
+			dir = _deque_steal(&pool->workers[(w->index + i) % pool->workers_len].deque);
+			if (dir != NULL)
+				w->stolen++;
+		}
+
+		if (dir != NULL) {
+			atomic_fetch_sub(&pool->queued, 1);
+			return dir;
+		}
+
+		mtx_lock(&pool->mutex); /* LOCK */
+
+		while ((atomic_load(&pool->queued) == 0) && (atomic_load(&pool->pending) > 0))
+			cnd_wait(&pool->cond, &pool->mutex);
+
+		const int is_done = (atomic_load(&pool->pending) == 0);
+
+		mtx_unlock(&pool->mutex); /* UNLOCK */
+
+		if (is_done)
+			return NULL;
+	}
+}
+
+
+/*
+ * a ring of its own: they are not shared between threads
+ */
+static void
+_worker_run(ScanWorker *w)
+{
+	ScanPool *const pool = w->pool;
+	if (pool->scan->backend == SCAN_BACKEND_URING)
+		w->has_ring = (uring_init(&w->ring, _URING_ENTRIES) == 0);
+
+	const atomic_int *const stop = pool->scan->stop;
+	ScanDir *dir;
+	while ((dir = _next(w)) != NULL) {
+		/* stopped: the rest is only taken off the queues */
+		if ((stop == NULL) || (atomic_load(stop) == 0))
+			_dir_list(w, dir);
+
+		/* the last one: wake everybody up to leave */
+		if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+			mtx_lock(&pool->mutex); /* LOCK */
+			cnd_broadcast(&pool->cond);
+			mtx_unlock(&pool->mutex); /* UNLOCK */
+		}
+	}
+
+	if (w->has_ring)
+		uring_deinit(&w->ring);
+}
+
+
+static int
+_worker_thrd(void *udata)
+{
+	_worker_run((ScanWorker *)udata);
+	return 0;
+}
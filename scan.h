@@ -0,0 +1,56 @@
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "util.h"
+
+
+#define SCAN_THREADS_MAX (32)
+
+
+typedef struct scan_file {
+	const char *path;	/* in Scan.arena */
+	size_t      path_len;
+	int64_t     size;
+	int64_t     mtime;	/* ns */
+	uint64_t    ino;
+} ScanFile;
+
+/*
+ * how file attributes are read: one fstatat() each, or a directory's worth in one
+ * io_uring submission (plain calls if the kernel does not allow it)
+ */
+typedef enum scan_backend {
+	SCAN_BACKEND_PLAIN,
+	SCAN_BACKEND_URING,
+} ScanBackend;
+
+/*
+ * by name, before anything is stat()ed; returns: 0: wanted
+ */
+typedef int (*ScanFilter)(const char name[]);
+
+/*
+ * Scan: a directory tree, listed by a pool of threads stealing directories from each
+ * other. The order does not depend on them: by version within a directory, its files
+ * before its subdirectories (what scandir() and a depth-first walk give).
+ */
+typedef struct scan {
+	int               thrds_num;	/* <= 0: 1 */
+	int               max_depth;	/* levels below the root, deeper is an error */
+	int               is_tree;	/* 0: the root's own files only */
+	ScanFilter        filter;	/* NULL: every file */
+	ScanBackend       backend;
+	Arena            *arena;
+	const atomic_int *stop;		/* NULL: none; set: the walk ends early, as an error */
+} Scan;
+
+
+int scan_files(const Scan *s, const char path[], ScanFile *files[]);
+
+
+#endif
@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+
+#include "stats.h"
+#include "util.h"
+
+
+static const char *const _timer_names[] = {
+	[STATS_TIMER_FILTER] = "filter",
+	[STATS_TIMER_MIXER] = "mixer",
+};
+
+static const char *const _gauge_names[] = {
+	[STATS_GAUGE_LIMITER] = "limiter",
+	[STATS_GAUGE_RT_BLOCK] = "rt block",
+	[STATS_GAUGE_DECODE] = "decode",
+};
+
+static const char *const _gauge_units[] = {
+	[STATS_GAUGE_LIMITER] = "dB",
+	[STATS_GAUGE_RT_BLOCK] = "switches",
+	[STATS_GAUGE_DECODE] = "errors",
+};
+
+
+static void _max_update(atomic_uint_least64_t *max, uint_least64_t val);
+
+
+/*
+ * public
+ */
+void
+stats_init(Stats *s)
+{
+	stats_reset(s);
+}
+
+
+void
+stats_reset(Stats *s)
+{
+	for (int i = 0; i < STATS_TIMER_END; i++) {
+		atomic_store(&s->timers[i].count, 0);
+		atomic_store(&s->timers[i].total_ns, 0);
+		atomic_store(&s->timers[i].max_ns, 0);
+	}
+
+	for (int i = 0; i < STATS_GAUGE_END; i++) {
+		atomic_store(&s->gauges[i].count, 0);
+		atomic_store(&s->gauges[i].total, 0);
+		atomic_store(&s->gauges[i].max, 0);
+	}
+}
+
+
+void
+stats_timer_add(Stats *s, StatsTimerType type, int64_t ns)
+{
+	assert(type < STATS_TIMER_END);
+
+	StatsTimer *const t = &s->timers[type];
+	const uint_least64_t val = (ns > 0)? (uint_least64_t)ns : 0;
+	atomic_fetch_add_explicit(&t->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&t->total_ns, val, memory_order_relaxed);
+	_max_update(&t->max_ns, val);
+}
+
+
+/*
+ * value: >= 0
+ */
+void
+stats_gauge_add(Stats *s, StatsGaugeType type, double value)
+{
+	assert(type < STATS_GAUGE_END);
+
+	StatsGauge *const g = &s->gauges[type];
+	const uint_least64_t val = (value > 0.0)? (uint_least64_t)llround(value * 1000.0) : 0;
+	atomic_fetch_add_explicit(&g->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&g->total, val, memory_order_relaxed);
+	_max_update(&g->max, val);
+}
+
+
+void
+stats_log(const Stats *s)
+{
+	for (int i = 0; i < STATS_TIMER_END; i++) {
+		const StatsTimer *const t = &s->timers[i];
+		const uint_least64_t count = atomic_load(&t->count);
+		if (count == 0) {
+			log_info("stats: %-8s: -", _timer_names[i]);
+			continue;
+		}
+
+		const double avg = (double)atomic_load(&t->total_ns) / (double)count;
+		log_info("stats: %-8s: count: %llu, avg: %.2f us, max: %.2f us", _timer_names[i],
+			 (unsigned long long)count, avg / 1000.0, (double)atomic_load(&t->max_ns) / 1000.0);
+	}
+
+	for (int i = 0; i < STATS_GAUGE_END; i++) {
+		const StatsGauge *const g = &s->gauges[i];
+		const uint_least64_t count = atomic_load(&g->count);
+		if (count == 0) {
+			log_info("stats: %-8s: -", _gauge_names[i]);
+			continue;
+		}
+
+		const double avg = (double)atomic_load(&g->total) / (double)count;
+		log_info("stats: %-8s: count: %llu, avg: %.2f %s, max: %.2f %s", _gauge_names[i],
+			 (unsigned long long)count, avg / 1000.0, _gauge_units[i],
+			 (double)atomic_load(&g->max) / 1000.0, _gauge_units[i]);
+	}
+}
+
+
+int64_t
+stats_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec * 1000000000) + (int64_t)ts.tv_nsec;
+}
+
+
+/*
+ * private
+ */
+static void
+_max_update(atomic_uint_least64_t *max, uint_least64_t val)
+{
+	uint_least64_t curr = atomic_load_explicit(max, memory_order_relaxed);
+	while (val > curr) {
+		if (atomic_compare_exchange_weak(max, &curr, val))
+			break;
+	}
+}
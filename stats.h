@@ -0,0 +1,57 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+
+/*
+ * Stats: lock-free timing counters, written from any thread, dumped to the log file
+ * (see ":stats")
+ */
+typedef enum stats_timer_type {
+	STATS_TIMER_FILTER,	/* per decoded frame through the avfilter graph */
+	STATS_TIMER_MIXER,	/* per mixed block, DSP chain included */
+
+	STATS_TIMER_END,
+} StatsTimerType;
+
+typedef enum stats_gauge_type {
+	STATS_GAUGE_LIMITER,	/* gain reduction (dB) per limited block */
+	STATS_GAUGE_RT_BLOCK,	/* DEBUG: voluntary context switches per audio callback that blocked */
+	STATS_GAUGE_DECODE,	/* decode errors per track that had any */
+
+	STATS_GAUGE_END,
+} StatsGaugeType;
+
+typedef struct stats_timer {
+	atomic_uint_least64_t count;
+	atomic_uint_least64_t total_ns;
+	atomic_uint_least64_t max_ns;
+} StatsTimer;
+
+/*
+ * values are kept in 1/1000 units
+ */
+typedef struct stats_gauge {
+	atomic_uint_least64_t count;
+	atomic_uint_least64_t total;
+	atomic_uint_least64_t max;
+} StatsGauge;
+
+typedef struct stats {
+	StatsTimer timers[STATS_TIMER_END];
+	StatsGauge gauges[STATS_GAUGE_END];
+} Stats;
+
+
+void    stats_init(Stats *s);
+void    stats_reset(Stats *s);
+void    stats_timer_add(Stats *s, StatsTimerType type, int64_t ns);
+void    stats_gauge_add(Stats *s, StatsGaugeType type, double value);
+void    stats_log(const Stats *s);
+int64_t stats_now_ns(void);
+
+
+#endif
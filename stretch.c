@@ -0,0 +1,331 @@
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "stretch.h"
+#include "dsp.h"
+#include "util.h"
+
+
+#define _HOP_MS   (12)
+#define _DELTA_MS (7)
+#define _COARSE   (4)
+#define _PI       (3.14159265358979323846)
+
+
+static void   _process(Stretch *s);
+static size_t _search(Stretch *s, size_t lo, size_t hi);
+static void   _mono(const Stretch *s, float dst[], size_t from, size_t len, size_t step);
+static size_t _range_lo(const Stretch *s);
+static void   _discard(Stretch *s);
+
+
+/*
+ * public
+ */
+int
+stretch_init(Stretch *s, unsigned channels, unsigned rate)
+{
+	memset(s, 0, sizeof(*s));
+	s->channels = channels;
+	s->rate = rate;
+	s->hop = ((rate * _HOP_MS) / 1000) & ~((size_t)_COARSE - 1);
+	s->delta = ((rate * _DELTA_MS) / 1000) & ~((size_t)_COARSE - 1);
+	s->speed = 1.0;
+
+	/* enough for the worst case: template + search range at STRETCH_SPEED_MAX */
+	s->in_size = (s->hop * 4) + (s->delta * 4);
+	s->in = malloc(s->in_size * channels * sizeof(float));
+	s->out = malloc(s->hop * channels * sizeof(float));
+	s->fade = malloc(s->hop * sizeof(float));
+	s->scratch = malloc((s->hop + (s->delta * 2) + _COARSE) * 4 * sizeof(float));
+	if ((s->in == NULL) || (s->out == NULL) || (s->fade == NULL) || (s->scratch == NULL)) {
+		log_err(errno, "stretch: stretch_init: malloc");
+		stretch_deinit(s);
+		return -1;
+	}
+
+	/* raised cosine, fade in */
+	for (size_t i = 0; i < s->hop; i++)
+		s->fade[i] = (float)(0.5 - (0.5 * cos((_PI * ((double)i + 0.5)) / (double)s->hop)));
+
+	return 0;
+}
+
+
+void
+stretch_deinit(Stretch *s)
+{
+	free(s->in);
+	free(s->out);
+	free(s->fade);
+	free(s->scratch);
+}
+
+
+/*
+ * drops everything buffered, e.g. a new track
+ */
+void
+stretch_reset(Stretch *s)
+{
+	s->is_active = (s->speed != 1.0);
+	s->in_len = 0;
+	s->prev = 0;
+	s->nominal = 0.0;
+	s->out_pos = 0;
+	s->out_len = 0;
+}
+
+
+/*
+ * 1.0: the buffered input is played out as is, then the stage becomes idle
+ */
+void
+stretch_set_speed(Stretch *s, double speed)
+{
+	if (speed < STRETCH_SPEED_MIN)
+		speed = STRETCH_SPEED_MIN;
+	else if (speed > STRETCH_SPEED_MAX)
+		speed = STRETCH_SPEED_MAX;
+
+	if ((speed != 1.0) && (s->is_active == 0)) {
+		s->speed = speed;
+		stretch_reset(s);
+		return;
+	}
+
+	s->speed = speed;
+}
+
+
+/*
+ * idle: nothing buffered, the caller may bypass the stage
+ */
+int
+stretch_is_idle(const Stretch *s)
+{
+	return ((s->is_active == 0) && (s->out_pos == s->out_len) && (s->in_len == 0));
+}
+
+
+/*
+ * returns: input frames needed before the next block can be produced
+ */
+size_t
+stretch_want(const Stretch *s)
+{
+	if (s->speed == 1.0)
+		return 0;
+
+	const size_t hi = (size_t)lround(s->nominal) + s->delta;
+	size_t need = s->prev + s->hop;
+	if ((hi + s->hop) > need)
+		need = hi + s->hop;
+
+	return (need > s->in_len)? (need - s->in_len) : 0;
+}
+
+
+float *
+stretch_feed_ptr(Stretch *s, size_t count)
+{
+	assert((s->in_len + count) <= s->in_size);
+	return &s->in[s->in_len * s->channels];
+}
+
+
+void
+stretch_feed_commit(Stretch *s, size_t count)
+{
+	s->in_len += count;
+}
+
+
+/*
+ * returns: written frames, less than 'count' when it needs more input
+ */
+size_t
+stretch_read(Stretch *s, float dst[], size_t count)
+{
+	const unsigned ch = s->channels;
+	size_t ret = 0;
+	while (ret < count) {
+		if (s->out_pos < s->out_len) {
+			size_t len = s->out_len - s->out_pos;
+			if (len > (count - ret))
+				len = count - ret;
+
+			memcpy(&dst[ret * ch], &s->out[s->out_pos * ch], len * ch * sizeof(float));
+			s->out_pos += len;
+			ret += len;
+			continue;
+		}
+
+		if (s->speed == 1.0) {
+			/* back to normal: the natural continuation, then idle */
+			size_t len = s->in_len - s->prev;
+			if (len > (count - ret))
+				len = count - ret;
+
+			memcpy(&dst[ret * ch], &s->in[s->prev * ch], len * ch * sizeof(float));
+			s->prev += len;
+			s->nominal = (double)s->prev;
+			ret += len;
+			if (s->prev == s->in_len) {
+				s->is_active = 0;
+				s->in_len = 0;
+				s->prev = 0;
+				s->nominal = 0.0;
+				break;
+			}
+
+			continue;
+		}
+
+		if (stretch_want(s) > 0)
+			break;
+
+		_process(s);
+	}
+
+	return ret;
+}
+
+
+/*
+ * private
+ */
+static void
+_process(Stretch *s)
+{
+	const unsigned ch = s->channels;
+	const size_t hop = s->hop;
+	const size_t lo = _range_lo(s);
+	const size_t hi = (size_t)lround(s->nominal) + s->delta;
+	const size_t x = _search(s, lo, hi);
+
+	/* 'prev' is the natural continuation of the last segment */
+	const float *const a = &s->in[s->prev * ch];
+	const float *const b = &s->in[x * ch];
+	for (size_t i = 0; i < hop; i++) {
+		const float w = s->fade[i];
+		for (unsigned j = 0; j < ch; j++) {
+			const size_t k = (i * ch) + j;
+			s->out[k] = (a[k] * (1.0f - w)) + (b[k] * w);
+		}
+	}
+
+	s->out_pos = 0;
+	s->out_len = hop;
+	s->prev = x + hop;
+	s->nominal += (double)hop * s->speed;
+	_discard(s);
+}
+
+
+/*
+ * normalized cross-correlation of the natural continuation against [lo, hi], coarse on
+ * a decimated mono mix first, then refined around the best match
+ */
+static size_t
+_search(Stretch *s, size_t lo, size_t hi)
+{
+	const size_t hop = s->hop;
+	const size_t range = (hi - lo) + hop;
+	float *const tpl = s->scratch;
+	float *const reg = tpl + hop;
+	float *const tpl_d = reg + range;
+	float *const reg_d = tpl_d + (hop / _COARSE);
+
+	_mono(s, tpl, s->prev, hop, 1);
+	_mono(s, reg, lo, range, 1);
+	_mono(s, tpl_d, s->prev, hop / _COARSE, _COARSE);
+	_mono(s, reg_d, lo, range / _COARSE, _COARSE);
+
+	/* coarse */
+	const size_t len_d = hop / _COARSE;
+	const size_t cands_d = ((hi - lo) / _COARSE) + 1;
+	double energy = dsp_dot(reg_d, reg_d, len_d);
+	double best_score = -INFINITY;
+	size_t best = 0;
+	for (size_t c = 0; c < cands_d; c++) {
+		if (c > 0) {
+			const float out = reg_d[c - 1];
+			const float in = reg_d[c + len_d - 1];
+			energy += ((double)in * in) - ((double)out * out);
+		}
+
+		const double score = (double)dsp_dot(tpl_d, &reg_d[c], len_d) / sqrt(fmax(energy, 1e-9));
+		if (score > best_score) {
+			best_score = score;
+			best = c * _COARSE;
+		}
+	}
+
+	/* fine */
+	const size_t f_lo = (best > (_COARSE - 1))? (best - (_COARSE - 1)) : 0;
+	size_t f_hi = best + (_COARSE - 1);
+	if (f_hi > (hi - lo))
+		f_hi = hi - lo;
+
+	size_t ret = best;
+	best_score = -INFINITY;
+	for (size_t c = f_lo; c <= f_hi; c++) {
+		const double en = dsp_dot(&reg[c], &reg[c], hop);
+		const double score = (double)dsp_dot(tpl, &reg[c], hop) / sqrt(fmax(en, 1e-9));
+		if (score > best_score) {
+			best_score = score;
+			ret = c;
+		}
+	}
+
+	return lo + ret;
+}
+
+
+static void
+_mono(const Stretch *s, float dst[], size_t from, size_t len, size_t step)
+{
+	const unsigned ch = s->channels;
+	const float scale = 1.0f / (float)ch;
+	for (size_t i = 0; i < len; i++) {
+		const float *const frm = &s->in[(from + (i * step)) * ch];
+		float sum = 0.0f;
+		for (unsigned j = 0; j < ch; j++)
+			sum += frm[j];
+
+		dst[i] = sum * scale;
+	}
+}
+
+
+static size_t
+_range_lo(const Stretch *s)
+{
+	const long lo = lround(s->nominal) - (long)s->delta;
+	return (lo > 0)? (size_t)lo : 0;
+}
+
+
+/*
+ * keeps only what the next block can still refer to
+ */
+static void
+_discard(Stretch *s)
+{
+	size_t keep = _range_lo(s);
+	if (keep > s->prev)
+		keep = s->prev;
+
+	if (keep == 0)
+		return;
+
+	const unsigned ch = s->channels;
+	memmove(s->in, &s->in[keep * ch], (s->in_len - keep) * ch * sizeof(float));
+	s->in_len -= keep;
+	s->prev -= keep;
+	s->nominal -= (double)keep;
+}
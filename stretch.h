@@ -0,0 +1,51 @@
+#ifndef __STRETCH_H__
+#define __STRETCH_H__
+
+
+#include <stddef.h>
+
+
+#define STRETCH_SPEED_MIN (0.5)
+#define STRETCH_SPEED_MAX (2.0)
+
+
+/*
+ * Stretch: WSOLA time stretch (tempo change, pitch preserved), interleaved float
+ *
+ * Output is produced in blocks of 'hop' frames. Each block crossfades the natural
+ * continuation of the previous segment into the input segment that resembles it
+ * best, searched around the nominal position (advancing 'hop * speed' per block).
+ * The cost per output frame does not depend on the speed.
+ */
+typedef struct stretch {
+	unsigned  channels;
+	unsigned  rate;
+	size_t    hop;
+	size_t    delta;
+	double    speed;
+	int       is_active;
+	float    *in;
+	size_t    in_len;
+	size_t    in_size;
+	size_t    prev;		/* chosen segment, relative to 'in' */
+	double    nominal;	/* relative to 'in' */
+	float    *out;
+	size_t    out_pos;
+	size_t    out_len;
+	float    *fade;
+	float    *scratch;
+} Stretch;
+
+
+int    stretch_init(Stretch *s, unsigned channels, unsigned rate);
+void   stretch_deinit(Stretch *s);
+void   stretch_reset(Stretch *s);
+void   stretch_set_speed(Stretch *s, double speed);
+int    stretch_is_idle(const Stretch *s);
+size_t stretch_want(const Stretch *s);
+float *stretch_feed_ptr(Stretch *s, size_t count);
+void   stretch_feed_commit(Stretch *s, size_t count);
+size_t stretch_read(Stretch *s, float dst[], size_t count);
+
+
+#endif
@@ -0,0 +1,1563 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "tags.h"
+#include "util.h"
+
+
+#define _HEAD_SIZE  (4096)		/* when the caller has not read it already */
+#define _TAIL_SIZE  (64 * 1024)		/* the last Ogg page is in there */
+#define _VALUE_MAX  (1024)		/* key=value, longer ones are cut anyway */
+#define _SYNC_MAX   (4096)		/* junk between the ID3v2 tag and the first frame */
+#define _WALK_SIZE  (256 * 1024)	/* read at a time by the frame walk */
+
+
+/*
+ * the header the caller read, pread() for the rest; opened once something is needed
+ * past it
+ */
+typedef struct tags_file {
+	const char    *path;
+	int            fd;
+	int64_t        size;
+	const uint8_t *head;
+	size_t         head_len;
+	uint8_t        buffer[_HEAD_SIZE];
+} TagsFile;
+
+/*
+ * a byte range of the file, or an Ogg packet spread over pages (and their segments)
+ */
+typedef struct tags_stream {
+	TagsFile *file;
+	int64_t   pos;
+	int64_t   end;		/* plain only */
+	int       is_ogg;
+	uint32_t  serial;
+	uint8_t   lacing[255];
+	int       segs;
+	int       seg;
+	size_t    seg_left;
+	int       is_last;	/* the current segment ends the packet */
+} TagsStream;
+
+/*
+ * one MPEG audio layer III frame header
+ */
+typedef struct tags_mpa {
+	int is_v1;
+	int is_mono;
+	int rate;
+	int bitrate;		/* kbit/s */
+	int frame_len;
+	int spf;		/* samples per frame */
+} TagsMpa;
+
+
+/* ID3v1 genres as libav names them, 0..191 */
+static const char *const _genres[] = {
+	"Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop", "Jazz",
+	"Metal", "New Age", "Oldies", "Other", "Pop", "R&B", "Rap", "Reggae", "Rock", "Techno",
+	"Industrial", "Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack", "Euro-Techno",
+	"Ambient", "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance", "Classical", "Instrumental",
+	"Acid", "House", "Game", "Sound Clip", "Gospel", "Noise", "AlternRock", "Bass", "Soul", "Punk",
+	"Space", "Meditative", "Instrumental Pop", "Instrumental Rock", "Ethnic", "Gothic", "Darkwave",
+	"Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream", "Southern Rock", "Comedy",
+	"Cult", "Gangsta", "Top 40", "Christian Rap", "Pop/Funk", "Jungle", "Native American",
+	"Cabaret", "New Wave", "Psychadelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal",
+	"Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock", "Folk",
+	"Folk-Rock", "National Folk", "Swing", "Fast Fusion", "Bebob", "Latin", "Revival", "Celtic",
+	"Bluegrass", "Avantgarde", "Gothic Rock", "Progressive Rock", "Psychedelic Rock",
+	"Symphonic Rock", "Slow Rock", "Big Band", "Chorus", "Easy Listening", "Acoustic", "Humour",
+	"Speech", "Chanson", "Opera", "Chamber Music", "Sonata", "Symphony", "Booty Bass", "Primus",
+	"Porn Groove", "Satire", "Slow Jam", "Club", "Tango", "Samba", "Folklore", "Ballad",
+	"Power Ballad", "Rhythmic Soul", "Freestyle", "Duet", "Punk Rock", "Drum Solo", "A capella",
+	"Euro-House", "Dance Hall", "Goa", "Drum & Bass", "Club-House", "Hardcore", "Terror", "Indie",
+	"BritPop", "Afro-Punk", "Polsk Punk", "Beat", "Christian Gangsta", "Heavy Metal",
+	"Black Metal", "Crossover", "Contemporary Christian", "Christian Rock", "Merengue", "Salsa",
+	"Thrash Metal", "Anime", "JPop", "SynthPop", "Abstract", "Art Rock", "Baroque", "Bhangra",
+	"Big Beat", "Breakbeat", "Chillout", "Downtempo", "Dub", "EBM", "Eclectic", "Electro",
+	"Electroclash", "Emo", "Experimental", "Garage", "Global", "IDM", "Illbient", "Industro-Goth",
+	"Jam Band", "Krautrock", "Leftfield", "Lounge", "Math Rock", "New Romantic", "Nu-Breakz",
+	"Post-Punk", "Post-Rock", "Psytrance", "Shoegaze", "Space Rock", "Trop Rock", "World Music",
+	"Neoclassical", "Audiobook", "Audio Theatre", "Neue Deutsche Welle", "Podcast", "Indie Rock",
+	"G-Funk", "Dubstep", "Garage Rock", "Psybient",
+};
+
+
+static int      _file_read(TagsFile *f, int64_t offt, void *buf, size_t len);
+static int      _stream_next(TagsStream *s);
+static int      _stream_read(TagsStream *s, void *buf, size_t len);
+static int      _stream_skip(TagsStream *s, uint64_t len);
+static void     _key(Tags *t, const char key[], const char val[], size_t len, int is_over);
+static int      _vorbis_comments(Tags *t, TagsStream *s);
+static int64_t  _id3v2(Tags *t, TagsFile *f, int64_t offt);
+static int64_t  _id3v2_len(TagsFile *f, int64_t offt);
+static int      _id3v2_frame(Tags *t, const char id[], uint8_t data[], size_t len);
+static size_t   _id3v2_text(char dst[], size_t size, const uint8_t src[], size_t len, int enc);
+static void     _id3v1(Tags *t, TagsFile *f);
+static void     _ape(Tags *t, TagsFile *f);
+static int      _mpa_header(const uint8_t b[], TagsMpa *m);
+static int      _mpa_is_info(const uint8_t frame[], size_t len, const TagsMpa *m);
+static int      _mp3(Tags *t, TagsFile *f, int64_t offt);
+static int64_t  _mp3_sync(TagsFile *f, int64_t offt, int is_tagged, TagsMpa *m);
+static int64_t  _mp3_end(TagsFile *f);
+static int64_t  _mp3_walk(TagsFile *f, int64_t pos, int64_t end, const TagsMpa *first);
+static int      _flac(Tags *t, TagsFile *f, int64_t offt);
+static int      _opus(Tags *t, TagsFile *f);
+static int      _wav(Tags *t, TagsFile *f);
+static int      _mp4(Tags *t, TagsFile *f);
+static int      _mp4_atom(TagsFile *f, int64_t pos, int64_t end, char type[], int64_t *body, int64_t *next);
+static int      _mp4_moov(Tags *t, TagsFile *f, int64_t pos, int64_t end);
+static void     _mp4_meta(Tags *t, TagsFile *f, int64_t pos, int64_t end);
+static void     _mp4_ilst(Tags *t, TagsFile *f, int64_t pos, int64_t end);
+static void     _genre_set(Tags *t, long idx);
+static size_t   _utf8_put(char dst[], size_t size, size_t len, uint32_t cp);
+static uint32_t _be16(const uint8_t b[]);
+static uint32_t _be24(const uint8_t b[]);
+static uint32_t _be32(const uint8_t b[]);
+static uint64_t _be64(const uint8_t b[]);
+static uint32_t _le16(const uint8_t b[]);
+static uint32_t _le32(const uint8_t b[]);
+static uint64_t _le64(const uint8_t b[]);
+static uint32_t _syncsafe(const uint8_t b[]);
+
+
+/*
+ * public
+ */
+/*
+ * only the headers, never a frame of audio: MP3 (ID3v2, ID3v1, APEv2, Xing/Info, VBRI,
+ * LAME), FLAC, Ogg Opus, RIFF WAVE and MP4; 'head': the first bytes of the file, NULL:
+ * read here
+ * returns: -1: not one of them, or not sure of it: libav knows better
+ */
+int
+tags_read(Tags *t, const char path[], int64_t size, const uint8_t head[], size_t head_len)
+{
+	memset(t, 0, sizeof(*t));
+
+	TagsFile f = {
+		.path = path,
+		.fd = -1,
+		.size = size,
+		.head = head,
+		.head_len = head_len,
+	};
+
+	if (head == NULL) {
+		const size_t len = (size < _HEAD_SIZE)? (size_t)size : _HEAD_SIZE;
+		if (_file_read(&f, 0, f.buffer, len) < 0)
+			goto err0;
+
+		f.head = f.buffer;
+		f.head_len = len;
+	}
+
+	if (f.head_len < 12)
+		goto err0;
+
+	int ret = -1;
+	const uint8_t *const h = f.head;
+	if (memcmp(h, "fLaC", 4) == 0)
+		ret = _flac(t, &f, 0);
+	else if (memcmp(h, "OggS", 4) == 0)
+		ret = _opus(t, &f);
+	else if ((memcmp(h, "RIFF", 4) == 0) && (memcmp(&h[8], "WAVE", 4) == 0))
+		ret = _wav(t, &f);
+	else if (memcmp(&h[4], "ftyp", 4) == 0)
+		ret = _mp4(t, &f);
+	else
+		ret = _mp3(t, &f, 0);
+
+	if (ret < 0)
+		goto err0;
+
+	if (f.fd >= 0)
+		close(f.fd);
+
+	return 0;
+
+err0:
+	if (f.fd >= 0)
+		close(f.fd);
+
+	return -1;
+}
+
+
+/*
+ * MP3 only: every frame header counted, the payloads in between skipped; exact where
+ * tags_read() had to go by the bitrate ('is_estimated'), but the whole file is read
+ * returns: -1: no MPEG audio there
+ */
+int
+tags_mp3_duration(const char path[], int64_t size, int64_t *duration)
+{
+	TagsFile f = {
+		.path = path,
+		.fd = -1,
+		.size = size,
+		.head = NULL,
+		.head_len = 0,
+	};
+
+	int ret = -1;
+	const int64_t id3_len = _id3v2_len(&f, 0);
+	TagsMpa m;
+	const int64_t audio = _mp3_sync(&f, id3_len, (id3_len > 0), &m);
+	if (audio < 0)
+		goto out0;
+
+	const int64_t samples = _mp3_walk(&f, audio, _mp3_end(&f), &m);
+	if (samples <= 0)
+		goto out0;
+
+	*duration = samples / m.rate;
+	ret = 0;
+
+out0:
+	if (f.fd >= 0)
+		close(f.fd);
+
+	return ret;
+}
+
+
+/*
+ * private
+ */
+/*
+ * all of 'len' or -1
+ */
+static int
+_file_read(TagsFile *f, int64_t offt, void *buf, size_t len)
+{
+	if ((offt < 0) || (offt > f->size) || ((int64_t)len > (f->size - offt)))
+		return -1;
+
+	uint8_t *dst = buf;
+	if ((uint64_t)offt < f->head_len) {
+		size_t n = f->head_len - (size_t)offt;
+		if (n > len)
+			n = len;
+
+		memcpy(dst, &f->head[offt], n);
+		dst += n;
+		offt += (int64_t)n;
+		len -= n;
+	}
+
+	while (len > 0) {
+		if (f->fd < 0) {
+			f->fd = open(f->path, O_RDONLY | O_CLOEXEC);
+			if (f->fd < 0)
+				return -1;
+		}
+
+		const ssize_t rd = pread(f->fd, dst, len, (off_t)offt);
+		if (rd < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return -1;
+		}
+
+		if (rd == 0)
+			return -1;
+
+		dst += rd;
+		offt += rd;
+		len -= (size_t)rd;
+	}
+
+	return 0;
+}
+
+
+/*
+ * the next byte of an Ogg packet: on to the next segment, the next page of its stream;
+ * returns: -1: the packet is over (or broken)
+ */
+static int
+_stream_next(TagsStream *s)
+{
+	while (s->seg_left == 0) {
+		if (s->is_last)
+			return -1;
+
+		if (s->seg < s->segs) {
+			s->seg_left = s->lacing[s->seg];
+			s->is_last = (s->lacing[s->seg] < 255);
+			s->seg++;
+			continue;
+		}
+
+		uint8_t hdr[27];
+		if ((_file_read(s->file, s->pos, hdr, sizeof(hdr)) < 0) || (memcmp(hdr, "OggS", 4) != 0))
+			return -1;
+
+		const int segs = hdr[26];
+		if (_file_read(s->file, s->pos + 27, s->lacing, (size_t)segs) < 0)
+			return -1;
+
+		s->pos += 27 + segs;
+		s->segs = segs;
+		s->seg = 0;
+		if (_le32(&hdr[14]) == s->serial)
+			continue;
+
+		/* another stream's page */
+		for (int i = 0; i < segs; i++)
+			s->pos += s->lacing[i];
+
+		s->segs = 0;
+	}
+
+	return 0;
+}
+
+
+static int
+_stream_read(TagsStream *s, void *buf, size_t len)
+{
+	if (s->is_ogg == 0) {
+		if ((int64_t)len > (s->end - s->pos))
+			return -1;
+
+		if (_file_read(s->file, s->pos, buf, len) < 0)
+			return -1;
+
+		s->pos += (int64_t)len;
+		return 0;
+	}
+
+	uint8_t *dst = buf;
+	while (len > 0) {
+		if (_stream_next(s) < 0)
+			return -1;
+
+		const size_t n = (s->seg_left < len)? s->seg_left : len;
+		if (_file_read(s->file, s->pos, dst, n) < 0)
+			return -1;
+
+		s->pos += (int64_t)n;
+		s->seg_left -= n;
+		dst += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+
+/*
+ * cover art: megabytes never read
+ */
+static int
+_stream_skip(TagsStream *s, uint64_t len)
+{
+	if (s->is_ogg == 0) {
+		if (len > (uint64_t)(s->end - s->pos))
+			return -1;
+
+		s->pos += (int64_t)len;
+		return 0;
+	}
+
+	while (len > 0) {
+		if (_stream_next(s) < 0)
+			return -1;
+
+		const size_t n = (s->seg_left < len)? s->seg_left : (size_t)len;
+		s->pos += (int64_t)n;
+		s->seg_left -= n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+
+/*
+ * the keys libav would give the playlist, case does not matter; the first value wins
+ * unless 'is_over'
+ */
+static void
+_key(Tags *t, const char key[], const char val[], size_t len, int is_over)
+{
+	char *dst;
+	if (strcasecmp(key, "title") == 0) {
+		dst = t->title;
+	} else if (strcasecmp(key, "artist") == 0) {
+		dst = t->artist;
+	} else if (strcasecmp(key, "album") == 0) {
+		dst = t->album;
+	} else if (strcasecmp(key, "genre") == 0) {
+		dst = t->genre;
+	} else {
+		if ((strcasecmp(key, "REPLAYGAIN_TRACK_GAIN") == 0) || (strcasecmp(key, "R128_TRACK_GAIN") == 0))
+			t->has_replaygain = 1;
+
+		return;
+	}
+
+	if ((dst[0] != '\0') && (is_over == 0))
+		return;
+
+	const char *const nul = memchr(val, '\0', len);
+	if (nul != NULL)
+		len = (size_t)(nul - val);
+
+	cstr_copy_n(dst, TAGS_STR_SIZE, val, len);
+}
+
+
+/*
+ * FLAC VORBIS_COMMENT, OpusTags: little endian lengths, "KEY=value" each
+ */
+static int
+_vorbis_comments(Tags *t, TagsStream *s)
+{
+	uint8_t b[4];
+	if ((_stream_read(s, b, 4) < 0) || (_stream_skip(s, _le32(b)) < 0) || (_stream_read(s, b, 4) < 0))
+		return -1;
+
+	char buf[_VALUE_MAX + 1];
+	const uint32_t count = _le32(b);
+	for (uint32_t i = 0; i < count; i++) {
+		if (_stream_read(s, b, 4) < 0)
+			return -1;
+
+		const uint32_t len = _le32(b);
+		const size_t n = (len < _VALUE_MAX)? len : _VALUE_MAX;
+		if ((_stream_read(s, buf, n) < 0) || (_stream_skip(s, len - n) < 0))
+			return -1;
+
+		buf[n] = '\0';
+		char *const eq = memchr(buf, '=', n);
+		if (eq == NULL)
+			continue;
+
+		*eq = '\0';
+		_key(t, buf, eq + 1, n - (size_t)(eq + 1 - buf), 0);
+	}
+
+	return 0;
+}
+
+
+/*
+ * frame by frame, only the text ones are read; returns: its size (0: none at 'offt'),
+ * -1: one libav has to take apart
+ */
+static int64_t
+_id3v2(Tags *t, TagsFile *f, int64_t offt)
+{
+	uint8_t hdr[10];
+	if ((_file_read(f, offt, hdr, sizeof(hdr)) < 0) || (memcmp(hdr, "ID3", 3) != 0))
+		return 0;
+
+	const int ver = hdr[3];
+	const int flags = hdr[5];
+	if ((ver < 2) || (ver > 4) || ((hdr[6] | hdr[7] | hdr[8] | hdr[9]) & 0x80))
+		return -1;
+
+	/* unsynchronised as a whole, compressed (2.2) */
+	if ((ver < 4) && ISSET(flags, 0x80))
+		return -1;
+	if ((ver == 2) && ISSET(flags, 0x40))
+		return -1;
+
+	const int64_t end = offt + 10 + _syncsafe(&hdr[6]);
+	const int64_t total = (end - offt) + (ISSET(flags, 0x10)? 10 : 0);
+	int64_t pos = offt + 10;
+	if (ISSET(flags, 0x40)) {
+		uint8_t ext[4];
+		if (_file_read(f, pos, ext, sizeof(ext)) < 0)
+			return -1;
+
+		pos += (ver == 3)? (4 + (int64_t)_be32(ext)) : (int64_t)_syncsafe(ext);
+	}
+
+	const int64_t frame_hdr = (ver == 2)? 6 : 10;
+	while ((pos + frame_hdr) <= end) {
+		uint8_t fh[10];
+		if (_file_read(f, pos, fh, (size_t)frame_hdr) < 0)
+			return -1;
+
+		/* padding */
+		if (fh[0] == '\0')
+			break;
+
+		char id[5] = { 0 };
+		int64_t len;
+		int fflags = 0;
+		if (ver == 2) {
+			memcpy(id, fh, 3);
+			len = _be24(&fh[3]);
+		} else {
+			memcpy(id, fh, 4);
+			len = (ver == 4)? _syncsafe(&fh[4]) : _be32(&fh[4]);
+			fflags = (int)_be16(&fh[8]);
+		}
+
+		pos += frame_hdr;
+		if ((len <= 0) || ((pos + len) > end))
+			break;
+
+		if (id[0] != 'T') {
+			pos += len;
+			continue;
+		}
+
+		/* compressed, encrypted */
+		if (((ver == 3) && ISSET(fflags, 0x00c0)) || ((ver == 4) && ISSET(fflags, 0x000c))) {
+			pos += len;
+			continue;
+		}
+
+		uint8_t data[_VALUE_MAX];
+		size_t n = (len < _VALUE_MAX)? (size_t)len : _VALUE_MAX;
+		if (_file_read(f, pos, data, n) < 0)
+			return -1;
+
+		uint8_t *p = data;
+		if ((ver == 3) && ISSET(fflags, 0x0020) && (n > 0)) {
+			p++;
+			n--;
+		}
+
+		if ((ver == 4) && ISSET(fflags, 0x0001) && (n >= 4)) {
+			p += 4;
+			n -= 4;
+		}
+
+		if ((ver == 4) && ISSET(fflags, 0x0002)) {
+			size_t j = 0;
+			for (size_t i = 0; i < n; i++) {
+				p[j++] = p[i];
+				if ((p[i] == 0xff) && ((i + 1) < n) && (p[i + 1] == 0x00))
+					i++;
+			}
+
+			n = j;
+		}
+
+		_id3v2_frame(t, id, p, n);
+		pos += len;
+	}
+
+	return total;
+}
+
+
+
+/*
+ * the whole tag, header and footer included; 0: none at 'offt'
+ */
+static int64_t
+_id3v2_len(TagsFile *f, int64_t offt)
+{
+	uint8_t hdr[10];
+	if ((_file_read(f, offt, hdr, sizeof(hdr)) < 0) || (memcmp(hdr, "ID3", 3) != 0) ||
+	    ((hdr[6] | hdr[7] | hdr[8] | hdr[9]) & 0x80))
+		return 0;
+
+	return 10 + (int64_t)_syncsafe(&hdr[6]) + (ISSET(hdr[5], 0x10)? 10 : 0);
+}
+
+static int
+_id3v2_frame(Tags *t, const char id[], uint8_t data[], size_t len)
+{
+	if (len < 2)
+		return -1;
+
+	const int enc = data[0];
+	char val[_VALUE_MAX];
+	if ((strcmp(id, "TXXX") == 0) || (strcmp(id, "TXX") == 0)) {
+		char desc[64];
+		const size_t used = _id3v2_text(desc, sizeof(desc), &data[1], len - 1, enc);
+		_id3v2_text(val, sizeof(val), &data[1 + used], len - 1 - used, enc);
+		_key(t, desc, val, strlen(val), 0);
+		return 0;
+	}
+
+	const char *key;
+	if ((strcmp(id, "TIT2") == 0) || (strcmp(id, "TT2") == 0))
+		key = "title";
+	else if ((strcmp(id, "TPE1") == 0) || (strcmp(id, "TP1") == 0))
+		key = "artist";
+	else if ((strcmp(id, "TALB") == 0) || (strcmp(id, "TAL") == 0))
+		key = "album";
+	else if ((strcmp(id, "TCON") == 0) || (strcmp(id, "TCO") == 0))
+		key = "genre";
+	else
+		return 0;
+
+	_id3v2_text(val, sizeof(val), &data[1], len - 1, enc);
+
+	/* "(17)", "17": an ID3v1 genre */
+	if ((key[0] == 'g') && (t->genre[0] == '\0')) {
+		char *end;
+		const char *const num = (val[0] == '(')? &val[1] : val;
+		const long idx = strtol(num, &end, 10);
+		if ((end != num) && (((val[0] == '(') && (*end == ')')) || ((val[0] != '(') && (*end == '\0')))) {
+			_genre_set(t, idx);
+			return 0;
+		}
+	}
+
+	_key(t, key, val, strlen(val), 0);
+	return 0;
+}
+
+
+/*
+ * one string out of 'src' to UTF-8 (the first of a list); returns: what it used,
+ * terminator included
+ */
+static size_t
+_id3v2_text(char dst[], size_t size, const uint8_t src[], size_t len, int enc)
+{
+	size_t out = 0;
+	size_t i = 0;
+	dst[0] = '\0';
+	switch (enc) {
+	case 0:
+		/* ISO-8859-1 */
+		for (; (i < len) && (src[i] != 0); i++)
+			out = _utf8_put(dst, size, out, src[i]);
+
+		return (i < len)? (i + 1) : i;
+	case 3:
+		for (; (i < len) && (src[i] != 0); i++) {
+			if ((out + 1) < size) {
+				dst[out++] = (char)src[i];
+				dst[out] = '\0';
+			}
+		}
+
+		return (i < len)? (i + 1) : i;
+	case 1:
+	case 2: {
+		/* UTF-16: with a BOM, big endian without one */
+		int is_le = 0;
+		if ((enc == 1) && (len >= 2)) {
+			if ((src[0] == 0xff) && (src[1] == 0xfe)) {
+				is_le = 1;
+				i = 2;
+			} else if ((src[0] == 0xfe) && (src[1] == 0xff)) {
+				i = 2;
+			}
+		}
+
+		for (; (i + 1) < len; i += 2) {
+			uint32_t cp = is_le? _le16(&src[i]) : _be16(&src[i]);
+			if (cp == 0)
+				return i + 2;
+
+			if ((cp >= 0xd800) && (cp < 0xdc00) && ((i + 3) < len)) {
+				const uint32_t lo = is_le? _le16(&src[i + 2]) : _be16(&src[i + 2]);
+				if ((lo >= 0xdc00) && (lo < 0xe000)) {
+					cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+					i += 2;
+				}
+			}
+
+			out = _utf8_put(dst, size, out, cp);
+		}
+
+		return len;
+	}
+	default:
+		return len;
+	}
+}
+
+
+/*
+ * the last 128 bytes: only when there is no other tag, as libav does it
+ */
+static void
+_id3v1(Tags *t, TagsFile *f)
+{
+	uint8_t tag[128];
+	if ((f->size < 128) || (_file_read(f, f->size - 128, tag, sizeof(tag)) < 0) || (memcmp(tag, "TAG", 3) != 0))
+		return;
+
+	static const struct { const char *key; size_t offt; } fields[] = {
+		{ "title", 3 }, { "artist", 33 }, { "album", 63 },
+	};
+
+	for (size_t i = 0; i < LEN(fields); i++) {
+		char val[30 * 2 + 1];
+		size_t out = 0;
+		val[0] = '\0';
+		for (size_t j = 0; (j < 30) && (tag[fields[i].offt + j] != 0); j++)
+			out = _utf8_put(val, sizeof(val), out, tag[fields[i].offt + j]);
+
+		while ((out > 0) && (val[out - 1] == ' '))
+			val[--out] = '\0';
+
+		_key(t, fields[i].key, val, out, 0);
+	}
+
+	if (tag[127] != 0xff)
+		_genre_set(t, tag[127]);
+}
+
+
+/*
+ * APEv2 at the end (before an ID3v1 tag): mp3gain puts its values there; they win, as
+ * with libav
+ */
+static void
+_ape(Tags *t, TagsFile *f)
+{
+	int64_t end = f->size;
+	uint8_t v1[3];
+	if ((end >= 128) && (_file_read(f, end - 128, v1, sizeof(v1)) == 0) && (memcmp(v1, "TAG", 3) == 0))
+		end -= 128;
+
+	uint8_t foot[32];
+	if ((end < 32) || (_file_read(f, end - 32, foot, sizeof(foot)) < 0) || (memcmp(foot, "APETAGEX", 8) != 0))
+		return;
+
+	const uint32_t size = _le32(&foot[12]);
+	const uint32_t count = _le32(&foot[16]);
+	if ((size < 32) || ((int64_t)size > end))
+		return;
+
+	int64_t pos = end - size;
+	const int64_t items_end = end - 32;
+	for (uint32_t i = 0; (i < count) && ((pos + 8) < items_end); i++) {
+		uint8_t hdr[8];
+		char buf[_VALUE_MAX + 1];
+		if (_file_read(f, pos, hdr, sizeof(hdr)) < 0)
+			return;
+
+		const uint32_t val_len = _le32(hdr);
+		const uint32_t flags = _le32(&hdr[4]);
+		pos += 8;
+
+		size_t n = (size_t)(items_end - pos);
+		if (n > 256)
+			n = 256;
+
+		if (_file_read(f, pos, buf, n) < 0)
+			return;
+
+		const char *const nul = memchr(buf, '\0', n);
+		if (nul == NULL)
+			return;
+
+		char key[256];
+		const size_t key_len = (size_t)(nul - buf);
+		memcpy(key, buf, key_len + 1);
+		pos += (int64_t)key_len + 1;
+		if ((int64_t)val_len > (items_end - pos))
+			return;
+
+		/* text only, not binary or links */
+		if (((flags >> 1) & 3) == 0) {
+			const size_t vn = (val_len < _VALUE_MAX)? val_len : _VALUE_MAX;
+			if (_file_read(f, pos, buf, vn) < 0)
+				return;
+
+			_key(t, key, buf, vn, 1);
+		}
+
+		pos += val_len;
+	}
+}
+
+
+/*
+ * layer III only: I and II are rare enough for libav
+ */
+static int
+_mpa_header(const uint8_t b[], TagsMpa *m)
+{
+	static const int bitrates[2][15] = {
+		{ 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+		{ 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },
+	};
+	static const int rates[3] = { 44100, 48000, 32000 };
+
+	const uint32_t h = _be32(b);
+	if ((h & 0xffe00000) != 0xffe00000)
+		return -1;
+
+	const int ver = (int)((h >> 19) & 3);
+	const int layer = (int)((h >> 17) & 3);
+	const int br = (int)((h >> 12) & 15);
+	const int sr = (int)((h >> 10) & 3);
+	if ((ver == 1) || (layer != 1) || (br == 0) || (br == 15) || (sr == 3))
+		return -1;
+
+	m->is_v1 = (ver == 3);
+	m->is_mono = (((h >> 6) & 3) == 3);
+	m->rate = rates[sr] >> ((ver == 3)? 0 : (ver == 2)? 1 : 2);
+	m->bitrate = bitrates[m->is_v1][br];
+	m->spf = m->is_v1? 1152 : 576;
+	m->frame_len = (((m->spf / 8) * m->bitrate * 1000) / m->rate) + (int)((h >> 9) & 1);
+	return 0;
+}
+
+
+/*
+ * the first frame says how long: Xing/Info (LAME), VBRI, or the bitrate of a CBR file
+ */
+static int
+_mp3(Tags *t, TagsFile *f, int64_t offt)
+{
+	const int64_t id3_len = _id3v2(t, f, offt);
+	if (id3_len < 0)
+		return -1;
+
+	offt += id3_len;
+
+	/* ID3v2 in front of a FLAC file: libav does not look at it either */
+	uint8_t magic[4];
+	if ((id3_len > 0) && (_file_read(f, offt, magic, sizeof(magic)) == 0) && (memcmp(magic, "fLaC", 4) == 0)) {
+		memset(t, 0, sizeof(*t));
+		return _flac(t, f, offt);
+	}
+
+	TagsMpa m;
+	const int64_t audio = _mp3_sync(f, offt, (id3_len > 0), &m);
+	if (audio < 0)
+		return -1;
+
+	uint8_t frame[4 + 32 + 120 + 36];
+	size_t frame_len = sizeof(frame);
+	if ((int64_t)frame_len > (f->size - audio))
+		frame_len = (size_t)(f->size - audio);
+
+	memset(frame, 0, sizeof(frame));
+	if (_file_read(f, audio, frame, frame_len) < 0)
+		return -1;
+
+	int64_t samples = -1;
+	const size_t side = m.is_v1? (m.is_mono? 17 : 32) : (m.is_mono? 9 : 17);
+	const uint8_t *x = &frame[4 + side];
+	if ((memcmp(x, "Xing", 4) == 0) || (memcmp(x, "Info", 4) == 0)) {
+		const uint32_t flags = _be32(&x[4]);
+		const uint8_t *p = &x[8];
+		if (ISSET(flags, 0x1)) {
+			samples = (int64_t)_be32(p) * m.spf;
+			p += 4;
+		}
+
+		if (ISSET(flags, 0x2))
+			p += 4;
+		if (ISSET(flags, 0x4))
+			p += 100;
+		if (ISSET(flags, 0x8))
+			p += 4;
+
+		/* LAME: encoder delay and padding, 12 bits each */
+		if ((samples > 0) && ((p + 24) <= &frame[sizeof(frame)]) &&
+		    ((memcmp(p, "LAME", 4) == 0) || (memcmp(p, "Lavf", 4) == 0) || (memcmp(p, "Lavc", 4) == 0))) {
+			const uint32_t dp = _be24(&p[21]);
+			const int64_t trim = (int64_t)(dp >> 12) + (int64_t)(dp & 0xfff);
+			if (trim < samples)
+				samples -= trim;
+		}
+	} else if (memcmp(&frame[4 + 32], "VBRI", 4) == 0) {
+		samples = (int64_t)_be32(&frame[4 + 32 + 14]) * m.spf;
+	}
+
+	if (samples > 0) {
+		t->duration = samples / m.rate;
+	} else {
+		t->duration = ((_mp3_end(f) - audio) * 8) / ((int64_t)m.bitrate * 1000);
+		t->is_estimated = 1;
+	}
+
+	if ((t->title[0] == '\0') && (t->artist[0] == '\0') && (t->album[0] == '\0') && (t->genre[0] == '\0'))
+		_id3v1(t, f);
+
+	_ape(t, f);
+	return 0;
+}
+
+
+
+/*
+ * the first header with another one after it, or a Xing/VBRI frame; 'is_tagged': junk
+ * between the tag and the audio is skipped, a stray sync word elsewhere is not a file
+ * returns: the offset of the frame, -1: none
+ */
+static int64_t
+_mp3_sync(TagsFile *f, int64_t offt, int is_tagged, TagsMpa *m)
+{
+	uint8_t buf[_SYNC_MAX];
+	size_t len = sizeof(buf);
+	if ((int64_t)len > (f->size - offt))
+		len = (size_t)(f->size - offt);
+	if ((len < 4) || (_file_read(f, offt, buf, len) < 0))
+		return -1;
+
+	for (size_t start = 0; (start + 4) <= len; start++) {
+		if ((start > 0) && (is_tagged == 0))
+			return -1;
+
+		if (_mpa_header(&buf[start], m) < 0)
+			continue;
+
+		uint8_t nb[4];
+		TagsMpa nm;
+		const int64_t next = offt + (int64_t)start + m->frame_len;
+		if ((_file_read(f, next, nb, sizeof(nb)) == 0) && (_mpa_header(nb, &nm) == 0) &&
+		    (nm.rate == m->rate) && (nm.is_v1 == m->is_v1))
+			return offt + (int64_t)start;
+
+		/* a file of one frame */
+		if (_mpa_is_info(&buf[start], len - start, m))
+			return offt + (int64_t)start;
+	}
+
+	return -1;
+}
+
+
+/*
+ * the end of the audio: before ID3v1 and APEv2 tags
+ */
+static int64_t
+_mp3_end(TagsFile *f)
+{
+	int64_t end = f->size;
+	uint8_t v1[3];
+	if ((end >= 128) && (_file_read(f, end - 128, v1, sizeof(v1)) == 0) && (memcmp(v1, "TAG", 3) == 0))
+		end -= 128;
+
+	uint8_t foot[32];
+	if ((end >= 32) && (_file_read(f, end - 32, foot, sizeof(foot)) == 0) && (memcmp(foot, "APETAGEX", 8) == 0)) {
+		/* the size is without the header, if there is one */
+		const int64_t len = (int64_t)_le32(&foot[12]) + (ISSET(_le32(&foot[20]), 0x80000000u)? 32 : 0);
+		if (len <= end)
+			end -= len;
+	}
+
+	return end;
+}
+
+
+/*
+ * samples in the frames from 'pos' to 'end'; lost sync is found again byte by byte, a
+ * header only trusted then with another one right after it, as libav does
+ */
+static int64_t
+_mp3_walk(TagsFile *f, int64_t pos, int64_t end, const TagsMpa *first)
+{
+	uint8_t *const buf = malloc(_WALK_SIZE);
+	if (buf == NULL) {
+		log_err(errno, "tags: _mp3_walk: malloc");
+		return -1;
+	}
+
+	if ((f->fd < 0) && ((f->fd = open(f->path, O_RDONLY | O_CLOEXEC)) >= 0))
+		posix_fadvise(f->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	int64_t samples = 0;
+	int64_t buf_offt = 0;
+	size_t buf_len = 0;
+	int is_lost = 0;
+	int is_first = 1;
+	while ((pos + 4) <= end) {
+		if ((pos + 4) > (buf_offt + (int64_t)buf_len)) {
+			buf_offt = pos;
+			buf_len = ((end - pos) < _WALK_SIZE)? (size_t)(end - pos) : _WALK_SIZE;
+			if (_file_read(f, buf_offt, buf, buf_len) < 0) {
+				samples = -1;
+				break;
+			}
+		}
+
+		const uint8_t *const h = &buf[pos - buf_offt];
+		const size_t avail = buf_len - (size_t)(pos - buf_offt);
+		TagsMpa m;
+		if ((_mpa_header(h, &m) < 0) || (m.rate != first->rate) || ((pos + m.frame_len) > end)) {
+			is_lost = 1;
+			pos++;
+			continue;
+		}
+
+		if (is_lost && ((pos + m.frame_len) < end)) {
+			uint8_t nb[4];
+			const uint8_t *next = &h[m.frame_len];
+			if (((size_t)m.frame_len + 4) > avail) {
+				if (_file_read(f, pos + m.frame_len, nb, sizeof(nb)) < 0) {
+					pos++;
+					continue;
+				}
+
+				next = nb;
+			}
+
+			TagsMpa nm;
+			if (_mpa_header(next, &nm) < 0) {
+				pos++;
+				continue;
+			}
+		}
+
+		is_lost = 0;
+
+		if ((is_first == 0) || (_mpa_is_info(h, avail, &m) == 0))
+			samples += m.spf;
+
+		is_first = 0;
+		pos += m.frame_len;
+	}
+
+	free(buf);
+	return samples;
+}
+
+
+/*
+ * a Xing, Info or VBRI header instead of audio: no samples of its own
+ */
+static int
+_mpa_is_info(const uint8_t frame[], size_t len, const TagsMpa *m)
+{
+	const size_t side = m->is_v1? (m->is_mono? 17 : 32) : (m->is_mono? 9 : 17);
+	if (((4 + side + 4) <= len) &&
+	    ((memcmp(&frame[4 + side], "Xing", 4) == 0) || (memcmp(&frame[4 + side], "Info", 4) == 0)))
+		return 1;
+
+	return (((4 + 32 + 4) <= len) && (memcmp(&frame[4 + 32], "VBRI", 4) == 0));
+}
+
+static int
+_flac(Tags *t, TagsFile *f, int64_t offt)
+{
+	uint8_t magic[4];
+	if ((_file_read(f, offt, magic, sizeof(magic)) < 0) || (memcmp(magic, "fLaC", 4) != 0))
+		return -1;
+
+	int64_t pos = offt + 4;
+	int64_t samples = 0;
+	int rate = 0;
+	for (;;) {
+		uint8_t hdr[4];
+		if (_file_read(f, pos, hdr, sizeof(hdr)) < 0)
+			return -1;
+
+		const int type = hdr[0] & 0x7f;
+		const int64_t len = _be24(&hdr[1]);
+		pos += 4;
+		if (type == 127)
+			return -1;
+
+		if (type == 0) {
+			uint8_t si[18];
+			if ((len < 34) || (_file_read(f, pos, si, sizeof(si)) < 0))
+				return -1;
+
+			rate = (int)(((uint32_t)si[10] << 12) | ((uint32_t)si[11] << 4) | ((uint32_t)si[12] >> 4));
+			samples = ((int64_t)(si[13] & 0x0f) << 32) | (int64_t)_be32(&si[14]);
+		} else if (type == 4) {
+			TagsStream s = {
+				.file = f,
+				.pos = pos,
+				.end = pos + len,
+			};
+
+			if (_vorbis_comments(t, &s) < 0)
+				return -1;
+		}
+
+		pos += len;
+		if (ISSET(hdr[0], 0x80))
+			break;
+	}
+
+	/* not in STREAMINFO: libav counts them */
+	if ((rate == 0) || (samples == 0))
+		return -1;
+
+	t->duration = samples / rate;
+	return 0;
+}
+
+
+/*
+ * OpusHead alone on the first page, OpusTags from the second on; the duration is the
+ * granule position of the last page
+ */
+static int
+_opus(Tags *t, TagsFile *f)
+{
+	uint8_t hdr[27];
+	if ((_file_read(f, 0, hdr, sizeof(hdr)) < 0) || (ISSET(hdr[5], 0x02) == 0))
+		return -1;
+
+	const uint32_t serial = _le32(&hdr[14]);
+	uint8_t lacing[255];
+	const int segs = hdr[26];
+	if (_file_read(f, 27, lacing, (size_t)segs) < 0)
+		return -1;
+
+	int64_t pos = 27 + segs;
+	uint8_t head[19];
+	if ((_file_read(f, pos, head, sizeof(head)) < 0) || (memcmp(head, "OpusHead", 8) != 0))
+		return -1;
+
+	const int64_t pre_skip = _le16(&head[10]);
+	for (int i = 0; i < segs; i++)
+		pos += lacing[i];
+
+	TagsStream s = {
+		.file = f,
+		.pos = pos,
+		.is_ogg = 1,
+		.serial = serial,
+	};
+
+	char magic[8];
+	if ((_stream_read(&s, magic, sizeof(magic)) < 0) || (memcmp(magic, "OpusTags", 8) != 0))
+		return -1;
+
+	if (_vorbis_comments(t, &s) < 0)
+		return -1;
+
+	size_t len = _TAIL_SIZE;
+	if ((int64_t)len > f->size)
+		len = (size_t)f->size;
+
+	uint8_t *const tail = malloc(len);
+	if (tail == NULL) {
+		log_err(errno, "tags: _opus: malloc");
+		return -1;
+	}
+
+	int ret = -1;
+	if (_file_read(f, f->size - (int64_t)len, tail, len) < 0)
+		goto out0;
+
+	for (size_t i = len - 27 + 1; i > 0; i--) {
+		const uint8_t *const p = &tail[i - 1];
+		if ((memcmp(p, "OggS", 4) != 0) || (p[4] != 0) || (_le32(&p[14]) != serial))
+			continue;
+
+		const uint64_t granule = _le64(&p[6]);
+		if (granule == UINT64_MAX)
+			continue;
+
+		if ((int64_t)granule < pre_skip)
+			break;
+
+		t->duration = ((int64_t)granule - pre_skip) / 48000;
+		ret = 0;
+		break;
+	}
+
+out0:
+	free(tail);
+	return ret;
+}
+
+
+/*
+ * "fmt " for the byte rate, "data" for the length, LIST/INFO and "id3 " for the tags
+ */
+static int
+_wav(Tags *t, TagsFile *f)
+{
+	int64_t pos = 12;
+	int64_t data_len = -1;
+	uint32_t byte_rate = 0;
+	while ((pos + 8) <= f->size) {
+		uint8_t hdr[8];
+		if (_file_read(f, pos, hdr, sizeof(hdr)) < 0)
+			return -1;
+
+		int64_t len = _le32(&hdr[4]);
+		pos += 8;
+		if (memcmp(hdr, "fmt ", 4) == 0) {
+			uint8_t fmt[16];
+			if ((len < 16) || (_file_read(f, pos, fmt, sizeof(fmt)) < 0))
+				return -1;
+
+			byte_rate = _le32(&fmt[8]);
+		} else if (memcmp(hdr, "data", 4) == 0) {
+			/* still being written, streamed */
+			if ((len == 0) || (len == UINT32_MAX) || (len > (f->size - pos)))
+				len = f->size - pos;
+
+			data_len = len;
+		} else if ((memcmp(hdr, "LIST", 4) == 0) && (len >= 4)) {
+			uint8_t type[4];
+			if (_file_read(f, pos, type, sizeof(type)) < 0)
+				return -1;
+
+			if (memcmp(type, "INFO", 4) == 0) {
+				int64_t sub = pos + 4;
+				const int64_t end = pos + len;
+				while ((sub + 8) <= end) {
+					uint8_t sh[8];
+					if (_file_read(f, sub, sh, sizeof(sh)) < 0)
+						return -1;
+
+					const int64_t sub_len = _le32(&sh[4]);
+					sub += 8;
+					if (sub_len > (end - sub))
+						break;
+
+					const char *key = NULL;
+					if (memcmp(sh, "INAM", 4) == 0)
+						key = "title";
+					else if (memcmp(sh, "IART", 4) == 0)
+						key = "artist";
+					else if (memcmp(sh, "IPRD", 4) == 0)
+						key = "album";
+					else if (memcmp(sh, "IGNR", 4) == 0)
+						key = "genre";
+
+					if (key != NULL) {
+						char val[_VALUE_MAX];
+						const size_t n = (sub_len < _VALUE_MAX)? (size_t)sub_len : _VALUE_MAX;
+						if (_file_read(f, sub, val, n) < 0)
+							return -1;
+
+						_key(t, key, val, n, 0);
+					}
+
+					sub += sub_len + (sub_len & 1);
+				}
+			}
+		} else if ((memcmp(hdr, "id3 ", 4) == 0) || (memcmp(hdr, "ID3 ", 4) == 0)) {
+			if (_id3v2(t, f, pos) < 0)
+				return -1;
+		}
+
+		pos += len + (len & 1);
+	}
+
+	if ((byte_rate == 0) || (data_len < 0))
+		return -1;
+
+	t->duration = data_len / byte_rate;
+	return 0;
+}
+
+
+static int
+_mp4(Tags *t, TagsFile *f)
+{
+	int64_t pos = 0;
+	while (pos < f->size) {
+		char type[5];
+		int64_t body;
+		int64_t next;
+		if (_mp4_atom(f, pos, f->size, type, &body, &next) < 0)
+			return -1;
+
+		if (strcmp(type, "moov") == 0)
+			return _mp4_moov(t, f, body, next);
+
+		pos = next;
+	}
+
+	return -1;
+}
+
+
+static int
+_mp4_atom(TagsFile *f, int64_t pos, int64_t end, char type[], int64_t *body, int64_t *next)
+{
+	uint8_t hdr[16];
+	if (((pos + 8) > end) || (_file_read(f, pos, hdr, 8) < 0))
+		return -1;
+
+	int64_t size = _be32(hdr);
+	int64_t hdr_len = 8;
+	if (size == 1) {
+		if (((pos + 16) > end) || (_file_read(f, pos + 8, &hdr[8], 8) < 0))
+			return -1;
+
+		size = (int64_t)_be64(&hdr[8]);
+		hdr_len = 16;
+	} else if (size == 0) {
+		size = end - pos;
+	}
+
+	if ((size < hdr_len) || (size > (end - pos)))
+		return -1;
+
+	memcpy(type, &hdr[4], 4);
+	type[4] = '\0';
+	*body = pos + hdr_len;
+	*next = pos + size;
+	return 0;
+}
+
+
+/*
+ * mvhd for the duration, udta/meta/ilst for the tags; the sample tables are skipped
+ */
+static int
+_mp4_moov(Tags *t, TagsFile *f, int64_t pos, int64_t end)
+{
+	int64_t duration = -1;
+	while (pos < end) {
+		char type[5];
+		int64_t body;
+		int64_t next;
+		if (_mp4_atom(f, pos, end, type, &body, &next) < 0)
+			return -1;
+
+		if (strcmp(type, "mvhd") == 0) {
+			uint8_t b[32];
+			if ((next - body) < 32 || (_file_read(f, body, b, sizeof(b)) < 0))
+				return -1;
+
+			uint32_t scale;
+			uint64_t len;
+			if (b[0] == 1) {
+				scale = _be32(&b[20]);
+				len = _be64(&b[24]);
+			} else {
+				scale = _be32(&b[12]);
+				len = _be32(&b[16]);
+			}
+
+			if ((scale == 0) || (len == 0) || (len == UINT64_MAX) || (len == UINT32_MAX))
+				return -1;
+
+			duration = (int64_t)(len / scale);
+		} else if (strcmp(type, "udta") == 0) {
+			int64_t sub = body;
+			while (sub < next) {
+				char sub_type[5];
+				int64_t sub_body;
+				int64_t sub_next;
+				if (_mp4_atom(f, sub, next, sub_type, &sub_body, &sub_next) < 0)
+					break;
+
+				if (strcmp(sub_type, "meta") == 0)
+					_mp4_meta(t, f, sub_body, sub_next);
+
+				sub = sub_next;
+			}
+		} else if (strcmp(type, "meta") == 0) {
+			_mp4_meta(t, f, body, next);
+		}
+
+		pos = next;
+	}
+
+	if (duration < 0)
+		return -1;
+
+	t->duration = duration;
+	return 0;
+}
+
+
+/*
+ * a full box in MP4 (version and flags first), not in QuickTime
+ */
+static void
+_mp4_meta(Tags *t, TagsFile *f, int64_t pos, int64_t end)
+{
+	uint8_t b[8];
+	if (_file_read(f, pos, b, sizeof(b)) < 0)
+		return;
+
+	if (memcmp(&b[4], "hdlr", 4) != 0)
+		pos += 4;
+
+	while (pos < end) {
+		char type[5];
+		int64_t body;
+		int64_t next;
+		if (_mp4_atom(f, pos, end, type, &body, &next) < 0)
+			return;
+
+		if (strcmp(type, "ilst") == 0)
+			_mp4_ilst(t, f, body, next);
+
+		pos = next;
+	}
+}
+
+
+static void
+_mp4_ilst(Tags *t, TagsFile *f, int64_t pos, int64_t end)
+{
+	while (pos < end) {
+		char type[5];
+		int64_t body;
+		int64_t next;
+		if (_mp4_atom(f, pos, end, type, &body, &next) < 0)
+			return;
+
+		const char *key = NULL;
+		if (strcmp(type, "\251nam") == 0)
+			key = "title";
+		else if (strcmp(type, "\251ART") == 0)
+			key = "artist";
+		else if (strcmp(type, "\251alb") == 0)
+			key = "album";
+		else if ((strcmp(type, "\251gen") == 0) || (strcmp(type, "gnre") == 0))
+			key = "genre";
+
+		/* "----": a freeform key in its "name" */
+		char name[64] = { 0 };
+		const int is_free = (strcmp(type, "----") == 0);
+		if ((key == NULL) && (is_free == 0)) {
+			pos = next;
+			continue;
+		}
+
+		int64_t sub = body;
+		while (sub < next) {
+			char sub_type[5];
+			int64_t sub_body;
+			int64_t sub_next;
+			if (_mp4_atom(f, sub, next, sub_type, &sub_body, &sub_next) < 0)
+				break;
+
+			const int64_t len = sub_next - sub_body;
+			if ((strcmp(sub_type, "name") == 0) && (len > 4)) {
+				const size_t n = ((len - 4) < (int64_t)sizeof(name))? (size_t)(len - 4) : (sizeof(name) - 1);
+				if (_file_read(f, sub_body + 4, name, n) == 0)
+					name[n] = '\0';
+			} else if ((strcmp(sub_type, "data") == 0) && (len >= 8)) {
+				uint8_t val[_VALUE_MAX];
+				const size_t n = ((len - 8) < _VALUE_MAX)? (size_t)(len - 8) : _VALUE_MAX;
+				uint8_t kind[4];
+				if ((_file_read(f, sub_body, kind, sizeof(kind)) < 0) || (_file_read(f, sub_body + 8, val, n) < 0))
+					break;
+
+				const uint32_t well_known = _be24(&kind[1]);
+				if (strcmp(type, "gnre") == 0) {
+					if (n >= 2)
+						_genre_set(t, (long)_be16(val) - 1);
+				} else if (well_known == 1) {
+					_key(t, is_free? name : key, (const char *)val, n, 0);
+				}
+
+				break;
+			}
+
+			sub = sub_next;
+		}
+
+		pos = next;
+	}
+}
+
+
+static void
+_genre_set(Tags *t, long idx)
+{
+	if ((idx < 0) || ((size_t)idx >= LEN(_genres)) || (t->genre[0] != '\0'))
+		return;
+
+	cstr_copy_n(t->genre, TAGS_STR_SIZE, _genres[idx], strlen(_genres[idx]));
+}
+
+
+/*
+ * returns: the new length, 'dst' NUL-terminated; what does not fit is dropped
+ */
+static size_t
+_utf8_put(char dst[], size_t size, size_t len, uint32_t cp)
+{
+	char buf[4];
+	size_t n;
+	if (cp < 0x80) {
+		buf[0] = (char)cp;
+		n = 1;
+	} else if (cp < 0x800) {
+		buf[0] = (char)(0xc0 | (cp >> 6));
+		buf[1] = (char)(0x80 | (cp & 0x3f));
+		n = 2;
+	} else if (cp < 0x10000) {
+		buf[0] = (char)(0xe0 | (cp >> 12));
+		buf[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		buf[2] = (char)(0x80 | (cp & 0x3f));
+		n = 3;
+	} else {
+		buf[0] = (char)(0xf0 | (cp >> 18));
+		buf[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+		buf[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+		buf[3] = (char)(0x80 | (cp & 0x3f));
+		n = 4;
+	}
+
+	if ((len + n) >= size)
+		return len;
+
+	memcpy(&dst[len], buf, n);
+	dst[len + n] = '\0';
+	return len + n;
+}
+
+
+static uint32_t
+_be16(const uint8_t b[])
+{
+	return ((uint32_t)b[0] << 8) | b[1];
+}
+
+
+static uint32_t
+_be24(const uint8_t b[])
+{
+	return ((uint32_t)b[0] << 16) | ((uint32_t)b[1] << 8) | b[2];
+}
+
+
+static uint32_t
+_be32(const uint8_t b[])
+{
+	return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+
+static uint64_t
+_be64(const uint8_t b[])
+{
+	return ((uint64_t)_be32(b) << 32) | _be32(&b[4]);
+}
+
+
+static uint32_t
+_le16(const uint8_t b[])
+{
+	return ((uint32_t)b[1] << 8) | b[0];
+}
+
+
+static uint32_t
+_le32(const uint8_t b[])
+{
+	return ((uint32_t)b[3] << 24) | ((uint32_t)b[2] << 16) | ((uint32_t)b[1] << 8) | b[0];
+}
+
+
+static uint64_t
+_le64(const uint8_t b[])
+{
+	return ((uint64_t)_le32(&b[4]) << 32) | _le32(b);
+}
+
+
+static uint32_t
+_syncsafe(const uint8_t b[])
+{
+	return ((uint32_t)(b[0] & 0x7f) << 21) | ((uint32_t)(b[1] & 0x7f) << 14) | ((uint32_t)(b[2] & 0x7f) << 7) |
+	       (b[3] & 0x7f);
+}
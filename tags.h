@@ -0,0 +1,30 @@
+#ifndef __TAGS_H__
+#define __TAGS_H__
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define TAGS_STR_SIZE (256)
+
+
+/*
+ * what the playlist shows of a file; strings in UTF-8, "" when not tagged
+ */
+typedef struct tags {
+	char    title[TAGS_STR_SIZE];
+	char    artist[TAGS_STR_SIZE];
+	char    album[TAGS_STR_SIZE];
+	char    genre[TAGS_STR_SIZE];
+	int64_t duration;	/* s */
+	int     is_estimated;	/* from the bitrate, see tags_mp3_duration() */
+	int     has_replaygain;
+} Tags;
+
+
+int tags_read(Tags *t, const char path[], int64_t size, const uint8_t head[], size_t head_len);
+int tags_mp3_duration(const char path[], int64_t size, int64_t *duration);
+
+
+#endif
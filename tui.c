@@ -2,6 +2,7 @@
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -51,6 +52,11 @@ static const char _dialog_type_chr[] = {
 };
 
 
+static const char *const _level_str[] = {
+	" ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█",
+};
+
+
 static const char *const _repeat_type_str[3] = {
 	[TUI_REPEAT_TYPE_ONE]  = "[r]",
 	[TUI_REPEAT_TYPE_ALL]  = "[R]",
@@ -68,8 +74,16 @@ static void _add_playlist_item(Tui *t, int idx, int pos);
 static void _set_header(Tui *t);
 static void _set_body(Tui *t);
 static void _set_footer(Tui *t);
+static void _set_wave(Tui *t, int end);
+static void _set_viz_spectrum(Tui *t, const VizResult *res);
+static void _set_viz_meter(Tui *t, const VizResult *res);
+static void _add_viz_bar(Tui *t, float rms, float peak, int width);
 static int  _get_playlist_relative_len(const Tui *t);
 static int  _playlist_check_items(Tui *t);
+static int  _playlist_index_of(const PlaylistItem *items[], int len, const char path[]);
+static int  _playlist_clamp(int idx, int len);
+static void _playlist_keep(TuiPlaylist *pl, const PlaylistItem *item);
+static const PlaylistItem *_playlist_active(const Tui *t);
 static void _playlist_cursor(Tui *t, int step, int is_scroll);
 static void _playlist_cursor_at(Tui *t, int idx);
 
@@ -108,6 +122,13 @@ tui_init(Tui *t, const char root_dir[])
 	t->state = _STATE_NORMAL;
 	t->root_dir = root_dir;
 	t->sleep_duration = 0;
+	t->progress_label = NULL;
+	t->progress_done = 0;
+	t->progress_total = 0;
+	t->viz_rows = 0;
+	t->wave_peaks = NULL;
+	t->wave_len = 0;
+	t->wave_bucket_ms = 0;
 	t->playlist.state = _PLAYER_STATE_STOPPED;
 	t->playlist.repeat = TUI_REPEAT_TYPE_NONE;
 	t->playlist.top = 0;
@@ -251,6 +272,77 @@ tui_set_playlist(Tui *t, const PlaylistItem *items[], int len)
 }
 
 
+/*
+ * the same playlist, changed: the active item and the cursor stay on their files,
+ * looked up by path; a removed one leaves the cursor where it was, a removed active
+ * one that still plays is kept for the footer with no row marked
+ */
+void
+tui_update_playlist(Tui *t, const PlaylistItem *items[], int len)
+{
+	if ((items == NULL) || (len <= 0)) {
+		len = 0;
+		items = NULL;
+	}
+
+	TuiPlaylist *const pl = &t->playlist;
+	const int sel_idx = pl->top + pl->curr;
+	int selected = -1;
+	if ((sel_idx >= 0) && (sel_idx < pl->items_len))
+		selected = _playlist_index_of(items, len, pl->items[sel_idx]->file_path);
+
+	if (selected < 0)
+		selected = _playlist_clamp(sel_idx, len);
+
+	const PlaylistItem *const act = _playlist_active(t);
+	int active = (act != NULL)? _playlist_index_of(items, len, act->file_path) : -1;
+	if ((active < 0) && (act != NULL) && (pl->state != _PLAYER_STATE_STOPPED)) {
+		if (act != &pl->playing)
+			_playlist_keep(pl, act);
+	} else if (active < 0) {
+		active = _playlist_clamp(pl->item_active, len);
+	}
+
+	pl->items = items;
+	pl->items_len = len;
+	pl->item_active = active;
+	pl->item_selected = selected;
+
+	/* the cursor keeps its row */
+	pl->top = selected - pl->curr;
+	if (pl->top < 0)
+		pl->top = 0;
+
+	pl->curr = selected - pl->top;
+	tui_draw(t);
+}
+
+
+/*
+ * the items 'first' .. 'last' changed in place: only their rows on screen are redrawn,
+ * the footer too (the active item may be one of them)
+ */
+void
+tui_update_items(Tui *t, int first, int last)
+{
+	const int top = t->playlist.top;
+	int end = top + _get_playlist_relative_len(t);
+	if (end > t->playlist.items_len)
+		end = t->playlist.items_len;
+
+	if (first < top)
+		first = top;
+	if (last >= end)
+		last = end - 1;
+
+	_draw_begin(t);
+	for (int i = first; i <= last; i++)
+		_add_playlist_item(t, i, i - top);
+
+	_set_footer(t);
+	_draw_end(t);
+}
+
 void
 tui_set_duration(Tui *t, int64_t duration)
 {
@@ -284,6 +376,78 @@ tui_set_repeat(Tui *t, TuiRepeatType type)
 }
 
 
+void
+tui_set_progress(Tui *t, const char label[], int done, int total)
+{
+	if ((t->progress_label == label) && (t->progress_done == done) && (t->progress_total == total))
+		return;
+
+	t->progress_label = label;
+	t->progress_done = done;
+	t->progress_total = total;
+
+	_draw_begin(t);
+	_set_footer(t);
+	_draw_end(t);
+}
+
+
+/*
+ * waveform of the playing item in the footer, 'peaks' (0 .. 255) must outlive it;
+ * NULL: none
+ */
+void
+tui_set_wave(Tui *t, const uint8_t peaks[], int len, int bucket_ms)
+{
+	if ((peaks == NULL) || (len <= 0) || (bucket_ms <= 0)) {
+		peaks = NULL;
+		len = 0;
+	}
+
+	t->wave_peaks = peaks;
+	t->wave_len = len;
+	t->wave_bucket_ms = bucket_ms;
+
+	_draw_begin(t);
+	_set_footer(t);
+	_draw_end(t);
+}
+
+
+/*
+ * shows or hides the visualisation row, the whole screen is redrawn
+ */
+void
+tui_set_viz(Tui *t, int enable)
+{
+	t->viz_rows = (enable)? 1 : 0;
+	tui_draw(t);
+}
+
+
+/*
+ * redraws the visualisation row only
+ */
+void
+tui_draw_viz(Tui *t, const VizResult *res)
+{
+	if ((t->viz_rows == 0) || (_get_playlist_relative_len(t) <= 0))
+		return;
+
+	_draw_begin(t);
+	str_append_fmt(&t->buffer, "\x1b[%d;1H\x1b[" CFG_VIZ_COLOR_FG ";" CFG_VIZ_COLOR_BG "m\x1b[K",
+		       t->footer_pos - 1);
+
+	if (res->mode == VIZ_MODE_SPECTRUM)
+		_set_viz_spectrum(t, res);
+	else if (res->mode == VIZ_MODE_METER)
+		_set_viz_meter(t, res);
+
+	str_append_n(&t->buffer, "\x1b[m", 3);
+	_draw_end(t);
+}
+
+
 void
 tui_playlist_cursor_up(Tui *t)
 {
@@ -391,6 +555,16 @@ tui_playlist_curr(Tui *t)
 }
 
 
+/*
+ * returns: the first item on screen, 'len': how many rows there are for them
+ */
+int
+tui_playlist_get_view(const Tui *t, int *len)
+{
+	*len = _get_playlist_relative_len(t);
+	return t->playlist.top;
+}
+
 void
 tui_playlist_find_begin(Tui *t)
 {
@@ -522,11 +696,10 @@ const PlaylistItem *
 tui_playlist_stop(Tui *t)
 {
 	const PlaylistItem *ret = NULL;
-	const int idx = t->playlist.item_active;
 	if (_playlist_check_items(t)) {
 		t->playlist.state = _PLAYER_STATE_STOPPED;
 		t->playlist.item_duration = 0;
-		ret = t->playlist.items[idx];
+		ret = _playlist_active(t);
 	}
 
 	_draw_begin(t);
@@ -556,7 +729,7 @@ tui_playlist_toggle(Tui *t)
 		break;
 	}
 
-	ret = t->playlist.items[t->playlist.item_active];
+	ret = _playlist_active(t);
 
 out0:
 	_draw_begin(t);
@@ -591,10 +764,11 @@ tui_playlist_next(Tui *t)
 		break;
 	}
 
+	/* from a removed one: the first, or the same again */
 	t->playlist.state = _PLAYER_STATE_PLAYING;
 	t->playlist.item_active = idx;
 	t->playlist.item_duration = 0;
-	ret = t->playlist.items[idx];
+	ret = _playlist_active(t);
 
 out0:
 	_draw_begin(t);
@@ -626,6 +800,22 @@ out0:
 }
 
 
+/*
+ * returns: the item being played, NULL: paused or stopped
+ */
+const PlaylistItem *
+tui_playlist_get_playing(Tui *t)
+{
+	if (t->playlist.state != _PLAYER_STATE_PLAYING)
+		return NULL;
+
+	if (_playlist_check_items(t) == 0)
+		return NULL;
+
+	return _playlist_active(t);
+}
+
+
 void
 tui_command_begin(Tui *t)
 {
@@ -927,7 +1117,7 @@ _set_footer(Tui *t)
 
 	char dur0[64];
 	char dur1[64];
-	const PlaylistItem *const item = t->playlist.items[t->playlist.item_active];
+	const PlaylistItem *const item = _playlist_active(t);
 	const char *const d0 = cstr_time_fmt(dur0, sizeof(dur0), t->playlist.item_duration);
 	const char *const d1 = cstr_time_fmt(dur1, sizeof(dur1), item->duration);
 	const int dpos = t->width - snprintf(NULL, 0, "[%s - %s]", d0, d1);
@@ -941,15 +1131,116 @@ _set_footer(Tui *t)
 	str_append_fmt(str, "\x1b[1;" CFG_FOOTER_COLOR_FG ";" CFG_FOOTER_COLOR_BG "m\x1b[K[%c]",
 		       _player_state_chr[t->playlist.state]);
 
-	str_append_fmt(str, "%s %d. %s", _repeat_type_str[t->playlist.repeat], t->playlist.item_active + 1, name);
+	if (t->playlist.item_active < 0)
+		str_append_fmt(str, "%s %s", _repeat_type_str[t->playlist.repeat], name);
+	else
+		str_append_fmt(str, "%s %d. %s", _repeat_type_str[t->playlist.repeat], t->playlist.item_active + 1, name);
+
+	int end = dpos;
+	if ((t->progress_label != NULL) && (t->progress_total > 0)) {
+		const int ppos = dpos - snprintf(NULL, 0, " [%s %d/%d]", t->progress_label, t->progress_done,
+						 t->progress_total);
+		str_append_fmt(str, "\x1b[%d;%dH [%s %d/%d]", t->footer_pos, ppos, t->progress_label,
+			       t->progress_done, t->progress_total);
+		end = ppos;
+	}
+
+	if ((t->wave_peaks != NULL) && (t->playlist.state != _PLAYER_STATE_STOPPED))
+		_set_wave(t, end);
+
 	str_append_fmt(str, "\x1b[%d;%dH [%s - %s]\x1b[m", t->footer_pos, dpos, d0, d1);
 }
 
 
+/*
+ * a third of the width, right before column 'end': played part bold, the rest dim;
+ * each column shows the loudest bucket it covers
+ */
+static void
+_set_wave(Tui *t, int end)
+{
+	const int len = t->width / 3;
+	const int start = end - len - 1;
+	if ((len < 8) || (start < (t->width / 3)))
+		return;
+
+	const int64_t played = (t->playlist.item_duration * 1000) / t->wave_bucket_ms;
+	const int64_t pos = (played * len) / t->wave_len;
+
+	Str *const str = &t->buffer;
+	str_append_fmt(str, "\x1b[%d;%dH ", t->footer_pos, start);
+	for (int i = 0; i < len; i++) {
+		if (i == pos)
+			str_append_n(str, "\x1b[22;2m", 7);
+
+		int lo = (int)(((int64_t)i * t->wave_len) / len);
+		int hi = (int)(((int64_t)(i + 1) * t->wave_len) / len);
+		if (hi <= lo)
+			hi = lo + 1;
+
+		uint8_t peak = 0;
+		for (int j = lo; (j < hi) && (j < t->wave_len); j++) {
+			if (t->wave_peaks[j] > peak)
+				peak = t->wave_peaks[j];
+		}
+
+		/* never blank: the bar stays readable through silence */
+		const int lvl = 1 + ((peak * (int)(LEN(_level_str) - 2)) / UINT8_MAX);
+		str_append(str, _level_str[lvl]);
+	}
+
+	str_append_n(str, "\x1b[22;1m", 7);
+}
+
+
+static void
+_set_viz_spectrum(Tui *t, const VizResult *res)
+{
+	const int len = (res->len < t->width)? res->len : t->width;
+	for (int i = 0; i < len; i++) {
+		const int lvl = (int)lroundf(res->bands[i] * (float)(LEN(_level_str) - 1));
+		str_append(&t->buffer, _level_str[lvl]);
+	}
+}
+
+
+/*
+ * L <rms: solid, peak: shaded> R <...>
+ */
+static void
+_set_viz_meter(Tui *t, const VizResult *res)
+{
+	const int width = (t->width - 6) / 2;
+	if (width <= 0)
+		return;
+
+	str_append_n(&t->buffer, "L ", 2);
+	_add_viz_bar(t, res->rms[0], res->peak[0], width);
+	str_append_n(&t->buffer, "  R ", 4);
+	_add_viz_bar(t, res->rms[1], res->peak[1], width);
+}
+
+
+static void
+_add_viz_bar(Tui *t, float rms, float peak, int width)
+{
+	const int rms_len = (int)lroundf(rms * (float)width);
+	const int peak_len = (int)lroundf(peak * (float)width);
+	for (int i = 0; i < width; i++) {
+		if (i < rms_len)
+			str_append_n(&t->buffer, "█", 3);
+		else if (i < peak_len)
+			str_append_n(&t->buffer, "░", 3);
+		else
+			str_append_n(&t->buffer, " ", 1);
+	}
+}
+
+
 static inline int
 _get_playlist_relative_len(const Tui *t)
 {
-	return t->footer_pos - 3;
+	return t->footer_pos - 3 - t->viz_rows;
 }
 
 
@@ -965,6 +1256,68 @@ _playlist_check_items(Tui *t)
 }
 
 
+/*
+ * returns: where 'path' is in 'items', -1: not there
+ */
+static int
+_playlist_index_of(const PlaylistItem *items[], int len, const char path[])
+{
+	for (int i = 0; i < len; i++) {
+		if (strcmp(items[i]->file_path, path) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+
+static int
+_playlist_clamp(int idx, int len)
+{
+	if ((len == 0) || (idx < 0))
+		return 0;
+
+	return (idx < len)? idx : (len - 1);
+}
+
+
+/*
+ * the strings of 'item' go with its store: the path is copied, the tags are not
+ */
+static void
+_playlist_keep(TuiPlaylist *pl, const PlaylistItem *item)
+{
+	const size_t name_offt = (size_t)(item->name - item->file_path);
+	const int len = snprintf(pl->playing_path, sizeof(pl->playing_path), "%s", item->file_path);
+
+	pl->playing = *item;
+	pl->playing.file_path = pl->playing_path;
+	pl->playing.name = ((size_t)len < sizeof(pl->playing_path))? &pl->playing_path[name_offt] : pl->playing_path;
+	pl->playing.title = "";
+	pl->playing.artist = "";
+	pl->playing.album = "";
+	pl->playing.genre = "";
+	pl->item_active = -1;
+}
+
+
+/*
+ * returns: the active item, the kept one if it is not listed anymore; NULL: none
+ */
+static const PlaylistItem *
+_playlist_active(const Tui *t)
+{
+	const TuiPlaylist *const pl = &t->playlist;
+	if (pl->item_active < 0)
+		return &pl->playing;
+
+	if (pl->item_active >= pl->items_len)
+		return NULL;
+
+	return pl->items[pl->item_active];
+}
+
+
 static void
 _playlist_cursor(Tui *t, int step, int is_scroll)
 {
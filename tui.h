@@ -2,12 +2,14 @@
 #define __TUI_H__
 
 
+#include <limits.h>
 #include <termios.h>
 #include <unistd.h>
 #include <stdint.h>
 
 #include "playlist.h"
 #include "util.h"
+#include "viz.h"
 #include "config.h"
 
 
@@ -31,29 +33,38 @@ typedef struct tui_playlist {
 	int                  curr;
 	int                  found;
 	int                  find_state;
-	int                  item_active;
+	int                  item_active;	/* -1: not listed anymore, see 'playing' */
 	int                  item_selected;
 	int64_t              item_duration;	/* min duration */
 	const PlaylistItem **items;
 	int                  items_len;
+	PlaylistItem         playing;	/* the active one, kept when an update removed it */
+	char                 playing_path[PATH_MAX];
 } TuiPlaylist;
 
 typedef struct termios TermIOS;
 
 typedef struct tui {
-	int          state;
-	int          width;
-	int          height;
-	int          header_pos;
-	int          body_pos;
-	int          footer_pos;
-	const char  *root_dir;
-	TuiPlaylist  playlist;
-	Str          buffer;
-	Str          input_buffer;
-	int          tty_fd;
-	TermIOS      termios_orig;
-	int64_t      sleep_duration;
+	int            state;
+	int            width;
+	int            height;
+	int            header_pos;
+	int            body_pos;
+	int            footer_pos;
+	int            viz_rows;		/* above the footer */
+	const uint8_t *wave_peaks;
+	int            wave_len;
+	int            wave_bucket_ms;
+	const char    *root_dir;
+	TuiPlaylist    playlist;
+	Str            buffer;
+	Str            input_buffer;
+	int            tty_fd;
+	TermIOS        termios_orig;
+	int64_t        sleep_duration;
+	const char    *progress_label;
+	int            progress_done;
+	int            progress_total;
 } Tui;
 
 
@@ -65,9 +76,15 @@ void tui_show_dialog(Tui *t, const char message[], TuiDialogType type);
 void tui_show_cursor(Tui *t, int enable);
 
 void tui_set_playlist(Tui *t, const PlaylistItem *items[], int len);
+void tui_update_playlist(Tui *t, const PlaylistItem *items[], int len);
+void tui_update_items(Tui *t, int first, int last);
 void tui_set_duration(Tui *t, int64_t duration);
 void tui_set_sleep_duration(Tui *t, int64_t duration);
 void tui_set_repeat(Tui *t, TuiRepeatType type);
+void tui_set_progress(Tui *t, const char label[], int done, int total);
+void tui_set_wave(Tui *t, const uint8_t peaks[], int len, int bucket_ms);
+void tui_set_viz(Tui *t, int enable);
+void tui_draw_viz(Tui *t, const VizResult *res);
 
 void tui_playlist_cursor_up(Tui *t);
 void tui_playlist_cursor_down(Tui *t);
@@ -76,6 +93,7 @@ void tui_playlist_page_down(Tui *t);
 void tui_playlist_top(Tui *t);
 void tui_playlist_bottom(Tui *t);
 void tui_playlist_curr(Tui *t);
+int  tui_playlist_get_view(const Tui *t, int *len);
 
 void tui_playlist_find_begin(Tui *t);
 void tui_playlist_find_query(Tui *t, const char query[], int len);
@@ -89,6 +107,7 @@ const PlaylistItem *tui_playlist_stop(Tui *t);
 const PlaylistItem *tui_playlist_toggle(Tui *t);
 const PlaylistItem *tui_playlist_next(Tui *t);
 const PlaylistItem *tui_playlist_prev(Tui *t);
+const PlaylistItem *tui_playlist_get_playing(Tui *t);
 
 void        tui_command_begin(Tui *t);
 void        tui_command_query(Tui *t, const char query[], int len);
@@ -0,0 +1,384 @@
+/* syscall(), struct statx */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+#include "util.h"
+
+
+/* everything is there since 5.6, asked anyway: it can be disabled piecemeal */
+static const uint8_t _ops[] = { IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE };
+
+
+static int  _map(Uring *u, const struct io_uring_params *params);
+static int  _probe(const Uring *u);
+static void _push(Uring *u, const struct io_uring_sqe *sqe);
+static int  _run(Uring *u, unsigned count, int res[]);
+static void _drain(Uring *u, unsigned count, unsigned reaped, int res[]);
+static void _close(const int fds[], unsigned count);
+
+
+/*
+ * public
+ */
+/*
+ * returns: -1: not available (old kernel, seccomp, io_uring_disabled), use plain system
+ * calls instead; only unexpected failures are logged
+ */
+int
+uring_init(Uring *u, unsigned entries)
+{
+	if (entries > URING_ENTRIES_MAX)
+		entries = URING_ENTRIES_MAX;
+
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	const int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if (fd < 0) {
+		if ((errno != ENOSYS) && (errno != EPERM))
+			log_err(errno, "uring: uring_init: io_uring_setup");
+
+		return -1;
+	}
+
+	u->fd = fd;
+	u->entries = params.sq_entries;
+	u->sq_ring = MAP_FAILED;
+	u->cq_ring = MAP_FAILED;
+	u->sqes = MAP_FAILED;
+	u->fds = malloc(2 * u->entries * sizeof(int));
+	if (u->fds == NULL) {
+		log_err(errno, "uring: uring_init: malloc");
+		goto err0;
+	}
+
+	if (_map(u, &params) < 0)
+		goto err0;
+
+	if (_probe(u) < 0)
+		goto err0;
+
+	u->tail = atomic_load_explicit(u->sq_tail, memory_order_relaxed);
+	return 0;
+
+err0:
+	uring_deinit(u);
+	return -1;
+}
+
+
+void
+uring_deinit(Uring *u)
+{
+	if (u->sqes != MAP_FAILED)
+		munmap(u->sqes, u->sqes_size);
+	if ((u->cq_ring != MAP_FAILED) && (u->cq_ring != u->sq_ring))
+		munmap(u->cq_ring, u->cq_ring_size);
+	if (u->sq_ring != MAP_FAILED)
+		munmap(u->sq_ring, u->sq_ring_size);
+
+	free(u->fds);
+	close(u->fd);
+}
+
+
+/*
+ * 'names' relative to 'dir_fd', links followed; returns: 0, -1: the ring failed, 'res'
+ * is not to be trusted
+ */
+int
+uring_statx(Uring *u, int dir_fd, const char *const names[], size_t len, unsigned mask,
+	    struct statx *stx, int res[])
+{
+	for (size_t offt = 0; offt < len; offt += u->entries) {
+		unsigned count = 0;
+		for (; (count < u->entries) && ((offt + count) < len); count++) {
+			const size_t i = offt + count;
+			_push(u, &(struct io_uring_sqe) {
+				.opcode = IORING_OP_STATX,
+				.fd = dir_fd,
+				.addr = (uint64_t)(uintptr_t)names[i],
+				.len = mask,
+				.off = (uint64_t)(uintptr_t)&stx[i],
+				.user_data = count,
+			});
+		}
+
+		if (_run(u, count, &res[offt]) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+ * the first 'size' bytes of each file: opened, read and closed in three rounds of one
+ * system call each; res: bytes read, or -errno; returns: 0, -1: the ring failed, every
+ * descriptor it opened is closed
+ */
+int
+uring_read_heads(Uring *u, const char *const paths[], size_t len, uint8_t *bufs[], size_t size,
+		 int res[])
+{
+	int *const closed = u->fds + u->entries;
+	for (size_t offt = 0; offt < len; offt += u->entries) {
+		unsigned count = 0;
+		for (; (count < u->entries) && ((offt + count) < len); count++) {
+			/* not opened, unless it completes */
+			u->fds[count] = -ECANCELED;
+			_push(u, &(struct io_uring_sqe) {
+				.opcode = IORING_OP_OPENAT,
+				.fd = AT_FDCWD,
+				.addr = (uint64_t)(uintptr_t)paths[offt + count],
+				.open_flags = O_RDONLY | O_CLOEXEC,
+				.user_data = count,
+			});
+		}
+
+		if (_run(u, count, u->fds) < 0) {
+			_close(u->fds, count);
+			return -1;
+		}
+
+		unsigned opened = 0;
+		for (unsigned i = 0; i < count; i++) {
+			res[offt + i] = u->fds[i];
+			if (u->fds[i] < 0)
+				continue;
+
+			_push(u, &(struct io_uring_sqe) {
+				.opcode = IORING_OP_READ,
+				.fd = u->fds[i],
+				.addr = (uint64_t)(uintptr_t)bufs[offt + i],
+				.len = (uint32_t)size,
+				.off = 0,
+				.user_data = i,
+			});
+
+			opened++;
+		}
+
+		if (opened == 0)
+			continue;
+
+		if (_run(u, opened, &res[offt]) < 0) {
+			_close(u->fds, count);
+			return -1;
+		}
+
+		for (unsigned i = 0; i < count; i++) {
+			if (u->fds[i] < 0)
+				continue;
+
+			/* not closed, unless it completes */
+			closed[i] = 1;
+			_push(u, &(struct io_uring_sqe) {
+				.opcode = IORING_OP_CLOSE,
+				.fd = u->fds[i],
+				.user_data = i,
+			});
+		}
+
+		if (_run(u, opened, closed) < 0) {
+			for (unsigned i = 0; i < count; i++) {
+				if ((u->fds[i] >= 0) && (closed[i] == 1))
+					close(u->fds[i]);
+			}
+
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+ * private
+ */
+static int
+_map(Uring *u, const struct io_uring_params *params)
+{
+	u->sq_ring_size = params->sq_off.array + (params->sq_entries * sizeof(unsigned));
+	u->cq_ring_size = params->cq_off.cqes + (params->cq_entries * sizeof(struct io_uring_cqe));
+	u->sqes_size = params->sq_entries * sizeof(struct io_uring_sqe);
+
+	const int is_single = ((params->features & IORING_FEAT_SINGLE_MMAP) != 0);
+	if (is_single && (u->cq_ring_size > u->sq_ring_size))
+		u->sq_ring_size = u->cq_ring_size;
+
+	u->sq_ring = mmap(NULL, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, u->fd, IORING_OFF_SQ_RING);
+	if (u->sq_ring == MAP_FAILED) {
+		log_err(errno, "uring: _map: mmap: sq");
+		return -1;
+	}
+
+	if (is_single) {
+		u->cq_ring = u->sq_ring;
+	} else {
+		u->cq_ring = mmap(NULL, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, u->fd,
+				  IORING_OFF_CQ_RING);
+		if (u->cq_ring == MAP_FAILED) {
+			log_err(errno, "uring: _map: mmap: cq");
+			return -1;
+		}
+	}
+
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, u->fd, IORING_OFF_SQES);
+	if (u->sqes == MAP_FAILED) {
+		log_err(errno, "uring: _map: mmap: sqes");
+		return -1;
+	}
+
+	uint8_t *const sq = u->sq_ring;
+	uint8_t *const cq = u->cq_ring;
+	u->sq_head = (atomic_uint *)(sq + params->sq_off.head);
+	u->sq_tail = (atomic_uint *)(sq + params->sq_off.tail);
+	u->sq_mask = (unsigned *)(sq + params->sq_off.ring_mask);
+	u->sq_array = (unsigned *)(sq + params->sq_off.array);
+	u->cq_head = (atomic_uint *)(cq + params->cq_off.head);
+	u->cq_tail = (atomic_uint *)(cq + params->cq_off.tail);
+	u->cq_mask = (unsigned *)(cq + params->cq_off.ring_mask);
+	u->cqes = (struct io_uring_cqe *)(cq + params->cq_off.cqes);
+	return 0;
+}
+
+
+static int
+_probe(const Uring *u)
+{
+	const size_t size = sizeof(struct io_uring_probe) + (256 * sizeof(struct io_uring_probe_op));
+	struct io_uring_probe *const probe = calloc(1, size);
+	if (probe == NULL) {
+		log_err(errno, "uring: _probe: calloc");
+		return -1;
+	}
+
+	int ret = -1;
+	if (syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+		goto out0;
+
+	for (size_t i = 0; i < LEN(_ops); i++) {
+		if ((_ops[i] > probe->last_op) || ((probe->ops[_ops[i]].flags & IO_URING_OP_SUPPORTED) == 0))
+			goto out0;
+	}
+
+	ret = 0;
+
+out0:
+	free(probe);
+	return ret;
+}
+
+
+/*
+ * never more than 'entries' before _run(): the ring is empty then, no full check
+ */
+static void
+_push(Uring *u, const struct io_uring_sqe *sqe)
+{
+	const unsigned idx = u->tail & *u->sq_mask;
+	u->sqes[idx] = *sqe;
+	u->sq_array[idx] = idx;
+	u->tail++;
+}
+
+
+/*
+ * submits what was pushed and waits for all of it; res[user_data]: the results
+ */
+static int
+_run(Uring *u, unsigned count, int res[])
+{
+	/* the entries are written before the kernel sees the tail move */
+	atomic_store_explicit(u->sq_tail, u->tail, memory_order_release);
+
+	unsigned submitted = 0;
+	unsigned reaped = 0;
+	for (;;) {
+		unsigned head = atomic_load_explicit(u->cq_head, memory_order_relaxed);
+		const unsigned tail = atomic_load_explicit(u->cq_tail, memory_order_acquire);
+		for (; head != tail; head++, reaped++) {
+			const struct io_uring_cqe *const cqe = &u->cqes[head & *u->cq_mask];
+			res[cqe->user_data] = cqe->res;
+		}
+
+		atomic_store_explicit(u->cq_head, head, memory_order_release);
+		if (reaped >= count)
+			return 0;
+
+		const long ret = syscall(__NR_io_uring_enter, u->fd, count - submitted, 1, IORING_ENTER_GETEVENTS,
+					 NULL, 0);
+		if (ret < 0) {
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
+
+			log_err(errno, "uring: _run: io_uring_enter");
+			_drain(u, count, reaped, res);
+			return -1;
+		}
+
+		submitted += (unsigned)ret;
+	}
+}
+
+
+/*
+ * _run() failed: what the kernel did not take is taken back, what it took is waited
+ * for, it may still write into the caller's buffers (or open files) until it completes
+ */
+static void
+_drain(Uring *u, unsigned count, unsigned reaped, int res[])
+{
+	/* no SQPOLL: the kernel takes entries only within io_uring_enter() */
+	const unsigned head = atomic_load_explicit(u->sq_head, memory_order_acquire);
+	const unsigned submitted = count - (u->tail - head);
+	u->tail = head;
+	atomic_store_explicit(u->sq_tail, head, memory_order_release);
+
+	for (;;) {
+		unsigned cq_head = atomic_load_explicit(u->cq_head, memory_order_relaxed);
+		const unsigned tail = atomic_load_explicit(u->cq_tail, memory_order_acquire);
+		for (; cq_head != tail; cq_head++, reaped++) {
+			const struct io_uring_cqe *const cqe = &u->cqes[cq_head & *u->cq_mask];
+			res[cqe->user_data] = cqe->res;
+		}
+
+		atomic_store_explicit(u->cq_head, cq_head, memory_order_release);
+		if (reaped >= submitted)
+			return;
+
+		if (syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0) {
+			if ((errno == EINTR) || (errno == EAGAIN))
+				continue;
+
+			log_err(errno, "uring: _drain: io_uring_enter: %u request(s) left", submitted - reaped);
+			return;
+		}
+	}
+}
+
+
+/*
+ * what a failed round left open; fds[i] < 0: not opened
+ */
+static void
+_close(const int fds[], unsigned count)
+{
+	for (unsigned i = 0; i < count; i++) {
+		if (fds[i] >= 0)
+			close(fds[i]);
+	}
+}
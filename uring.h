@@ -0,0 +1,52 @@
+#ifndef __URING_H__
+#define __URING_H__
+
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define URING_ENTRIES_MAX (256)
+
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct statx;
+
+/*
+ * Uring: io_uring through its system calls (no liburing), one per thread. Work goes in
+ * batches of up to 'entries' requests; every call waits for all of its own, results
+ * are indexed like its input: >= 0, or -errno.
+ */
+typedef struct uring {
+	int                  fd;
+	unsigned             entries;
+	unsigned             tail;		/* ours, published on submit */
+	void                *sq_ring;
+	size_t               sq_ring_size;
+	void                *cq_ring;		/* sq_ring: one mapping */
+	size_t               cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t               sqes_size;
+	atomic_uint         *sq_head;
+	atomic_uint         *sq_tail;
+	unsigned            *sq_mask;
+	unsigned            *sq_array;
+	atomic_uint         *cq_head;
+	atomic_uint         *cq_tail;
+	unsigned            *cq_mask;
+	struct io_uring_cqe *cqes;
+	int                 *fds;		/* entries, then as many close results */
+} Uring;
+
+
+int  uring_init(Uring *u, unsigned entries);
+void uring_deinit(Uring *u);
+int  uring_statx(Uring *u, int dir_fd, const char *const names[], size_t len, unsigned mask,
+		 struct statx *stx, int res[]);
+int  uring_read_heads(Uring *u, const char *const paths[], size_t len, uint8_t *bufs[], size_t size,
+		      int res[]);
+
+
+#endif
@@ -12,6 +12,8 @@
 #include <time.h>
 #include <threads.h>
 
+#include <sys/stat.h>
+
 #include "util.h"
 
 
@@ -454,6 +456,90 @@ array_ptr_append(ArrayPtr *a, void *item)
 }
 
 
+/*
+ * Arena
+ */
+struct arena_block {
+	ArenaBlock *next;
+	size_t      len;
+	size_t      size;
+	char        data[];
+};
+
+
+void
+arena_init(Arena *a, size_t block_size)
+{
+	a->head = NULL;
+	a->block_size = block_size;
+}
+
+
+void
+arena_deinit(Arena *a)
+{
+	ArenaBlock *block = a->head;
+	while (block != NULL) {
+		ArenaBlock *const next = block->next;
+		free(block);
+		block = next;
+	}
+
+	a->head = NULL;
+}
+
+
+char *
+arena_strdup_n(Arena *a, const char cstr[], size_t len)
+{
+	const size_t size = len + 1; /* including '\0' */
+	ArenaBlock *block = a->head;
+	if ((block == NULL) || ((block->size - block->len) < size)) {
+		/* larger than a block: a block of its own */
+		const size_t block_size = (size > a->block_size)? size : a->block_size;
+		block = malloc(sizeof(ArenaBlock) + block_size);
+		if (block == NULL)
+			return NULL;
+
+		block->next = a->head;
+		block->len = 0;
+		block->size = block_size;
+		a->head = block;
+	}
+
+	char *const ret = &block->data[block->len];
+	memcpy(ret, cstr, len);
+	ret[len] = '\0';
+	block->len += size;
+	return ret;
+}
+
+
+/*
+ * 'from' gives its blocks to 'a' and is empty after that; 'a' keeps filling its own
+ */
+void
+arena_merge(Arena *a, Arena *from)
+{
+	ArenaBlock *const head = from->head;
+	if (head == NULL)
+		return;
+
+	ArenaBlock *tail = head;
+	while (tail->next != NULL)
+		tail = tail->next;
+
+	if (a->head == NULL) {
+		a->head = head;
+	} else {
+		tail->next = a->head->next;
+		a->head->next = head;
+	}
+
+	from->head = NULL;
+}
+
+
 /*
  * Stream
  */
@@ -497,6 +583,53 @@ is_ascii(int c)
 }
 
 
+/*
+ * file
+ */
+static const char *
+_file_xdg_path(Str *s, const char env[], const char home_dir[], const char name[])
+{
+	const char *const xdg = getenv(env);
+	if (cstr_is_empty(xdg) == 0) {
+		if (str_set(s, xdg) == NULL)
+			return NULL;
+	} else {
+		const char *const home = getenv("HOME");
+		if (cstr_is_empty(home))
+			return NULL;
+
+		if (str_set_fmt(s, "%s/%s", home, home_dir) == NULL)
+			return NULL;
+	}
+
+	if ((mkdir(s->cstr, 0755) < 0) && (errno != EEXIST))
+		return NULL;
+
+	if (str_append(s, "/moedance") == NULL)
+		return NULL;
+
+	if ((mkdir(s->cstr, 0755) < 0) && (errno != EEXIST))
+		return NULL;
+
+	errno = 0;
+	return str_append_fmt(s, "/%s", name);
+}
+
+
+const char *
+file_cache_path(Str *s, const char name[])
+{
+	return _file_xdg_path(s, "XDG_CACHE_HOME", ".cache", name);
+}
+
+
+const char *
+file_config_path(Str *s, const char name[])
+{
+	return _file_xdg_path(s, "XDG_CONFIG_HOME", ".config", name);
+}
+
+
 /*
  * Log
  */
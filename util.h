@@ -68,6 +68,22 @@ void array_ptr_deinit(ArrayPtr *a);
 int  array_ptr_append(ArrayPtr *a, void *item);
 
 
+/*
+ * Arena: many small strings, freed all at once; one malloc per block
+ */
+typedef struct arena_block ArenaBlock;
+
+typedef struct arena {
+	ArenaBlock *head;
+	size_t      block_size;
+} Arena;
+
+void  arena_init(Arena *a, size_t block_size);
+void  arena_deinit(Arena *a);
+char *arena_strdup_n(Arena *a, const char cstr[], size_t len);
+void  arena_merge(Arena *a, Arena *from);
+
+
 /*
  * Stream
  */
@@ -91,6 +107,13 @@ const char *space_tokenizer_next(SpaceTokenizer *s, const char raw[]);
 int is_ascii(int c);
 
 
+/*
+ * file
+ */
+const char *file_cache_path(Str *s, const char name[]);
+const char *file_config_path(Str *s, const char name[]);
+
+
 /*
  * log
  */
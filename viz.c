@@ -0,0 +1,367 @@
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+#include "viz.h"
+#include "dsp.h"
+#include "player.h"
+#include "stats.h"
+#include "util.h"
+#include "config.h"
+
+
+#define _PI            (3.14159265358979323846)
+#define _FREQ_LO       (30.0)
+#define _FREQ_HI       (16000.0)
+#define _SPECTRUM_DB   (-72.0)
+#define _METER_DB      (-60.0)
+#define _FALL          (0.05f)	/* per frame */
+
+
+static int   _start(Viz *v, VizMode mode);
+static void  _stop(Viz *v);
+static int   _thrd(void *udata);
+static void  _pull(Viz *v, size_t count);
+static void  _spectrum(Viz *v);
+static void  _meter(Viz *v, size_t count);
+static float _level(double amp, double floor_db);
+static float _fall(float prev, float curr);
+
+
+/*
+ * public
+ */
+int
+viz_init(Viz *v, struct player *player)
+{
+	memset(v, 0, sizeof(*v));
+	atomic_store(&v->is_alive, 0);
+	atomic_store(&v->bands_len, 0);
+	v->mode = VIZ_MODE_OFF;
+	v->event_fd = -1;
+	v->rate = PLAYER_SAMPLE_RATE;
+	v->player = player;
+
+	if (mtx_init(&v->mutex, mtx_plain) != thrd_success) {
+		log_err(0, "viz: viz_init: mtx_init: failed");
+		return -1;
+	}
+
+	v->window = malloc(VIZ_FFT_SIZE * sizeof(float));
+	v->history = malloc(VIZ_FFT_SIZE * 2 * sizeof(float));
+	v->re = malloc(VIZ_FFT_SIZE * sizeof(float));
+	v->im = malloc(VIZ_FFT_SIZE * sizeof(float));
+	if ((v->window == NULL) || (v->history == NULL) || (v->re == NULL) || (v->im == NULL)) {
+		log_err(errno, "viz: viz_init: malloc");
+		viz_deinit(v);
+		return -1;
+	}
+
+	/* hann */
+	for (size_t i = 0; i < VIZ_FFT_SIZE; i++)
+		v->window[i] = (float)(0.5 - (0.5 * cos((2.0 * _PI * (double)i) / (double)VIZ_FFT_SIZE)));
+
+	return 0;
+}
+
+
+void
+viz_deinit(Viz *v)
+{
+	_stop(v);
+	free(v->window);
+	free(v->history);
+	free(v->re);
+	free(v->im);
+	mtx_destroy(&v->mutex);
+}
+
+
+/*
+ * UI thread only
+ */
+int
+viz_set_mode(Viz *v, VizMode mode)
+{
+	if (mode == v->mode)
+		return 0;
+
+	_stop(v);
+	if (mode == VIZ_MODE_OFF)
+		return 0;
+
+	return _start(v, mode);
+}
+
+
+VizMode
+viz_get_mode(const Viz *v)
+{
+	return v->mode;
+}
+
+
+/*
+ * spectrum bands, usually the terminal width
+ */
+void
+viz_set_bands(Viz *v, int len)
+{
+	if (len < 1)
+		len = 1;
+	else if (len > VIZ_BANDS_MAX)
+		len = VIZ_BANDS_MAX;
+
+	atomic_store_explicit(&v->bands_len, len, memory_order_relaxed);
+}
+
+
+/*
+ * returns: readable once a new result is out, -1: VIZ_MODE_OFF
+ */
+int
+viz_get_fd(const Viz *v)
+{
+	return v->event_fd;
+}
+
+
+int
+viz_read(Viz *v, VizResult *res)
+{
+	uint64_t val;
+	if ((read(v->event_fd, &val, sizeof(val)) < 0) && (errno != EAGAIN)) {
+		log_err(errno, "viz: viz_read: read");
+		return -1;
+	}
+
+	mtx_lock(&v->mutex); /* LOCK */
+	*res = v->shared;
+	mtx_unlock(&v->mutex); /* UNLOCK */
+	return 0;
+}
+
+
+/*
+ * private
+ */
+static int
+_start(Viz *v, VizMode mode)
+{
+	v->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (v->event_fd < 0) {
+		log_err(errno, "viz: _start: eventfd");
+		return -1;
+	}
+
+	memset(v->history, 0, VIZ_FFT_SIZE * 2 * sizeof(float));
+	memset(&v->result, 0, sizeof(v->result));
+	v->result.mode = mode;
+	v->shared = v->result;
+
+	player_tap_enable(v->player, 1);
+	atomic_store(&v->is_alive, 1);
+	if (thrd_create(&v->thrd, _thrd, v) != thrd_success) {
+		log_err(0, "viz: _start: thrd_create: failed");
+		atomic_store(&v->is_alive, 0);
+		player_tap_enable(v->player, 0);
+		close(v->event_fd);
+		v->event_fd = -1;
+		return -1;
+	}
+
+	v->mode = mode;
+	return 0;
+}
+
+
+static void
+_stop(Viz *v)
+{
+	if (v->mode == VIZ_MODE_OFF)
+		return;
+
+	atomic_store(&v->is_alive, 0);
+	thrd_join(v->thrd, NULL);
+	player_tap_enable(v->player, 0);
+	close(v->event_fd);
+	v->event_fd = -1;
+	v->mode = VIZ_MODE_OFF;
+}
+
+
+static int
+_thrd(void *udata)
+{
+	Viz *const v = (Viz *)udata;
+
+	/* linux: the nice value is per-thread */
+	if (setpriority(PRIO_PROCESS, 0, CFG_VIZ_NICE) < 0)
+		log_err(errno, "viz: _thrd: setpriority");
+
+	const struct timespec ts = { .tv_nsec = 1000000000L / CFG_VIZ_FPS };
+	int64_t last = stats_now_ns();
+	while (atomic_load(&v->is_alive)) {
+		thrd_sleep(&ts, NULL);
+
+		/* consumed at the playback pace: the tap is filled one device buffer at a time */
+		const int64_t now = stats_now_ns();
+		v->rate = player_get_rate(v->player);
+		const size_t count = (size_t)(((now - last) * (int64_t)v->rate) / 1000000000L);
+		last = now;
+
+		_pull(v, count);
+		if (v->result.mode == VIZ_MODE_SPECTRUM)
+			_spectrum(v);
+		else
+			_meter(v, (count < VIZ_FFT_SIZE)? count : VIZ_FFT_SIZE);
+
+		mtx_lock(&v->mutex); /* LOCK */
+		v->shared = v->result;
+		mtx_unlock(&v->mutex); /* UNLOCK */
+
+		const uint64_t val = 1;
+		if ((write(v->event_fd, &val, sizeof(val)) < 0) && (errno != EAGAIN))
+			log_err(errno, "viz: _thrd: write");
+	}
+
+	return 0;
+}
+
+
+/*
+ * slides 'count' frames from the tap into the history, anything older than one
+ * history length is skipped
+ */
+static void
+_pull(Viz *v, size_t count)
+{
+	const size_t lag = VIZ_FFT_SIZE * 4;
+	const size_t avail = player_tap_available(v->player);
+	if (avail > lag)
+		player_tap_read(v->player, NULL, avail - lag);
+
+	if (count > VIZ_FFT_SIZE) {
+		player_tap_read(v->player, NULL, count - VIZ_FFT_SIZE);
+		count = VIZ_FFT_SIZE;
+	}
+
+	if (count == 0)
+		return;
+
+	float *const h = v->history;
+	memmove(h, &h[count * 2], (VIZ_FFT_SIZE - count) * 2 * sizeof(float));
+
+	float *const tail = &h[(VIZ_FFT_SIZE - count) * 2];
+	const size_t rd = player_tap_read(v->player, tail, count);
+
+	/* not played yet (paused, underrun): silence */
+	memset(&tail[rd * 2], 0, (count - rd) * 2 * sizeof(float));
+}
+
+
+/*
+ * log spaced bands from _FREQ_LO to _FREQ_HI, the loudest bin of each band
+ */
+static void
+_spectrum(Viz *v)
+{
+	const float *const h = v->history;
+	float *const re = v->re;
+	float *const im = v->im;
+	for (size_t i = 0; i < VIZ_FFT_SIZE; i++) {
+		re[i] = ((h[i * 2] + h[(i * 2) + 1]) * 0.5f) * v->window[i];
+		im[i] = 0.0f;
+	}
+
+	dsp_fft(re, im, VIZ_FFT_SIZE);
+
+	VizResult *const r = &v->result;
+	const int len = atomic_load_explicit(&v->bands_len, memory_order_relaxed);
+	if (len != r->len) {
+		memset(r->bands, 0, sizeof(r->bands));
+		r->len = len;
+	}
+
+	/* hann: a full scale sine peaks at VIZ_FFT_SIZE / 4 */
+	const double scale = 4.0 / (double)VIZ_FFT_SIZE;
+	const double bin_hz = (double)v->rate / (double)VIZ_FFT_SIZE;
+	const double ratio = _FREQ_HI / _FREQ_LO;
+	for (int i = 0; i < len; i++) {
+		const double f0 = _FREQ_LO * pow(ratio, (double)i / (double)len);
+		const double f1 = _FREQ_LO * pow(ratio, (double)(i + 1) / (double)len);
+		size_t lo = (size_t)lround(f0 / bin_hz);
+		size_t hi = (size_t)lround(f1 / bin_hz);
+		if (lo < 1)
+			lo = 1;
+		if (hi <= lo)
+			hi = lo + 1;
+		if (hi > (VIZ_FFT_SIZE / 2))
+			hi = VIZ_FFT_SIZE / 2;
+
+		double mag = 0.0;
+		for (size_t k = lo; k < hi; k++)
+			mag = fmax(mag, hypot(re[k], im[k]));
+
+		r->bands[i] = _fall(r->bands[i], _level(mag * scale, _SPECTRUM_DB));
+	}
+}
+
+
+/*
+ * peak and RMS of the frames pulled since the last result
+ */
+static void
+_meter(Viz *v, size_t count)
+{
+	VizResult *const r = &v->result;
+	const float *const h = &v->history[(VIZ_FFT_SIZE - count) * 2];
+	for (int j = 0; j < 2; j++) {
+		double peak = 0.0;
+		double sum = 0.0;
+		for (size_t i = 0; i < count; i++) {
+			const double x = h[(i * 2) + (size_t)j];
+			peak = fmax(peak, fabs(x));
+			sum += x * x;
+		}
+
+		const double rms = (count > 0)? sqrt(sum / (double)count) : 0.0;
+		r->peak[j] = _fall(r->peak[j], _level(peak, _METER_DB));
+		r->rms[j] = _fall(r->rms[j], _level(rms, _METER_DB));
+	}
+}
+
+
+static float
+_level(double amp, double floor_db)
+{
+	if (amp <= 0.0)
+		return 0.0f;
+
+	const double ret = ((20.0 * log10(amp)) - floor_db) / -floor_db;
+	if (ret < 0.0)
+		return 0.0f;
+	if (ret > 1.0)
+		return 1.0f;
+
+	return (float)ret;
+}
+
+
+/*
+ * rises at once, falls slowly
+ */
+static float
+_fall(float prev, float curr)
+{
+	prev -= _FALL;
+	return (curr > prev)? curr : prev;
+}
@@ -0,0 +1,69 @@
+#ifndef __VIZ_H__
+#define __VIZ_H__
+
+
+#include <stdatomic.h>
+#include <threads.h>
+
+
+#define VIZ_BANDS_MAX (256)
+#define VIZ_FFT_SIZE  (2048)
+
+
+typedef enum viz_mode {
+	VIZ_MODE_OFF,
+	VIZ_MODE_SPECTRUM,
+	VIZ_MODE_METER,
+
+	VIZ_MODE_END,
+} VizMode;
+
+/*
+ * levels: 0.0 .. 1.0
+ */
+typedef struct viz_result {
+	VizMode mode;
+	int     len;
+	float   bands[VIZ_BANDS_MAX];
+	float   peak[2];
+	float   rms[2];
+} VizResult;
+
+/*
+ * Viz: spectrum analyser and peak/RMS meter of what the device plays
+ *
+ * The stream callback copies its output into the player tap; a low priority thread
+ * drains it at the playback pace, analyses the last VIZ_FFT_SIZE frames and wakes
+ * the UI through 'event_fd', CFG_VIZ_FPS times per second at most. VIZ_MODE_OFF:
+ * no thread, no tap.
+ */
+struct player;
+
+typedef struct viz {
+	atomic_int      is_alive;
+	atomic_int      bands_len;
+	VizMode         mode;		/* UI thread */
+	int             event_fd;
+	unsigned        rate;		/* analysis thread, follows the device */
+	struct player  *player;
+	float          *window;
+	float          *history;	/* interleaved stereo, VIZ_FFT_SIZE frames */
+	float          *re;
+	float          *im;
+	VizResult       result;		/* analysis thread */
+	VizResult       shared;
+	mtx_t           mutex;
+	thrd_t          thrd;
+} Viz;
+
+
+int     viz_init(Viz *v, struct player *player);
+void    viz_deinit(Viz *v);
+int     viz_set_mode(Viz *v, VizMode mode);
+VizMode viz_get_mode(const Viz *v);
+void    viz_set_bands(Viz *v, int len);
+int     viz_get_fd(const Viz *v);
+int     viz_read(Viz *v, VizResult *res);
+
+
+#endif
@@ -0,0 +1,402 @@
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+
+#include "watch.h"
+
+
+/* files are written and closed, created (links), moved or deleted; so are directories */
+#define _MASK      (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+#define _READ_SIZE (16 * 1024)
+
+
+typedef struct watch_dir {
+	int  wd;
+	char path[];
+} WatchDir;
+
+
+static int     _tree_add(Watch *w, const char path[]);
+static int     _dir_add(Watch *w, const char path[]);
+static size_t  _dir_find(const Watch *w, int wd);
+static void    _dir_remove_tree(Watch *w, const char path[]);
+static void    _event(Watch *w, const struct inotify_event *ev);
+static void    _change_add(Watch *w, const char path[], int is_tree);
+static void    _array_remove(ArrayPtr *a, size_t idx);
+static int     _path_depth(const Watch *w, const char path[]);
+static int     _path_is_under(const char path[], const char dir[]);
+static int64_t _now_ms(void);
+
+
+/*
+ * public
+ */
+int
+watch_init(Watch *w, const char root[], int depth_max)
+{
+	const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (fd < 0) {
+		log_err(errno, "watch: watch_init: inotify_init1");
+		return -1;
+	}
+
+	w->fd = fd;
+	w->root = root;
+	w->depth_max = depth_max;
+	w->first_ms = 0;
+	w->last_ms = 0;
+	array_ptr_init(&w->dirs);
+	array_ptr_init(&w->changes);
+
+	if (_tree_add(w, root) < 0) {
+		watch_deinit(w);
+		return -1;
+	}
+
+#ifdef DEBUG
+	log_info("watch: watch_init: %zu directories", w->dirs.len);
+#endif
+	return 0;
+}
+
+
+void
+watch_deinit(Watch *w)
+{
+	close(w->fd);
+	for (size_t i = 0; i < w->dirs.len; i++)
+		free(w->dirs.items[i]);
+
+	array_ptr_deinit(&w->dirs);
+	watch_changes_free(&w->changes);
+}
+
+
+int
+watch_get_fd(const Watch *w)
+{
+	return w->fd;
+}
+
+
+/*
+ * everything the kernel has queued; returns: events read, -1: error
+ */
+int
+watch_read(Watch *w)
+{
+	_Alignas(struct inotify_event) char buffer[_READ_SIZE];
+
+	int count = 0;
+	for (;;) {
+		const ssize_t rd = read(w->fd, buffer, sizeof(buffer));
+		if (rd < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN)
+				break;
+
+			log_err(errno, "watch: watch_read: read");
+			return -1;
+		}
+
+		if (rd == 0)
+			break;
+
+		for (ssize_t offt = 0; offt < rd; count++) {
+			const struct inotify_event *const ev = (const struct inotify_event *)&buffer[offt];
+			_event(w, ev);
+			offt += (ssize_t)(sizeof(*ev) + ev->len);
+		}
+	}
+
+	return count;
+}
+
+
+/*
+ * hands out the pending changes once nothing happened for 'settle_ms', or the first of
+ * them is 'delay_max_ms' old; returns: the count, 0: none or not yet
+ */
+int
+watch_take(Watch *w, int64_t settle_ms, int64_t delay_max_ms, ArrayPtr *changes)
+{
+	if (w->changes.len == 0)
+		return 0;
+
+	const int64_t now = _now_ms();
+	if (((now - w->last_ms) < settle_ms) && ((now - w->first_ms) < delay_max_ms))
+		return 0;
+
+	*changes = w->changes;
+	array_ptr_init(&w->changes);
+	return (int)changes->len;
+}
+
+
+void
+watch_changes_free(ArrayPtr *changes)
+{
+	for (size_t i = 0; i < changes->len; i++)
+		free(changes->items[i]);
+
+	array_ptr_deinit(changes);
+	array_ptr_init(changes);
+}
+
+
+/*
+ * private
+ */
+/*
+ * 'path' and the directories below it, as deep as the playlist walk goes
+ */
+static int
+_tree_add(Watch *w, const char path[])
+{
+	if (_path_depth(w, path) > w->depth_max)
+		return 0;
+
+	if (_dir_add(w, path) < 0)
+		return -1;
+
+	DIR *const dir = opendir(path);
+	if (dir == NULL) {
+		log_err(errno, "watch: _tree_add: opendir: %s", path);
+		return 0;
+	}
+
+	int ret = 0;
+	struct dirent *ent;
+	while ((ent = readdir(dir)) != NULL) {
+		if (ent->d_name[0] == '.')
+			continue;
+
+		char sub[PATH_MAX];
+		if (snprintf(sub, sizeof(sub), "%s/%s", path, ent->d_name) >= (int)sizeof(sub))
+			continue;
+
+		struct stat st;
+		if ((stat(sub, &st) < 0) || (S_ISDIR(st.st_mode) == 0))
+			continue;
+
+		/* out of watches: the rest would fail the same */
+		ret = _tree_add(w, sub);
+		if (ret < 0)
+			break;
+	}
+
+	closedir(dir);
+	return ret;
+}
+
+
+static int
+_dir_add(Watch *w, const char path[])
+{
+	const int wd = inotify_add_watch(w->fd, path, _MASK);
+	if (wd < 0) {
+		if (errno == ENOSPC)
+			log_err(errno, "watch: _dir_add: %s: see fs.inotify.max_user_watches", path);
+		else
+			log_err(errno, "watch: _dir_add: inotify_add_watch: %s", path);
+
+		return -1;
+	}
+
+	const size_t path_len = strlen(path);
+	WatchDir *const dir = malloc(sizeof(WatchDir) + path_len + 1);
+	if (dir == NULL) {
+		log_err(errno, "watch: _dir_add: malloc");
+		inotify_rm_watch(w->fd, wd);
+		return -1;
+	}
+
+	dir->wd = wd;
+	memcpy(dir->path, path, path_len + 1);
+
+	/* the same inode again (moved): the same descriptor, a new path */
+	const size_t idx = _dir_find(w, wd);
+	if ((idx < w->dirs.len) && (((WatchDir *)w->dirs.items[idx])->wd == wd)) {
+		free(w->dirs.items[idx]);
+		w->dirs.items[idx] = dir;
+		return 0;
+	}
+
+	if (array_ptr_append(&w->dirs, dir) < 0) {
+		log_err(errno, "watch: _dir_add: array_ptr_append");
+		inotify_rm_watch(w->fd, wd);
+		free(dir);
+		return -1;
+	}
+
+	void **const items = w->dirs.items;
+	memmove(&items[idx + 1], &items[idx], (w->dirs.len - 1 - idx) * sizeof(void *));
+	items[idx] = dir;
+	return 0;
+}
+
+
+/*
+ * returns: the index of 'wd', or where it would go
+ */
+static size_t
+_dir_find(const Watch *w, int wd)
+{
+	size_t lo = 0;
+	size_t hi = w->dirs.len;
+	while (lo < hi) {
+		const size_t mid = lo + ((hi - lo) / 2);
+		if (((const WatchDir *)w->dirs.items[mid])->wd < wd)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+
+static void
+_dir_remove_tree(Watch *w, const char path[])
+{
+	for (size_t i = w->dirs.len; i > 0; i--) {
+		WatchDir *const dir = w->dirs.items[i - 1];
+		if ((strcmp(dir->path, path) != 0) && (_path_is_under(dir->path, path) == 0))
+			continue;
+
+		/* gone already if it was deleted */
+		inotify_rm_watch(w->fd, dir->wd);
+		free(dir);
+		_array_remove(&w->dirs, i - 1);
+	}
+}
+
+
+static void
+_event(Watch *w, const struct inotify_event *ev)
+{
+	if (ISSET(ev->mask, IN_Q_OVERFLOW)) {
+		log_err(0, "watch: _event: queue overflow, scanning everything");
+		_change_add(w, w->root, 1);
+		return;
+	}
+
+	const size_t idx = _dir_find(w, ev->wd);
+	if ((idx == w->dirs.len) || (((WatchDir *)w->dirs.items[idx])->wd != ev->wd))
+		return;
+
+	const WatchDir *const dir = w->dirs.items[idx];
+	if (ISSET(ev->mask, IN_IGNORED)) {
+		free(w->dirs.items[idx]);
+		_array_remove(&w->dirs, idx);
+		return;
+	}
+
+	/* the directory itself, hidden entries: the walk skips them too */
+	if ((ev->len == 0) || (ev->name[0] == '.'))
+		return;
+
+	if (ISSET(ev->mask, IN_ISDIR) == 0) {
+		_change_add(w, dir->path, 0);
+		return;
+	}
+
+	char path[PATH_MAX];
+	if (snprintf(path, sizeof(path), "%s/%s", dir->path, ev->name) >= (int)sizeof(path))
+		return;
+
+	if (ISSET(ev->mask, IN_DELETE | IN_MOVED_FROM))
+		_dir_remove_tree(w, path);
+	else
+		_tree_add(w, path);
+
+	_change_add(w, path, 1);
+}
+
+
+static void
+_change_add(Watch *w, const char path[], int is_tree)
+{
+	const int64_t now = _now_ms();
+	if (w->changes.len == 0)
+		w->first_ms = now;
+
+	w->last_ms = now;
+	for (size_t i = 0; i < w->changes.len;) {
+		WatchChange *const c = w->changes.items[i];
+		const int is_same = (strcmp(c->path, path) == 0);
+		if ((is_same && (c->is_tree || (is_tree == 0))) || (c->is_tree && _path_is_under(path, c->path)))
+			return;
+
+		if (is_tree && (is_same || _path_is_under(c->path, path))) {
+			free(c);
+			_array_remove(&w->changes, i);
+			continue;
+		}
+
+		i++;
+	}
+
+	const size_t path_len = strlen(path);
+	WatchChange *const c = malloc(sizeof(WatchChange) + path_len + 1);
+	if (c == NULL) {
+		log_err(errno, "watch: _change_add: malloc");
+		return;
+	}
+
+	c->is_tree = is_tree;
+	memcpy(c->path, path, path_len + 1);
+	if (array_ptr_append(&w->changes, c) < 0) {
+		log_err(errno, "watch: _change_add: array_ptr_append");
+		free(c);
+	}
+}
+
+
+static void
+_array_remove(ArrayPtr *a, size_t idx)
+{
+	memmove(&a->items[idx], &a->items[idx + 1], (a->len - idx - 1) * sizeof(void *));
+	a->len--;
+}
+
+
+/*
+ * levels below the root: "root" 0, "root/a" 1
+ */
+static int
+_path_depth(const Watch *w, const char path[])
+{
+	int depth = 0;
+	for (const char *p = path + strlen(w->root); *p != '\0'; p++) {
+		if (*p == '/')
+			depth++;
+	}
+
+	return depth;
+}
+
+
+static int
+_path_is_under(const char path[], const char dir[])
+{
+	const size_t len = strlen(dir);
+	return ((strncmp(path, dir, len) == 0) && (path[len] == '/'));
+}
+
+
+static int64_t
+_now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
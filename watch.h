@@ -0,0 +1,43 @@
+#ifndef __WATCH_H__
+#define __WATCH_H__
+
+
+#include <stdint.h>
+
+#include "util.h"
+
+
+/*
+ * a directory to scan again: its own files, or everything below it too
+ */
+typedef struct watch_change {
+	int  is_tree;
+	char path[];
+} WatchChange;
+
+/*
+ * Watch: inotify on a directory tree, down to 'depth_max' levels below 'root'.
+ * Events are not reported one by one: they mark directories to scan again, and those
+ * are handed out once the tree has been quiet for a while (or changing for too long),
+ * so a burst of a few hundred files is one update.
+ */
+typedef struct watch {
+	int         fd;
+	const char *root;
+	int         depth_max;
+	ArrayPtr    dirs;		/* sorted by watch descriptor */
+	ArrayPtr    changes;	/* WatchChange: pending, none covers another */
+	int64_t     first_ms;	/* of the pending changes */
+	int64_t     last_ms;
+} Watch;
+
+
+int  watch_init(Watch *w, const char root[], int depth_max);
+void watch_deinit(Watch *w);
+int  watch_get_fd(const Watch *w);
+int  watch_read(Watch *w);
+int  watch_take(Watch *w, int64_t settle_ms, int64_t delay_max_ms, ArrayPtr *changes);
+void watch_changes_free(ArrayPtr *changes);
+
+
+#endif
@@ -0,0 +1,401 @@
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+
+#include "wave.h"
+#include "decode.h"
+#include "config.h"
+
+
+#define _MAGIC    "MDWV"
+#define _FLOOR_DB (-48.0)
+#define _LEN_MAX  (10 * 3600 * (1000 / WAVE_BUCKET_MS))
+
+
+typedef struct wave_header {
+	char     magic[4];
+	uint32_t bucket_ms;
+	int64_t  size;
+	int64_t  mtime;
+	int32_t  len;
+	uint32_t reserved;
+} WaveHeader;
+
+
+static int       _path_set(Wave *w, const char file_path[]);
+static int       _cache_file(const Wave *w, char dest[], size_t size);
+static WaveData *_cache_load(const Wave *w);
+static void      _cache_save(const Wave *w, const WaveData *data);
+static void      _compute(Job *j, void *item, void *udata);
+static uint8_t   _peak_level(float peak);
+
+
+/*
+ * public
+ */
+int
+wave_init(Wave *w)
+{
+	w->is_running = 0;
+	w->path = NULL;
+	w->size = 0;
+	w->mtime = 0;
+	w->data = NULL;
+	w->pending = NULL;
+
+	if (str_init_alloc(&w->dir, 256) < 0) {
+		log_err(errno, "wave: wave_init: str_init_alloc");
+		return -1;
+	}
+
+	/* no persistence, but keep going */
+	if (file_cache_path(&w->dir, CFG_WAVE_CACHE_DIR) == NULL) {
+		log_err(errno, "wave: wave_init: file_cache_path");
+		str_set_n(&w->dir, NULL, 0);
+		return 0;
+	}
+
+	if ((mkdir(w->dir.cstr, 0755) < 0) && (errno != EEXIST)) {
+		log_err(errno, "wave: wave_init: mkdir: %s", w->dir.cstr);
+		str_set_n(&w->dir, NULL, 0);
+	}
+
+	return 0;
+}
+
+
+void
+wave_deinit(Wave *w)
+{
+	wave_stop(w);
+	free(w->data);
+	free(w->path);
+	str_deinit(&w->dir);
+}
+
+
+/*
+ * returns: the cached summary, NULL: not cached (a background pass is started, see
+ * wave_update()) or failed
+ */
+const WaveData *
+wave_load(Wave *w, const char file_path[])
+{
+	wave_stop(w);
+	free(w->data);
+	w->data = NULL;
+
+	if (_path_set(w, file_path) < 0)
+		return NULL;
+
+	w->data = _cache_load(w);
+	if (w->data != NULL)
+		return w->data;
+
+	w->items[0] = w;
+	if (job_start(&w->job, w->items, 1, 1, _compute, w) < 0)
+		return NULL;
+
+	w->is_running = 1;
+	return NULL;
+}
+
+
+/*
+ * returns: the summary once the background pass is done, NULL: still running or idle
+ */
+const WaveData *
+wave_update(Wave *w)
+{
+	if (w->is_running == 0)
+		return NULL;
+
+	int total = 0;
+	if (job_get_progress(&w->job, &total) < total)
+		return NULL;
+
+	job_stop(&w->job);
+	w->is_running = 0;
+	w->data = w->pending;
+	w->pending = NULL;
+	return w->data;
+}
+
+
+void
+wave_stop(Wave *w)
+{
+	if (w->is_running == 0)
+		return;
+
+	job_stop(&w->job);
+	free(w->pending);
+	w->pending = NULL;
+	w->is_running = 0;
+}
+
+
+/*
+ * private
+ */
+static int
+_path_set(Wave *w, const char file_path[])
+{
+	free(w->path);
+	w->path = NULL;
+
+	char path[PATH_MAX];
+	if (file_path[0] == '/') {
+		if (snprintf(path, sizeof(path), "%s", file_path) >= (int)sizeof(path))
+			goto err0;
+	} else {
+		char cwd[PATH_MAX];
+		if (getcwd(cwd, sizeof(cwd)) == NULL) {
+			log_err(errno, "wave: _path_set: getcwd");
+			return -1;
+		}
+
+		/* skip './' */
+		const char *const rel = (strncmp(file_path, "./", 2) == 0)? file_path + 2 : file_path;
+		if (snprintf(path, sizeof(path), "%s/%s", cwd, rel) >= (int)sizeof(path))
+			goto err0;
+	}
+
+	struct stat st;
+	if (stat(path, &st) < 0) {
+		log_err(errno, "wave: _path_set: stat: %s", path);
+		return -1;
+	}
+
+	w->path = strdup(path);
+	if (w->path == NULL) {
+		log_err(errno, "wave: _path_set: strdup");
+		return -1;
+	}
+
+	w->size = (int64_t)st.st_size;
+	w->mtime = (int64_t)st.st_mtime;
+	return 0;
+
+err0:
+	log_err(ENAMETOOLONG, "wave: _path_set: snprintf: %s", file_path);
+	return -1;
+}
+
+
+/*
+ * "<dir>/<FNV-1a 64 of the path>"
+ */
+static int
+_cache_file(const Wave *w, char dest[], size_t size)
+{
+	if (cstr_is_empty(w->dir.cstr))
+		return -1;
+
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const char *p = w->path; *p != '\0'; p++) {
+		hash ^= (uint8_t)*p;
+		hash *= 0x100000001b3ull;
+	}
+
+	if (snprintf(dest, size, "%s/%016" PRIx64, w->dir.cstr, hash) >= (int)size) {
+		log_err(ENAMETOOLONG, "wave: _cache_file: snprintf");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static WaveData *
+_cache_load(const Wave *w)
+{
+	char path[PATH_MAX];
+	if (_cache_file(w, path, sizeof(path)) < 0)
+		return NULL;
+
+	FILE *const file = fopen(path, "rb");
+	if (file == NULL) {
+		if (errno != ENOENT)
+			log_err(errno, "wave: _cache_load: fopen: %s", path);
+
+		return NULL;
+	}
+
+	WaveData *ret = NULL;
+	WaveHeader hdr;
+	if (fread(&hdr, sizeof(hdr), 1, file) != 1)
+		goto out0;
+
+	/* stale or foreign: recomputed and overwritten */
+	if ((memcmp(hdr.magic, _MAGIC, sizeof(hdr.magic)) != 0) || (hdr.bucket_ms != WAVE_BUCKET_MS) ||
+	    (hdr.size != w->size) || (hdr.mtime != w->mtime) || (hdr.len <= 0) || (hdr.len > _LEN_MAX))
+		goto out0;
+
+	ret = malloc(sizeof(WaveData) + (size_t)hdr.len);
+	if (ret == NULL) {
+		log_err(errno, "wave: _cache_load: malloc");
+		goto out0;
+	}
+
+	ret->len = hdr.len;
+	if (fread(ret->peaks, 1, (size_t)hdr.len, file) != (size_t)hdr.len) {
+		free(ret);
+		ret = NULL;
+	}
+
+out0:
+	fclose(file);
+	return ret;
+}
+
+
+static void
+_cache_save(const Wave *w, const WaveData *data)
+{
+	char path[PATH_MAX];
+	if (_cache_file(w, path, sizeof(path)) < 0)
+		return;
+
+	char tmp[PATH_MAX];
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+		log_err(ENAMETOOLONG, "wave: _cache_save: snprintf");
+		return;
+	}
+
+	FILE *const file = fopen(tmp, "wb");
+	if (file == NULL) {
+		log_err(errno, "wave: _cache_save: fopen: %s", tmp);
+		return;
+	}
+
+	WaveHeader hdr = {
+		.bucket_ms = WAVE_BUCKET_MS,
+		.size = w->size,
+		.mtime = w->mtime,
+		.len = data->len,
+	};
+
+	memcpy(hdr.magic, _MAGIC, sizeof(hdr.magic));
+	const int is_ok = ((fwrite(&hdr, sizeof(hdr), 1, file) == 1) &&
+			   (fwrite(data->peaks, 1, (size_t)data->len, file) == (size_t)data->len));
+
+	if ((fclose(file) != 0) || (is_ok == 0)) {
+		log_err(errno, "wave: _cache_save: fwrite: %s", tmp);
+		unlink(tmp);
+		return;
+	}
+
+	if (rename(tmp, path) < 0) {
+		log_err(errno, "wave: _cache_save: rename: %s", path);
+		unlink(tmp);
+	}
+}
+
+
+/*
+ * mono, at the source rate: no resampling, the cheapest pass through the decoder
+ */
+static void
+_compute(Job *j, void *item, void *udata)
+{
+	Wave *const w = (Wave *)udata;
+
+	Decode dec;
+	if (decode_open(&dec, w->path, 1) < 0)
+		return;
+
+	const size_t bucket = ((size_t)dec.rate * WAVE_BUCKET_MS) / 1000;
+	size_t size = 1024;
+	WaveData *data = malloc(sizeof(WaveData) + size);
+	if (data == NULL) {
+		log_err(errno, "wave: _compute: malloc");
+		goto out0;
+	}
+
+	data->len = 0;
+	size_t pos = 0;
+	float peak = 0.0f;
+	for (;;) {
+		if (job_yield(j) < 0)
+			goto err0;
+
+		const float *frames;
+		const int ret = decode_read(&dec, &frames);
+		if (ret < 0)
+			goto err0;
+
+		for (int i = 0; i < ret; i++) {
+			const float x = fabsf(frames[i]);
+			if (x > peak)
+				peak = x;
+
+			if (++pos < bucket)
+				continue;
+
+			if ((size_t)data->len == size) {
+				WaveData *const tmp = realloc(data, sizeof(WaveData) + (size * 2));
+				if (tmp == NULL) {
+					log_err(errno, "wave: _compute: realloc");
+					goto err0;
+				}
+
+				data = tmp;
+				size *= 2;
+			}
+
+			data->peaks[data->len++] = _peak_level(peak);
+			if (data->len >= _LEN_MAX)
+				break;
+
+			pos = 0;
+			peak = 0.0f;
+		}
+
+		if ((ret == 0) || (data->len >= _LEN_MAX))
+			break;
+	}
+
+	/* the tail is dropped: shorter than one bucket */
+	if (data->len == 0)
+		goto err0;
+
+	_cache_save(w, data);
+	w->pending = data;
+#ifdef DEBUG
+	log_info("wave: _compute: %s: %d peaks", w->path, data->len);
+#endif
+	decode_close(&dec);
+	(void)item;
+	return;
+
+err0:
+	free(data);
+out0:
+	decode_close(&dec);
+	(void)item;
+}
+
+
+static uint8_t
+_peak_level(float peak)
+{
+	if (peak <= 0.0f)
+		return 0;
+
+	const double ret = ((20.0 * log10(peak)) - _FLOOR_DB) / -_FLOOR_DB;
+	if (ret <= 0.0)
+		return 0;
+	if (ret >= 1.0)
+		return UINT8_MAX;
+
+	return (uint8_t)lround(ret * UINT8_MAX);
+}
@@ -0,0 +1,47 @@
+#ifndef __WAVE_H__
+#define __WAVE_H__
+
+
+#include <stdint.h>
+
+#include "job.h"
+#include "util.h"
+
+
+#define WAVE_BUCKET_MS (100)
+
+
+/*
+ * peaks: one per WAVE_BUCKET_MS of audio, 0 .. 255 (dB scaled), ~6 KB for 10 minutes
+ */
+typedef struct wave_data {
+	int      len;
+	uint8_t  peaks[];
+} WaveData;
+
+/*
+ * Wave: waveform summary of the playing track, computed once by a background decode
+ * pass and cached in "$XDG_CACHE_HOME/moedance/CFG_WAVE_CACHE_DIR/", one file per
+ * track path, invalidated by size and mtime.
+ */
+typedef struct wave {
+	int       is_running;
+	Job       job;
+	void     *items[1];
+	char     *path;		/* absolute */
+	int64_t   size;
+	int64_t   mtime;
+	WaveData *data;
+	WaveData *pending;	/* job result */
+	Str       dir;
+} Wave;
+
+
+int             wave_init(Wave *w);
+void            wave_deinit(Wave *w);
+const WaveData *wave_load(Wave *w, const char file_path[]);
+const WaveData *wave_update(Wave *w);
+void            wave_stop(Wave *w);
+
+
+#endif